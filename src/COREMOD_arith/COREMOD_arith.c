@@ -51,11 +51,13 @@
 
 #include "image_crop.h"
 #include "image_cropmask.h"
+#include "image_cropstream.h"
 #include "image_dxdy.h"
 #include "image_merge3D.h"
 #include "image_stats.h"
 #include "image_total.h"
 #include "imfunctions.h"
+#include "image_tmedian.h"
 #include "set_pixel.h"
 
 #include "image_arith__im__im.h"
@@ -106,6 +108,10 @@ static errno_t init_module_CLI()
     
     CLIADDCMD_COREMODE_arith__cropmask();
 
+    CLIADDCMD_COREMOD_arith__cropstream();
+
+    CLIADDCMD_COREMOD_arith__image_tmedian();
+
     // add atexit functions here
 
     return RETURN_SUCCESS;
@@ -0,0 +1,1013 @@
+/**
+ * @file    arith_expr.c
+ * @brief   compiled element-wise arithmetic expressions
+ *
+ * execute_arith evaluates one operation at a time, writing each
+ * intermediate result to a named _tmp image or variable. An expression
+ * like out=(a+b)*c-d allocates, fills and deletes several full-size
+ * images, and looks names up at every step.
+ *
+ * Here the expression is compiled once into a postfix program :
+ * - names are resolved at compile time, variables become constants
+ * - constant sub-expressions are folded
+ * - constant operands are carried by the instruction
+ * The program is then run over blocks of ARITH_EXPR_BLOCKSIZE pixels :
+ * each instruction is a tight loop over the block, and intermediate
+ * values stay in a small per-thread stack that fits in cache.
+ * Every pixel is read once per input image and written once.
+ *
+ * Stack buffers come from a scratch pool, one slot per thread. Slots are
+ * grown by the calling thread before the parallel region, and each
+ * thread then only uses its own slot, so no lock is needed. The pool is
+ * kept between calls.
+ *
+ * Computation is in double, rounded once to the output type. The legacy
+ * path rounds every intermediate image to float, so float results may
+ * differ in the last bits.
+ *
+ * Expressions that cannot be compiled (image reduction functions such as
+ * itot or perc, unknown names, mismatched image sizes, complex images)
+ * are left to the legacy path.
+ */
+
+#include <ctype.h>
+#include <math.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "arith_expr.h"
+#include "mathfuncs.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#define OMP_NELEMENT_LIMIT 1000000
+#endif
+
+// compiled path enabled by default, can be turned off to benchmark/validate
+static int arith_expr_enabled = 1;
+
+// scratch pool : one stack buffer per thread
+static double **arith_expr_pool       = NULL;
+static long    *arith_expr_poolsize   = NULL; // [double]
+static int      arith_expr_poolNBslot = 0;
+
+static const struct
+{
+    const char *name;
+    double (*f1)(double);
+} arith_expr_func1[] = {{"acos", &Pacos},
+    {"asin", &Pasin},
+    {"atan", &Patan},
+    {"ceil", &Pceil},
+    {"cos", &Pcos},
+    {"cosh", &Pcosh},
+    {"exp", &Pexp},
+    {"fabs", &Pfabs},
+    {"floor", &Pfloor},
+    {"ln", &Pln},
+    {"log", &Plog},
+    {"sqrt", &Psqrt},
+    {"sin", &Psin},
+    {"sinh", &Psinh},
+    {"tan", &Ptan},
+    {"tanh", &Ptanh},
+    {"posi", &Ppositive}
+};
+
+static const struct
+{
+    const char *name;
+    double (*f2)(double, double);
+} arith_expr_func2[] = {{"fmod", &Pfmod},
+    {"min", &Pminv},
+    {"max", &Pmaxv},
+    {"testlt", &Ptestlt},
+    {"testmt", &Ptestmt}
+};
+
+// functions known to execute_arith, not element-wise
+static const char *arith_expr_nocompile[] =
+{
+    "imedian", "itot", "imean", "imin", "imax", "imdx", "imdy", "perc"
+};
+
+#define ARITH_EXPR_NB(table) ((int) (sizeof(table) / sizeof(table[0])))
+
+#define ARITH_EXPR_MAXTOKEN 100
+
+typedef struct
+{
+    // tokens, as split by execute_arith
+    int  NBtoken;
+    char token[ARITH_EXPR_MAXTOKEN][100];
+    int  itoken; // next token
+
+    ARITH_EXPR *expr;
+    int         depth; // current stack depth
+} ARITH_EXPR_PARSER;
+
+// parsed operand : constant, or value pushed on the stack
+typedef struct
+{
+    int    iscst;
+    double v;
+} ARITH_EXPR_VAL;
+
+void arith_expr_set_enable(int enable)
+{
+    arith_expr_enabled = enable;
+}
+
+int arith_expr_get_enable()
+{
+    return arith_expr_enabled;
+}
+
+/** @brief Split expression into tokens
+ *
+ * Same rules as execute_arith : spaces are removed, "=-" becomes "=0-",
+ * "=+" becomes "=", and +,-,*,/,^,(,),=,"," are single-character tokens
+ * except for a sign in a number exponent.
+ *
+ * @return 0 if OK
+ */
+static int arith_expr_tokenize(const char *cmd1, ARITH_EXPR_PARSER *ps)
+{
+    char cmd[1000];
+    int  j = 0;
+
+    for(int i = 0; cmd1[i] != '\0'; i++)
+    {
+        if(j > (int) sizeof(cmd) - 3)
+        {
+            return 1;
+        }
+        if((cmd1[i] == '=') && (cmd1[i + 1] == '-'))
+        {
+            cmd[j++] = '=';
+            cmd[j++] = '0';
+        }
+        else if((cmd1[i] == '=') && (cmd1[i + 1] == '+'))
+        {
+            cmd[j++] = '=';
+            i++;
+        }
+        else if(cmd1[i] != ' ')
+        {
+            cmd[j++] = cmd1[i];
+        }
+    }
+    cmd[j] = '\0';
+
+    ps->NBtoken = 0;
+    int l       = 0;
+    for(int i = 0; i < j; i++)
+    {
+        int sep = (strchr("+-*/^()=,", cmd[i]) != NULL);
+
+        if(((cmd[i] == '+') || (cmd[i] == '-')) && (i > 1) &&
+                ((cmd[i - 1] == 'e') || (cmd[i - 1] == 'E')) &&
+                isdigit(cmd[i - 2]) && isdigit(cmd[i + 1]))
+        {
+            // sign of exponent
+            sep = 0;
+        }
+
+        if((l > 0) && (sep || (l == 99)))
+        {
+            ps->token[ps->NBtoken][l] = '\0';
+            ps->NBtoken++;
+            l = 0;
+        }
+        if(ps->NBtoken == ARITH_EXPR_MAXTOKEN)
+        {
+            return 1;
+        }
+        ps->token[ps->NBtoken][l++] = cmd[i];
+        if(sep)
+        {
+            ps->token[ps->NBtoken][l] = '\0';
+            ps->NBtoken++;
+            l = 0;
+        }
+    }
+    if(l > 0)
+    {
+        ps->token[ps->NBtoken][l] = '\0';
+        ps->NBtoken++;
+    }
+
+    return 0;
+}
+
+static const char *arith_expr_peek(ARITH_EXPR_PARSER *ps)
+{
+    if(ps->itoken < ps->NBtoken)
+    {
+        return ps->token[ps->itoken];
+    }
+    return "";
+}
+
+static int arith_expr_accept(ARITH_EXPR_PARSER *ps, const char *tok)
+{
+    if(strcmp(arith_expr_peek(ps), tok) == 0)
+    {
+        ps->itoken++;
+        return 1;
+    }
+    return 0;
+}
+
+/** @brief Apply operation to constants, for folding
+ */
+static double arith_expr_apply(const ARITH_EXPR_INSN *insn, double a, double b)
+{
+    switch(insn->op)
+    {
+    case ARITH_EXPR_OP_NEG:
+        return -a;
+    case ARITH_EXPR_OP_ADD:
+        return a + b;
+    case ARITH_EXPR_OP_SUB:
+        return a - b;
+    case ARITH_EXPR_OP_MUL:
+        return a * b;
+    case ARITH_EXPR_OP_DIV:
+        return a / b;
+    case ARITH_EXPR_OP_POW:
+        return pow(a, b);
+    case ARITH_EXPR_OP_FUNC1:
+        return insn->f1(a);
+    case ARITH_EXPR_OP_FUNC2:
+        return insn->f2(a, b);
+    case ARITH_EXPR_OP_TRUNC:
+        return Ptrunc(a, insn->v0, insn->v1);
+    }
+    return 0.0;
+}
+
+static int arith_expr_emit(ARITH_EXPR_PARSER *ps, ARITH_EXPR_INSN insn)
+{
+    if(ps->expr->NBinsn == ARITH_EXPR_MAXINSN)
+    {
+        return 1;
+    }
+    ps->expr->insn[ps->expr->NBinsn++] = insn;
+    return 0;
+}
+
+/** @brief Emit unary instruction, or fold if operand is constant
+ */
+static int
+arith_expr_unary(ARITH_EXPR_PARSER *ps, ARITH_EXPR_INSN insn, ARITH_EXPR_VAL *a)
+{
+    if(a->iscst)
+    {
+        a->v = arith_expr_apply(&insn, a->v, 0.0);
+        return 0;
+    }
+    return arith_expr_emit(ps, insn);
+}
+
+/** @brief Emit binary instruction, or fold if both operands are constant
+ *
+ * Result is written to a.
+ */
+static int arith_expr_binary(ARITH_EXPR_PARSER *ps,
+                             ARITH_EXPR_INSN    insn,
+                             ARITH_EXPR_VAL    *a,
+                             ARITH_EXPR_VAL     b)
+{
+    if(a->iscst && b.iscst)
+    {
+        a->v = arith_expr_apply(&insn, a->v, b.v);
+        return 0;
+    }
+
+    if(b.iscst)
+    {
+        insn.arg = ARITH_EXPR_ARG_RCST;
+        insn.v0  = b.v;
+    }
+    else if(a->iscst)
+    {
+        insn.arg = ARITH_EXPR_ARG_LCST;
+        insn.v0  = a->v;
+    }
+    else
+    {
+        insn.arg = ARITH_EXPR_ARG_STACK;
+        ps->depth--;
+    }
+    a->iscst = 0;
+
+    return arith_expr_emit(ps, insn);
+}
+
+static int arith_expr_parse_sum(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val);
+
+/** @brief Number, variable, image, function call or parenthesis
+ */
+static int arith_expr_parse_primary(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val)
+{
+    const char     *tok = arith_expr_peek(ps);
+    char           *endptr;
+    ARITH_EXPR_INSN insn = {0};
+
+    if(tok[0] == '\0')
+    {
+        return 1;
+    }
+
+    if(arith_expr_accept(ps, "("))
+    {
+        if(arith_expr_parse_sum(ps, val) != 0)
+        {
+            return 1;
+        }
+        return (arith_expr_accept(ps, ")") == 0);
+    }
+
+    // number
+    val->v = strtod(tok, &endptr);
+    if((endptr != tok) && (*endptr == '\0'))
+    {
+        val->iscst = 1;
+        ps->itoken++;
+        return 0;
+    }
+
+    // function of one variable
+    for(int i = 0; i < ARITH_EXPR_NB(arith_expr_func1); i++)
+    {
+        if(strcmp(tok, arith_expr_func1[i].name) == 0)
+        {
+            ps->itoken++;
+            if((arith_expr_accept(ps, "(") == 0) ||
+                    (arith_expr_parse_sum(ps, val) != 0) ||
+                    (arith_expr_accept(ps, ")") == 0))
+            {
+                return 1;
+            }
+            insn.op = ARITH_EXPR_OP_FUNC1;
+            insn.f1 = arith_expr_func1[i].f1;
+            return arith_expr_unary(ps, insn, val);
+        }
+    }
+
+    // function of two variables
+    for(int i = 0; i < ARITH_EXPR_NB(arith_expr_func2); i++)
+    {
+        if(strcmp(tok, arith_expr_func2[i].name) == 0)
+        {
+            ARITH_EXPR_VAL b;
+
+            ps->itoken++;
+            if((arith_expr_accept(ps, "(") == 0) ||
+                    (arith_expr_parse_sum(ps, val) != 0) ||
+                    (arith_expr_accept(ps, ",") == 0) ||
+                    (arith_expr_parse_sum(ps, &b) != 0) ||
+                    (arith_expr_accept(ps, ")") == 0))
+            {
+                return 1;
+            }
+            insn.op = ARITH_EXPR_OP_FUNC2;
+            insn.f2 = arith_expr_func2[i].f2;
+            return arith_expr_binary(ps, insn, val, b);
+        }
+    }
+
+    // trunc(x, min, max), bounds must be constant
+    if(strcmp(tok, "trunc") == 0)
+    {
+        ARITH_EXPR_VAL b, c;
+
+        ps->itoken++;
+        if((arith_expr_accept(ps, "(") == 0) ||
+                (arith_expr_parse_sum(ps, val) != 0) ||
+                (arith_expr_accept(ps, ",") == 0) ||
+                (arith_expr_parse_sum(ps, &b) != 0) ||
+                (arith_expr_accept(ps, ",") == 0) ||
+                (arith_expr_parse_sum(ps, &c) != 0) ||
+                (arith_expr_accept(ps, ")") == 0))
+        {
+            return 1;
+        }
+        if((b.iscst == 0) || (c.iscst == 0))
+        {
+            return 1;
+        }
+        insn.op = ARITH_EXPR_OP_TRUNC;
+        insn.v0 = b.v;
+        insn.v1 = c.v;
+        return arith_expr_unary(ps, insn, val);
+    }
+
+    for(int i = 0; i < ARITH_EXPR_NB(arith_expr_nocompile); i++)
+    {
+        if(strcmp(tok, arith_expr_nocompile[i]) == 0)
+        {
+            return 1;
+        }
+    }
+
+    // variable
+    {
+        variableID IDvar = variable_ID(tok);
+        if(IDvar != -1)
+        {
+            val->iscst = 1;
+            val->v     = data.variable[IDvar].value.f;
+            ps->itoken++;
+            return 0;
+        }
+    }
+
+    // image
+    {
+        ARITH_EXPR *expr = ps->expr;
+        imageID     ID   = image_ID(tok);
+        int         slot;
+
+        if(ID == -1)
+        {
+            return 1;
+        }
+        switch(data.image[ID].md[0].datatype)
+        {
+        case _DATATYPE_COMPLEX_FLOAT:
+        case _DATATYPE_COMPLEX_DOUBLE:
+            return 1;
+        }
+
+        for(slot = 0; slot < expr->NBimage; slot++)
+        {
+            if(expr->ID[slot] == ID)
+            {
+                break;
+            }
+        }
+        if(slot == expr->NBimage)
+        {
+            if(expr->NBimage == ARITH_EXPR_MAXIMAGE)
+            {
+                return 1;
+            }
+            if(expr->NBimage == 0)
+            {
+                expr->nelement = data.image[ID].md[0].nelement;
+                expr->naxis    = data.image[ID].md[0].naxis;
+                for(int k = 0; k < expr->naxis; k++)
+                {
+                    expr->size[k] = data.image[ID].md[0].size[k];
+                }
+            }
+            else if((long) data.image[ID].md[0].nelement != expr->nelement)
+            {
+                return 1;
+            }
+            if(data.image[ID].md[0].datatype == _DATATYPE_DOUBLE)
+            {
+                expr->datatypeout = _DATATYPE_DOUBLE;
+            }
+            expr->ID[expr->NBimage++] = ID;
+        }
+
+        ps->itoken++;
+        val->iscst = 0;
+        insn.op    = ARITH_EXPR_OP_LOAD;
+        insn.slot  = slot;
+        ps->depth++;
+        if(ps->depth > expr->depth)
+        {
+            expr->depth = ps->depth;
+        }
+        if(ps->depth > ARITH_EXPR_MAXDEPTH)
+        {
+            return 1;
+        }
+        return arith_expr_emit(ps, insn);
+    }
+}
+
+static int arith_expr_parse_unary(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val)
+{
+    if(arith_expr_accept(ps, "-"))
+    {
+        ARITH_EXPR_INSN insn = {0};
+
+        if(arith_expr_parse_unary(ps, val) != 0)
+        {
+            return 1;
+        }
+        insn.op = ARITH_EXPR_OP_NEG;
+        return arith_expr_unary(ps, insn, val);
+    }
+    if(arith_expr_accept(ps, "+"))
+    {
+        return arith_expr_parse_unary(ps, val);
+    }
+    return arith_expr_parse_primary(ps, val);
+}
+
+static int arith_expr_parse_pow(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val)
+{
+    if(arith_expr_parse_unary(ps, val) != 0)
+    {
+        return 1;
+    }
+    while(arith_expr_accept(ps, "^"))
+    {
+        ARITH_EXPR_VAL  b;
+        ARITH_EXPR_INSN insn = {0};
+
+        if(arith_expr_parse_unary(ps, &b) != 0)
+        {
+            return 1;
+        }
+        insn.op = ARITH_EXPR_OP_POW;
+        if(arith_expr_binary(ps, insn, val, b) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int arith_expr_parse_product(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val)
+{
+    if(arith_expr_parse_pow(ps, val) != 0)
+    {
+        return 1;
+    }
+    for(;;)
+    {
+        ARITH_EXPR_VAL  b;
+        ARITH_EXPR_INSN insn = {0};
+
+        if(arith_expr_accept(ps, "*"))
+        {
+            insn.op = ARITH_EXPR_OP_MUL;
+        }
+        else if(arith_expr_accept(ps, "/"))
+        {
+            insn.op = ARITH_EXPR_OP_DIV;
+        }
+        else
+        {
+            return 0;
+        }
+        if((arith_expr_parse_pow(ps, &b) != 0) ||
+                (arith_expr_binary(ps, insn, val, b) != 0))
+        {
+            return 1;
+        }
+    }
+}
+
+static int arith_expr_parse_sum(ARITH_EXPR_PARSER *ps, ARITH_EXPR_VAL *val)
+{
+    if(arith_expr_parse_product(ps, val) != 0)
+    {
+        return 1;
+    }
+    for(;;)
+    {
+        ARITH_EXPR_VAL  b;
+        ARITH_EXPR_INSN insn = {0};
+
+        if(arith_expr_accept(ps, "+"))
+        {
+            insn.op = ARITH_EXPR_OP_ADD;
+        }
+        else if(arith_expr_accept(ps, "-"))
+        {
+            insn.op = ARITH_EXPR_OP_SUB;
+        }
+        else
+        {
+            return 0;
+        }
+        if((arith_expr_parse_product(ps, &b) != 0) ||
+                (arith_expr_binary(ps, insn, val, b) != 0))
+        {
+            return 1;
+        }
+    }
+}
+
+/** @brief Compile expression
+ *
+ * Syntax is that of execute_arith : [<out> =] <expression>
+ * Variables are read at compile time.
+ *
+ * @return 0 if compiled, 1 if expression should go to the legacy path
+ */
+int arith_expr_compile(const char *cmd, ARITH_EXPR *expr)
+{
+    ARITH_EXPR_PARSER ps;
+    ARITH_EXPR_VAL    val = {0};
+
+    memset(expr, 0, sizeof(ARITH_EXPR));
+    expr->datatypeout = _DATATYPE_FLOAT;
+
+    if(arith_expr_tokenize(cmd, &ps) != 0)
+    {
+        return 1;
+    }
+    ps.itoken = 0;
+    ps.expr   = expr;
+    ps.depth  = 0;
+
+    if((ps.NBtoken > 2) && (strcmp(ps.token[1], "=") == 0))
+    {
+        if(strchr("+-*/^()=,", ps.token[0][0]) != NULL)
+        {
+            return 1;
+        }
+        strncpy(expr->outname, ps.token[0], STRINGMAXLEN_IMGNAME - 1);
+        ps.itoken = 2;
+    }
+
+    if((arith_expr_parse_sum(&ps, &val) != 0) || (ps.itoken != ps.NBtoken))
+    {
+        return 1;
+    }
+
+    if(val.iscst)
+    {
+        // scalar result, no image was loaded
+        expr->value = val.v;
+    }
+
+    return 0;
+}
+
+/** @brief Make sure scratch pool has a slot of nbdouble for each thread
+ *
+ * Called outside of parallel regions.
+ */
+static errno_t arith_expr_pool_alloc(int NBslot, long nbdouble)
+{
+    if(NBslot > arith_expr_poolNBslot)
+    {
+        arith_expr_pool =
+            (double **) realloc(arith_expr_pool, sizeof(double *) * NBslot);
+        arith_expr_poolsize =
+            (long *) realloc(arith_expr_poolsize, sizeof(long) * NBslot);
+        if((arith_expr_pool == NULL) || (arith_expr_poolsize == NULL))
+        {
+            PRINT_ERROR("realloc() error");
+            abort();
+        }
+        for(int slot = arith_expr_poolNBslot; slot < NBslot; slot++)
+        {
+            arith_expr_pool[slot]     = NULL;
+            arith_expr_poolsize[slot] = 0;
+        }
+        arith_expr_poolNBslot = NBslot;
+    }
+
+    for(int slot = 0; slot < NBslot; slot++)
+    {
+        if(arith_expr_poolsize[slot] < nbdouble)
+        {
+            free(arith_expr_pool[slot]);
+            arith_expr_pool[slot] =
+                (double *) malloc(sizeof(double) * nbdouble);
+            if(arith_expr_pool[slot] == NULL)
+            {
+                PRINT_ERROR("malloc() error");
+                abort();
+            }
+            arith_expr_poolsize[slot] = nbdouble;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+#define ARITH_EXPR_LOAD(type, member)                                          \
+    {                                                                          \
+        const type *restrict in = data.image[ID].array.member + ii0;           \
+        for(long i = 0; i < n; i++)                                            \
+        {                                                                      \
+            s[i] = (double) in[i];                                             \
+        }                                                                      \
+    }                                                                          \
+    break
+
+static void arith_expr_load(imageID ID, double *restrict s, long ii0, long n)
+{
+    switch(data.image[ID].md[0].datatype)
+    {
+    case _DATATYPE_FLOAT:
+        ARITH_EXPR_LOAD(float, F);
+    case _DATATYPE_DOUBLE:
+        ARITH_EXPR_LOAD(double, D);
+    case _DATATYPE_UINT8:
+        ARITH_EXPR_LOAD(uint8_t, UI8);
+    case _DATATYPE_UINT16:
+        ARITH_EXPR_LOAD(uint16_t, UI16);
+    case _DATATYPE_UINT32:
+        ARITH_EXPR_LOAD(uint32_t, UI32);
+    case _DATATYPE_UINT64:
+        ARITH_EXPR_LOAD(uint64_t, UI64);
+    case _DATATYPE_INT8:
+        ARITH_EXPR_LOAD(int8_t, SI8);
+    case _DATATYPE_INT16:
+        ARITH_EXPR_LOAD(int16_t, SI16);
+    case _DATATYPE_INT32:
+        ARITH_EXPR_LOAD(int32_t, SI32);
+    case _DATATYPE_INT64:
+        ARITH_EXPR_LOAD(int64_t, SI64);
+    }
+}
+
+// binary instruction loop over block : s1 = s1 OP s2, s2 or s1 may be v0
+#define ARITH_EXPR_BINARY(EXPR)                                                \
+    switch(insn->arg)                                                          \
+    {                                                                          \
+    case ARITH_EXPR_ARG_STACK:                                                 \
+        for(long i = 0; i < n; i++)                                            \
+        {                                                                      \
+            double a = s1[i];                                                  \
+            double b = s2[i];                                                  \
+            s1[i]    = EXPR;                                                   \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_EXPR_ARG_RCST:                                                  \
+        for(long i = 0; i < n; i++)                                            \
+        {                                                                      \
+            double a = s1[i];                                                  \
+            double b = v0;                                                     \
+            s1[i]    = EXPR;                                                   \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_EXPR_ARG_LCST:                                                  \
+        for(long i = 0; i < n; i++)                                            \
+        {                                                                      \
+            double a = v0;                                                     \
+            double b = s1[i];                                                  \
+            s1[i]    = EXPR;                                                   \
+        }                                                                      \
+        break;                                                                 \
+    }                                                                          \
+    break
+
+/** @brief Run program over one block of n pixels starting at ii0
+ *
+ * stack holds expr->depth x ARITH_EXPR_BLOCKSIZE values.
+ * Result is left in stack[0..n-1].
+ */
+static void arith_expr_block(const ARITH_EXPR *expr,
+                             double *restrict  stack,
+                             long              ii0,
+                             long              n)
+{
+    int sp = 0; // stack depth
+
+    for(int k = 0; k < expr->NBinsn; k++)
+    {
+        const ARITH_EXPR_INSN *insn = &expr->insn[k];
+
+        if(insn->op == ARITH_EXPR_OP_LOAD)
+        {
+            arith_expr_load(expr->ID[insn->slot],
+                            stack + sp * ARITH_EXPR_BLOCKSIZE,
+                            ii0,
+                            n);
+            sp++;
+            continue;
+        }
+
+        if((insn->op == ARITH_EXPR_OP_NEG) || (insn->op == ARITH_EXPR_OP_FUNC1) ||
+                (insn->op == ARITH_EXPR_OP_TRUNC))
+        {
+            double *restrict s = stack + (sp - 1) * ARITH_EXPR_BLOCKSIZE;
+            double vmin        = insn->v0;
+            double vmax        = insn->v1;
+
+            switch(insn->op)
+            {
+            case ARITH_EXPR_OP_NEG:
+                for(long i = 0; i < n; i++)
+                {
+                    s[i] = -s[i];
+                }
+                break;
+            case ARITH_EXPR_OP_FUNC1:
+                for(long i = 0; i < n; i++)
+                {
+                    s[i] = insn->f1(s[i]);
+                }
+                break;
+            case ARITH_EXPR_OP_TRUNC:
+                for(long i = 0; i < n; i++)
+                {
+                    double v = s[i];
+                    s[i]     = (v < vmin) ? vmin : v;
+                    s[i]     = (v > vmax) ? vmax : s[i];
+                }
+                break;
+            }
+            continue;
+        }
+
+        // binary : top of stack is right operand unless constant
+        if(insn->arg == ARITH_EXPR_ARG_STACK)
+        {
+            sp--;
+        }
+        {
+            double *restrict s1 = stack + (sp - 1) * ARITH_EXPR_BLOCKSIZE;
+            double *restrict s2 = stack + sp * ARITH_EXPR_BLOCKSIZE;
+            double v0           = insn->v0;
+
+            switch(insn->op)
+            {
+            case ARITH_EXPR_OP_ADD:
+                ARITH_EXPR_BINARY(a + b);
+            case ARITH_EXPR_OP_SUB:
+                ARITH_EXPR_BINARY(a - b);
+            case ARITH_EXPR_OP_MUL:
+                ARITH_EXPR_BINARY(a * b);
+            case ARITH_EXPR_OP_DIV:
+                ARITH_EXPR_BINARY(a / b);
+            case ARITH_EXPR_OP_POW:
+                if((insn->arg == ARITH_EXPR_ARG_RCST) && (v0 == 2.0))
+                {
+                    for(long i = 0; i < n; i++)
+                    {
+                        s1[i] = s1[i] * s1[i];
+                    }
+                    break;
+                }
+                ARITH_EXPR_BINARY(pow(a, b));
+            case ARITH_EXPR_OP_FUNC2:
+                ARITH_EXPR_BINARY(insn->f2(a, b));
+            }
+        }
+    }
+}
+
+/** @brief Evaluate compiled expression into out
+ *
+ * out is an array of expr->nelement pixels of type expr->datatypeout.
+ */
+errno_t arith_expr_eval(const ARITH_EXPR *expr, void *out)
+{
+    DEBUG_TRACE_FSTART();
+
+    long nelement = expr->nelement;
+    long NBblock  = (nelement + ARITH_EXPR_BLOCKSIZE - 1) / ARITH_EXPR_BLOCKSIZE;
+    int  NBslot   = 1;
+
+#ifdef _OPENMP
+    NBslot = omp_get_max_threads();
+#endif
+    arith_expr_pool_alloc(NBslot,
+                          (long) (expr->depth + 1) * ARITH_EXPR_BLOCKSIZE);
+
+    #pragma omp parallel for schedule(static) if (nelement > OMP_NELEMENT_LIMIT)
+    for(long iblock = 0; iblock < NBblock; iblock++)
+    {
+        int slot = 0;
+#ifdef _OPENMP
+        slot = omp_get_thread_num();
+#endif
+        double *restrict stack = arith_expr_pool[slot];
+        long ii0               = iblock * ARITH_EXPR_BLOCKSIZE;
+        long n                 = nelement - ii0;
+
+        if(n > ARITH_EXPR_BLOCKSIZE)
+        {
+            n = ARITH_EXPR_BLOCKSIZE;
+        }
+
+        arith_expr_block(expr, stack, ii0, n);
+
+        if(expr->datatypeout == _DATATYPE_DOUBLE)
+        {
+            double *restrict dout = (double *) out + ii0;
+            for(long i = 0; i < n; i++)
+            {
+                dout[i] = stack[i];
+            }
+        }
+        else
+        {
+            float *restrict fout = (float *) out + ii0;
+            for(long i = 0; i < n; i++)
+            {
+                fout[i] = (float) stack[i];
+            }
+        }
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+/** @brief Compile and execute expression
+ *
+ * Result is assigned as execute_arith does : scalar result to variable
+ * (value is printed), image result to image. Without assignment, scalar
+ * result is printed.
+ *
+ * @return 1 if executed, 0 if expression should go to the legacy path
+ */
+int arith_expr_execute(const char *cmd)
+{
+    ARITH_EXPR expr;
+
+    if(arith_expr_enabled == 0)
+    {
+        return 0;
+    }
+    if(arith_expr_compile(cmd, &expr) != 0)
+    {
+        return 0;
+    }
+
+    if(expr.NBimage == 0)
+    {
+        if(expr.outname[0] != '\0')
+        {
+            if(variable_ID(expr.outname) != -1)
+            {
+                delete_variable_ID(expr.outname);
+            }
+            if(image_ID(expr.outname) != -1)
+            {
+                delete_image_ID(expr.outname, DELETE_IMAGE_ERRMODE_WARNING);
+            }
+            create_variable_ID(expr.outname, expr.value);
+        }
+        printf("%.20g\n", expr.value);
+        return 1;
+    }
+
+    // no assignment, or out=im which renames im
+    if((expr.outname[0] == '\0') || (expr.NBinsn == 1))
+    {
+        return 0;
+    }
+
+    {
+        // output overwrites an input : compute to temporary, then rename
+        int     outisinput = 0;
+        imageID IDout;
+        imageID IDprev = image_ID(expr.outname);
+
+        for(int slot = 0; slot < expr.NBimage; slot++)
+        {
+            if(expr.ID[slot] == IDprev)
+            {
+                outisinput = 1;
+            }
+        }
+
+        if(variable_ID(expr.outname) != -1)
+        {
+            delete_variable_ID(expr.outname);
+        }
+
+        if(outisinput)
+        {
+            CREATE_IMAGENAME(tmpname, "_tmpexpr_%d", (int) getpid());
+            create_image_ID(tmpname,
+                            expr.naxis,
+                            expr.size,
+                            expr.datatypeout,
+                            data.SHARED_DFT,
+                            data.NBKEYWORD_DFT,
+                            0,
+                            &IDout);
+            arith_expr_eval(&expr, data.image[IDout].array.raw);
+            delete_image_ID(expr.outname, DELETE_IMAGE_ERRMODE_WARNING);
+            chname_image_ID(tmpname, expr.outname);
+        }
+        else
+        {
+            if(IDprev != -1)
+            {
+                delete_image_ID(expr.outname, DELETE_IMAGE_ERRMODE_WARNING);
+            }
+            create_image_ID(expr.outname,
+                            expr.naxis,
+                            expr.size,
+                            expr.datatypeout,
+                            data.SHARED_DFT,
+                            data.NBKEYWORD_DFT,
+                            0,
+                            &IDout);
+            arith_expr_eval(&expr, data.image[IDout].array.raw);
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file    arith_expr.h
+ * @brief   compiled element-wise arithmetic expressions
+ */
+
+#ifndef COREMOD_ARITH_ARITH_EXPR_H
+#define COREMOD_ARITH_ARITH_EXPR_H
+
+#include <stdint.h>
+
+#define ARITH_EXPR_MAXINSN  100 // same as execute_arith word limit
+#define ARITH_EXPR_MAXIMAGE 32  // distinct input images
+#define ARITH_EXPR_MAXDEPTH 32  // evaluation stack depth
+
+// pixels processed per instruction
+#define ARITH_EXPR_BLOCKSIZE 256
+
+// instructions
+#define ARITH_EXPR_OP_LOAD  0 // push input image
+#define ARITH_EXPR_OP_NEG   1
+#define ARITH_EXPR_OP_ADD   2
+#define ARITH_EXPR_OP_SUB   3
+#define ARITH_EXPR_OP_MUL   4
+#define ARITH_EXPR_OP_DIV   5
+#define ARITH_EXPR_OP_POW   6
+#define ARITH_EXPR_OP_FUNC1 7 // f1(x)
+#define ARITH_EXPR_OP_FUNC2 8 // f2(x, y)
+#define ARITH_EXPR_OP_TRUNC 9 // clamp x to [v0, v1]
+
+// binary instruction operands
+#define ARITH_EXPR_ARG_STACK 0 // both on stack
+#define ARITH_EXPR_ARG_RCST  1 // right operand is v0
+#define ARITH_EXPR_ARG_LCST  2 // left operand is v0
+
+typedef struct
+{
+    int    op;
+    int    arg;
+    int    slot; // input image, ARITH_EXPR_OP_LOAD
+    double v0;
+    double v1;
+    double (*f1)(double);
+    double (*f2)(double, double);
+} ARITH_EXPR_INSN;
+
+typedef struct
+{
+    char outname[STRINGMAXLEN_IMGNAME]; // empty if no assignment
+
+    // program, postfix
+    int             NBinsn;
+    ARITH_EXPR_INSN insn[ARITH_EXPR_MAXINSN];
+    int             depth; // max stack depth
+
+    // input images, each loaded once per block
+    int     NBimage;
+    imageID ID[ARITH_EXPR_MAXIMAGE];
+
+    // result is a scalar if NBimage = 0
+    double value;
+
+    long     nelement;
+    uint8_t  naxis;
+    uint32_t size[3];
+    uint8_t  datatypeout; // FLOAT, DOUBLE if any input is DOUBLE
+} ARITH_EXPR;
+
+void arith_expr_set_enable(int enable);
+
+int arith_expr_get_enable();
+
+int arith_expr_compile(const char *cmd, ARITH_EXPR *expr);
+
+errno_t arith_expr_eval(const ARITH_EXPR *expr, void *out);
+
+int arith_expr_execute(const char *cmd);
+
+#endif
@@ -9,6 +9,11 @@
 
 #include "COREMOD_memory/COREMOD_memory.h"
 
+#include "image_crop.h"
+
+// total size above which crop copy is multithreaded
+#define CROP_OMP_NBBYTE_LIMIT 4000000
+
 // ==========================================
 // Forward declaration(s)
 // ==========================================
@@ -118,6 +123,115 @@ errno_t image_crop_addCLIcmd()
     return RETURN_SUCCESS;
 }
 
+/**
+ * @brief Compute row spans copied by crop
+ *
+ * Input and output are row-major : for each (slice, row) of the
+ * intersection between the crop box and the input image, the pixels to be
+ * copied are contiguous in both input and output. Spans are described by
+ * the first span offsets and row/slice strides, so they can be computed
+ * once and reused for every frame of a stream.
+ *
+ * Pixels of the crop box outside the input image are not written.
+ *
+ * @param spans     output span description
+ * @param datatype  input and output data type
+ * @param naxis     number of axis (1 to 3)
+ * @param insize    input image size
+ * @param outsize   output image size
+ * @param start     crop box start in input image, may be negative
+ */
+errno_t image_crop_spans_init(IMAGE_CROP_SPANS *spans,
+                              uint8_t           datatype,
+                              long              naxis,
+                              const uint32_t   *insize,
+                              const uint32_t   *outsize,
+                              const long       *start)
+{
+    long insz[3]  = {1, 1, 1};
+    long outsz[3] = {1, 1, 1};
+    long st[3]    = {0, 0, 0};
+    long cstart[3];
+    long cend[3];
+
+    int typesize = ImageStreamIO_typesize(datatype);
+    if(typesize < 1)
+    {
+        return RETURN_FAILURE;
+    }
+
+    for(long i = 0; (i < naxis) && (i < 3); i++)
+    {
+        insz[i]  = insize[i];
+        outsz[i] = outsize[i];
+        st[i]    = start[i];
+    }
+
+    memset(spans, 0, sizeof(IMAGE_CROP_SPANS));
+    for(int i = 0; i < 3; i++)
+    {
+        cstart[i] = (st[i] < 0) ? 0 : st[i];
+        cend[i]   = st[i] + outsz[i];
+        if(cend[i] > insz[i])
+        {
+            cend[i] = insz[i];
+        }
+        if(cend[i] <= cstart[i])
+        {
+            // no overlap
+            return RETURN_SUCCESS;
+        }
+    }
+
+    spans->spanbytes      = (size_t) typesize * (cend[0] - cstart[0]);
+    spans->NBrow          = cend[1] - cstart[1];
+    spans->NBslice        = cend[2] - cstart[2];
+    spans->inrowstride    = (uint64_t) typesize * insz[0];
+    spans->outrowstride   = (uint64_t) typesize * outsz[0];
+    spans->inslicestride  = spans->inrowstride * insz[1];
+    spans->outslicestride = spans->outrowstride * outsz[1];
+    spans->inoffset0      = cstart[2] * spans->inslicestride +
+                            cstart[1] * spans->inrowstride +
+                            (uint64_t) typesize * cstart[0];
+    spans->outoffset0 = (cstart[2] - st[2]) * spans->outslicestride +
+                        (cstart[1] - st[1]) * spans->outrowstride +
+                        (uint64_t) typesize * (cstart[0] - st[0]);
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Copy crop row spans from input to output array
+ *
+ * Large crops are split across threads.
+ */
+void image_crop_spans_copy(const IMAGE_CROP_SPANS *spans,
+                           const void             *inarray,
+                           void                   *outarray)
+{
+    const char *in     = (const char *) inarray;
+    char       *out    = (char *) outarray;
+    uint64_t    NBspan = (uint64_t) spans->NBrow * spans->NBslice;
+
+    if(spans->spanbytes == 0)
+    {
+        return;
+    }
+
+    #pragma omp parallel for if (NBspan * spans->spanbytes > CROP_OMP_NBBYTE_LIMIT)
+    for(uint64_t span = 0; span < NBspan; span++)
+    {
+        uint64_t slice = span / spans->NBrow;
+        uint64_t row   = span - slice * spans->NBrow;
+
+        memcpy(out + spans->outoffset0 + slice * spans->outslicestride +
+               row * spans->outrowstride,
+               in + spans->inoffset0 + slice * spans->inslicestride +
+               row * spans->inrowstride,
+               spans->spanbytes);
+    }
+}
+
 imageID arith_image_crop(const char *ID_name,
                          const char *ID_out,
                          long       *start,
@@ -239,431 +353,22 @@ imageID arith_image_crop(const char *ID_name,
             naxis);
     }
 
-    if(naxis == 1)
-    {
-        if(datatype == _DATATYPE_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.F[ii - start[0]] =
-                    data.image[IDin].array.F[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.D[ii - start[0]] =
-                    data.image[IDin].array.D[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_COMPLEX_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.CF[ii - start[0]].re =
-                    data.image[IDin].array.CF[ii].re;
-                data.image[IDout].array.CF[ii - start[0]].im =
-                    data.image[IDin].array.CF[ii].im;
-            }
-        }
-        else if(datatype == _DATATYPE_COMPLEX_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.CD[ii - start[0]].re =
-                    data.image[IDin].array.CD[ii].re;
-                data.image[IDout].array.CD[ii - start[0]].im =
-                    data.image[IDin].array.CD[ii].im;
-            }
-        }
-        else if(datatype == _DATATYPE_UINT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.UI8[ii - start[0]] =
-                    data.image[IDin].array.UI8[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_UINT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.UI16[ii - start[0]] =
-                    data.image[IDin].array.UI16[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_UINT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.UI32[ii - start[0]] =
-                    data.image[IDin].array.UI32[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_UINT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.UI64[ii - start[0]] =
-                    data.image[IDin].array.UI64[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_INT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.SI8[ii - start[0]] =
-                    data.image[IDin].array.SI8[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_INT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.SI16[ii - start[0]] =
-                    data.image[IDin].array.SI16[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_INT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.SI32[ii - start[0]] =
-                    data.image[IDin].array.SI32[ii];
-            }
-        }
-        else if(datatype == _DATATYPE_INT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-            {
-                data.image[IDout].array.SI64[ii - start[0]] =
-                    data.image[IDin].array.SI64[ii];
-            }
-        }
-        else
-        {
-            PRINT_ERROR("invalid data type");
-            exit(0);
-        }
-    }
-    if(naxis == 2)
+    if(naxis > 3)
     {
-        if(datatype == _DATATYPE_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.F[(jj - start[1]) * naxesout[0] +
-                                              (ii - start[0])] =
-                                                  data.image[IDin].array.F[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.D[(jj - start[1]) * naxesout[0] +
-                                              (ii - start[0])] =
-                                                  data.image[IDin].array.D[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_COMPLEX_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                {
-                    data.image[IDout]
-                    .array
-                    .CF[(jj - start[1]) * naxesout[0] + (ii - start[0])]
-                    .re = data.image[IDin].array.CF[jj * naxes[0] + ii].re;
-                    data.image[IDout]
-                    .array
-                    .CF[(jj - start[1]) * naxesout[0] + (ii - start[0])]
-                    .im = data.image[IDin].array.CF[jj * naxes[0] + ii].im;
-                }
-        }
-        else if(datatype == _DATATYPE_COMPLEX_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                {
-                    data.image[IDout]
-                    .array
-                    .CD[(jj - start[1]) * naxesout[0] + (ii - start[0])]
-                    .re = data.image[IDin].array.CD[jj * naxes[0] + ii].re;
-                    data.image[IDout]
-                    .array
-                    .CD[(jj - start[1]) * naxesout[0] + (ii - start[0])]
-                    .im = data.image[IDin].array.CD[jj * naxes[0] + ii].im;
-                }
-        }
-        else if(datatype == _DATATYPE_UINT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.UI8[(jj - start[1]) * naxesout[0] +
-                                                (ii - start[0])] =
-                                                    data.image[IDin].array.UI8[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_UINT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.UI16[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.UI16[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_UINT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.UI32[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.UI32[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_UINT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.UI64[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.UI64[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_INT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.SI8[(jj - start[1]) * naxesout[0] +
-                                                (ii - start[0])] =
-                                                    data.image[IDin].array.SI8[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_INT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.SI16[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.SI16[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_INT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.SI32[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.SI32[jj * naxes[0] + ii];
-        }
-        else if(datatype == _DATATYPE_INT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    data.image[IDout].array.SI64[(jj - start[1]) * naxesout[0] +
-                                                 (ii - start[0])] =
-                                                     data.image[IDin].array.SI64[jj * naxes[0] + ii];
-        }
-        else
-        {
-            PRINT_ERROR("invalid data type");
-            exit(0);
-        }
+        PRINT_ERROR("naxis %ld > 3 not supported", naxis);
+        exit(0);
     }
-    if(naxis == 3)
+
+    IMAGE_CROP_SPANS spans;
+    if(image_crop_spans_init(&spans, datatype, naxis, naxes, naxesout, start) !=
+            RETURN_SUCCESS)
     {
-        //	printf("naxis = 3\n");
-        if(datatype == _DATATYPE_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.F
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin].array.F[kk * naxes[0] * naxes[1] +
-                                                      jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.D
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin].array.D[kk * naxes[0] * naxes[1] +
-                                                      jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_COMPLEX_FLOAT)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout]
-                        .array
-                        .CF[(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                            (jj - start[1]) * naxesout[0] + (ii - start[0])]
-                        .re = data.image[IDin]
-                              .array
-                              .CF[kk * naxes[0] * naxes[1] +
-                                     jj * naxes[0] + ii]
-                              .re;
-                        data.image[IDout]
-                        .array
-                        .CF[(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                            (jj - start[1]) * naxesout[0] + (ii - start[0])]
-                        .im = data.image[IDin]
-                              .array
-                              .CF[kk * naxes[0] * naxes[1] +
-                                     jj * naxes[0] + ii]
-                              .im;
-                    }
-        }
-        else if(datatype == _DATATYPE_COMPLEX_DOUBLE)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout]
-                        .array
-                        .CD[(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                            (jj - start[1]) * naxesout[0] + (ii - start[0])]
-                        .re = data.image[IDin]
-                              .array
-                              .CD[kk * naxes[0] * naxes[1] +
-                                     jj * naxes[0] + ii]
-                              .re;
-                        data.image[IDout]
-                        .array
-                        .CD[(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                            (jj - start[1]) * naxesout[0] + (ii - start[0])]
-                        .im = data.image[IDin]
-                              .array
-                              .CD[kk * naxes[0] * naxes[1] +
-                                     jj * naxes[0] + ii]
-                              .im;
-                    }
-        }
-        else if(datatype == _DATATYPE_UINT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.UI8
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.UI8[kk * naxes[0] * naxes[1] +
-                                           jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_UINT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.UI16
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.UI16[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_UINT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.UI32
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.UI32[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_UINT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.UI64
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.UI64[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_INT8)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.SI8
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.SI8[kk * naxes[0] * naxes[1] +
-                                           jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_INT16)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.SI16
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.SI16[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_INT32)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.SI32
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.SI32[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else if(datatype == _DATATYPE_INT64)
-        {
-            for(uint32_t ii = start_c[0]; ii < end_c[0]; ii++)
-                for(uint32_t jj = start_c[1]; jj < end_c[1]; jj++)
-                    for(uint32_t kk = start_c[2]; kk < end_c[2]; kk++)
-                    {
-                        data.image[IDout].array.SI64
-                        [(kk - start[2]) * naxesout[0] * naxesout[1] +
-                                         (jj - start[1]) * naxesout[0] + (ii - start[0])] =
-                             data.image[IDin]
-                             .array.SI64[kk * naxes[0] * naxes[1] +
-                                            jj * naxes[0] + ii];
-                    }
-        }
-        else
-        {
-            PRINT_ERROR("invalid data type");
-            exit(0);
-        }
+        PRINT_ERROR("invalid data type");
+        exit(0);
     }
+    image_crop_spans_copy(&spans,
+                          data.image[IDin].array.raw,
+                          data.image[IDout].array.raw);
 
     free(naxesout);
     free(naxes);
@@ -3,6 +3,35 @@
  *
  */
 
+#ifndef COREMOD_ARITH_IMAGE_CROP_H
+#define COREMOD_ARITH_IMAGE_CROP_H
+
+// contiguous row spans copied by crop, see image_crop_spans_init()
+typedef struct
+{
+    size_t   spanbytes; // bytes per span, 0 if crop box outside input
+    uint32_t NBrow;     // spans per slice
+    uint32_t NBslice;
+
+    uint64_t inoffset0; // byte offset of first span
+    uint64_t outoffset0;
+    uint64_t inrowstride; // bytes
+    uint64_t outrowstride;
+    uint64_t inslicestride;
+    uint64_t outslicestride;
+} IMAGE_CROP_SPANS;
+
+errno_t image_crop_spans_init(IMAGE_CROP_SPANS *spans,
+                              uint8_t           datatype,
+                              long              naxis,
+                              const uint32_t   *insize,
+                              const uint32_t   *outsize,
+                              const long       *start);
+
+void image_crop_spans_copy(const IMAGE_CROP_SPANS *spans,
+                           const void             *inarray,
+                           void                   *outarray);
+
 errno_t image_crop_addCLIcmd();
 
 imageID arith_image_crop(const char *ID_name,
@@ -26,3 +55,5 @@ imageID arith_image_extract3D(const char *in_name,
                               long        xstart,
                               long        ystart,
                               long        zstart);
+
+#endif
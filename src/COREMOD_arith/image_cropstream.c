@@ -0,0 +1,213 @@
+/**
+ * @file    image_cropstream.c
+ * @brief   crop region of interest from live stream
+ *
+ * Row spans are computed once and reused for every frame. They are only
+ * recomputed if the crop box is changed.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "image_crop.h"
+
+// variables local to this translation unit
+static char *insname;
+static long  fpi_insname;
+
+static char *outsname;
+static long  fpi_outsname;
+
+static uint32_t *cropxstart;
+static long      fpi_cropxstart;
+
+static uint32_t *cropxsize;
+static long      fpi_cropxsize;
+
+static uint32_t *cropystart;
+static long      fpi_cropystart;
+
+static uint32_t *cropysize;
+static long      fpi_cropysize;
+
+
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_STREAM,
+        ".insname",
+        "input stream name",
+        "inim",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &insname,
+        &fpi_insname
+    },
+    {
+        CLIARG_STR,
+        ".outsname",
+        "output stream name",
+        "outim",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &outsname,
+        &fpi_outsname
+    },
+    {
+        CLIARG_UINT32,
+        ".cropxstart",
+        "crop x coord start",
+        "30",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &cropxstart,
+        &fpi_cropxstart
+    },
+    {
+        CLIARG_UINT32,
+        ".cropxsize",
+        "crop x coord size",
+        "32",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &cropxsize,
+        &fpi_cropxsize
+    },
+    {
+        CLIARG_UINT32,
+        ".cropystart",
+        "crop y coord start",
+        "20",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &cropystart,
+        &fpi_cropystart
+    },
+    {
+        CLIARG_UINT32,
+        ".cropysize",
+        "crop y coord size",
+        "32",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &cropysize,
+        &fpi_cropysize
+    }
+};
+
+
+
+// Optional custom configuration setup.
+// Runs once at conf startup
+//
+static errno_t customCONFsetup()
+{
+    if(data.fpsptr != NULL)
+    {
+        data.fpsptr->parray[fpi_insname].fpflag |=
+            FPFLAG_STREAM_RUN_REQUIRED | FPFLAG_CHECKSTREAM;
+
+        data.fpsptr->parray[fpi_cropxstart].fpflag |= FPFLAG_WRITERUN;
+        data.fpsptr->parray[fpi_cropystart].fpflag |= FPFLAG_WRITERUN;
+    }
+
+    return RETURN_SUCCESS;
+}
+
+// Optional custom configuration checks.
+// Runs at every configuration check loop iteration
+//
+static errno_t customCONFcheck()
+{
+
+    if(data.fpsptr != NULL)
+    {
+    }
+
+    return RETURN_SUCCESS;
+}
+
+static CLICMDDATA CLIcmddata = {"cropstream",
+                                "crop region of interest from stream",
+                                CLICMD_FIELDS_DEFAULTS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    printf("Copy region of interest of 2D input stream to output stream\n");
+    printf("Output stream has input stream datatype\n");
+    printf("Crop start can be changed while running\n");
+    return RETURN_SUCCESS;
+}
+
+
+
+
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    // CONNECT TO INPUT STREAM
+    IMGID imgin = mkIMGID_from_name(insname);
+    resolveIMGID(&imgin, ERRMODE_ABORT);
+    printf("Input stream size : %u %u\n", imgin.md->size[0], imgin.md->size[1]);
+
+    // CONNNECT TO OR CREATE OUTPUT STREAM
+    IMGID imgout = stream_connect_create_2D(outsname,
+                                            *cropxsize,
+                                            *cropysize,
+                                            imgin.md->datatype);
+
+    uint32_t insize[2]  = {imgin.md->size[0], imgin.md->size[1]};
+    uint32_t outsize[2] = {*cropxsize, *cropysize};
+    long     start[2]   = {-1, -1};
+
+    IMAGE_CROP_SPANS spans;
+
+    INSERT_STD_PROCINFO_COMPUTEFUNC_INIT;
+
+
+
+    INSERT_STD_PROCINFO_COMPUTEFUNC_LOOPSTART
+    {
+        if((start[0] != *cropxstart) || (start[1] != *cropystart))
+        {
+            start[0] = *cropxstart;
+            start[1] = *cropystart;
+            image_crop_spans_init(&spans,
+                                  imgin.md->datatype,
+                                  2,
+                                  insize,
+                                  outsize,
+                                  start);
+            // area outside input image
+            memset(imgout.im->array.raw,
+                   0,
+                   ImageStreamIO_typesize(imgin.md->datatype) *
+                   imgout.md->nelement);
+        }
+
+        image_crop_spans_copy(&spans,
+                              imgin.im->array.raw,
+                              imgout.im->array.raw);
+
+        processinfo_update_output_stream(processinfo, imgout.ID);
+    }
+    INSERT_STD_PROCINFO_COMPUTEFUNC_END
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+
+
+INSERT_STD_FPSCLIfunctions
+
+
+
+
+// Register function in CLI
+errno_t
+CLIADDCMD_COREMOD_arith__cropstream()
+{
+
+    CLIcmddata.FPS_customCONFsetup = customCONFsetup;
+    CLIcmddata.FPS_customCONFcheck = customCONFcheck;
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,6 @@
+#ifndef COREMOD_ARITH_CROPSTREAM_H
+#define COREMOD_ARITH_CROPSTREAM_H
+
+errno_t CLIADDCMD_COREMOD_arith__cropstream();
+
+#endif
@@ -0,0 +1,654 @@
+/**
+ * @file    image_percentile.c
+ * @brief   percentile and median by selection
+ *
+ * Percentile value for fraction f is the element of rank (long)(f * n) in
+ * the sorted array, as previously obtained by full sort.
+ *
+ * 8-bit and 16-bit integer arrays are processed by histogram : single pass,
+ * no copy. The histogram has its own per-thread buffer, kept across calls.
+ * Other types are copied to a per-thread work buffer, reused across calls,
+ * and ranks are obtained by selection (quickselect with 3-way partition,
+ * falling back to heap sort if partitioning degenerates). Several ranks are
+ * resolved in a single multi-selection.
+ *
+ * Temporal median computes per-pixel median along the third axis of a cube,
+ * in parallel over pixel blocks.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "image_percentile.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// number of pixels gathered together in temporal median
+#define TMEDIAN_BLOCKSIZE 64
+
+// ranges smaller than this are sorted by insertion
+#define SELECT_SMALLRANGE 16
+
+// work buffers up to this size [byte] are kept for the next call
+#define PERCENTILE_WORKBUFF_KEEPSIZE 262144
+
+// work buffer, reused across calls
+static __thread void  *workbuff     = NULL;
+static __thread size_t workbuffsize = 0;
+
+static void *get_workbuff(size_t size)
+{
+    if(size > workbuffsize)
+    {
+        free(workbuff);
+        workbuff = malloc(size);
+        if(workbuff == NULL)
+        {
+            PRINT_ERROR("malloc() error");
+            abort();
+        }
+        workbuffsize = size;
+    }
+    return workbuff;
+}
+
+// free work buffer if larger than keepsize
+static void release_workbuff(size_t keepsize)
+{
+    if(workbuffsize > keepsize)
+    {
+        free(workbuff);
+        workbuff     = NULL;
+        workbuffsize = 0;
+    }
+}
+
+// histogram buffer, sized for 16-bit types, kept across calls
+#define PERCENTILE_HIST_NBVAL 65536
+
+static __thread uint64_t *histbuff = NULL;
+
+static uint64_t *get_histbuff()
+{
+    if(histbuff == NULL)
+    {
+        histbuff = (uint64_t *) malloc(sizeof(uint64_t) * PERCENTILE_HIST_NBVAL);
+        if(histbuff == NULL)
+        {
+            PRINT_ERROR("malloc() error");
+            abort();
+        }
+    }
+    return histbuff;
+}
+
+
+
+// Selection kernels for type T
+//
+// multiselect_SFX(a, lo, hi, rank, NBrank, depth) reorders a[lo..hi] so
+// that a[rank[i]] holds the value of rank rank[i].
+// rank must be sorted ascending, all within [lo, hi].
+//
+#define PERCENTILE_SELECT_DEFINE(T, SFX)                                       \
+    static void siftdown_##SFX(T *a, long root, long n)                        \
+    {                                                                          \
+        while(1)                                                               \
+        {                                                                      \
+            long child = 2 * root + 1;                                         \
+            if(child >= n)                                                     \
+            {                                                                  \
+                break;                                                         \
+            }                                                                  \
+            if((child + 1 < n) && (a[child] < a[child + 1]))                   \
+            {                                                                  \
+                child++;                                                       \
+            }                                                                  \
+            if(!(a[root] < a[child]))                                          \
+            {                                                                  \
+                break;                                                         \
+            }                                                                  \
+            T tmp    = a[root];                                                \
+            a[root]  = a[child];                                               \
+            a[child] = tmp;                                                    \
+            root     = child;                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void heapsort_##SFX(T *a, long n)                                   \
+    {                                                                          \
+        for(long start = n / 2 - 1; start >= 0; start--)                       \
+        {                                                                      \
+            siftdown_##SFX(a, start, n);                                       \
+        }                                                                      \
+        for(long end = n - 1; end > 0; end--)                                  \
+        {                                                                      \
+            T tmp  = a[0];                                                     \
+            a[0]   = a[end];                                                   \
+            a[end] = tmp;                                                      \
+            siftdown_##SFX(a, 0, end);                                         \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void insertionsort_##SFX(T *a, long lo, long hi)                    \
+    {                                                                          \
+        for(long i = lo + 1; i <= hi; i++)                                     \
+        {                                                                      \
+            T    v = a[i];                                                     \
+            long j = i - 1;                                                    \
+            while((j >= lo) && (v < a[j]))                                     \
+            {                                                                  \
+                a[j + 1] = a[j];                                               \
+                j--;                                                           \
+            }                                                                  \
+            a[j + 1] = v;                                                      \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void multiselect_##SFX(T          *a,                               \
+                                  long        lo,                              \
+                                  long        hi,                              \
+                                  const long *rank,                            \
+                                  int         NBrank,                          \
+                                  int         depth)                           \
+    {                                                                          \
+        while(NBrank > 0)                                                      \
+        {                                                                      \
+            if(hi - lo < SELECT_SMALLRANGE)                                    \
+            {                                                                  \
+                insertionsort_##SFX(a, lo, hi);                                \
+                return;                                                        \
+            }                                                                  \
+            if(depth == 0)                                                     \
+            {                                                                  \
+                heapsort_##SFX(a + lo, hi - lo + 1);                           \
+                return;                                                        \
+            }                                                                  \
+            depth--;                                                           \
+                                                                               \
+            /* median of 3 pivot */                                            \
+            T    va  = a[lo];                                                  \
+            T    vb  = a[lo + (hi - lo) / 2];                                  \
+            T    vc  = a[hi];                                                  \
+            T    piv = (va < vb) ? ((vb < vc) ? vb : ((va < vc) ? vc : va))    \
+                       : ((va < vc) ? va : ((vb < vc) ? vc : vb));             \
+                                                                               \
+            /* 3-way partition : <piv [lo,lt-1] ==piv [lt,gt] >piv */          \
+            long lt = lo;                                                      \
+            long gt = hi;                                                      \
+            long i  = lo;                                                      \
+            while(i <= gt)                                                     \
+            {                                                                  \
+                T v = a[i];                                                    \
+                if(v < piv)                                                    \
+                {                                                              \
+                    a[i]  = a[lt];                                             \
+                    a[lt] = v;                                                 \
+                    lt++;                                                      \
+                    i++;                                                       \
+                }                                                              \
+                else if(piv < v)                                               \
+                {                                                              \
+                    a[i]  = a[gt];                                             \
+                    a[gt] = v;                                                 \
+                    gt--;                                                      \
+                }                                                              \
+                else                                                           \
+                {                                                              \
+                    i++;                                                       \
+                }                                                              \
+            }                                                                  \
+                                                                               \
+            int i1 = 0;                                                        \
+            while((i1 < NBrank) && (rank[i1] < lt))                            \
+            {                                                                  \
+                i1++;                                                          \
+            }                                                                  \
+            int i2 = i1;                                                       \
+            while((i2 < NBrank) && (rank[i2] <= gt))                           \
+            {                                                                  \
+                i2++;                                                          \
+            }                                                                  \
+            if(i1 > 0)                                                         \
+            {                                                                  \
+                multiselect_##SFX(a, lo, lt - 1, rank, i1, depth);             \
+            }                                                                  \
+            rank += i2;                                                        \
+            NBrank -= i2;                                                      \
+            lo = gt + 1;                                                       \
+        }                                                                      \
+    }
+
+PERCENTILE_SELECT_DEFINE(float, float)
+PERCENTILE_SELECT_DEFINE(double, double)
+PERCENTILE_SELECT_DEFINE(int64_t, int64)
+PERCENTILE_SELECT_DEFINE(uint64_t, uint64)
+
+
+
+static int select_depth(long nelement)
+{
+    int depth = 0;
+    while(nelement > 1)
+    {
+        nelement >>= 1;
+        depth++;
+    }
+    return 2 * depth + 4;
+}
+
+/**
+ * @brief Ranks for fractions, sorted and unique
+ *
+ * @param rankindex  index in sorted rank array for each fraction
+ * @return number of unique ranks
+ */
+static int percentile_ranks(long          nelement,
+                            const double *fraction,
+                            int           NBfraction,
+                            long         *rank,
+                            int          *rankindex)
+{
+    long *rankf = (long *) malloc(sizeof(long) * NBfraction);
+    if(rankf == NULL)
+    {
+        PRINT_ERROR("malloc() error");
+        abort();
+    }
+
+    for(int i = 0; i < NBfraction; i++)
+    {
+        long r = (long)(fraction[i] * nelement);
+        if(r < 0)
+        {
+            r = 0;
+        }
+        if(r > nelement - 1)
+        {
+            r = nelement - 1;
+        }
+        rankf[i] = r;
+        rank[i]  = r;
+    }
+
+    // sort (few elements) and remove duplicates
+    for(int i = 1; i < NBfraction; i++)
+    {
+        long v = rank[i];
+        int  j = i - 1;
+        while((j >= 0) && (v < rank[j]))
+        {
+            rank[j + 1] = rank[j];
+            j--;
+        }
+        rank[j + 1] = v;
+    }
+    int NBrank = 0;
+    for(int i = 0; i < NBfraction; i++)
+    {
+        if((NBrank == 0) || (rank[i] != rank[NBrank - 1]))
+        {
+            rank[NBrank] = rank[i];
+            NBrank++;
+        }
+    }
+
+    for(int i = 0; i < NBfraction; i++)
+    {
+        int k = 0;
+        while(rank[k] != rankf[i])
+        {
+            k++;
+        }
+        rankindex[i] = k;
+    }
+    free(rankf);
+
+    return NBrank;
+}
+
+
+
+// Histogram percentile for integer type T with NBval values starting at vmin
+//
+#define PERCENTILE_HISTOGRAM(T, NBval, vmin)                                   \
+    {                                                                          \
+        const T  *a    = (const T *) array;                                    \
+        uint64_t *hist = get_histbuff();                                       \
+        memset(hist, 0, sizeof(uint64_t) * NBval);                             \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            hist[(long) a[ii] - (vmin)]++;                                     \
+        }                                                                      \
+        uint64_t cumul = 0;                                                    \
+        int      ir    = 0;                                                    \
+        for(long v = 0; (v < NBval) && (ir < NBrank); v++)                     \
+        {                                                                      \
+            cumul += hist[v];                                                  \
+            while((ir < NBrank) && ((uint64_t) rank[ir] < cumul))              \
+            {                                                                  \
+                rankvalue[ir] = (double)(v + (vmin));                          \
+                ir++;                                                          \
+            }                                                                  \
+        }                                                                      \
+    }
+
+// Selection percentile : copy array of type TIN to work buffer of type T
+//
+#define PERCENTILE_SELECT(TIN, T, SFX)                                         \
+    {                                                                          \
+        const TIN *a  = (const TIN *) array;                                   \
+        T         *wa = (T *) get_workbuff(sizeof(T) * nelement);              \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            wa[ii] = (T) a[ii];                                                \
+        }                                                                      \
+        multiselect_##SFX(wa,                                                  \
+                          0,                                                   \
+                          nelement - 1,                                        \
+                          rank,                                                \
+                          NBrank,                                              \
+                          select_depth(nelement));                             \
+        for(int ir = 0; ir < NBrank; ir++)                                     \
+        {                                                                      \
+            rankvalue[ir] = (double) wa[rank[ir]];                             \
+        }                                                                      \
+    }
+
+/**
+ * @brief Percentiles of array
+ *
+ * Input array is not modified.
+ *
+ * @param array       input array
+ * @param datatype    input data type
+ * @param nelement    number of elements
+ * @param fraction    fractions [0-1]
+ * @param NBfraction  number of fractions
+ * @param value       output values, one per fraction
+ */
+errno_t image_percentile_array(const void   *array,
+                               uint8_t       datatype,
+                               long          nelement,
+                               const double *fraction,
+                               int           NBfraction,
+                               double       *value)
+{
+    if((nelement < 1) || (NBfraction < 1))
+    {
+        return RETURN_FAILURE;
+    }
+
+    long   *rank      = (long *) malloc(sizeof(long) * NBfraction);
+    int    *rankindex = (int *) malloc(sizeof(int) * NBfraction);
+    double *rankvalue = (double *) malloc(sizeof(double) * NBfraction);
+    if((rank == NULL) || (rankindex == NULL) || (rankvalue == NULL))
+    {
+        PRINT_ERROR("malloc() error");
+        abort();
+    }
+
+    int NBrank =
+        percentile_ranks(nelement, fraction, NBfraction, rank, rankindex);
+
+    errno_t ret = RETURN_SUCCESS;
+    switch(datatype)
+    {
+    case _DATATYPE_UINT8:
+        PERCENTILE_HISTOGRAM(uint8_t, 256, 0)
+        break;
+    case _DATATYPE_INT8:
+        PERCENTILE_HISTOGRAM(int8_t, 256, -128)
+        break;
+    case _DATATYPE_UINT16:
+        PERCENTILE_HISTOGRAM(uint16_t, 65536, 0)
+        break;
+    case _DATATYPE_INT16:
+        PERCENTILE_HISTOGRAM(int16_t, 65536, -32768)
+        break;
+    case _DATATYPE_FLOAT:
+        PERCENTILE_SELECT(float, float, float)
+        break;
+    case _DATATYPE_DOUBLE:
+        PERCENTILE_SELECT(double, double, double)
+        break;
+    case _DATATYPE_UINT32:
+        PERCENTILE_SELECT(uint32_t, int64_t, int64)
+        break;
+    case _DATATYPE_INT32:
+        PERCENTILE_SELECT(int32_t, int64_t, int64)
+        break;
+    case _DATATYPE_INT64:
+        PERCENTILE_SELECT(int64_t, int64_t, int64)
+        break;
+    case _DATATYPE_UINT64:
+        PERCENTILE_SELECT(uint64_t, uint64_t, uint64)
+        break;
+    default:
+        ret = RETURN_FAILURE;
+        break;
+    }
+
+    if(ret == RETURN_SUCCESS)
+    {
+        for(int i = 0; i < NBfraction; i++)
+        {
+            value[i] = rankvalue[rankindex[i]];
+        }
+    }
+
+    free(rank);
+    free(rankindex);
+    free(rankvalue);
+    release_workbuff(PERCENTILE_WORKBUFF_KEEPSIZE);
+
+    return ret;
+}
+
+
+
+/**
+ * @brief Percentiles of image, computed in a single pass
+ */
+errno_t arith_image_percentiles(const char   *ID_name,
+                                const double *fraction,
+                                int           NBfraction,
+                                double       *value)
+{
+    DEBUG_TRACE_FSTART();
+
+    imageID ID = image_ID(ID_name);
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("image %s not found", ID_name);
+    }
+
+    if(image_percentile_array(data.image[ID].array.raw,
+                              data.image[ID].md[0].datatype,
+                              data.image[ID].md[0].nelement,
+                              fraction,
+                              NBfraction,
+                              value) != RETURN_SUCCESS)
+    {
+        FUNC_RETURN_FAILURE("image %s: type not supported", ID_name);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+
+// Gather block of np pixels starting at p0, for all slices, into buff
+// buff[p * zsize + kk]
+//
+#define TMEDIAN_GATHER(TIN, T)                                                 \
+    {                                                                          \
+        const TIN *a = (const TIN *) inarray;                                  \
+        for(long kk = 0; kk < zsize; kk++)                                     \
+        {                                                                      \
+            const TIN *aslice = a + kk * xysize + p0;                          \
+            for(long p = 0; p < np; p++)                                       \
+            {                                                                  \
+                buff[p * zsize + kk] = (T) aslice[p];                          \
+            }                                                                  \
+        }                                                                      \
+    }
+
+static void tmedian_gather_double(const void *inarray,
+                                  uint8_t     datatype,
+                                  long        xysize,
+                                  long        zsize,
+                                  long        p0,
+                                  long        np,
+                                  double     *buff)
+{
+    switch(datatype)
+    {
+    case _DATATYPE_UINT8:
+        TMEDIAN_GATHER(uint8_t, double)
+        break;
+    case _DATATYPE_INT8:
+        TMEDIAN_GATHER(int8_t, double)
+        break;
+    case _DATATYPE_UINT16:
+        TMEDIAN_GATHER(uint16_t, double)
+        break;
+    case _DATATYPE_INT16:
+        TMEDIAN_GATHER(int16_t, double)
+        break;
+    case _DATATYPE_UINT32:
+        TMEDIAN_GATHER(uint32_t, double)
+        break;
+    case _DATATYPE_INT32:
+        TMEDIAN_GATHER(int32_t, double)
+        break;
+    case _DATATYPE_UINT64:
+        TMEDIAN_GATHER(uint64_t, double)
+        break;
+    case _DATATYPE_INT64:
+        TMEDIAN_GATHER(int64_t, double)
+        break;
+    case _DATATYPE_DOUBLE:
+        TMEDIAN_GATHER(double, double)
+        break;
+    }
+}
+
+/**
+ * @brief Per-pixel median along third axis of cube
+ *
+ * Output is 2D, float for float input, double otherwise.
+ * Even number of slices : upper median, as arith_image_median.
+ */
+imageID arith_image_temporal_median(const char *IDin_name,
+                                    const char *IDout_name)
+{
+    DEBUG_TRACE_FSTART();
+
+    imageID IDin = image_ID(IDin_name);
+    imageID IDout;
+
+    if(IDin == -1)
+    {
+        PRINT_ERROR("image %s not found", IDin_name);
+        DEBUG_TRACE_FEXIT();
+        return -1;
+    }
+    if(data.image[IDin].md[0].naxis != 3)
+    {
+        PRINT_ERROR("image %s: 3D image required", IDin_name);
+        DEBUG_TRACE_FEXIT();
+        return -1;
+    }
+
+    uint8_t datatype = data.image[IDin].md[0].datatype;
+    if((datatype == _DATATYPE_COMPLEX_FLOAT) ||
+            (datatype == _DATATYPE_COMPLEX_DOUBLE))
+    {
+        PRINT_ERROR("image %s: complex type not supported", IDin_name);
+        DEBUG_TRACE_FEXIT();
+        return -1;
+    }
+
+    uint32_t naxes[2] = {data.image[IDin].md[0].size[0],
+                         data.image[IDin].md[0].size[1]
+                        };
+    long     xysize   = (long) naxes[0] * naxes[1];
+    long     zsize    = data.image[IDin].md[0].size[2];
+    long     NBblock  = (xysize + TMEDIAN_BLOCKSIZE - 1) / TMEDIAN_BLOCKSIZE;
+    long     rank     = zsize / 2;
+
+    uint8_t datatypeout =
+        (datatype == _DATATYPE_FLOAT) ? _DATATYPE_FLOAT : _DATATYPE_DOUBLE;
+    create_image_ID(IDout_name,
+                    2,
+                    naxes,
+                    datatypeout,
+                    data.SHARED_DFT,
+                    data.NBKEYWORD_DFT,
+                    0,
+                    &IDout);
+
+    int depth = select_depth(zsize);
+
+    #pragma omp parallel if (xysize * zsize > 100000)
+    {
+        if(datatype == _DATATYPE_FLOAT)
+        {
+            float *buff = (float *) get_workbuff(sizeof(float) *
+                                                 TMEDIAN_BLOCKSIZE * zsize);
+            const void *inarray = data.image[IDin].array.F;
+
+            #pragma omp for schedule(dynamic, 4)
+            for(long block = 0; block < NBblock; block++)
+            {
+                long p0 = block * TMEDIAN_BLOCKSIZE;
+                long np = (p0 + TMEDIAN_BLOCKSIZE > xysize) ? xysize - p0
+                          : TMEDIAN_BLOCKSIZE;
+                TMEDIAN_GATHER(float, float)
+                for(long p = 0; p < np; p++)
+                {
+                    float *pbuff = buff + p * zsize;
+                    multiselect_float(pbuff, 0, zsize - 1, &rank, 1, depth);
+                    data.image[IDout].array.F[p0 + p] = pbuff[rank];
+                }
+            }
+        }
+        else
+        {
+            double *buff = (double *) get_workbuff(sizeof(double) *
+                                                   TMEDIAN_BLOCKSIZE * zsize);
+
+            #pragma omp for schedule(dynamic, 4)
+            for(long block = 0; block < NBblock; block++)
+            {
+                long p0 = block * TMEDIAN_BLOCKSIZE;
+                long np = (p0 + TMEDIAN_BLOCKSIZE > xysize) ? xysize - p0
+                          : TMEDIAN_BLOCKSIZE;
+                tmedian_gather_double(data.image[IDin].array.raw,
+                                      datatype,
+                                      xysize,
+                                      zsize,
+                                      p0,
+                                      np,
+                                      buff);
+                for(long p = 0; p < np; p++)
+                {
+                    double *pbuff = buff + p * zsize;
+                    multiselect_double(pbuff, 0, zsize - 1, &rank, 1, depth);
+                    data.image[IDout].array.D[p0 + p] = pbuff[rank];
+                }
+            }
+        }
+
+        // OpenMP worker threads outlive this call
+        release_workbuff(0);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return IDout;
+}
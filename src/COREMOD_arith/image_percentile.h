@@ -0,0 +1,24 @@
+/**
+ * @file    image_percentile.h
+ *
+ */
+
+#ifndef COREMOD_ARITH_IMAGE_PERCENTILE_H
+#define COREMOD_ARITH_IMAGE_PERCENTILE_H
+
+errno_t image_percentile_array(const void   *array,
+                               uint8_t       datatype,
+                               long          nelement,
+                               const double *fraction,
+                               int           NBfraction,
+                               double       *value);
+
+errno_t arith_image_percentiles(const char   *ID_name,
+                                const double *fraction,
+                                int           NBfraction,
+                                double       *value);
+
+imageID arith_image_temporal_median(const char *IDin_name,
+                                    const char *IDout_name);
+
+#endif
@@ -9,8 +9,7 @@
 
 #include "COREMOD_memory/COREMOD_memory.h"
 
-#include "COREMOD_tools/COREMOD_tools.h"
-
+#include "image_percentile.h"
 #include "image_total.h"
 
 double arith_image_mean(const char *ID_name)
@@ -408,182 +407,11 @@ double arith_image_max(const char *ID_name)
 
 double arith_image_percentile(const char *ID_name, double fraction)
 {
-    imageID         ID;
-    long            ii;
-    double          value  = 0;
-    long           *arrayL = NULL;
-    float          *arrayF = NULL;
-    double         *arrayD = NULL;
-    unsigned short *arrayU = NULL;
-    long            nelement;
-    uint8_t         datatype;
-    int             atypeOK = 1;
-
-    ID       = image_ID(ID_name);
-    datatype = data.image[ID].md[0].datatype;
-
-    nelement = data.image[ID].md[0].nelement;
-
-    void *array_raw = malloc(ImageStreamIO_typesize(datatype) * nelement);
-    if(array_raw == NULL)
-    {
-        PRINT_ERROR("malloc() error");
-        exit(EXIT_FAILURE);
-    }
-    memcpy(array_raw, data.image[ID].array.raw,
-           ImageStreamIO_typesize(datatype) * nelement);
-
-
-    switch(datatype)
-    {
-        case _DATATYPE_FLOAT:
-            arrayF = array_raw;
-            quick_sort_float(arrayF, nelement);
-            value = 0.0;//(double) arrayF[(long)(fraction * nelement)];
-            break;
-
-        case _DATATYPE_DOUBLE:
-            arrayD = array_raw;
-            quick_sort_double(arrayD, nelement);
-            value = arrayD[(long)(fraction * nelement)];
-            break;
-
-        case _DATATYPE_UINT8:
-            arrayU = (unsigned short *) malloc(sizeof(unsigned short) * nelement);
-            if(arrayU == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayU[ii] = data.image[ID].array.UI8[ii];
-            }
-            quick_sort_ushort(arrayU, nelement);
-            value = arrayU[(long)(fraction * nelement)];
-            free(arrayU);
-            break;
-
-        case _DATATYPE_UINT16:
-            arrayU = (unsigned short *) malloc(sizeof(unsigned short) * nelement);
-            if(arrayU == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayU[ii] = data.image[ID].array.UI16[ii];
-            }
-            quick_sort_ushort(arrayU, nelement);
-            value = arrayU[(long)(fraction * nelement)];
-            free(arrayU);
-            break;
-
-        case _DATATYPE_UINT32:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayU == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = data.image[ID].array.UI32[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        case _DATATYPE_UINT64:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayU == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = data.image[ID].array.UI64[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        case _DATATYPE_INT8:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayL == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = (long) data.image[ID].array.SI8[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = (double) arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        case _DATATYPE_INT16:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayL == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = (long) data.image[ID].array.SI16[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = (double) arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        case _DATATYPE_INT32:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayL == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = (long) data.image[ID].array.SI32[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = (double) arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        case _DATATYPE_INT64:
-            arrayL = (long *) malloc(sizeof(long) * nelement);
-            if(arrayL == NULL)
-            {
-                PRINT_ERROR("malloc() error");
-                exit(EXIT_FAILURE);
-            }
-            for(ii = 0; ii < nelement; ii++)
-            {
-                arrayL[ii] = (long) data.image[ID].array.SI64[ii];
-            }
-            quick_sort_long(arrayL, nelement);
-            value = (double) arrayL[(long)(fraction * nelement)];
-            free(arrayL);
-            break;
-
-        default:
-            PRINT_ERROR("Image type not supported");
-            atypeOK = 0;
-            break;
-    }
+    double value = 0.0;
 
-    if(atypeOK == 0)
+    if(arith_image_percentiles(ID_name, &fraction, 1, &value) != RETURN_SUCCESS)
     {
+        PRINT_ERROR("Image type not supported");
         exit(EXIT_FAILURE);
     }
 
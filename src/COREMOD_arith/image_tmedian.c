@@ -0,0 +1,70 @@
+/**
+ * @file    image_tmedian.c
+ * @brief   per-pixel median of cube
+ *
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "image_percentile.h"
+
+// variables local to this translation unit
+static char *inimname;
+static char *outimname;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_IMG,
+        ".in_name",
+        "input cube",
+        "imc",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &inimname,
+        NULL
+    },
+    {
+        CLIARG_STR,
+        ".out_name",
+        "output image",
+        "immed",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &outimname,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imtmedian",
+                                "per-pixel median along cube third axis",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    printf("Output is float for float input, double otherwise\n");
+    printf("Even number of slices: upper median\n");
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    if(arith_image_temporal_median(inimname, outimname) == -1)
+    {
+        FUNC_RETURN_FAILURE("temporal median failed");
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_COREMOD_arith__image_tmedian()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,6 @@
+#ifndef COREMOD_ARITH_IMAGE_TMEDIAN_H
+#define COREMOD_ARITH_IMAGE_TMEDIAN_H
+
+errno_t CLIADDCMD_COREMOD_arith__image_tmedian();
+
+#endif
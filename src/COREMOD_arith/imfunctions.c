@@ -11,6 +11,8 @@
 
 #include "COREMOD_memory/COREMOD_memory.h"
 
+#include "imfunctions_kernels.h"
+
 #ifdef _OPENMP
 #include <omp.h>
 #define OMP_NELEMENT_LIMIT 1000000
@@ -1365,6 +1367,52 @@ errno_t arith_image_function_2_1(const char *ID_name1,
             exit(0);
         }
 
+    // type-specialized kernel, falls back to pt2function if not available
+    {
+        int op = arith_kernel_op(pt2function);
+        int kernelOK;
+
+        if(op3D2Dto3D == 0)
+        {
+            kernelOK = arith_kernel_2_1(op,
+                                        datatypeout,
+                                        data.image[IDout].array.raw,
+                                        datatype1,
+                                        data.image[ID1].array.raw,
+                                        datatype2,
+                                        data.image[ID2].array.raw,
+                                        nelement);
+        }
+        else
+        {
+            int sizeout = ImageStreamIO_typesize(datatypeout);
+            int size1   = ImageStreamIO_typesize(datatype1);
+
+            kernelOK = 1;
+            for(kk = 0; (kk < naxes[2]) && (kernelOK == 1); kk++)
+            {
+                kernelOK = arith_kernel_2_1(
+                               op,
+                               datatypeout,
+                               (char *) data.image[IDout].array.raw +
+                               kk * xysize * sizeout,
+                               datatype1,
+                               (char *) data.image[ID1].array.raw +
+                               kk * xysize * size1,
+                               datatype2,
+                               data.image[ID2].array.raw,
+                               xysize);
+            }
+        }
+
+        if(kernelOK == 1)
+        {
+            free(naxes);
+            free(naxes2);
+            return RETURN_SUCCESS;
+        }
+    }
+
     //# ifdef _OPENMP
     //    #pragma omp parallel if (nelement>OMP_NELEMENT_LIMIT)
     //    {
@@ -4241,6 +4289,20 @@ errno_t arith_image_function_2_1_inplace_byID(
 
     data.image[ID1].md[0].write = 1;
 
+    if(arith_kernel_2_1(arith_kernel_op(pt2function),
+                        datatype1,
+                        data.image[ID1].array.raw,
+                        datatype1,
+                        data.image[ID1].array.raw,
+                        datatype2,
+                        data.image[ID2].array.raw,
+                        nelement) == 1)
+    {
+        data.image[ID1].md[0].write = 0;
+        data.image[ID1].md[0].cnt0++;
+        return EXIT_SUCCESS;
+    }
+
 #ifdef _OPENMP
     #pragma omp parallel if (nelement > OMP_NELEMENT_LIMIT)
     {
@@ -4753,6 +4815,17 @@ int arith_image_function_1f_1(const char *ID_name,
     free(naxes);
     nelement = data.image[ID].md[0].nelement;
 
+    if(arith_kernel_1f_1(arith_kernel_op(pt2function),
+                         datatypeout,
+                         data.image[IDout].array.raw,
+                         datatype,
+                         data.image[ID].array.raw,
+                         f1,
+                         nelement) == 1)
+    {
+        return EXIT_SUCCESS;
+    }
+
 #ifdef _OPENMP
     #pragma omp parallel if (nelement > OMP_NELEMENT_LIMIT)
     {
@@ -4888,6 +4961,17 @@ int arith_image_function_1f_1_inplace_byID(
     datatype = data.image[ID].md[0].datatype;
     nelement = data.image[ID].md[0].nelement;
 
+    if(arith_kernel_1f_1(arith_kernel_op(pt2function),
+                         datatype,
+                         data.image[ID].array.raw,
+                         datatype,
+                         data.image[ID].array.raw,
+                         f1,
+                         nelement) == 1)
+    {
+        return EXIT_SUCCESS;
+    }
+
 #ifdef _OPENMP
     #pragma omp parallel if (nelement > OMP_NELEMENT_LIMIT)
     {
@@ -0,0 +1,399 @@
+/**
+ * @file    imfunctions_kernels.c
+ * @brief   type-specialized kernels for image arithmetic
+ *
+ * The generic arith_image_function_* calls a double(*)(double,double)
+ * function pointer for every pixel, which prevents vectorization.
+ * For the common operations (add, sub, mult, div, min, max) on
+ * float, double and uint16 images, a kernel specialized for the
+ * (operation, input types, output type) tuple is selected once per call.
+ * Kernels are plain loops over contiguous arrays, so that the compiler
+ * can vectorize them (-Ofast -march=native).
+ *
+ * Combinations without a kernel return 0, and the caller falls back to
+ * the function pointer path.
+ *
+ * float output kernels compute in float : for +,-,* and min/max on float
+ * and uint16 inputs this is bit-identical to computing in double and
+ * rounding to float. Division is done in double, as -Ofast otherwise
+ * replaces vectorized float division by an approximate reciprocal.
+ * uint16 output (in-place only) wraps around on overflow, and has no
+ * division kernel.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "imfunctions_kernels.h"
+#include "mathfuncs.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#define OMP_NELEMENT_LIMIT 1000000
+#endif
+
+// kernels enabled by default, can be turned off to benchmark/validate
+static int arith_kernel_enabled = 1;
+
+typedef void (*ARITHKERNEL_2_1)(
+    int op, void *out, const void *in1, const void *in2, long nelement);
+
+typedef void (*ARITHKERNEL_1F_1)(
+    int op, void *out, const void *in, double f1, long nelement);
+
+// Loop over elements for operation op
+// A and B are expressions of index ii
+//
+#define ARITH_KERNEL_OPLOOP(op, out, TOUT, TCALC, A, B)                        \
+    switch(op)                                                                 \
+    {                                                                          \
+    case ARITH_KERNEL_OP_ADD:                                                  \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((TCALC)(A) + (TCALC)(B));                         \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_SUB:                                                  \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((TCALC)(A) - (TCALC)(B));                         \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_SUBM:                                                 \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((TCALC)(B) - (TCALC)(A));                         \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_MULT:                                                 \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((TCALC)(A) * (TCALC)(B));                         \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_DIV:                                                  \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((double)(A) / (double)(B));                       \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_DIV1:                                                 \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            out[ii] = (TOUT)((double)(B) / (double)(A));                       \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_MIN:                                                  \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            TCALC a = (TCALC)(A);                                              \
+            TCALC b = (TCALC)(B);                                              \
+            out[ii] = (TOUT)((a < b) ? a : b);                                 \
+        }                                                                      \
+        break;                                                                 \
+    case ARITH_KERNEL_OP_MAX:                                                  \
+        for(long ii = 0; ii < nelement; ii++)                                  \
+        {                                                                      \
+            TCALC a = (TCALC)(A);                                              \
+            TCALC b = (TCALC)(B);                                              \
+            out[ii] = (TOUT)((a > b) ? a : b);                                 \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+// image, image -> image
+#define ARITH_KERNEL_2_1(NAME, TOUT, TIN1, TIN2, TCALC)                        \
+    static void NAME(int         op,                                           \
+                     void       *outv,                                         \
+                     const void *in1v,                                         \
+                     const void *in2v,                                         \
+                     long        nelement)                                     \
+    {                                                                          \
+        TOUT       *out = (TOUT *) outv;                                       \
+        const TIN1 *in1 = (const TIN1 *) in1v;                                 \
+        const TIN2 *in2 = (const TIN2 *) in2v;                                 \
+        ARITH_KERNEL_OPLOOP(op, out, TOUT, TCALC, in1[ii], in2[ii])            \
+    }
+
+// image, scalar -> image
+#define ARITH_KERNEL_1F_1(NAME, TOUT, TIN)                                     \
+    static void NAME(int         op,                                           \
+                     void       *outv,                                         \
+                     const void *inv,                                          \
+                     double      f1,                                           \
+                     long        nelement)                                     \
+    {                                                                          \
+        TOUT      *out = (TOUT *) outv;                                        \
+        const TIN *in  = (const TIN *) inv;                                    \
+        ARITH_KERNEL_OPLOOP(op, out, TOUT, double, in[ii], f1)                 \
+    }
+
+ARITH_KERNEL_2_1(kernel_F_FF, float, float, float, float)
+ARITH_KERNEL_2_1(kernel_F_FUI16, float, float, uint16_t, float)
+ARITH_KERNEL_2_1(kernel_F_UI16F, float, uint16_t, float, float)
+ARITH_KERNEL_2_1(kernel_F_UI16UI16, float, uint16_t, uint16_t, float)
+ARITH_KERNEL_2_1(kernel_D_DD, double, double, double, double)
+ARITH_KERNEL_2_1(kernel_D_DF, double, double, float, double)
+ARITH_KERNEL_2_1(kernel_D_FD, double, float, double, double)
+ARITH_KERNEL_2_1(kernel_D_DUI16, double, double, uint16_t, double)
+ARITH_KERNEL_2_1(kernel_D_UI16D, double, uint16_t, double, double)
+ARITH_KERNEL_2_1(kernel_UI16_UI16UI16, uint16_t, uint16_t, uint16_t, uint32_t)
+
+ARITH_KERNEL_1F_1(kernel_F_F_f, float, float)
+ARITH_KERNEL_1F_1(kernel_F_UI16_f, float, uint16_t)
+ARITH_KERNEL_1F_1(kernel_D_D_f, double, double)
+
+void arith_kernel_set_enable(int enable)
+{
+    arith_kernel_enabled = enable;
+}
+
+int arith_kernel_get_enable()
+{
+    return arith_kernel_enabled;
+}
+
+/**
+ * @brief Identify operation from math function pointer
+ *
+ * Returns ARITH_KERNEL_OP_NONE if function has no kernel
+ */
+int arith_kernel_op(double (*pt2function)(double, double))
+{
+    if(pt2function == &Padd)
+    {
+        return ARITH_KERNEL_OP_ADD;
+    }
+    if(pt2function == &Psub)
+    {
+        return ARITH_KERNEL_OP_SUB;
+    }
+    if(pt2function == &Psubm)
+    {
+        return ARITH_KERNEL_OP_SUBM;
+    }
+    if(pt2function == &Pmult)
+    {
+        return ARITH_KERNEL_OP_MULT;
+    }
+    if(pt2function == &Pdiv)
+    {
+        return ARITH_KERNEL_OP_DIV;
+    }
+    if(pt2function == &Pdiv1)
+    {
+        return ARITH_KERNEL_OP_DIV1;
+    }
+    if(pt2function == &Pminv)
+    {
+        return ARITH_KERNEL_OP_MIN;
+    }
+    if(pt2function == &Pmaxv)
+    {
+        return ARITH_KERNEL_OP_MAX;
+    }
+    return ARITH_KERNEL_OP_NONE;
+}
+
+static ARITHKERNEL_2_1
+select_kernel_2_1(uint8_t datatypeout, uint8_t datatype1, uint8_t datatype2)
+{
+    if(datatypeout == _DATATYPE_FLOAT)
+    {
+        if(datatype1 == _DATATYPE_FLOAT)
+        {
+            if(datatype2 == _DATATYPE_FLOAT)
+            {
+                return kernel_F_FF;
+            }
+            if(datatype2 == _DATATYPE_UINT16)
+            {
+                return kernel_F_FUI16;
+            }
+        }
+        if(datatype1 == _DATATYPE_UINT16)
+        {
+            if(datatype2 == _DATATYPE_FLOAT)
+            {
+                return kernel_F_UI16F;
+            }
+            if(datatype2 == _DATATYPE_UINT16)
+            {
+                return kernel_F_UI16UI16;
+            }
+        }
+    }
+
+    if(datatypeout == _DATATYPE_DOUBLE)
+    {
+        if(datatype1 == _DATATYPE_DOUBLE)
+        {
+            if(datatype2 == _DATATYPE_DOUBLE)
+            {
+                return kernel_D_DD;
+            }
+            if(datatype2 == _DATATYPE_FLOAT)
+            {
+                return kernel_D_DF;
+            }
+            if(datatype2 == _DATATYPE_UINT16)
+            {
+                return kernel_D_DUI16;
+            }
+        }
+        if(datatype2 == _DATATYPE_DOUBLE)
+        {
+            if(datatype1 == _DATATYPE_FLOAT)
+            {
+                return kernel_D_FD;
+            }
+            if(datatype1 == _DATATYPE_UINT16)
+            {
+                return kernel_D_UI16D;
+            }
+        }
+    }
+
+    if((datatypeout == _DATATYPE_UINT16) && (datatype1 == _DATATYPE_UINT16) &&
+            (datatype2 == _DATATYPE_UINT16))
+    {
+        return kernel_UI16_UI16UI16;
+    }
+
+    return NULL;
+}
+
+static ARITHKERNEL_1F_1 select_kernel_1f_1(uint8_t datatypeout,
+        uint8_t datatype)
+{
+    if(datatypeout == _DATATYPE_FLOAT)
+    {
+        if(datatype == _DATATYPE_FLOAT)
+        {
+            return kernel_F_F_f;
+        }
+        if(datatype == _DATATYPE_UINT16)
+        {
+            return kernel_F_UI16_f;
+        }
+    }
+    if((datatypeout == _DATATYPE_DOUBLE) && (datatype == _DATATYPE_DOUBLE))
+    {
+        return kernel_D_D_f;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Apply operation op to two arrays
+ *
+ * out may be equal to in1 (in-place operation).
+ * Returns 1 if a kernel was applied, 0 if caller should fall back to
+ * the generic function pointer path.
+ */
+int arith_kernel_2_1(int         op,
+                     uint8_t     datatypeout,
+                     void       *out,
+                     uint8_t     datatype1,
+                     const void *in1,
+                     uint8_t     datatype2,
+                     const void *in2,
+                     long        nelement)
+{
+    if((arith_kernel_enabled == 0) || (op == ARITH_KERNEL_OP_NONE))
+    {
+        return 0;
+    }
+
+    // integer division would trap on zero divisor
+    if((datatypeout == _DATATYPE_UINT16) &&
+            ((op == ARITH_KERNEL_OP_DIV) || (op == ARITH_KERNEL_OP_DIV1)))
+    {
+        return 0;
+    }
+
+    ARITHKERNEL_2_1 kernel =
+        select_kernel_2_1(datatypeout, datatype1, datatype2);
+    if(kernel == NULL)
+    {
+        return 0;
+    }
+
+    int sizeout = ImageStreamIO_typesize(datatypeout);
+    int size1   = ImageStreamIO_typesize(datatype1);
+    int size2   = ImageStreamIO_typesize(datatype2);
+
+#ifdef _OPENMP
+    #pragma omp parallel if (nelement > OMP_NELEMENT_LIMIT)
+    {
+        // contiguous chunk per thread
+        long nthreads = omp_get_num_threads();
+        long ithread  = omp_get_thread_num();
+        long ii0      = nelement * ithread / nthreads;
+        long ii1      = nelement * (ithread + 1) / nthreads;
+
+        kernel(op,
+               (char *) out + ii0 * sizeout,
+               (const char *) in1 + ii0 * size1,
+               (const char *) in2 + ii0 * size2,
+               ii1 - ii0);
+    }
+#else
+    (void) sizeout;
+    (void) size1;
+    (void) size2;
+    kernel(op, out, in1, in2, nelement);
+#endif
+
+    return 1;
+}
+
+/**
+ * @brief Apply operation op to array and scalar f1
+ *
+ * out may be equal to in (in-place operation).
+ * Returns 1 if a kernel was applied, 0 otherwise.
+ */
+int arith_kernel_1f_1(int         op,
+                      uint8_t     datatypeout,
+                      void       *out,
+                      uint8_t     datatype,
+                      const void *in,
+                      double      f1,
+                      long        nelement)
+{
+    if((arith_kernel_enabled == 0) || (op == ARITH_KERNEL_OP_NONE))
+    {
+        return 0;
+    }
+
+    ARITHKERNEL_1F_1 kernel = select_kernel_1f_1(datatypeout, datatype);
+    if(kernel == NULL)
+    {
+        return 0;
+    }
+
+    int sizeout = ImageStreamIO_typesize(datatypeout);
+    int sizein  = ImageStreamIO_typesize(datatype);
+
+#ifdef _OPENMP
+    #pragma omp parallel if (nelement > OMP_NELEMENT_LIMIT)
+    {
+        long nthreads = omp_get_num_threads();
+        long ithread  = omp_get_thread_num();
+        long ii0      = nelement * ithread / nthreads;
+        long ii1      = nelement * (ithread + 1) / nthreads;
+
+        kernel(op,
+               (char *) out + ii0 * sizeout,
+               (const char *) in + ii0 * sizein,
+               f1,
+               ii1 - ii0);
+    }
+#else
+    (void) sizeout;
+    (void) sizein;
+    kernel(op, out, in, f1, nelement);
+#endif
+
+    return 1;
+}
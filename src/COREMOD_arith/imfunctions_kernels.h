@@ -0,0 +1,43 @@
+/**
+ * @file    imfunctions_kernels.h
+ * @brief   type-specialized kernels for image arithmetic
+ *
+ */
+
+#ifndef COREMOD_ARITH_IMFUNCTIONS_KERNELS_H
+#define COREMOD_ARITH_IMFUNCTIONS_KERNELS_H
+
+#define ARITH_KERNEL_OP_NONE 0
+#define ARITH_KERNEL_OP_ADD  1 // a + b
+#define ARITH_KERNEL_OP_SUB  2 // a - b
+#define ARITH_KERNEL_OP_SUBM 3 // b - a
+#define ARITH_KERNEL_OP_MULT 4 // a * b
+#define ARITH_KERNEL_OP_DIV  5 // a / b
+#define ARITH_KERNEL_OP_DIV1 6 // b / a
+#define ARITH_KERNEL_OP_MIN  7
+#define ARITH_KERNEL_OP_MAX  8
+
+void arith_kernel_set_enable(int enable);
+
+int arith_kernel_get_enable();
+
+int arith_kernel_op(double (*pt2function)(double, double));
+
+int arith_kernel_2_1(int         op,
+                     uint8_t     datatypeout,
+                     void       *out,
+                     uint8_t     datatype1,
+                     const void *in1,
+                     uint8_t     datatype2,
+                     const void *in2,
+                     long        nelement);
+
+int arith_kernel_1f_1(int         op,
+                      uint8_t     datatypeout,
+                      void       *out,
+                      uint8_t     datatype,
+                      const void *in,
+                      double      f1,
+                      long        nelement);
+
+#endif
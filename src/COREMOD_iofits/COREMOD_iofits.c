@@ -23,8 +23,6 @@ INIT_MODULE_LIB(COREMOD_iofits)
 
 static errno_t init_module_CLI()
 {
-    COREMOD_iofits_data.FITSIO_status = 0;
-
     CLIADDCMD_COREMOD_iofits__loadfits();
     CLIADDCMD_COREMOD_iofits__saveFITS();
 
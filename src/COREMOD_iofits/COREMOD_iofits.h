@@ -13,5 +13,6 @@
 #include "COREMOD_iofits/loadmemstream.h"
 #include "COREMOD_iofits/read_keyword.h"
 #include "COREMOD_iofits/savefits.h"
+#include "COREMOD_iofits/savefits_async.h"
 
 #endif
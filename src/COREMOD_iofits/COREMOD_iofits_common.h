@@ -3,6 +3,7 @@
 
 #include <fitsio.h>
 
+// unused : cfitsio status is local to each call
 typedef struct
 {
     int FITSIO_status;
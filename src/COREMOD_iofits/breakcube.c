@@ -3,14 +3,20 @@
  */
 
 #include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
 
 #include "COREMOD_memory/COREMOD_memory.h"
 
+#include "savefits_async.h"
+
 // ==========================================
 // Forward declaration(s)
 // ==========================================
 
-imageID break_cube(const char *restrict ID_name);
+errno_t break_cube(const char *restrict ID_name);
+
+errno_t break_cube_files(const char *restrict ID_name,
+                         const char *restrict fileprefix);
 
 // ==========================================
 // Command line interface wrapper function(s)
@@ -36,6 +42,21 @@ errno_t break_cube_cli()
     return CLICMD_SUCCESS;
 }
 
+errno_t break_cube_files_cli()
+{
+    if(0 + CLI_checkarg(1, CLIARG_IMG) + CLI_checkarg(2, CLIARG_STR) == 0)
+    {
+        break_cube_files(data.cmdargtoken[1].val.string,
+                         data.cmdargtoken[2].val.string);
+
+        return CLICMD_SUCCESS;
+    }
+    else
+    {
+        return CLICMD_INVALID_ARG;
+    }
+}
+
 // ==========================================
 // Register CLI command(s)
 // ==========================================
@@ -51,24 +72,53 @@ errno_t breakcube_addCLIcmd()
                        "breakcube imc",
                        "int break_cube(char *ID_name)");
 
+    RegisterCLIcommand(
+        "breakcube2files",
+        __FILE__,
+        break_cube_files_cli,
+        "write cube slices to FITS files, file name is prefix followed by 5 "
+        "digits and .fits, files are written in parallel",
+        "<input image> <output file prefix>",
+        "breakcube2files imc dir/im_",
+        "int break_cube_files(char *ID_name, char *fileprefix)");
+
     return RETURN_SUCCESS;
 }
 
-imageID break_cube(const char *restrict ID_name)
+errno_t break_cube(const char *restrict ID_name)
 {
-    imageID  ID;
-    uint32_t naxes[3];
-    long     i;
+    DEBUG_TRACE_FSTART();
 
-    ID       = image_ID(ID_name);
+    imageID         ID;
+    imageID        *IDarray;
+    uint32_t        naxes[3];
+    long            i;
+    size_t          slicesize;
+    struct timespec t0, t1;
+
+    milk_clock_gettime(&t0);
+
+    ID = image_ID(ID_name);
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("image %s not found", ID_name);
+    }
     naxes[0] = data.image[ID].md[0].size[0];
     naxes[1] = data.image[ID].md[0].size[1];
     naxes[2] = data.image[ID].md[0].size[2];
+    slicesize = ImageStreamIO_typesize(data.image[ID].md[0].datatype) *
+                naxes[0] * naxes[1];
 
-    for(uint32_t kk = 0; kk < naxes[2]; kk++)
+    IDarray = (imageID *) malloc(sizeof(imageID) * naxes[2]);
+    if(IDarray == NULL)
     {
-        long ID1;
+        PRINT_ERROR("malloc error");
+        abort();
+    }
 
+    // create all slices first : data.image may be reallocated
+    for(uint32_t kk = 0; kk < naxes[2]; kk++)
+    {
         CREATE_IMAGENAME(framename, "%s_%5u", ID_name, kk);
 
         for(i = 0; i < (long) strlen(framename); i++)
@@ -78,15 +128,114 @@ imageID break_cube(const char *restrict ID_name)
                 framename[i] = '0';
             }
         }
-        create_2Dimage_ID(framename, naxes[0], naxes[1], &ID1);
-        for(uint32_t ii = 0; ii < naxes[0]; ii++)
-            for(uint32_t jj = 0; jj < naxes[1]; jj++)
-            {
-                data.image[ID1].array.F[jj * naxes[0] + ii] =
-                    data.image[ID]
-                    .array.F[kk * naxes[0] * naxes[1] + jj * naxes[0] + ii];
-            }
+        if(create_image_ID(framename,
+                           2,
+                           naxes,
+                           data.image[ID].md[0].datatype,
+                           data.SHARED_DFT,
+                           data.NBKEYWORD_DFT,
+                           0,
+                           &IDarray[kk]) != RETURN_SUCCESS)
+        {
+            free(IDarray);
+            FUNC_RETURN_FAILURE("cannot create slice %s", framename);
+        }
+    }
+
+    // slices are contiguous : one memcpy per frame
+    char *ptrcube = (char *) data.image[ID].array.raw;
+
+    #pragma omp parallel for schedule(static)
+    for(uint32_t kk = 0; kk < naxes[2]; kk++)
+    {
+        memcpy(data.image[IDarray[kk]].array.raw,
+               ptrcube + slicesize * kk,
+               slicesize);
+    }
+
+    free(IDarray);
+
+    milk_clock_gettime(&t1);
+    {
+        double dt = timespec_diff_double(t0, t1);
+        printf("%u frames in %.3f s (%.1f frames/s)\n",
+               naxes[2],
+               dt,
+               naxes[2] / dt);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+/** @brief Write cube slices to FITS files <fileprefix>00000.fits ...
+ *
+ * Each slice is copied to a buffer image and written by the async save
+ * worker pool, which takes its own copy on submit : the buffer is reused
+ * immediately.
+ */
+errno_t break_cube_files(const char *restrict ID_name,
+                         const char *restrict fileprefix)
+{
+    DEBUG_TRACE_FSTART();
+    imageID         ID;
+    imageID         IDbuff;
+    uint32_t        naxes[3];
+    size_t          slicesize;
+    long            NBfail;
+    struct timespec t0, t1;
+
+    milk_clock_gettime(&t0);
+
+    ID = image_ID(ID_name);
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("image %s does not exist", ID_name);
+    }
+    naxes[0]  = data.image[ID].md[0].size[0];
+    naxes[1]  = data.image[ID].md[0].size[1];
+    naxes[2]  = data.image[ID].md[0].size[2];
+    slicesize = ImageStreamIO_typesize(data.image[ID].md[0].datatype) *
+                naxes[0] * naxes[1];
+
+    delete_image_ID("_breakcube", DELETE_IMAGE_ERRMODE_IGNORE);
+    FUNC_CHECK_RETURN(create_image_ID("_breakcube",
+                                      2,
+                                      naxes,
+                                      data.image[ID].md[0].datatype,
+                                      0,
+                                      0,
+                                      0,
+                                      &IDbuff));
+
+    for(uint32_t kk = 0; kk < naxes[2]; kk++)
+    {
+        memcpy(data.image[IDbuff].array.raw,
+               (char *) data.image[ID].array.raw + slicesize * kk,
+               slicesize);
+
+        char fname[STRINGMAXLEN_FULLFILENAME];
+        WRITE_FULLFILENAME(fname, "%s%05u.fits", fileprefix, kk);
+        saveFITS_async_submit("_breakcube", -1, fname, 0, "", NULL, 0);
+    }
+    NBfail = saveFITS_async_waitall();
+
+    delete_image_ID("_breakcube", DELETE_IMAGE_ERRMODE_WARNING);
+
+    if(NBfail != 0)
+    {
+        FUNC_RETURN_FAILURE("%ld files could not be written", NBfail);
     }
 
-    return ID;
+    milk_clock_gettime(&t1);
+    {
+        double dt = timespec_diff_double(t0, t1);
+        printf("%u frames in %.3f s (%.1f frames/s)\n",
+               naxes[2],
+               dt,
+               naxes[2] / dt);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
 }
@@ -4,4 +4,7 @@
 
 errno_t breakcube_addCLIcmd();
 
-imageID break_cube(const char *restrict ID_name);
+errno_t break_cube(const char *restrict ID_name);
+
+errno_t break_cube_files(const char *restrict ID_name,
+                         const char *restrict fileprefix);
@@ -4,29 +4,29 @@
 
 #include "COREMOD_iofits_common.h"
 
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
-
+// status is the caller's cfitsio status, reset to 0 on return
 // set print to 0 if error message should not be printed to stderr
 // set print to 1 if error message should be printed to stderr
 int check_FITSIO_status(const char *restrict cfile,
                         const char *restrict cfunc,
                         long cline,
-                        int  print)
+                        int  print,
+                        int *status)
 {
     int Ferr = 0;
 
-    if(COREMOD_iofits_data.FITSIO_status != 0)
+    if(*status != 0)
     {
         if(print == 1)
         {
             char errstr[STRINGMAXLEN_FITSIOCHECK_ERRSTRING];
-            fits_get_errstatus(COREMOD_iofits_data.FITSIO_status, errstr);
+            fits_get_errstatus(*status, errstr);
             fprintf(stderr,
                     "%c[%d;%dmFITSIO error %d [%s, %s, %ld]: %s%c[%d;m\n\a",
                     (char) 27,
                     1,
                     31,
-                    COREMOD_iofits_data.FITSIO_status,
+                    *status,
                     cfile,
                     cfunc,
                     cline,
@@ -34,9 +34,9 @@ int check_FITSIO_status(const char *restrict cfile,
                     (char) 27,
                     0);
         }
-        Ferr = COREMOD_iofits_data.FITSIO_status;
+        Ferr = *status;
     }
-    COREMOD_iofits_data.FITSIO_status = 0;
+    *status = 0;
 
     return (Ferr);
 }
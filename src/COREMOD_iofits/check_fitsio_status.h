@@ -5,4 +5,5 @@
 int check_FITSIO_status(const char *restrict cfile,
                         const char *restrict cfunc,
                         long cline,
-                        int  print);
+                        int  print,
+                        int *status);
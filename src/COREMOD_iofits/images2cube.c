@@ -2,10 +2,21 @@
  * @file    images2cube.c
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
 
 #include "COREMOD_memory/COREMOD_memory.h"
 
+#include "loadfits.h"
+
+#define FILES2CUBE_NBREADER       4  // prefetch threads
+#define FILES2CUBE_PREFETCH_DEPTH 16 // frames ahead of current frame
+
 // ==========================================
 // Forward declaration(s)
 // ==========================================
@@ -14,6 +25,10 @@ errno_t images_to_cube(const char *restrict img_name,
                        long nbframes,
                        const char *restrict cube_name);
 
+errno_t files_to_cube(const char *restrict fileprefix,
+                      long nbframes,
+                      const char *restrict cube_name);
+
 // ==========================================
 // Command line interface wrapper function(s)
 // ==========================================
@@ -39,6 +54,24 @@ errno_t images_to_cube_cli()
     return CLICMD_SUCCESS;
 }
 
+errno_t files_to_cube_cli()
+{
+    if(0 + CLI_checkarg(1, CLIARG_STR) + CLI_checkarg(2, CLIARG_INT64) +
+            CLI_checkarg(3, CLIARG_STR_NOT_IMG) ==
+            0)
+    {
+        files_to_cube(data.cmdargtoken[1].val.string,
+                      data.cmdargtoken[2].val.numl,
+                      data.cmdargtoken[3].val.string);
+
+        return CLICMD_SUCCESS;
+    }
+    else
+    {
+        return CLICMD_INVALID_ARG;
+    }
+}
+
 // ==========================================
 // Register CLI command(s)
 // ==========================================
@@ -56,34 +89,48 @@ errno_t images2cube_addCLIcmd()
         "imgs2cube im_ 100 imc",
         "int images_to_cube(char *img_name, long nbframes, char *cube_name)");
 
+    RegisterCLIcommand(
+        "files2cube",
+        __FILE__,
+        files_to_cube_cli,
+        "combine FITS files into cube, file name is prefix followed by 5 "
+        "digits and .fits, files are prefetched in parallel",
+        "<input file prefix> <number of frames> <output cube>",
+        "files2cube dir/im_ 100 imc",
+        "int files_to_cube(char *fileprefix, long nbframes, char *cube_name)");
+
     return RETURN_SUCCESS;
 }
 
-errno_t images_to_cube(const char *restrict img_name,
-                       long nbframes,
-                       const char *restrict cube_name)
+/** @brief Check slice against cube, return slice size [byte]
+ *
+ * @return 0 if size or type mismatch
+ */
+static size_t images_to_cube_slicesize(imageID ID, imageID IDslice)
 {
-    DEBUG_TRACE_FSTART();
-    imageID  ID;
-    imageID  ID1;
-    long     frame;
-    uint32_t naxes[2];
-    uint32_t xsize, ysize;
+    if((data.image[IDslice].md[0].size[0] != data.image[ID].md[0].size[0]) ||
+            (data.image[IDslice].md[0].size[1] != data.image[ID].md[0].size[1]) ||
+            (data.image[IDslice].md[0].datatype != data.image[ID].md[0].datatype))
+    {
+        return 0;
+    }
 
-    frame = 0;
+    return ImageStreamIO_typesize(data.image[ID].md[0].datatype) *
+           data.image[ID].md[0].size[0] * data.image[ID].md[0].size[1];
+}
 
-    CREATE_IMAGENAME(imname, "%s%05ld", img_name, frame);
+/** @brief Create cube from first slice
+ */
+static errno_t images_to_cube_create(const char *restrict cube_name,
+                                     imageID IDslice,
+                                     long    nbframes,
+                                     imageID *outID)
+{
+    uint32_t naxes[3];
 
-    ID1 = image_ID(imname);
-    if(ID1 == -1)
-    {
-        PRINT_ERROR("Image \"%s\" does not exist", imname);
-        exit(0);
-    }
-    naxes[0] = data.image[ID1].md[0].size[0];
-    naxes[1] = data.image[ID1].md[0].size[1];
-    xsize    = naxes[0];
-    ysize    = naxes[1];
+    naxes[0] = data.image[IDslice].md[0].size[0];
+    naxes[1] = data.image[IDslice].md[0].size[1];
+    naxes[2] = nbframes;
 
     printf("SIZE = %ld %ld %ld\n",
            (long) naxes[0],
@@ -91,47 +138,288 @@ errno_t images_to_cube(const char *restrict img_name,
            (long) nbframes);
     fflush(stdout);
 
+    return create_image_ID(cube_name,
+                           3,
+                           naxes,
+                           data.image[IDslice].md[0].datatype,
+                           data.SHARED_DFT,
+                           data.NBKEYWORD_DFT,
+                           0,
+                           outID);
+}
+
+errno_t images_to_cube(const char *restrict img_name,
+                       long nbframes,
+                       const char *restrict cube_name)
+{
+    DEBUG_TRACE_FSTART();
+    imageID         ID;
+    imageID        *IDarray;
+    struct timespec t0, t1;
+
+    milk_clock_gettime(&t0);
+
+    IDarray = (imageID *) malloc(sizeof(imageID) * nbframes);
+    if(IDarray == NULL)
+    {
+        FUNC_RETURN_FAILURE("malloc error");
+    }
+
+    for(long frame = 0; frame < nbframes; frame++)
+    {
+        CREATE_IMAGENAME(imname, "%s%05ld", img_name, frame);
+        IDarray[frame] = image_ID(imname);
+        if(IDarray[frame] == -1)
+        {
+            if(frame == 0)
+            {
+                PRINT_ERROR("Image \"%s\" does not exist", imname);
+                exit(0);
+            }
+            PRINT_ERROR("Image \"%s\" does not exist - skipping", imname);
+        }
+    }
+
+    // cube creation may reallocate data.image
     FUNC_CHECK_RETURN(
-        create_3Dimage_ID(cube_name, naxes[0], naxes[1], nbframes, &ID));
+        images_to_cube_create(cube_name, IDarray[0], nbframes, &ID));
+
+    size_t slicesize = images_to_cube_slicesize(ID, IDarray[0]);
+    for(long frame = 1; frame < nbframes; frame++)
+    {
+        if((IDarray[frame] != -1) &&
+                (images_to_cube_slicesize(ID, IDarray[frame]) == 0))
+        {
+            PRINT_ERROR("Image %ld has wrong size or type", frame);
+            exit(0);
+        }
+    }
+
+    // slices are contiguous : one memcpy per frame
+    char *ptrcube = (char *) data.image[ID].array.raw;
+
+    #pragma omp parallel for schedule(static)
+    for(long frame = 0; frame < nbframes; frame++)
+    {
+        if(IDarray[frame] != -1)
+        {
+            memcpy(ptrcube + slicesize * frame,
+                   data.image[IDarray[frame]].array.raw,
+                   slicesize);
+        }
+    }
+
+    free(IDarray);
+
+    milk_clock_gettime(&t1);
+    {
+        double dt = timespec_diff_double(t0, t1);
+        printf("%ld frames in %.3f s (%.1f frames/s)\n",
+               nbframes,
+               dt,
+               nbframes / dt);
+    }
 
-    for(uint32_t ii = 0; ii < naxes[0]; ii++)
-        for(uint32_t jj = 0; jj < naxes[1]; jj++)
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+// ==========================================
+// files to cube
+// ==========================================
+
+// prefetch state, shared with reader threads
+typedef struct
+{
+    const char *fileprefix;
+    long        nbframes;
+
+    long nextframe;    // next frame to prefetch
+    long currentframe; // frame being loaded in cube
+    int  stop;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+} FILES2CUBE_PREFETCH;
+
+/** @brief Reader thread : read upcoming files into page cache
+ *
+ * Files up to FILES2CUBE_PREFETCH_DEPTH frames ahead of the current frame
+ * are read, so that load_fits in the main thread finds them in memory.
+ */
+static void *files_to_cube_reader(void *arg)
+{
+    FILES2CUBE_PREFETCH *pf = (FILES2CUBE_PREFETCH *) arg;
+
+    pthread_mutex_lock(&pf->mutex);
+    while(1)
+    {
+        while((pf->stop == 0) && (pf->nextframe < pf->nbframes) &&
+                (pf->nextframe > pf->currentframe + FILES2CUBE_PREFETCH_DEPTH))
+        {
+            pthread_cond_wait(&pf->cond, &pf->mutex);
+        }
+        if((pf->stop == 1) || (pf->nextframe >= pf->nbframes))
+        {
+            break;
+        }
+        long frame = pf->nextframe;
+        pf->nextframe++;
+        pthread_mutex_unlock(&pf->mutex);
+
+        char fname[STRINGMAXLEN_FULLFILENAME];
+        WRITE_FULLFILENAME(fname, "%s%05ld.fits", pf->fileprefix, frame);
+        int fd = open(fname, O_RDONLY);
+        if(fd != -1)
         {
-            data.image[ID]
-            .array.F[frame * naxes[0] * naxes[1] + (jj * naxes[0] + ii)] =
-                data.image[ID1].array.F[jj * naxes[0] + ii];
+            struct stat st;
+            if(fstat(fd, &st) == 0)
+            {
+                // blocks until read
+                readahead(fd, 0, st.st_size);
+            }
+            close(fd);
         }
 
-    for(frame = 1; frame < nbframes; frame++)
+        pthread_mutex_lock(&pf->mutex);
+    }
+    pthread_mutex_unlock(&pf->mutex);
+
+    return NULL;
+}
+
+/** @brief Assemble FITS files <fileprefix>00000.fits ... into cube
+ *
+ * Files are prefetched by a pool of reader threads while the main thread
+ * loads and copies the current frame. Cube datatype is the datatype of
+ * the first file.
+ *
+ * If a file cannot be loaded or does not match the first file, the cube is
+ * deleted and an error is returned.
+ */
+errno_t files_to_cube(const char *restrict fileprefix,
+                      long nbframes,
+                      const char *restrict cube_name)
+{
+    DEBUG_TRACE_FSTART();
+    imageID             ID = -1;
+    size_t              slicesize = 0;
+    long                NBloaded  = 0;
+    int                 loadOK    = 1;
+    struct timespec     t0, t1;
+    FILES2CUBE_PREFETCH pf;
+    pthread_t           readerthread[FILES2CUBE_NBREADER];
+    int                 NBreader = 0;
+
+    milk_clock_gettime(&t0);
+
+    pf.fileprefix   = fileprefix;
+    pf.nbframes     = nbframes;
+    pf.nextframe    = 0;
+    pf.currentframe = 0;
+    pf.stop         = 0;
+    pthread_mutex_init(&pf.mutex, NULL);
+    pthread_cond_init(&pf.cond, NULL);
+
+    for(int i = 0; i < FILES2CUBE_NBREADER; i++)
     {
-        WRITE_IMAGENAME(imname, "%s%05ld", img_name, frame);
-        printf("Adding image %s -> %ld/%ld ... ", img_name, frame, nbframes);
-        fflush(stdout);
+        if(pthread_create(&readerthread[NBreader],
+                          NULL,
+                          files_to_cube_reader,
+                          &pf) == 0)
+        {
+            NBreader++;
+        }
+    }
+
+    for(long frame = 0; (frame < nbframes) && (loadOK == 1); frame++)
+    {
+        char    fname[STRINGMAXLEN_FULLFILENAME];
+        imageID IDslice = -1;
+
+        pthread_mutex_lock(&pf.mutex);
+        pf.currentframe = frame;
+        pthread_cond_broadcast(&pf.cond);
+        pthread_mutex_unlock(&pf.mutex);
 
-        ID1 = image_ID(imname);
-        if(ID1 == -1)
+        WRITE_FULLFILENAME(fname, "%s%05ld.fits", fileprefix, frame);
+        if((load_fits(fname,
+                      "_files2cube",
+                      LOADFITS_ERRMODE_WARNING,
+                      &IDslice) != RETURN_SUCCESS) ||
+                (IDslice == -1))
         {
-            PRINT_ERROR("Image \"%s\" does not exist - skipping", imname);
+            PRINT_ERROR("cannot load file %s", fname);
+            loadOK = 0;
+            break;
         }
-        else
+
+        if(frame == 0)
         {
-            naxes[0] = data.image[ID1].md[0].size[0];
-            naxes[1] = data.image[ID1].md[0].size[1];
-            if((xsize != naxes[0]) || (ysize != naxes[1]))
+            if(images_to_cube_create(cube_name, IDslice, nbframes, &ID) !=
+                    RETURN_SUCCESS)
             {
-                PRINT_ERROR("Image has wrong size");
-                exit(0);
+                PRINT_ERROR("cannot create cube %s", cube_name);
+                ID     = -1;
+                loadOK = 0;
+            }
+            else
+            {
+                // data.image may have been reallocated
+                IDslice   = image_ID("_files2cube");
+                slicesize = images_to_cube_slicesize(ID, IDslice);
             }
-            for(uint32_t ii = 0; ii < naxes[0]; ii++)
-                for(uint32_t jj = 0; jj < naxes[1]; jj++)
-                {
-                    data.image[ID].array.F[frame * naxes[0] * naxes[1] +
-                                           (jj * naxes[0] + ii)] =
-                                               data.image[ID1].array.F[jj * naxes[0] + ii];
-                }
         }
-        printf("Done\n");
-        fflush(stdout);
+
+        if(loadOK == 1)
+        {
+            if(images_to_cube_slicesize(ID, IDslice) != slicesize)
+            {
+                PRINT_ERROR("file %s has wrong size or type", fname);
+                loadOK = 0;
+            }
+            else
+            {
+                memcpy((char *) data.image[ID].array.raw + slicesize * frame,
+                       data.image[IDslice].array.raw,
+                       slicesize);
+                NBloaded++;
+            }
+        }
+        delete_image_ID("_files2cube", DELETE_IMAGE_ERRMODE_WARNING);
+    }
+
+    pthread_mutex_lock(&pf.mutex);
+    pf.stop = 1;
+    pthread_cond_broadcast(&pf.cond);
+    pthread_mutex_unlock(&pf.mutex);
+    for(int i = 0; i < NBreader; i++)
+    {
+        pthread_join(readerthread[i], NULL);
+    }
+    pthread_mutex_destroy(&pf.mutex);
+    pthread_cond_destroy(&pf.cond);
+
+    if(loadOK == 0)
+    {
+        if(ID != -1)
+        {
+            delete_image_ID(cube_name, DELETE_IMAGE_ERRMODE_WARNING);
+        }
+        FUNC_RETURN_FAILURE("cube %s not created", cube_name);
+    }
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("no cube created");
+    }
+
+    milk_clock_gettime(&t1);
+    {
+        double dt = timespec_diff_double(t0, t1);
+        printf("%ld frames in %.3f s (%.1f frames/s)\n",
+               NBloaded,
+               dt,
+               NBloaded / dt);
     }
 
     DEBUG_TRACE_FEXIT();
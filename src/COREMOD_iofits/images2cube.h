@@ -7,3 +7,7 @@ errno_t images2cube_addCLIcmd();
 errno_t images_to_cube(const char *restrict img_name,
                        long nbframes,
                        const char *restrict cube_name);
+
+errno_t files_to_cube(const char *restrict fileprefix,
+                      long nbframes,
+                      const char *restrict cube_name);
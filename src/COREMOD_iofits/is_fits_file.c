@@ -6,8 +6,6 @@
 #include "CommandLineInterface/CLIcore.h"
 #include "check_fitsio_status.h"
 
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
-
 int is_fits_file(const char *restrict file_name)
 {
     int       value = 0;
@@ -30,18 +28,19 @@ int is_fits_file(const char *restrict file_name)
     else
     {
         fitsfile *fptr;
+        int       status = 0;
 
         EXECUTE_SYSTEM_COMMAND("touch fitscheck.%s", file_name);
 
         if(!fits_open_file(&fptr,
                            file_name,
                            READONLY,
-                           &COREMOD_iofits_data.FITSIO_status))
+                           &status))
         {
-            fits_close_file(fptr, &COREMOD_iofits_data.FITSIO_status);
+            fits_close_file(fptr, &status);
             value = 1;
         }
-        if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) == 1)
+        if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) == 1)
         {
             PRINT_ERROR("Error in function is_fits_file(%s)", file_name);
         }
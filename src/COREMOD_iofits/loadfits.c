@@ -12,13 +12,13 @@
 
 #include "check_fitsio_status.h"
 #include "data_type_code.h"
+#include "loadfits.h"
+#include "loadfits_mmap.h"
 
 #include "COREMOD_memory/image_keyword_addD.h"
 #include "COREMOD_memory/image_keyword_addL.h"
 #include "COREMOD_memory/image_keyword_addS.h"
 
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
-
 // CLI function arguments and parameters
 static char *infilename;
 static char *outimname;
@@ -76,6 +76,103 @@ static errno_t help_function()
     return RETURN_SUCCESS;
 }
 
+/** @brief Import FITS keyword into image
+ *
+ * keyname, kwvaluestr and kwcomment are as returned by fits_read_keyn :
+ * string values include enclosing quotes.
+ * Structural keywords (BITPIX, NAXIS ...) and keywords without value are
+ * ignored.
+ */
+errno_t load_fits_keyword(IMGID img,
+                          int   kwnum,
+                          char *keyname,
+                          char *kwvaluestr,
+                          char *kwcomment)
+{
+    // keywords to ignore
+    char *keywordignore[] = {"BITPIX",
+                             "NAXIS",
+                             "SIMPLE",
+                             "EXTEND",
+                             "COMMENT",
+                             "DATE",
+                             "NAXIS1",
+                             "NAXIS2",
+                             "NAXIS3",
+                             "NAXIS4",
+                             "BSCALE",
+                             "BZERO",
+                             0
+                            };
+
+    //printf("FITS KEYW %3d  %8s %20s / %s\n", kwnum, keyname, kwvaluestr, kwcomment);
+
+    int kwignore = 0;
+    int ki       = 0;
+    while(keywordignore[ki])
+    {
+        if(strcmp(keywordignore[ki], keyname) == 0)
+        {
+            //printf("%3d IGNORING %s\n", kwnum, keyname);
+            kwignore = 1;
+            break;
+        }
+        ki++;
+    }
+
+    if((kwignore == 0) && (strlen(kwvaluestr) > 0))
+    {
+        int kwtypeOK = 0;
+
+        // is this a long ?
+        char *tailstr;
+        long  kwlongval = strtol(kwvaluestr, &tailstr, 10);
+        if(strlen(tailstr) == 0)
+        {
+            kwtypeOK = 1;
+            printf("%3d FITS KEYW [L] %-8s= %20ld / %s\n",
+                   kwnum,
+                   keyname,
+                   kwlongval,
+                   kwcomment);
+            image_keyword_addL(img, keyname, kwlongval, kwcomment);
+        }
+
+        if(kwtypeOK == 0)
+        {
+            // is this a float ?
+            double kwdoubleval = strtold(kwvaluestr, &tailstr);
+            if(strlen(tailstr) == 0)
+            {
+                kwtypeOK = 1;
+                printf("%3d FITS KEYW [D] %-8s= %20g / %s\n",
+                       kwnum,
+                       keyname,
+                       kwdoubleval,
+                       kwcomment);
+                image_keyword_addD(img, keyname, kwdoubleval, kwcomment);
+            }
+
+            if(kwtypeOK == 0)
+            {
+                // default to string
+                printf("%3d FITS KEYW [S] %-8s= %-20s / %s\n",
+                       kwnum,
+                       keyname,
+                       kwvaluestr,
+                       kwcomment);
+                // remove leading and trailing '
+                kwvaluestr[strlen(kwvaluestr) - 1] = '\0';
+                char *kwvaluestr1;
+                kwvaluestr1 = kwvaluestr + 1;
+                image_keyword_addS(img, keyname, kwvaluestr1, kwcomment);
+            }
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
 /// errmode values :
 /// LOADFITS_ERRMODE_IGNORE  (0) print warning, do not show error messages, continue
 /// LOADFITS_ERRMODE_WARNING (1) print error, continue
@@ -115,6 +212,17 @@ errno_t load_fits(const char *restrict file_name,
 
     DEBUG_TRACEPOINT("FARG \"%s\" %s %d", file_name, ID_name, errmode);
 
+    // uncompressed FITS file : map and convert directly into image
+    if(load_fits_mmap(file_name, ID_name, &ID) == 1)
+    {
+        if(IDout != NULL)
+        {
+            *IDout = ID;
+        }
+        DEBUG_TRACE_FEXIT();
+        return RETURN_SUCCESS;
+    }
+
     {
         // Open fitsio file pointer
         // tyr 3 consecutive times and then give up if not successful
@@ -519,21 +627,6 @@ errno_t load_fits(const char *restrict file_name,
 
     IMGID img = makesetIMGID(ID_name, ID);
 
-    // keywords to ignore
-    char *keywordignore[] = {"BITPIX",
-                             "NAXIS",
-                             "SIMPLE",
-                             "EXTEND",
-                             "COMMENT",
-                             "DATE",
-                             "NAXIS1",
-                             "NAXIS2",
-                             "NAXIS3",
-                             "NAXIS4",
-                             "BSCALE",
-                             "BZERO",
-                             0
-                            };
     printf("%d FITS keywords detected\n", nbFITSkeys);
     for(int kwnum = 0; kwnum < nbFITSkeys; kwnum++)
     {
@@ -550,70 +643,7 @@ errno_t load_fits(const char *restrict file_name,
                            &status);
         }
 
-        //printf("FITS KEYW %3d  %8s %20s / %s\n", kwnum, keyname, kwvaluestr, kwcomment);
-
-        int kwignore = 0;
-        int ki       = 0;
-        while(keywordignore[ki])
-        {
-            if(strcmp(keywordignore[ki], keyname) == 0)
-            {
-                //printf("%3d IGNORING %s\n", kwnum, keyname);
-                kwignore = 1;
-                break;
-            }
-            ki++;
-        }
-
-        if((kwignore == 0) && (strlen(kwvaluestr) > 0))
-        {
-            int kwtypeOK = 0;
-
-            // is this a long ?
-            char *tailstr;
-            long  kwlongval = strtol(kwvaluestr, &tailstr, 10);
-            if(strlen(tailstr) == 0)
-            {
-                kwtypeOK = 1;
-                printf("%3d FITS KEYW [L] %-8s= %20ld / %s\n",
-                       kwnum,
-                       keyname,
-                       kwlongval,
-                       kwcomment);
-                image_keyword_addL(img, keyname, kwlongval, kwcomment);
-            }
-
-            if(kwtypeOK == 0)
-            {
-                // is this a float ?
-                double kwdoubleval = strtold(kwvaluestr, &tailstr);
-                if(strlen(tailstr) == 0)
-                {
-                    kwtypeOK = 1;
-                    printf("%3d FITS KEYW [D] %-8s= %20g / %s\n",
-                           kwnum,
-                           keyname,
-                           kwdoubleval,
-                           kwcomment);
-                    image_keyword_addD(img, keyname, kwdoubleval, kwcomment);
-                }
-
-                if(kwtypeOK == 0)
-                {
-                    // default to string
-                    printf("%3d FITS KEYW [S] %-8s= %-20s / %s\n",
-                           kwnum,
-                           keyname,
-                           kwvaluestr,
-                           kwcomment);
-                    // remove leading and trailing '
-                    kwvaluestr[strlen(kwvaluestr) - 1] = '\0';
-                    char *kwvaluestr1;
-                    kwvaluestr1 = kwvaluestr + 1;
-                    image_keyword_addS(img, keyname, kwvaluestr1, kwcomment);
-                }
-            }
-        }
+        load_fits_keyword(img, kwnum, keyname, kwvaluestr, kwcomment);
     }
 
     {
@@ -12,6 +12,12 @@
 
 errno_t CLIADDCMD_COREMOD_iofits__loadfits();
 
+errno_t load_fits_keyword(IMGID img,
+                          int   kwnum,
+                          char *keyname,
+                          char *kwvaluestr,
+                          char *kwcomment);
+
 errno_t load_fits(const char *restrict file_name,
                   const char *restrict ID_name,
                   int      errmode,
@@ -0,0 +1,474 @@
+/**
+ * @file    loadfits_mmap.c
+ * @brief   load uncompressed FITS files without cfitsio
+ *
+ * The file is mapped in memory, the primary header is parsed directly,
+ * and pixel values are byte-swapped / converted in parallel chunks
+ * straight into the destination image, which may be a shared memory
+ * stream. There is no intermediate buffer : load time is bounded by disk
+ * (or page cache) bandwidth.
+ *
+ * Only the common, unscaled cases are handled here (BSCALE = 1, BZERO = 0,
+ * and BITPIX = 16 with BZERO = 32768 for unsigned 16-bit), with the same
+ * output datatype as load_fits. Anything else (compressed files, cfitsio
+ * extended file name syntax, scaled data, empty primary HDU, truncated
+ * file) is left to the cfitsio path.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_iofits_common.h"
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "loadfits.h"
+#include "loadfits_mmap.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#define OMP_NELEMENT_LIMIT 1000000
+#endif
+
+// FITS is big-endian
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FITS_BSWAP16(x) (x)
+#define FITS_BSWAP32(x) (x)
+#define FITS_BSWAP64(x) (x)
+#else
+#define FITS_BSWAP16(x) __builtin_bswap16(x)
+#define FITS_BSWAP32(x) __builtin_bswap32(x)
+#define FITS_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+#define FITS_BLOCKSIZE 2880
+#define FITS_CARDSIZE  80
+
+// pixels converted per chunk
+#define LOADFITS_MMAP_CHUNK 262144
+
+// enabled by default, can be turned off to benchmark/validate
+static int load_fits_mmap_enabled = 1;
+
+void load_fits_mmap_set_enable(int enable)
+{
+    load_fits_mmap_enabled = enable;
+}
+
+int load_fits_mmap_get_enable()
+{
+    return load_fits_mmap_enabled;
+}
+
+/** @brief Parse header card as fits_read_keyn
+ *
+ * String values keep their enclosing quotes. Trailing blanks are
+ * removed from keyname and comment.
+ */
+static void fitscard_parse(const char *card,
+                           char       *keyname,
+                           char       *value,
+                           char       *comment)
+{
+    char buf[FITS_CARDSIZE + 1];
+    int  ii = 0;
+    int  n;
+
+    memcpy(buf, card, FITS_CARDSIZE);
+    buf[FITS_CARDSIZE] = '\0';
+
+    memcpy(keyname, buf, 8);
+    keyname[8] = '\0';
+    for(n = 7; (n >= 0) && (keyname[n] == ' '); n--)
+    {
+        keyname[n] = '\0';
+    }
+
+    value[0]   = '\0';
+    comment[0] = '\0';
+
+    if((buf[8] != '=') || (buf[9] != ' '))
+    {
+        // no value : COMMENT, HISTORY, blank
+        return;
+    }
+
+    ii = 10;
+    ii += strspn(buf + ii, " ");
+
+    if(buf[ii] == '\'')
+    {
+        // string, '' is an escaped quote
+        int jj = ii + 1;
+        while(jj < FITS_CARDSIZE)
+        {
+            if(buf[jj] == '\'')
+            {
+                if(buf[jj + 1] != '\'')
+                {
+                    break;
+                }
+                jj++;
+            }
+            jj++;
+        }
+        if(jj == FITS_CARDSIZE)
+        {
+            jj--;
+        }
+        n = jj - ii + 1;
+    }
+    else if(buf[ii] == '(')
+    {
+        // complex
+        n = strcspn(buf + ii, ")");
+        if(buf[ii + n] == ')')
+        {
+            n++;
+        }
+    }
+    else
+    {
+        n = strcspn(buf + ii, " /");
+    }
+    memcpy(value, buf + ii, n);
+    value[n] = '\0';
+    ii += n;
+
+    ii += strspn(buf + ii, " ");
+    if(buf[ii] == '/')
+    {
+        ii++;
+        if(buf[ii] == ' ')
+        {
+            ii++;
+        }
+        strcpy(comment, buf + ii);
+        for(n = strlen(comment) - 1; (n >= 0) && (comment[n] == ' '); n--)
+        {
+            comment[n] = '\0';
+        }
+    }
+}
+
+/** @brief Convert pixels [ii0, ii1[ from FITS data to image
+ */
+static void fitsdata_convert(
+    int bitpix, int usign, const void *in, void *out, long ii0, long ii1)
+{
+    switch(bitpix)
+    {
+    case 8:
+    {
+        const uint8_t *restrict pin  = (const uint8_t *) in;
+        float *restrict         pout = (float *) out;
+        for(long ii = ii0; ii < ii1; ii++)
+        {
+            pout[ii] = pin[ii];
+        }
+    }
+    break;
+
+    case 16:
+    {
+        const uint16_t *restrict pin  = (const uint16_t *) in;
+        uint16_t *restrict       pout = (uint16_t *) out;
+        if(usign)
+        {
+            // BZERO = 32768
+            for(long ii = ii0; ii < ii1; ii++)
+            {
+                pout[ii] = FITS_BSWAP16(pin[ii]) ^ 0x8000;
+            }
+        }
+        else
+        {
+            // signed values to unsigned image : negative clipped to 0
+            for(long ii = ii0; ii < ii1; ii++)
+            {
+                int16_t v = (int16_t) FITS_BSWAP16(pin[ii]);
+                pout[ii]  = (v < 0) ? 0 : v;
+            }
+        }
+    }
+    break;
+
+    case 32:
+    case -32:
+    {
+        const uint32_t *restrict pin  = (const uint32_t *) in;
+        uint32_t *restrict       pout = (uint32_t *) out;
+        for(long ii = ii0; ii < ii1; ii++)
+        {
+            pout[ii] = FITS_BSWAP32(pin[ii]);
+        }
+    }
+    break;
+
+    case 64:
+    case -64:
+    {
+        const uint64_t *restrict pin  = (const uint64_t *) in;
+        uint64_t *restrict       pout = (uint64_t *) out;
+        for(long ii = ii0; ii < ii1; ii++)
+        {
+            pout[ii] = FITS_BSWAP64(pin[ii]);
+        }
+    }
+    break;
+    }
+}
+
+/** @brief Load FITS file, bypassing cfitsio
+ *
+ * @return 1 if loaded, 0 if file should go to the cfitsio path
+ */
+int load_fits_mmap(const char *restrict file_name,
+                   const char *restrict ID_name,
+                   imageID *IDout)
+{
+    struct timespec t0, t1;
+    struct stat     st;
+    int             fd;
+    char           *map;
+    size_t          mapsize;
+
+    int      bitpix  = 0;
+    long     naxis   = -1;
+    uint32_t naxes[3] = {0, 0, 0};
+    double   bscale  = 1.0;
+    double   bzero   = 0.0;
+    int      NBcard  = -1; // cards before END
+    int      usign   = 0;
+    uint8_t  datatype;
+    imageID  ID;
+
+    if(load_fits_mmap_enabled == 0)
+    {
+        return 0;
+    }
+
+    // cfitsio extended file name syntax, stdin, URLs
+    if((file_name[0] == '!') || (file_name[0] == '-') ||
+            (strpbrk(file_name, "[]") != NULL) || (strstr(file_name, "://") != NULL))
+    {
+        return 0;
+    }
+
+    milk_clock_gettime(&t0);
+
+    fd = open(file_name, O_RDONLY);
+    if(fd == -1)
+    {
+        return 0;
+    }
+    if((fstat(fd, &st) == -1) || (!S_ISREG(st.st_mode)) ||
+            (st.st_size < FITS_BLOCKSIZE))
+    {
+        close(fd);
+        return 0;
+    }
+    mapsize = st.st_size;
+    map     = (char *) mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    // gzip and other compressed files fail here
+    if(strncmp(map, "SIMPLE  =", 9) != 0)
+    {
+        munmap(map, mapsize);
+        return 0;
+    }
+
+    // primary header
+    for(long icard = 0; (icard + 1) * FITS_CARDSIZE <= (long) mapsize;
+            icard++)
+    {
+        const char *card = map + icard * FITS_CARDSIZE;
+        char        keyname[9];
+        char        value[FLEN_VALUE];
+        char        comment[FLEN_COMMENT];
+        char       *tailstr;
+
+        if(strncmp(card, "END", 3) == 0)
+        {
+            int i = 3;
+            while((i < FITS_CARDSIZE) && (card[i] == ' '))
+            {
+                i++;
+            }
+            if(i == FITS_CARDSIZE)
+            {
+                NBcard = icard;
+                break;
+            }
+        }
+        if(strncmp(card, "HIERARCH", 8) == 0)
+        {
+            break;
+        }
+
+        fitscard_parse(card, keyname, value, comment);
+        if(icard == 0)
+        {
+            if(strcmp(value, "T") != 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        if(strcmp(keyname, "BITPIX") == 0)
+        {
+            bitpix = strtol(value, &tailstr, 10);
+        }
+        else if(strcmp(keyname, "NAXIS") == 0)
+        {
+            naxis = strtol(value, &tailstr, 10);
+        }
+        else if((strncmp(keyname, "NAXIS", 5) == 0) && (keyname[6] == '\0') &&
+                (keyname[5] >= '1') && (keyname[5] <= '3'))
+        {
+            naxes[keyname[5] - '1'] = strtol(value, &tailstr, 10);
+        }
+        else if(strcmp(keyname, "BSCALE") == 0)
+        {
+            bscale = strtod(value, &tailstr);
+        }
+        else if(strcmp(keyname, "BZERO") == 0)
+        {
+            bzero = strtod(value, &tailstr);
+        }
+        else
+        {
+            continue;
+        }
+        if(*tailstr != '\0')
+        {
+            // e.g. Fortran D exponent
+            break;
+        }
+    }
+
+    switch(bitpix)
+    {
+    case -32:
+    case 8:
+        datatype = _DATATYPE_FLOAT;
+        break;
+    case -64:
+        datatype = _DATATYPE_DOUBLE;
+        break;
+    case 16:
+        datatype = _DATATYPE_UINT16;
+        usign    = (bzero == 32768.0);
+        break;
+    case 32:
+        datatype = _DATATYPE_INT32;
+        break;
+    case 64:
+        datatype = _DATATYPE_INT64;
+        break;
+    default:
+        datatype = 0;
+    }
+
+    long nelement = 1;
+    for(long i = 0; i < naxis; i++)
+    {
+        nelement *= naxes[i];
+    }
+
+    size_t dataoffset = ((size_t) (NBcard + 1) * FITS_CARDSIZE + FITS_BLOCKSIZE - 1) /
+                        FITS_BLOCKSIZE * FITS_BLOCKSIZE;
+    size_t datasize = (size_t) nelement * abs(bitpix) / 8;
+
+    if((NBcard < 0) || (datatype == 0) || (naxis < 1) || (naxis > 3) ||
+            (nelement == 0) || (bscale != 1.0) || ((bzero != 0.0) && (usign == 0)) ||
+            (dataoffset + datasize > mapsize))
+    {
+        munmap(map, mapsize);
+        return 0;
+    }
+
+    printf(">>>>>>> loadfits file \"%s\" [mmap]\n", file_name);
+    printf("[%ld", (long) naxes[0]);
+    for(long i = 1; i < naxis; i++)
+    {
+        printf(",%ld", (long) naxes[i]);
+    }
+    printf("] %d %f %f\n", bitpix, bscale, bzero);
+    fflush(stdout);
+
+    create_image_ID(ID_name,
+                    naxis,
+                    naxes,
+                    datatype,
+                    data.SHARED_DFT,
+                    data.NBKEYWORD_DFT,
+                    0,
+                    &ID);
+
+    {
+        const char *in      = map + dataoffset;
+        void       *out     = data.image[ID].array.raw;
+        long        NBchunk = (nelement + LOADFITS_MMAP_CHUNK - 1) /
+                              LOADFITS_MMAP_CHUNK;
+
+        madvise(map, mapsize, MADV_WILLNEED);
+
+        #pragma omp parallel for schedule(dynamic) if (nelement > OMP_NELEMENT_LIMIT)
+        for(long ichunk = 0; ichunk < NBchunk; ichunk++)
+        {
+            long ii0 = ichunk * LOADFITS_MMAP_CHUNK;
+            long ii1 = ii0 + LOADFITS_MMAP_CHUNK;
+            if(ii1 > nelement)
+            {
+                ii1 = nelement;
+            }
+            fitsdata_convert(bitpix, usign, in, out, ii0, ii1);
+        }
+    }
+
+    {
+        IMGID img = makesetIMGID(ID_name, ID);
+
+        printf("%d FITS keywords detected\n", NBcard);
+        for(int kwnum = 0; kwnum < NBcard; kwnum++)
+        {
+            char keyname[9];
+            char kwvaluestr[FLEN_VALUE];
+            char kwcomment[FLEN_COMMENT];
+
+            fitscard_parse(map + kwnum * FITS_CARDSIZE,
+                           keyname,
+                           kwvaluestr,
+                           kwcomment);
+            load_fits_keyword(img, kwnum, keyname, kwvaluestr, kwcomment);
+        }
+    }
+
+    munmap(map, mapsize);
+
+    milk_clock_gettime(&t1);
+    {
+        double dt = timespec_diff_double(t0, t1);
+        printf("loaded %.1f MB in %.3f s (%.1f MB/s)\n",
+               1.0e-6 * datasize,
+               dt,
+               1.0e-6 * datasize / dt);
+    }
+
+    list_image_ID();
+
+    *IDout = ID;
+
+    return 1;
+}
@@ -0,0 +1,16 @@
+/**
+ * @file    loadfits_mmap.h
+ */
+
+#ifndef MILK_COREMOD_IOFIT_LOADFITS_MMAP_H
+#define MILK_COREMOD_IOFIT_LOADFITS_MMAP_H
+
+void load_fits_mmap_set_enable(int enable);
+
+int load_fits_mmap_get_enable();
+
+int load_fits_mmap(const char *restrict file_name,
+                   const char *restrict ID_name,
+                   imageID *IDout);
+
+#endif
@@ -13,8 +13,6 @@
 #include "loadfits.h"
 #include "savefits.h"
 
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
-
 
 
 
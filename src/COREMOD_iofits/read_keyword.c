@@ -7,8 +7,6 @@
 #include "COREMOD_iofits_common.h"
 #include "check_fitsio_status.h"
 
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
-
 int read_keyword(const char *restrict file_name,
                  const char *restrict KEYWORD,
                  char *restrict content)
@@ -16,11 +14,12 @@ int read_keyword(const char *restrict file_name,
     fitsfile *fptr; /* FITS file pointer, defined in fitsio.h */
     int       exists = 0;
     int       n;
+    int       status = 0;
 
     if(!fits_open_file(&fptr,
                        file_name,
                        READONLY,
-                       &COREMOD_iofits_data.FITSIO_status))
+                       &status))
     {
         char comment[STRINGMAXLEN_FITSKEYWCOMMENT];
         char str1[STRINGMAXLEN_FITSKEYWORDVALUE];
@@ -29,7 +28,7 @@ int read_keyword(const char *restrict file_name,
                              KEYWORD,
                              str1,
                              comment,
-                             &COREMOD_iofits_data.FITSIO_status))
+                             &status))
         {
             PRINT_ERROR("Keyword \"%s\" does not exist in file \"%s\"",
                         KEYWORD,
@@ -46,9 +45,9 @@ int read_keyword(const char *restrict file_name,
                     "many characters");
             }
         }
-        fits_close_file(fptr, &COREMOD_iofits_data.FITSIO_status);
+        fits_close_file(fptr, &status);
     }
-    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 0) == 1)
+    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 0, &status) == 1)
     {
         PRINT_ERROR("Error reading keyword \"%s\" in file \"%s\"",
                     KEYWORD,
@@ -6,6 +6,7 @@
 #include "CommandLineInterface/CLIcore.h"
 
 #include <pthread.h>
+#include <unistd.h>
 
 // Handle old fitsios
 #ifndef ULONGLONG_IMG
@@ -17,8 +18,7 @@
 #include "check_fitsio_status.h"
 #include "file_exists.h"
 #include "is_fits_file.h"
-
-extern COREMOD_IOFITS_DATA COREMOD_iofits_data;
+#include "savefits.h"
 
 // variables local to this translation unit
 static char *inimname;
@@ -88,6 +88,17 @@ static errno_t help_function()
 
 
 
+/**
+ * @brief Close and remove partially written temporary file, on error
+ */
+static void saveFITS_abandon(fitsfile *fptr, const char *fnametmp)
+{
+    // own status : closes even if previous call failed
+    int status = 0;
+    fits_close_file(fptr, &status);
+    unlink(fnametmp);
+}
+
 /**
  * @brief Write FITS file - wrapper kept for backwards compatibility before introducing
  * optional input image truncation
@@ -109,16 +120,57 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                            IMAGE_KEYWORD *kwarray,
                            int            kwarraysize)
 {
+    DEBUG_TRACE_FSTART();
+
+    IMGID imgin = mkIMGID_from_name(inputimname);
+    resolveIMGID(&imgin, ERRMODE_WARN);
+    if(imgin.ID == -1)
+    {
+        PRINT_WARNING("Image %s does not exist in memory - cannot save to FITS",
+                      inputimname);
+        DEBUG_TRACE_FEXIT();
+        return RETURN_SUCCESS;
+    }
 
+    FUNC_CHECK_RETURN(saveFITS_image_opt_trunc(imgin.im,
+                      truncate,
+                      outputFITSname,
+                      outputbitpix,
+                      importheaderfile,
+                      kwarray,
+                      kwarraysize));
 
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Write FITS file from image structure
+ *
+ * Same as saveFITS_opt_trunc, image given by IMAGE structure instead of
+ * name. The structure may be a copy of the data.image entry : only md,
+ * array and kw pointers are used, and the image table is not accessed.
+ */
+errno_t saveFITS_image_opt_trunc(IMAGE *image,
+                                 int    truncate,
+                                 const char *__restrict outputFITSname,
+                                 int outputbitpix,
+                                 const char *__restrict importheaderfile,
+                                 IMAGE_KEYWORD *kwarray,
+                                 int            kwarraysize)
+{
     DEBUG_TRACE_FSTART();
+
+    const char *inputimname = image->md->name;
+
     printf("Saving image %s to file %s, bitpix = %d, slice truncation %d\n",
            inputimname,
            outputFITSname,
            outputbitpix,
            truncate);
 
-    COREMOD_iofits_data.FITSIO_status = 0;
+    // per-call cfitsio status : function can run concurrently
+    int status = 0;
 
     // get PID to include in file name, so that file name is unique
     pthread_t self_id = pthread_self();
@@ -140,20 +192,10 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                    (long) self_id);
     printf("temp name : %s\n", fnametmp);
 
-    IMGID imgin = mkIMGID_from_name(inputimname);
-    resolveIMGID(&imgin, ERRMODE_WARN);
-    if(imgin.ID == -1)
-    {
-        PRINT_WARNING("Image %s does not exist in memory - cannot save to FITS",
-                      inputimname);
-        DEBUG_TRACE_FEXIT();
-        return RETURN_SUCCESS;
-    }
-
     // data types
-    uint8_t datatype       = imgin.md->datatype;
+    uint8_t datatype       = image->md->datatype;
     int     FITSIOdatatype = ImageStreamIO_FITSIOdatatype(datatype);
-    char *datainptr = (char *) imgin.im->array.raw;
+    char *datainptr = (char *) image->array.raw;
 
     int     bitpix;
 
@@ -266,30 +308,29 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
     fflush(stdout);
 
     fitsfile *fptr;
-    COREMOD_iofits_data.FITSIO_status = 0;
+    status = 0;
     DEBUG_TRACEPOINT("creating FITS file %s", fnametmp);
-    fits_create_file(&fptr, fnametmp, &COREMOD_iofits_data.FITSIO_status);
+    fits_create_file(&fptr, fnametmp, &status);
     DEBUG_TRACEPOINT(" ");
 
-    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
     {
-        char errstring[200];
+        char errstring[200] = "";
         if(access(fnametmp, F_OK) == 0)
         {
             snprintf(errstring, 200, "File already exists");
         }
-        PRINT_ERROR("fits_create_file error %d on file %s %s",
-                    COREMOD_iofits_data.FITSIO_status,
-                    fnametmp,
-                    errstring);
-        abort();
+        // report to caller : may run in a save worker thread
+        FUNC_RETURN_FAILURE("fits_create_file error on file %s %s",
+                            fnametmp,
+                            errstring);
     }
 
-    int  naxis = imgin.md->naxis;
+    int  naxis = image->md->naxis;
     long naxesl[3];
     for(int i = 0; i < naxis; i++)
     {
-        naxesl[i] = (long) imgin.md->size[i];
+        naxesl[i] = (long) image->md->size[i];
     }
     if(truncate >= 0)
     {
@@ -304,17 +345,16 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
 
 
     //printf(">>>>>>>> bitpix = %d\n", bitpix);
-    COREMOD_iofits_data.FITSIO_status = 0;
+    status = 0;
     fits_create_img(fptr,
                     bitpix,
                     naxis,
                     naxesl,
-                    &COREMOD_iofits_data.FITSIO_status);
-    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+                    &status);
+    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
     {
-        PRINT_ERROR("fits_create_img error on file %s", fnametmp);
-        EXECUTE_SYSTEM_COMMAND("rm %s", fnametmp);
-        FUNC_RETURN_FAILURE(" ");
+        saveFITS_abandon(fptr, fnametmp);
+        FUNC_RETURN_FAILURE("fits_create_img error on file %s", fnametmp);
     }
 
     DEBUG_TRACEPOINT(" ");
@@ -335,36 +375,40 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
 
             char *header;
 
-            COREMOD_iofits_data.FITSIO_status = 0;
+            status = 0;
             fits_open_file(&fptr_header,
                            importheaderfile,
                            READONLY,
-                           &COREMOD_iofits_data.FITSIO_status);
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+                           &status);
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
-                PRINT_ERROR("fits_open_file error on file %s",
-                            importheaderfile);
-                abort();
+                saveFITS_abandon(fptr, fnametmp);
+                FUNC_RETURN_FAILURE("fits_open_file error on file %s",
+                                    importheaderfile);
             }
 
-            COREMOD_iofits_data.FITSIO_status = 0;
+            status = 0;
             fits_hdr2str(fptr_header,
                          1,
                          NULL,
                          0,
                          &header,
                          &nkeys,
-                         &COREMOD_iofits_data.FITSIO_status);
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+                         &status);
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
-                PRINT_ERROR("fits_hdr2str erroron file %s", importheaderfile);
-                abort();
+                status = 0;
+                fits_close_file(fptr_header, &status);
+                saveFITS_abandon(fptr, fnametmp);
+                FUNC_RETURN_FAILURE("fits_hdr2str error on file %s",
+                                    importheaderfile);
             }
             printf("imported %d header cards\n", nkeys);
 
             char *hptr; // pointer to header
             hptr = header;
-            while(*hptr)
+            int headerOK = 1;
+            while((headerOK == 1) && (*hptr))
             {
                 char fitscard[81];
                 snprintf(fitscard, 81, "%.80s", hptr);
@@ -394,39 +438,46 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
 
                 if(writecard == 1)
                 {
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                    status = 0;
                     fits_write_record(fptr,
                                       fitscard,
-                                      &COREMOD_iofits_data.FITSIO_status);
-                    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) !=
+                                      &status);
+                    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) !=
                             0)
                     {
                         PRINT_ERROR(
                             "fits_write_record error on "
                             "file %s",
                             importheaderfile);
-                        abort();
+                        headerOK = 0;
                     }
                 }
                 hptr += 80;
             }
 
-            COREMOD_iofits_data.FITSIO_status = 0;
-            fits_free_memory(header, &COREMOD_iofits_data.FITSIO_status);
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+            status = 0;
+            fits_free_memory(header, &status);
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
                 PRINT_ERROR("fits_free_memory error on file %s",
                             importheaderfile);
-                abort();
+                headerOK = 0;
             }
 
-            COREMOD_iofits_data.FITSIO_status = 0;
-            fits_close_file(fptr_header, &COREMOD_iofits_data.FITSIO_status);
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+            status = 0;
+            fits_close_file(fptr_header, &status);
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
                 PRINT_ERROR("fits_close_file error on file %s",
                             importheaderfile);
-                abort();
+                headerOK = 0;
+            }
+
+            if(headerOK == 0)
+            {
+                saveFITS_abandon(fptr, fnametmp);
+                FUNC_RETURN_FAILURE("cannot import header from %s",
+                                    importheaderfile);
             }
         }
     }
@@ -438,12 +489,12 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
     // These are technical keywords that shouldn't be propagated to FITS.
 
     {
-        int NBkw  = imgin.md->NBkw;
+        int NBkw  = image->md->NBkw;
         int kwcnt = 0;
         printf("----------- NUMBER KW = %d ---------------\n", NBkw);
         for(int kw = 0; kw < NBkw; kw++)
         {
-            if(imgin.im->kw[kw].name[0] == '_')
+            if(image->kw[kw].name[0] == '_')
             {
                 // Skip keywords that start with a "_"
                 continue;
@@ -452,45 +503,45 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
             char tmpkwvalstr[81];
             // Don't rely on the stream keyword type, but instead rely
             // On the existing type in the auxfitsheader. If any at all?
-            switch(imgin.im->kw[kw].type)
+            switch(image->kw[kw].type)
             {
                 case 'L':
                     printf("writing keyword [L] %-8s= %20ld / %s\n",
-                           imgin.im->kw[kw].name,
-                           imgin.im->kw[kw].value.numl,
-                           imgin.im->kw[kw].comment);
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                           image->kw[kw].name,
+                           image->kw[kw].value.numl,
+                           image->kw[kw].comment);
+                    status = 0;
                     fits_update_key(fptr,
                                     TLONG,
-                                    imgin.im->kw[kw].name,
-                                    &imgin.im->kw[kw].value.numl,
-                                    imgin.im->kw[kw].comment,
-                                    &COREMOD_iofits_data.FITSIO_status);
+                                    image->kw[kw].name,
+                                    &image->kw[kw].value.numl,
+                                    image->kw[kw].comment,
+                                    &status);
                     kwcnt++;
                     break;
 
                 case 'D':
                     printf("writing keyword [D] %-8s= %20g / %s\n",
-                           imgin.im->kw[kw].name,
-                           imgin.im->kw[kw].value.numf,
-                           imgin.im->kw[kw].comment);
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                           image->kw[kw].name,
+                           image->kw[kw].value.numf,
+                           image->kw[kw].comment);
+                    status = 0;
                     fits_update_key(fptr,
                                     TDOUBLE,
-                                    imgin.im->kw[kw].name,
-                                    &imgin.im->kw[kw].value.numf,
-                                    imgin.im->kw[kw].comment,
-                                    &COREMOD_iofits_data.FITSIO_status);
+                                    image->kw[kw].name,
+                                    &image->kw[kw].value.numf,
+                                    image->kw[kw].comment,
+                                    &status);
                     kwcnt++;
                     break;
 
                 case 'S':
-                    snprintf(tmpkwvalstr, 81, "'%s'", imgin.im->kw[kw].value.valstr);
+                    snprintf(tmpkwvalstr, 81, "'%s'", image->kw[kw].value.valstr);
                     printf("writing keyword [S] %-8s= %20s / %s\n",
-                           imgin.im->kw[kw].name,
+                           image->kw[kw].name,
                            tmpkwvalstr,
-                           imgin.im->kw[kw].comment);
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                           image->kw[kw].comment);
+                    status = 0;
                     // MIND THAT WE ADDED SINGLE QUOTES JUST ABOVE IN snprintf!!
                     if((strncmp("'#TRUE#'", tmpkwvalstr, 8) == 0) ||
                             (strncmp("'#FALSE#'", tmpkwvalstr, 9) == 0))
@@ -500,20 +551,20 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                             strncmp("'#TRUE#'", tmpkwvalstr, 6) == 0;
                         fits_update_key(fptr,
                                         TLOGICAL,
-                                        imgin.im->kw[kw].name,
+                                        image->kw[kw].name,
                                         &tmpval_is_true,
-                                        imgin.im->kw[kw].comment,
-                                        &COREMOD_iofits_data.FITSIO_status);
+                                        image->kw[kw].comment,
+                                        &status);
                     }
                     else
                     {
                         // Normal string
                         fits_update_key(fptr,
                                         TSTRING,
-                                        imgin.im->kw[kw].name,
-                                        imgin.im->kw[kw].value.valstr,
-                                        imgin.im->kw[kw].comment,
-                                        &COREMOD_iofits_data.FITSIO_status);
+                                        image->kw[kw].name,
+                                        image->kw[kw].value.valstr,
+                                        image->kw[kw].comment,
+                                        &status);
                     }
                     kwcnt++;
                     break;
@@ -522,11 +573,11 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                     break;
             }
 
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
-                PRINT_ERROR("fits_write_record error on keyword %s",
-                            imgin.im->kw[kw].name);
-                abort();
+                saveFITS_abandon(fptr, fnametmp);
+                FUNC_RETURN_FAILURE("fits_update_key error on keyword %s",
+                                    image->kw[kw].name);
             }
         }
     }
@@ -543,17 +594,17 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
             switch(kwarray[kwi].type)
             {
                 case 'L':
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                    status = 0;
                     fits_update_key(fptr,
                                     TLONG,
                                     kwarray[kwi].name,
                                     &kwarray[kwi].value.numl,
                                     kwarray[kwi].comment,
-                                    &COREMOD_iofits_data.FITSIO_status);
+                                    &status);
                     break;
 
                 case 'D':
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                    status = 0;
                     printf("writing keyword [D] %-8s= %20g / %s\n",
                            kwarray[kwi].name,
                            kwarray[kwi].value.numf,
@@ -563,7 +614,7 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                                     kwarray[kwi].name,
                                     &kwarray[kwi].value.numf,
                                     kwarray[kwi].comment,
-                                    &COREMOD_iofits_data.FITSIO_status);
+                                    &status);
                     break;
 
                 case 'S':
@@ -572,24 +623,24 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                            kwarray[kwi].name,
                            tmpkwvalstr,
                            kwarray[kwi].comment);
-                    COREMOD_iofits_data.FITSIO_status = 0;
+                    status = 0;
                     fits_update_key(fptr,
                                     TSTRING,
                                     kwarray[kwi].name,
                                     kwarray[kwi].value.valstr,
                                     kwarray[kwi].comment,
-                                    &COREMOD_iofits_data.FITSIO_status);
+                                    &status);
                     break;
 
                 default:
                     break;
             }
 
-            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+            if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
             {
-                PRINT_ERROR("fits_write_record error on keyword %s",
-                            kwarray[kwi].name);
-                abort();
+                saveFITS_abandon(fptr, fnametmp);
+                FUNC_RETURN_FAILURE("fits_update_key error on keyword %s",
+                                    kwarray[kwi].name);
             }
         }
     }
@@ -603,24 +654,24 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                     "BSCALE",
                     &bscaleval,
                     "Real=fits-value*BSCALE+BZERO",
-                    &COREMOD_iofits_data.FITSIO_status);
+                    &status);
     fits_update_key(fptr,
                     TFLOAT,
                     "BZERO",
                     &bzeroval,
                     "Real=fits-value*BSCALE+BZERO",
-                    &COREMOD_iofits_data.FITSIO_status);
+                    &status);
 
 
-    long fpixel                       = 1;
-    COREMOD_iofits_data.FITSIO_status = 0;
+    long fpixel = 1;
+    status      = 0;
     fits_write_img(fptr,
                    FITSIOdatatype,
                    fpixel,
                    nelements,
                    datainptr,
-                   &COREMOD_iofits_data.FITSIO_status);
-    int errcode = check_FITSIO_status(__FILE__, __func__, __LINE__, 1);
+                   &status);
+    int errcode = check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status);
     if(errcode != 0)
     {
         if(errcode == 412)
@@ -629,27 +680,31 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
         }
         else
         {
-            PRINT_ERROR("fits_write_img error %d on file %s",
-                        errcode,
-                        fnametmp);
-            EXECUTE_SYSTEM_COMMAND("rm %s", fnametmp);
-            FUNC_RETURN_FAILURE(" ");
+            saveFITS_abandon(fptr, fnametmp);
+            FUNC_RETURN_FAILURE("fits_write_img error %d on file %s",
+                                errcode,
+                                fnametmp);
         }
     }
 
-    COREMOD_iofits_data.FITSIO_status = 0;
-    fits_write_date(fptr, &COREMOD_iofits_data.FITSIO_status);
+    status = 0;
+    fits_write_date(fptr, &status);
 
-    COREMOD_iofits_data.FITSIO_status = 0;
-    fits_close_file(fptr, &COREMOD_iofits_data.FITSIO_status);
-    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1) != 0)
+    // fptr is released by fits_close_file, also on error
+    status = 0;
+    fits_close_file(fptr, &status);
+    if(check_FITSIO_status(__FILE__, __func__, __LINE__, 1, &status) != 0)
     {
-        PRINT_ERROR("fits_close_file error on file %s", fnametmp);
-        EXECUTE_SYSTEM_COMMAND("rm %s", fnametmp);
-        FUNC_RETURN_FAILURE(" ");
+        unlink(fnametmp);
+        FUNC_RETURN_FAILURE("fits_close_file error on file %s", fnametmp);
     }
 
-    EXECUTE_SYSTEM_COMMAND_ERRCHECK("mv %s %s", fnametmp, outputFITSname);
+    // atomic, same directory
+    if(rename(fnametmp, outputFITSname) != 0)
+    {
+        unlink(fnametmp);
+        FUNC_RETURN_FAILURE("cannot rename %s to %s", fnametmp, outputFITSname);
+    }
 
     DEBUG_TRACE_FEXIT();
     return RETURN_SUCCESS;
@@ -24,6 +24,14 @@ errno_t saveFITS_opt_trunc(const char *__restrict inputimname,
                            IMAGE_KEYWORD *kwarray,
                            int            kwarraysize);
 
+errno_t saveFITS_image_opt_trunc(IMAGE *image,
+                                 int    truncate,
+                                 const char *__restrict outputFITSname,
+                                 int outputbitpix,
+                                 const char *__restrict importheaderfile,
+                                 IMAGE_KEYWORD *kwarray,
+                                 int            kwarraysize);
+
 errno_t save_fits(const char *__restrict inputimname,
                   const char *__restrict outputFITSname);
 
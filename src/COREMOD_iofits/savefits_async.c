@@ -0,0 +1,367 @@
+/**
+ * @file    savefits_async.c
+ * @brief   save FITS files in background worker threads
+ *
+ * Jobs (image, file name, optional header file and keywords) are queued
+ * in a fixed-size ring and written by a small pool of worker threads
+ * calling saveFITS_opt_trunc, so that several files can be written
+ * concurrently, e.g. to different disks.
+ *
+ * saveFITS_async_submit returns a job ID immediately. It only blocks if
+ * SAVEFITS_ASYNC_QUEUESIZE jobs are already pending. Completion is
+ * obtained with saveFITS_async_wait (one job) or saveFITS_async_waitall.
+ *
+ * The image is copied when the job is submitted (metadata, pixels and
+ * keywords) : it may be modified or deleted, and the image table
+ * reallocated, while the job is pending. Queued jobs hold up to
+ * SAVEFITS_ASYNC_QUEUESIZE image copies.
+ *
+ * Concurrent writes require a thread-safe cfitsio build (--enable-reentrant,
+ * default in recent distributions).
+ */
+
+#include <pthread.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "savefits.h"
+#include "savefits_async.h"
+
+// job states
+#define SAVEFITS_ASYNC_FREE    0
+#define SAVEFITS_ASYNC_QUEUED  1
+#define SAVEFITS_ASYNC_RUNNING 2
+#define SAVEFITS_ASYNC_DONE    3
+
+typedef struct
+{
+    long jobid;
+    int  state;
+
+    // copy of image taken on submit, image.md/array/kw point to job buffers
+    IMAGE          image;
+    IMAGE_METADATA md;
+    void          *pixels;
+    IMAGE_KEYWORD *imkw;
+    char  fname[STRINGMAXLEN_FULLFILENAME];
+    char importheaderfile[STRINGMAXLEN_FULLFILENAME]; // empty if none
+    int  truncate;
+    int  bitpix;
+
+    // copy of caller's keywords
+    IMAGE_KEYWORD *kwarray;
+    int            kwarraysize;
+
+    errno_t ret;
+} SAVEFITS_ASYNC_JOB;
+
+// variables local to this translation unit
+static SAVEFITS_ASYNC_JOB jobqueue[SAVEFITS_ASYNC_QUEUESIZE];
+
+static pthread_mutex_t jobmutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  jobcond_todo = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  jobcond_done = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workerthread[SAVEFITS_ASYNC_MAXTHREAD];
+static int       NBworker   = 0;
+static int       workerstop = 0;
+
+static long NBjobsubmit = 0; // next job ID
+static long NBjobstart  = 0;
+static long NBjobdone   = 0;
+static long NBjobfail   = 0; // since last saveFITS_async_waitall
+
+static void *saveFITS_async_worker(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&jobmutex);
+    while(1)
+    {
+        while((NBjobstart == NBjobsubmit) && (workerstop == 0))
+        {
+            pthread_cond_wait(&jobcond_todo, &jobmutex);
+        }
+        if(NBjobstart == NBjobsubmit)
+        {
+            // stop requested and queue empty
+            break;
+        }
+
+        SAVEFITS_ASYNC_JOB *job = &jobqueue[NBjobstart % SAVEFITS_ASYNC_QUEUESIZE];
+        NBjobstart++;
+        job->state = SAVEFITS_ASYNC_RUNNING;
+        pthread_mutex_unlock(&jobmutex);
+
+        errno_t ret = saveFITS_image_opt_trunc(&job->image,
+                                               job->truncate,
+                                               job->fname,
+                                               job->bitpix,
+                                               job->importheaderfile,
+                                               job->kwarray,
+                                               job->kwarraysize);
+
+        pthread_mutex_lock(&jobmutex);
+        free(job->pixels);
+        job->pixels = NULL;
+        free(job->imkw);
+        job->imkw = NULL;
+        free(job->kwarray);
+        job->kwarray     = NULL;
+        job->kwarraysize = 0;
+        job->ret         = ret;
+        job->state       = SAVEFITS_ASYNC_DONE;
+        if(ret != RETURN_SUCCESS)
+        {
+            NBjobfail++;
+        }
+        NBjobdone++;
+        pthread_cond_broadcast(&jobcond_done);
+    }
+    pthread_mutex_unlock(&jobmutex);
+
+    return NULL;
+}
+
+// call with jobmutex locked
+static errno_t saveFITS_async_start(int NBthread)
+{
+    if(NBthread < 1)
+    {
+        NBthread = 1;
+    }
+    if(NBthread > SAVEFITS_ASYNC_MAXTHREAD)
+    {
+        NBthread = SAVEFITS_ASYNC_MAXTHREAD;
+    }
+
+    workerstop = 0;
+    while(NBworker < NBthread)
+    {
+        if(pthread_create(&workerthread[NBworker],
+                          NULL,
+                          saveFITS_async_worker,
+                          NULL) != 0)
+        {
+            PRINT_ERROR("pthread_create error");
+            break;
+        }
+        NBworker++;
+    }
+    if(NBworker == 0)
+    {
+        return RETURN_FAILURE;
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/** @brief Start worker pool
+ *
+ * Optional : saveFITS_async_submit starts SAVEFITS_ASYNC_NBTHREAD_DFT
+ * workers if the pool is not running. Can be called again to add workers.
+ */
+errno_t saveFITS_async_init(int NBthread)
+{
+    pthread_mutex_lock(&jobmutex);
+    errno_t ret = saveFITS_async_start(NBthread);
+    pthread_mutex_unlock(&jobmutex);
+
+    return ret;
+}
+
+/** @brief Queue image to be saved to FITS file
+ *
+ * Arguments are the same as saveFITS_opt_trunc. The image, strings and
+ * keywords are copied, and can be modified or released by the caller on
+ * return. Must be called from the thread that creates and deletes images.
+ *
+ * @return job ID, -1 if error (including image not found)
+ */
+long saveFITS_async_submit(const char *__restrict inputimname,
+                           int truncate,
+                           const char *__restrict outputFITSname,
+                           int outputbitpix,
+                           const char *__restrict importheaderfile,
+                           IMAGE_KEYWORD *kwarray,
+                           int            kwarraysize)
+{
+    IMAGE_KEYWORD *kwcopy   = NULL;
+    void          *pixcopy  = NULL;
+    IMAGE_KEYWORD *imkwcopy = NULL;
+    long           jobid;
+
+    imageID ID = image_ID(inputimname);
+    if(ID == -1)
+    {
+        PRINT_WARNING("Image %s does not exist in memory - cannot save to FITS",
+                      inputimname);
+        return -1;
+    }
+
+    if(kwarraysize > 0)
+    {
+        kwcopy = (IMAGE_KEYWORD *) malloc(sizeof(IMAGE_KEYWORD) * kwarraysize);
+        if(kwcopy == NULL)
+        {
+            PRINT_ERROR("malloc error");
+            return -1;
+        }
+        memcpy(kwcopy, kwarray, sizeof(IMAGE_KEYWORD) * kwarraysize);
+    }
+
+    // image copy : job must not read memory released by delete_image_ID
+    IMAGE_METADATA *md = data.image[ID].md;
+    size_t nbbyte = md->nelement * ImageStreamIO_typesize(md->datatype);
+    pixcopy       = malloc(nbbyte);
+    if(md->NBkw > 0)
+    {
+        imkwcopy =
+            (IMAGE_KEYWORD *) malloc(sizeof(IMAGE_KEYWORD) * md->NBkw);
+    }
+    if((pixcopy == NULL) || ((md->NBkw > 0) && (imkwcopy == NULL)))
+    {
+        PRINT_ERROR("malloc error");
+        free(kwcopy);
+        free(pixcopy);
+        free(imkwcopy);
+        return -1;
+    }
+    memcpy(pixcopy, data.image[ID].array.raw, nbbyte);
+    if(md->NBkw > 0)
+    {
+        memcpy(imkwcopy,
+               data.image[ID].kw,
+               sizeof(IMAGE_KEYWORD) * md->NBkw);
+    }
+
+    pthread_mutex_lock(&jobmutex);
+
+    if(NBworker == 0)
+    {
+        if(saveFITS_async_start(SAVEFITS_ASYNC_NBTHREAD_DFT) != RETURN_SUCCESS)
+        {
+            pthread_mutex_unlock(&jobmutex);
+            free(kwcopy);
+            free(pixcopy);
+            free(imkwcopy);
+            return -1;
+        }
+    }
+
+    // wait for slot to be released by job submitted QUEUESIZE earlier
+    SAVEFITS_ASYNC_JOB *job = &jobqueue[NBjobsubmit % SAVEFITS_ASYNC_QUEUESIZE];
+    while((job->state == SAVEFITS_ASYNC_QUEUED) ||
+            (job->state == SAVEFITS_ASYNC_RUNNING))
+    {
+        pthread_cond_wait(&jobcond_done, &jobmutex);
+    }
+
+    job->image           = data.image[ID];
+    job->md              = *md;
+    job->pixels          = pixcopy;
+    job->imkw            = imkwcopy;
+    job->image.md        = &job->md;
+    job->image.array.raw = pixcopy;
+    job->image.kw        = imkwcopy;
+    strncpy(job->fname, outputFITSname, STRINGMAXLEN_FULLFILENAME - 1);
+    job->fname[STRINGMAXLEN_FULLFILENAME - 1] = '\0';
+    job->importheaderfile[0]                   = '\0';
+    if(importheaderfile != NULL)
+    {
+        strncpy(job->importheaderfile,
+                importheaderfile,
+                STRINGMAXLEN_FULLFILENAME - 1);
+        job->importheaderfile[STRINGMAXLEN_FULLFILENAME - 1] = '\0';
+    }
+    job->truncate    = truncate;
+    job->bitpix      = outputbitpix;
+    job->kwarray     = kwcopy;
+    job->kwarraysize = kwarraysize;
+    job->ret         = RETURN_SUCCESS;
+    job->state       = SAVEFITS_ASYNC_QUEUED;
+    job->jobid       = NBjobsubmit;
+
+    jobid = NBjobsubmit;
+    NBjobsubmit++;
+    pthread_cond_signal(&jobcond_todo);
+
+    pthread_mutex_unlock(&jobmutex);
+
+    return jobid;
+}
+
+/** @brief Wait for job completion
+ *
+ * ret is set to the saveFITS_opt_trunc return value. It is only kept for
+ * the last SAVEFITS_ASYNC_QUEUESIZE jobs : older jobs report
+ * RETURN_SUCCESS here, failures are still counted by
+ * saveFITS_async_waitall.
+ */
+errno_t saveFITS_async_wait(long jobid, errno_t *ret)
+{
+    pthread_mutex_lock(&jobmutex);
+    if((jobid < 0) || (jobid >= NBjobsubmit))
+    {
+        pthread_mutex_unlock(&jobmutex);
+        PRINT_ERROR("invalid job ID %ld", jobid);
+        return RETURN_FAILURE;
+    }
+
+    SAVEFITS_ASYNC_JOB *job = &jobqueue[jobid % SAVEFITS_ASYNC_QUEUESIZE];
+    while((job->jobid == jobid) && (job->state != SAVEFITS_ASYNC_DONE))
+    {
+        pthread_cond_wait(&jobcond_done, &jobmutex);
+    }
+    if(ret != NULL)
+    {
+        *ret = (job->jobid == jobid) ? job->ret : RETURN_SUCCESS;
+    }
+    pthread_mutex_unlock(&jobmutex);
+
+    return RETURN_SUCCESS;
+}
+
+/** @brief Wait until all submitted jobs have completed
+ *
+ * @return number of failed jobs since previous call
+ */
+long saveFITS_async_waitall()
+{
+    long NBfail;
+
+    pthread_mutex_lock(&jobmutex);
+    while(NBjobdone < NBjobsubmit)
+    {
+        pthread_cond_wait(&jobcond_done, &jobmutex);
+    }
+    NBfail    = NBjobfail;
+    NBjobfail = 0;
+    pthread_mutex_unlock(&jobmutex);
+
+    return NBfail;
+}
+
+/** @brief Complete pending jobs and stop worker pool
+ */
+errno_t saveFITS_async_stop()
+{
+    pthread_mutex_lock(&jobmutex);
+    workerstop = 1;
+    pthread_cond_broadcast(&jobcond_todo);
+    pthread_mutex_unlock(&jobmutex);
+
+    for(int i = 0; i < NBworker; i++)
+    {
+        pthread_join(workerthread[i], NULL);
+    }
+
+    pthread_mutex_lock(&jobmutex);
+    NBworker   = 0;
+    workerstop = 0;
+    pthread_mutex_unlock(&jobmutex);
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file    savefits_async.h
+ */
+
+#ifndef MILK_COREMOD_IOFIT_SAVEFITS_ASYNC_H
+#define MILK_COREMOD_IOFIT_SAVEFITS_ASYNC_H
+
+#define SAVEFITS_ASYNC_QUEUESIZE    64 // jobs queued or completed
+#define SAVEFITS_ASYNC_MAXTHREAD    16
+#define SAVEFITS_ASYNC_NBTHREAD_DFT 4
+
+errno_t saveFITS_async_init(int NBthread);
+
+long saveFITS_async_submit(const char *__restrict inputimname,
+                           int truncate,
+                           const char *__restrict outputFITSname,
+                           int outputbitpix,
+                           const char *__restrict importheaderfile,
+                           IMAGE_KEYWORD *kwarray,
+                           int            kwarraysize);
+
+errno_t saveFITS_async_wait(long jobid, errno_t *ret);
+
+long saveFITS_async_waitall();
+
+errno_t saveFITS_async_stop();
+
+#endif
@@ -68,13 +68,17 @@
 
 #include "shmimlog.h"
 #include "shmimlogcmd.h"
+#include "shmimlograw.h"
+#include "shmimraw2fits.h"
 
 #include "saveall.h"
 #include "shmim_purge.h"
 #include "shmim_setowner.h"
 #include "stream_TCP.h"
+#include "stream_TCPmux.h"
 #include "stream_UDP.h"
 #include "stream_ave.h"
+#include "stream_latency.h"
 #include "stream_copy.h"
 #include "stream_delay.h"
 #include "stream_merge.h"
@@ -159,6 +163,8 @@ static errno_t init_module_CLI()
     CLIADDCMD_COREMOD_memory__streamdelay();
     saveall_addCLIcmd();
     stream__TCP_addCLIcmd();
+    CLIADDCMD_COREMOD_memory__stream_latency();
+    stream__TCPmux_addCLIcmd();
     stream__UDP_addCLIcmd();
     stream_pixmapdecode_addCLIcmd();
 
@@ -178,6 +184,8 @@ static errno_t init_module_CLI()
 
     CLIADDCMD_COREMOD_memory__shmimlog();
     CLIADDCMD_COREMOD_memory__shmimlogcmd();
+    CLIADDCMD_COREMOD_memory__shmimlograw();
+    CLIADDCMD_COREMOD_memory__shmimraw2fits();
 
     // add atexit functions here
 
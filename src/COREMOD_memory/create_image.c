@@ -418,6 +418,7 @@ errno_t create_image_ID(const char *name,
                                shared,
                                NBkw,
                                CBsize);
+        image_ID_index_insert(ID);
     }
     else
     {
@@ -132,6 +132,7 @@ errno_t delete_image(IMGID img, int errmode)
     }
     else
     {
+        image_ID_index_remove(ID);
         data.image[ID].used = 0;
 
         if(data.image[ID].md[0].shared == 1)
@@ -45,6 +45,7 @@ errno_t destroy_shared_image_ID(const char *__restrict imname)
     ID = image_ID(imname);
     if((ID != -1) && (data.image[ID].md[0].shared == 1))
     {
+        image_ID_index_remove(ID);
         ImageStreamIO_destroyIm(&data.image[ID]);
     }
     else
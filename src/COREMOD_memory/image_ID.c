@@ -1,56 +1,309 @@
 /**
  * @file    image_ID.c
  * @brief   find image ID(s) from name
+ *
+ * Name lookups go through a hash index (name -> ID) kept in sync by
+ * create_image_ID, read_sharedmem_image, chname_image_ID, delete_image and
+ * memory_re_alloc.
+ *
+ * Image slots filled by other means (plugins calling ImageStreamIO directly,
+ * slots marked used without next_avail_image_ID, streams reconnected in
+ * place) are not in the index : a lookup miss falls back to a linear scan,
+ * and a slot found by the scan is indexed. Misses therefore cost a scan, as
+ * without the index, hits do not. Every hit is checked against
+ * data.image[], a stale entry triggers a full rebuild.
  */
 
+#include <pthread.h>
+
 #include "CommandLineInterface/CLIcore.h"
 
-/* ID number corresponding to a name */
-imageID image_ID(const char *name)
+#include "image_ID.h"
+
+// slot values
+#define IMAGEIDINDEX_EMPTY     -1
+#define IMAGEIDINDEX_TOMBSTONE -2
+
+typedef struct
 {
-    DEBUG_TRACE_FSTART();
+    uint32_t hash;
+    imageID  ID; // or IMAGEIDINDEX_EMPTY, IMAGEIDINDEX_TOMBSTONE
+    char     name[STRINGMAXLEN_IMAGE_NAME];
+} IMAGEIDINDEX_SLOT;
 
-    imageID i;
-    int     loopOK;
-    imageID tmpID = 0;
+static pthread_mutex_t imindex_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    i      = 0;
-    loopOK = 1;
-    while(loopOK == 1)
+static IMAGEIDINDEX_SLOT *imindex_slot = NULL;
+static long imindex_size    = 0; // number of slots, power of 2
+static long imindex_nbtomb  = 0; // number of tombstones
+static long imindex_NBimage = 0; // data.NB_MAX_IMAGE at last rebuild
+
+// slot index for each image ID, -1 if not indexed
+static long *imindex_IDslot = NULL;
+
+// FNV-1a
+static inline uint32_t imindex_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while(*name != '\0')
     {
-        if(data.image[i].used == 1)
+        h ^= (uint8_t)(*name);
+        h *= 16777619u;
+        name++;
+    }
+    return h;
+}
+
+/** @brief Find slot holding name, or -1
+ */
+static long imindex_find(const char *name, uint32_t h)
+{
+    long mask = imindex_size - 1;
+    long s    = h & mask;
+
+    while(imindex_slot[s].ID != IMAGEIDINDEX_EMPTY)
+    {
+        if((imindex_slot[s].ID >= 0) && (imindex_slot[s].hash == h) &&
+                (strcmp(imindex_slot[s].name, name) == 0))
         {
-            if((strncmp(name, data.image[i].name, strlen(name)) == 0) &&
-                    (data.image[i].name[strlen(name)] == '\0'))
+            return s;
+        }
+        s = (s + 1) & mask;
+    }
+    return -1;
+}
+
+static void imindex_removeslot(long s)
+{
+    imageID ID = imindex_slot[s].ID;
+    if((ID >= 0) && (ID < imindex_NBimage))
+    {
+        imindex_IDslot[ID] = -1;
+    }
+    imindex_slot[s].ID = IMAGEIDINDEX_TOMBSTONE;
+    imindex_nbtomb++;
+}
+
+/** @brief Add image ID to index, assumes index is sized
+ *
+ * If name is already indexed to another ID, keeps the existing entry
+ * if valid (lowest ID wins on rebuild, as with linear scan).
+ */
+static void imindex_add(imageID ID)
+{
+    const char *name = data.image[ID].name;
+
+    if(name[0] == '\0')
+    {
+        return;
+    }
+
+    if(imindex_IDslot[ID] != -1)
+    {
+        imindex_removeslot(imindex_IDslot[ID]);
+    }
+
+    uint32_t h = imindex_hash(name);
+    long     s = imindex_find(name, h);
+    if(s != -1)
+    {
+        imageID IDprev = imindex_slot[s].ID;
+        if((data.image[IDprev].used == 1) &&
+                (strcmp(data.image[IDprev].name, name) == 0))
+        {
+            return;
+        }
+        imindex_removeslot(s);
+    }
+
+    long mask = imindex_size - 1;
+    s         = h & mask;
+    while(imindex_slot[s].ID >= 0)
+    {
+        s = (s + 1) & mask;
+    }
+    if(imindex_slot[s].ID == IMAGEIDINDEX_TOMBSTONE)
+    {
+        imindex_nbtomb--;
+    }
+    imindex_slot[s].hash = h;
+    imindex_slot[s].ID   = ID;
+    strncpy(imindex_slot[s].name, name, STRINGMAXLEN_IMAGE_NAME - 1);
+    imindex_slot[s].name[STRINGMAXLEN_IMAGE_NAME - 1] = '\0';
+    imindex_IDslot[ID]                                 = s;
+}
+
+/** @brief Rebuild index from data.image[], resizing if needed
+ *
+ * Caller holds imindex_mutex.
+ */
+static errno_t imindex_rebuild()
+{
+    long size = 64;
+    while(size < 2 * data.NB_MAX_IMAGE)
+    {
+        size *= 2;
+    }
+
+    if(size != imindex_size)
+    {
+        IMAGEIDINDEX_SLOT *slot =
+            realloc(imindex_slot, sizeof(IMAGEIDINDEX_SLOT) * size);
+        if(slot == NULL)
+        {
+            PRINT_ERROR("image ID index allocation failed");
+            return RETURN_FAILURE;
+        }
+        imindex_slot = slot;
+        imindex_size = size;
+    }
+
+    if(data.NB_MAX_IMAGE != imindex_NBimage)
+    {
+        long *IDslot = realloc(imindex_IDslot, sizeof(long) * data.NB_MAX_IMAGE);
+        if(IDslot == NULL)
+        {
+            PRINT_ERROR("image ID index allocation failed");
+            return RETURN_FAILURE;
+        }
+        imindex_IDslot  = IDslot;
+        imindex_NBimage = data.NB_MAX_IMAGE;
+    }
+
+    for(long s = 0; s < imindex_size; s++)
+    {
+        imindex_slot[s].ID = IMAGEIDINDEX_EMPTY;
+    }
+    imindex_nbtomb = 0;
+    for(imageID ID = 0; ID < imindex_NBimage; ID++)
+    {
+        imindex_IDslot[ID] = -1;
+    }
+
+    for(imageID ID = 0; ID < imindex_NBimage; ID++)
+    {
+        if(data.image[ID].used == 1)
+        {
+            imindex_add(ID);
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/** @brief Make sure index matches current data.image allocation
+ */
+static inline errno_t imindex_check()
+{
+    if((imindex_NBimage != data.NB_MAX_IMAGE) ||
+            (imindex_nbtomb > imindex_size / 4))
+    {
+        return imindex_rebuild();
+    }
+    return RETURN_SUCCESS;
+}
+
+static imageID imindex_lookup(const char *name)
+{
+    imageID ID = -1;
+
+    pthread_mutex_lock(&imindex_mutex);
+
+    if(imindex_check() == RETURN_SUCCESS)
+    {
+        uint32_t h = imindex_hash(name);
+        long     s = imindex_find(name, h);
+
+        if(s != -1)
+        {
+            ID = imindex_slot[s].ID;
+            if((data.image[ID].used != 1) ||
+                    (strcmp(data.image[ID].name, name) != 0))
             {
-                loopOK = 0;
-                tmpID  = i;
-                clock_gettime(CLOCK_REALTIME,
-                              &data.image[i].md[0].lastaccesstime);
+                // slot was freed or renamed outside of the index hooks
+                imindex_rebuild();
+                s  = imindex_find(name, h);
+                ID = (s == -1) ? -1 : imindex_slot[s].ID;
             }
         }
-        i++;
 
-        if(i == data.NB_MAX_IMAGE)
+        if(s == -1)
         {
-            loopOK = 0;
-            tmpID  = -1;
+            // slot may have been filled outside of the index hooks
+            ID = image_ID_linearscan(name);
+            if(ID != -1)
+            {
+                imindex_add(ID);
+            }
         }
     }
+    else
+    {
+        // allocation failed : fall back to linear scan
+        ID = image_ID_linearscan(name);
+    }
 
-    DEBUG_TRACEPOINT("FOUT %s -> %ld", name, tmpID);
-    DEBUG_TRACE_FEXIT();
-    return tmpID;
+    pthread_mutex_unlock(&imindex_mutex);
+
+    return ID;
 }
 
-/* ID number corresponding to a name */
-imageID image_ID_noaccessupdate(const char *name)
+/** @brief Add/update image ID in name index
+ *
+ * Call after the image name has been written to data.image[ID].name
+ */
+errno_t image_ID_index_insert(imageID ID)
 {
-    DEBUG_TRACE_FSTART();
+    pthread_mutex_lock(&imindex_mutex);
+    if(imindex_check() == RETURN_SUCCESS)
+    {
+        imindex_add(ID);
+    }
+    pthread_mutex_unlock(&imindex_mutex);
+
+    return RETURN_SUCCESS;
+}
 
+/** @brief Remove image ID from name index
+ *
+ * Call before the slot is released or renamed.
+ */
+errno_t image_ID_index_remove(imageID ID)
+{
+    pthread_mutex_lock(&imindex_mutex);
+    if((ID >= 0) && (ID < imindex_NBimage) && (imindex_IDslot[ID] != -1))
+    {
+        imindex_removeslot(imindex_IDslot[ID]);
+    }
+    pthread_mutex_unlock(&imindex_mutex);
+
+    return RETURN_SUCCESS;
+}
+
+/** @brief Rebuild name index from image table
+ *
+ * Called when data.image is reallocated.
+ */
+errno_t image_ID_index_rebuild()
+{
+    errno_t ret;
+
+    pthread_mutex_lock(&imindex_mutex);
+    ret = imindex_rebuild();
+    pthread_mutex_unlock(&imindex_mutex);
+
+    return ret;
+}
+
+/** @brief ID number corresponding to a name, linear scan
+ *
+ * Reference implementation, does not use the name index.
+ */
+imageID image_ID_linearscan(const char *name)
+{
     imageID i;
-    imageID tmpID = 0;
     int     loopOK;
+    imageID tmpID = 0;
 
     i      = 0;
     loopOK = 1;
@@ -74,6 +327,35 @@ imageID image_ID_noaccessupdate(const char *name)
         }
     }
 
+    return tmpID;
+}
+
+/* ID number corresponding to a name */
+imageID image_ID(const char *name)
+{
+    DEBUG_TRACE_FSTART();
+
+    imageID tmpID = imindex_lookup(name);
+
+    if(tmpID != -1)
+    {
+        // coarse clock : vDSO read, no syscall
+        clock_gettime(CLOCK_REALTIME_COARSE,
+                      &data.image[tmpID].md[0].lastaccesstime);
+    }
+
+    DEBUG_TRACEPOINT("FOUT %s -> %ld", name, tmpID);
+    DEBUG_TRACE_FEXIT();
+    return tmpID;
+}
+
+/* ID number corresponding to a name */
+imageID image_ID_noaccessupdate(const char *name)
+{
+    DEBUG_TRACE_FSTART();
+
+    imageID tmpID = imindex_lookup(name);
+
     DEBUG_TRACE_FEXIT();
     return tmpID;
 }
@@ -111,6 +393,11 @@ imageID next_avail_image_ID()
         exit(0);
     }
 
+    // name is written by caller
+    pthread_mutex_lock(&imindex_mutex);
+    data.image[ID].name[0] = '\0';
+    pthread_mutex_unlock(&imindex_mutex);
+
     DEBUG_TRACEPOINT("FOUT ID : %ld", ID);
 
     DEBUG_TRACE_FEXIT();
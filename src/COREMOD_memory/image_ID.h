@@ -6,4 +6,12 @@ imageID image_ID(const char *name);
 
 imageID image_ID_noaccessupdate(const char *name);
 
+imageID image_ID_linearscan(const char *name);
+
 imageID next_avail_image_ID();
+
+errno_t image_ID_index_insert(imageID ID);
+
+errno_t image_ID_index_remove(imageID ID);
+
+errno_t image_ID_index_rebuild();
@@ -252,7 +252,9 @@ imageID chname_image_ID(const char *ID_name, const char *new_name)
     if((image_ID(new_name) == -1) && (variable_ID(new_name) == -1))
     {
         ID = image_ID(ID_name);
+        image_ID_index_remove(ID);
         strcpy(data.image[ID].name, new_name);
+        image_ID_index_insert(ID);
         //      if ( Debug > 0 ) { printf("change image name %s -> %s\n",ID_name,new_name);}
     }
     else
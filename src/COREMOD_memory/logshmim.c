@@ -51,6 +51,13 @@ errno_t COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         const char *logdir,
         const char *IDlogdata_name);
 
+errno_t COREMOD_MEMORY_sharedMem_2Dim_logring(const char *IDname,
+        uint32_t    zsize,
+        const char *logdir,
+        const char *IDlogdata_name,
+        int         NBcube,
+        int         NBwriter);
+
 // ==========================================
 // Command line interface wrapper function(s)
 // ==========================================
@@ -109,14 +116,28 @@ static errno_t COREMOD_MEMORY_sharedMem_2Dim_log__cli()
         sprintf(data.cmdargtoken[4].val.string, "null");
     }
 
+    // optional ring size and number of writer threads
+    int NBcube   = 2;
+    int NBwriter = 1;
+    if(CLI_checkarg_noerrmsg(5, CLIARG_INT64) == 0)
+    {
+        NBcube = data.cmdargtoken[5].val.numl;
+        if(CLI_checkarg_noerrmsg(6, CLIARG_INT64) == 0)
+        {
+            NBwriter = data.cmdargtoken[6].val.numl;
+        }
+    }
+
     if(0 + CLI_checkarg(1, 3) + CLI_checkarg(2, CLIARG_INT64) +
             CLI_checkarg(3, 3) ==
             0)
     {
-        COREMOD_MEMORY_sharedMem_2Dim_log(data.cmdargtoken[1].val.string,
-                                          data.cmdargtoken[2].val.numl,
-                                          data.cmdargtoken[3].val.string,
-                                          data.cmdargtoken[4].val.string);
+        COREMOD_MEMORY_sharedMem_2Dim_logring(data.cmdargtoken[1].val.string,
+                                              data.cmdargtoken[2].val.numl,
+                                              data.cmdargtoken[3].val.string,
+                                              data.cmdargtoken[4].val.string,
+                                              NBcube,
+                                              NBwriter);
         return CLICMD_SUCCESS;
     }
     else
@@ -136,11 +157,12 @@ errno_t logshmim_addCLIcmd()
                        __FILE__,
                        COREMOD_MEMORY_sharedMem_2Dim_log__cli,
                        "logs shared memory stream (run in current directory)",
-                       "<shm image> <cubesize [long]> <logdir>",
-                       "shmimstreamlog wfscamim 10000 /media/data \"\"",
-                       "long COREMOD_MEMORY_sharedMem_2Dim_log(const char "
+                       "<shm image> <cubesize [long]> <logdir> [logdata] "
+                       "[NBcube] [NBwriter]",
+                       "shmimstreamlog wfscamim 10000 /media/data null 4 2",
+                       "long COREMOD_MEMORY_sharedMem_2Dim_logring(const char "
                        "*IDname, uint32_t zsize, const char *logdir, "
-                       "const char *IDlogdata_name");
+                       "const char *IDlogdata_name, int NBcube, int NBwriter)");
 
     RegisterCLIcommand(
         "shmimslogstat",
@@ -172,61 +194,22 @@ errno_t logshmim_addCLIcmd()
     return RETURN_SUCCESS;
 }
 
+// local time zone is set through TZ environment variable, not thread-safe
+static pthread_mutex_t savecube_tzlock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * ## Purpose
  *
- * Save telemetry stream data
+ * Write telemetry cube and timing file to disk
+ *
+ * Called by save_fits_function, by logshmim writer threads and by the
+ * raw log converter.
  *
  */
-void *save_fits_function(void *ptr)
+void logshmim_savecube(STREAMSAVE_THREAD_MESSAGE *tmsg)
 {
-    imageID ID;
-
-    //struct savethreadmsg *tmsg; // = malloc(sizeof(struct savethreadmsg));
-    STREAMSAVE_THREAD_MESSAGE *tmsg;
-
-    uint32_t *imsizearray;
-    uint32_t  xsize, ysize;
-    uint8_t   datatype;
-
-    imageID IDc;
-    long    framesize; // in bytes
-    char   *ptr0;      // source pointer
-    char   *ptr1;      // destination pointer
-    long    k;
-    FILE   *fp;
-
-    // Set save function to RT priority 0
-    // This is meant to be lower priority than the data collection into buffers
-    //
-    int                RT_priority = 0;
-    struct sched_param schedpar;
-
-    schedpar.sched_priority = RT_priority;
-    if(seteuid(data.euid) != 0)  //This goes up to maximum privileges
-    {
-        PRINT_ERROR("seteuid error");
-    }
-    sched_setscheduler(0,
-                       SCHED_FIFO,
-                       &schedpar); //other option is SCHED_RR, might be faster
-    if(seteuid(data.ruid) != 0)    //Go back to normal privileges
-    {
-        PRINT_ERROR("seteuid error");
-    }
-
-    printf("===================== START SAVE THREAD =====================\n");
-    fflush(stdout);
-
-    imsizearray = (uint32_t *) malloc(sizeof(uint32_t) * 3);
-    if(imsizearray == NULL)
-    {
-        PRINT_ERROR("malloc error");
-        abort();
-    }
-
-    //    tmsg = (struct savethreadmsg*) ptr;
-    tmsg = (STREAMSAVE_THREAD_MESSAGE *) ptr;
+    long  k;
+    FILE *fp;
 
     // Add custom keywords
     int            NBcustomKW = 9;
@@ -280,12 +263,15 @@ void *save_fits_function(void *ptr)
     // Local time
 
     // get time zone
-    time_t t = time(NULL);
+    time_t    t = time(NULL);
+    struct tm lt;
+    pthread_mutex_lock(&savecube_tzlock);
     // OVERRIDE localtime to HST
     putenv("TZ=Pacific/Honolulu");
-    struct tm lt = *localtime(&t);
+    lt = *localtime(&t);
     printf("TIMEZONE TIMEZONE %s\n", lt.tm_zone);
     putenv("TZ=");
+    pthread_mutex_unlock(&savecube_tzlock);
 
     printf("TIMEZONE TIMEZONE %s\n", lt.tm_zone);
 
@@ -383,10 +369,46 @@ void *save_fits_function(void *ptr)
         }
         fclose(fp);
     }
+}
 
-    ID   = image_ID(tmsg->iname);
-    tret = ID;
-    free(imsizearray);
+/**
+ * ## Purpose
+ *
+ * Save telemetry stream data
+ *
+ */
+void *save_fits_function(void *ptr)
+{
+    STREAMSAVE_THREAD_MESSAGE *tmsg;
+
+    // Set save function to RT priority 0
+    // This is meant to be lower priority than the data collection into buffers
+    //
+    int                RT_priority = 0;
+    struct sched_param schedpar;
+
+    schedpar.sched_priority = RT_priority;
+    if(seteuid(data.euid) != 0)  //This goes up to maximum privileges
+    {
+        PRINT_ERROR("seteuid error");
+    }
+    sched_setscheduler(0,
+                       SCHED_FIFO,
+                       &schedpar); //other option is SCHED_RR, might be faster
+    if(seteuid(data.ruid) != 0)    //Go back to normal privileges
+    {
+        PRINT_ERROR("seteuid error");
+    }
+
+    printf("===================== START SAVE THREAD =====================\n");
+    fflush(stdout);
+
+    //    tmsg = (struct savethreadmsg*) ptr;
+    tmsg = (STREAMSAVE_THREAD_MESSAGE *) ptr;
+
+    logshmim_savecube(tmsg);
+
+    tret = image_ID(tmsg->iname);
 
     printf("===================== END SAVE THREAD =====================\n");
     fflush(stdout);
@@ -497,6 +519,12 @@ errno_t COREMOD_MEMORY_logshim_printstatus(const char *IDname)
         printf(" filecnt = %lld\n", map[0].filecnt);
         printf("interval = %ld\n", map[0].interval);
         printf("logexit  = %d\n", map[0].logexit);
+        printf("  NBcube = %d\n", map[0].NBcube);
+        printf("NBwriter = %d\n", map[0].NBwriter);
+        printf("  queued = %d\n", map[0].NBcubequeued);
+        printf("inflight = %lld bytes\n", map[0].bytesinflight);
+        printf("ringfull = %lld\n", map[0].NBringfull);
+        printf(" dropped = %lld\n", map[0].NBframedropped);
 
         if(munmap(map, sizeof(LOGSHIM_CONF)) == -1)
         {
@@ -606,6 +634,120 @@ errno_t COREMOD_MEMORY_logshim_set_logexit(const char *IDname, int setv)
     return RETURN_SUCCESS;
 }
 
+// cube buffer status in writer ring
+#define LOGCUBE_FREE    0 // available for logging
+#define LOGCUBE_FILLING 1 // logger writing frames into cube
+#define LOGCUBE_QUEUED  2 // waiting for a writer thread
+#define LOGCUBE_WRITING 3 // writer thread saving cube to disk
+
+typedef struct
+{
+    imageID IDb;
+    char    iname[STRINGMAXLEN_IMGNAME];
+    int     status;
+    long    nbbyte; // size of data to be written
+
+    STREAMSAVE_THREAD_MESSAGE tmsg;
+
+    // recording time for each frame
+    double *array_time;
+    double *array_aqtime; // acquisition time
+
+    // counters
+    uint64_t *array_cnt0;
+    uint64_t *array_cnt1;
+} LOGSHMIM_CUBE;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_queued; // a cube has been queued, or exit
+    pthread_cond_t  cond_free;   // a cube has been written
+
+    int            NBcube;
+    LOGSHMIM_CUBE *cube;
+
+    // FIFO of queued cube indices
+    int *queue;
+    int  queuestart;
+    int  NBinqueue;
+
+    int writerexit; // writers exit when queue is empty
+
+    LOGSHIM_CONF *logshimconf; // stats are published there
+} LOGSHMIM_RING;
+
+/** @brief Writer thread: save queued cubes until exit
+ *
+ * Cubes are taken from the ring FIFO in order of arrival.
+ * Several writers may be saving different cubes simultaneously.
+ */
+static void *logshmim_writer_thread(void *ptr)
+{
+    LOGSHMIM_RING *ring = (LOGSHMIM_RING *) ptr;
+
+    // lower priority than the data collection into buffers
+    struct sched_param schedpar;
+    schedpar.sched_priority = 0;
+    if(seteuid(data.euid) != 0)  //This goes up to maximum privileges
+    {
+        PRINT_ERROR("seteuid error");
+    }
+    sched_setscheduler(0, SCHED_FIFO, &schedpar);
+    if(seteuid(data.ruid) != 0)  //Go back to normal privileges
+    {
+        PRINT_ERROR("seteuid error");
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    while(1)
+    {
+        while((ring->NBinqueue == 0) && (ring->writerexit == 0))
+        {
+            pthread_cond_wait(&ring->cond_queued, &ring->lock);
+        }
+        if(ring->NBinqueue == 0)
+        {
+            break;
+        }
+
+        int cubeindex    = ring->queue[ring->queuestart];
+        ring->queuestart = (ring->queuestart + 1) % ring->NBcube;
+        ring->NBinqueue--;
+        ring->cube[cubeindex].status = LOGCUBE_WRITING;
+        pthread_mutex_unlock(&ring->lock);
+
+        logshmim_savecube(&ring->cube[cubeindex].tmsg);
+
+        pthread_mutex_lock(&ring->lock);
+        ring->cube[cubeindex].status = LOGCUBE_FREE;
+        ring->logshimconf[0].NBcubequeued--;
+        ring->logshimconf[0].bytesinflight -= ring->cube[cubeindex].nbbyte;
+        pthread_cond_broadcast(&ring->cond_free);
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    return NULL;
+}
+
+/** @brief Logs a shared memory stream onto disk
+ *
+ * Same as COREMOD_MEMORY_sharedMem_2Dim_logring with 2 cube buffers and
+ * a single writer thread.
+ */
+errno_t COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
+        uint32_t    zsize,
+        const char *logdir,
+        const char *IDlogdata_name)
+{
+    return COREMOD_MEMORY_sharedMem_2Dim_logring(IDname,
+            zsize,
+            logdir,
+            IDlogdata_name,
+            2,
+            1);
+}
+
 /** @brief Logs a shared memory stream onto disk
  *
  * uses semlog semaphore
@@ -613,12 +755,23 @@ errno_t COREMOD_MEMORY_logshim_set_logexit(const char *IDname, int setv)
  * uses data cube buffer to store frames
  * if an image name logdata exists (should ideally be in shared mem),
  * then this will be included in the timing txt file
+ *
+ * Frames are written into a ring of NBcube cube buffers. Full cubes are
+ * queued to a pool of NBwriter threads which save them to disk.
+ * If the next cube buffer is still queued or being written, the logger
+ * waits for it, and frames arriving in the meantime are dropped.
+ *
+ * Ring statistics (queued cubes, bytes in flight, ring full events,
+ * dropped frames) are published in the logshimconf shared memory and,
+ * if enabled, in the processinfo status message.
  */
 errno_t __attribute__((hot))
-COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
-                                  uint32_t    zsize,
-                                  const char *logdir,
-                                  const char *IDlogdata_name)
+COREMOD_MEMORY_sharedMem_2Dim_logring(const char *IDname,
+                                      uint32_t    zsize,
+                                      const char *logdir,
+                                      const char *IDlogdata_name,
+                                      int         NBcube,
+                                      int         NBwriter)
 {
     // WAIT time. If no new frame during this time, save existing cube
     int WaitSec = 5;
@@ -627,15 +780,12 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
     uint32_t           xsize;
     uint32_t           ysize;
     imageID            IDb;
-    imageID            IDb0;
-    imageID            IDb1;
     long               index = 0;
     unsigned long long cnt   = 0;
     int                buffer;
     uint8_t            datatype;
     uint32_t          *imsizearray;
     char               fname[STRINGMAXLEN_FILENAME];
-    char               iname[STRINGMAXLEN_IMGNAME];
 
     time_t          t;
     struct tm      *uttimeStart;
@@ -654,10 +804,8 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
 
     char fnameascii[200];
 
-    pthread_t                  thread_savefits;
-    int                        tOK = 0;
-    int                        iret_savefits;
-    STREAMSAVE_THREAD_MESSAGE *tmsg = malloc(sizeof(STREAMSAVE_THREAD_MESSAGE));
+    LOGSHMIM_RING ring;
+    pthread_t    *thread_writer;
 
     long NBfiles = -1; // run forever
 
@@ -667,24 +815,17 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
     int       wOK;
     int       noframe;
 
-    char logb0name[500];
-    char logb1name[500];
-
     int is3Dcube = 0; // this is a rolling buffer
 
     LOGSHIM_CONF *logshimconf;
 
     // recording time for each frame
     double *array_time;
-    double *array_time_cp;
     double *array_aqtime; // acquisition time
-    double *array_aqtime_cp;
 
     // counters
     uint64_t *array_cnt0;
-    uint64_t *array_cnt0_cp;
     uint64_t *array_cnt1;
-    uint64_t *array_cnt1_cp;
 
     int                RT_priority = 80; //any number from 0-99
     struct sched_param schedpar;
@@ -697,6 +838,20 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
     // 1: print statements outside fast loop
     // 2: print everything
 
+    if(NBcube < 2)
+    {
+        NBcube = 2;
+    }
+    if(NBwriter < 1)
+    {
+        NBwriter = 1;
+    }
+    if(NBwriter > NBcube - 1)
+    {
+        // at most NBcube-1 cubes can be written while logger fills one
+        NBwriter = NBcube - 1;
+    }
+
     // convert wait time into number of couunter steps (counter mode only)
     cntwaitlim = (long)(WaitSec * 1000000 / waitdelayus);
 
@@ -714,6 +869,21 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         PRINT_ERROR("seteuid error");
     }
 
+    PROCESSINFO *processinfo = NULL;
+    if(data.processinfo == 1)
+    {
+        char pinfoname[STRINGMAXLEN_PROCESSINFO_NAME];
+        snprintf(pinfoname, STRINGMAXLEN_PROCESSINFO_NAME, "log-%s", IDname);
+        processinfo           = processinfo_shm_create(pinfoname, 0);
+        processinfo->loopstat = 0; // loop initialization
+
+        strcpy(processinfo->source_FUNCTION, __FUNCTION__);
+        strcpy(processinfo->source_FILE, __FILE__);
+        processinfo->source_LINE = __LINE__;
+
+        processinfo_WriteMessage(processinfo, "Waiting for input stream");
+    }
+
     IDlogdata = image_ID(IDlogdata_name);
     if(IDlogdata != -1)
     {
@@ -732,6 +902,13 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
     logshimconf[0].logexit  = 0;
     logshimconf[0].interval = 1;
 
+    logshimconf[0].NBcube         = NBcube;
+    logshimconf[0].NBwriter       = NBwriter;
+    logshimconf[0].NBcubequeued   = 0;
+    logshimconf[0].bytesinflight  = 0;
+    logshimconf[0].NBringfull     = 0;
+    logshimconf[0].NBframedropped = 0;
+
     imsizearray = (uint32_t *) malloc(sizeof(uint32_t) * 3);
 
     read_sharedmem_image(IDname);
@@ -745,40 +922,80 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         is3Dcube = 1;
     }
 
-    /** create the 2 buffers */
+    int typesize = ImageStreamIO_typesize(datatype);
+    if(typesize == -1)
+    {
+        printf("ERROR: WRONG DATA TYPE\n");
+        exit(0);
+    }
+    framesize = typesize * xsize * ysize;
+
+    /** create the NBcube buffers */
 
     imsizearray[0] = xsize;
     imsizearray[1] = ysize;
     imsizearray[2] = zsize;
 
-    sprintf(logb0name, "%s_logbuff0", IDname);
-    sprintf(logb1name, "%s_logbuff1", IDname);
-
-    create_image_ID(logb0name,
-                    3,
-                    imsizearray,
-                    datatype,
-                    1,
-                    data.image[ID].md[0].NBkw,
-                    0,
-                    &IDb0);
-    create_image_ID(logb1name,
-                    3,
-                    imsizearray,
-                    datatype,
-                    1,
-                    data.image[ID].md[0].NBkw,
-                    0,
-                    &IDb1);
-
-    // copy keywords
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.cond_queued, NULL);
+    pthread_cond_init(&ring.cond_free, NULL);
+    ring.NBcube      = NBcube;
+    ring.queuestart  = 0;
+    ring.NBinqueue   = 0;
+    ring.writerexit  = 0;
+    ring.logshimconf = logshimconf;
+
+    ring.cube = (LOGSHMIM_CUBE *) malloc(sizeof(LOGSHMIM_CUBE) * NBcube);
+    ring.queue = (int *) malloc(sizeof(int) * NBcube);
+    if((ring.cube == NULL) || (ring.queue == NULL))
     {
-        memcpy(data.image[IDb0].kw,
-               data.image[ID].kw,
-               sizeof(IMAGE_KEYWORD) * data.image[ID].md[0].NBkw);
-        memcpy(data.image[IDb1].kw,
+        PRINT_ERROR("malloc error");
+        abort();
+    }
+
+    for(int cubei = 0; cubei < NBcube; cubei++)
+    {
+        LOGSHMIM_CUBE *cube = &ring.cube[cubei];
+
+        snprintf(cube->iname, STRINGMAXLEN_IMGNAME, "%s_logbuff%d", IDname,
+                 cubei);
+        create_image_ID(cube->iname,
+                        3,
+                        imsizearray,
+                        datatype,
+                        1,
+                        data.image[ID].md[0].NBkw,
+                        0,
+                        &cube->IDb);
+
+        // copy keywords
+        memcpy(data.image[cube->IDb].kw,
                data.image[ID].kw,
                sizeof(IMAGE_KEYWORD) * data.image[ID].md[0].NBkw);
+
+        COREMOD_MEMORY_image_set_semflush(cube->iname, -1);
+
+        cube->status       = LOGCUBE_FREE;
+        cube->nbbyte       = 0;
+        cube->array_time   = (double *) malloc(sizeof(double) * zsize);
+        cube->array_aqtime = (double *) malloc(sizeof(double) * zsize);
+        cube->array_cnt0   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
+        cube->array_cnt1   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
+    }
+
+    thread_writer = (pthread_t *) malloc(sizeof(pthread_t) * NBwriter);
+    for(int wi = 0; wi < NBwriter; wi++)
+    {
+        int iret =
+            pthread_create(&thread_writer[wi], NULL, logshmim_writer_thread,
+                           &ring);
+        if(iret)
+        {
+            fprintf(stderr,
+                    "Error - pthread_create() return code: %d\n",
+                    iret);
+            exit(EXIT_FAILURE);
+        }
     }
 
     // find creation time keyword
@@ -792,36 +1009,21 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         }
     }
 
-    COREMOD_MEMORY_image_set_semflush(logb0name, -1);
-    COREMOD_MEMORY_image_set_semflush(logb1name, -1);
+    buffer                   = 0;
+    ring.cube[buffer].status = LOGCUBE_FILLING;
+    IDb                      = ring.cube[buffer].IDb;
+    array_time               = ring.cube[buffer].array_time;
+    array_aqtime             = ring.cube[buffer].array_aqtime;
+    array_cnt0               = ring.cube[buffer].array_cnt0;
+    array_cnt1               = ring.cube[buffer].array_cnt1;
 
-    array_time   = (double *) malloc(sizeof(double) * zsize);
-    array_aqtime = (double *) malloc(sizeof(double) * zsize);
-    array_cnt0   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
-    array_cnt1   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
-
-    array_time_cp   = (double *) malloc(sizeof(double) * zsize);
-    array_aqtime_cp = (double *) malloc(sizeof(double) * zsize);
-    array_cnt0_cp   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
-    array_cnt1_cp   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
-
-    IDb = IDb0;
-
-    int typesize = ImageStreamIO_typesize(datatype);
-    if(typesize == -1)
-    {
-        printf("ERROR: WRONG DATA TYPE\n");
-        exit(0);
-    }
-    framesize = typesize * xsize * ysize;
     ptr0_0 = (char *) data.image[ID].array.raw;
 
     ptr1_0 = (char *) data.image[IDb].array.raw;
 
     cnt = data.image[ID].md[0].cnt0 - 1;
 
-    buffer = 0;
-    index  = 0;
+    index = 0;
 
     printf("logdata ID = %ld\n", IDlogdata);
     list_image_ID();
@@ -845,6 +1047,11 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         }
     }
 
+    if(processinfo != NULL)
+    {
+        processinfo->loopstat = 1; // loop running
+    }
+
     while((logshimconf[0].filecnt != NBfiles) && (logshimconf[0].logexit == 0))
     {
         int timeout; // 1 if timeout has occurred
@@ -896,24 +1103,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                             index);
                     }
 
-                    strcpy(tmsg->iname, iname);
-                    strcpy(tmsg->fname, fname);
-                    tmsg->partial  = 1; // partial cube
-                    tmsg->cubesize = index;
-
-                    memcpy(array_time_cp, array_time, sizeof(double) * index);
-                    memcpy(array_aqtime_cp,
-                           array_aqtime,
-                           sizeof(double) * index);
-                    memcpy(array_cnt0_cp, array_cnt0, sizeof(uint64_t) * index);
-                    memcpy(array_cnt1_cp, array_cnt1, sizeof(uint64_t) * index);
-
-                    tmsg->arrayindex  = array_cnt0_cp;
-                    tmsg->arraycnt0   = array_cnt0_cp;
-                    tmsg->arraycnt1   = array_cnt1_cp;
-                    tmsg->arraytime   = array_time_cp;
-                    tmsg->arrayaqtime = array_aqtime_cp;
-
                     timeout = 1;
                 }
                 if(errno == EINTR)
@@ -999,21 +1188,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                             __LINE__);
                     }
 
-                    strcpy(tmsg->iname, iname);
-                    strcpy(tmsg->fname, fname);
-                    tmsg->partial  = 1; // partial cube
-                    tmsg->cubesize = index;
-
-                    memcpy(array_time_cp, array_time, sizeof(double) * index);
-                    memcpy(array_cnt0_cp, array_cnt0, sizeof(uint64_t) * index);
-                    memcpy(array_cnt1_cp, array_cnt1, sizeof(uint64_t) * index);
-
-                    tmsg->arrayindex  = array_cnt0_cp;
-                    tmsg->arraycnt0   = array_cnt0_cp;
-                    tmsg->arraycnt1   = array_cnt1_cp;
-                    tmsg->arraytime   = array_time_cp;
-                    tmsg->arrayaqtime = array_aqtime_cp;
-
                     wOK = 0;
                     if(index == 0)
                     {
@@ -1040,9 +1214,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
             t           = time(NULL);
             uttimeStart = gmtime(&t);
             clock_gettime(CLOCK_REALTIME, &timenowStart);
-
-            //     sprintf(fname,"%s/%s_%02d:%02d:%02ld.%09ld.fits", logdir, IDname, uttime->tm_hour, uttime->tm_min, timenow.tv_sec % 60, timenow.tv_nsec);
-            //            sprintf(fnameascii,"%s/%s_%02d:%02d:%02ld.%09ld.txt", logdir, IDname, uttime->tm_hour, uttime->tm_min, timenow.tv_sec % 60, timenow.tv_nsec);
         }
 
         if(VERBOSE > 1)
@@ -1064,9 +1235,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                 }
 
                 /// measure time
-                //   t = time(NULL);
-                //   uttime = gmtime(&t);
-
                 clock_gettime(CLOCK_REALTIME, &timenow);
 
                 if(is3Dcube == 1)
@@ -1096,7 +1264,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
 
                 array_cnt0[index] = data.image[ID].md[0].cnt0;
                 array_cnt1[index] = data.image[ID].md[0].cnt1;
-                //array_time[index] = uttime->tm_hour*3600.0 + uttime->tm_min*60.0 + timenow.tv_sec % 60 + 1.0e-9*timenow.tv_nsec;
                 array_time[index] = timenow.tv_sec + 1.0e-9 * timenow.tv_nsec;
                 if(aqtimekwi != -1)
                 {
@@ -1131,7 +1298,8 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         if((index > zsize - 1) || ((timeout == 1) && (index > 0)) ||
                 ((logshimconf[0].on == 0) && (index > 0)))
         {
-            long NBframemissing;
+            long                       NBframemissing;
+            STREAMSAVE_THREAD_MESSAGE *tmsg = &ring.cube[buffer].tmsg;
 
             /// save image
             if(VERBOSE > 0)
@@ -1145,16 +1313,6 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                     (long) zsize);
             }
 
-            sprintf(iname, "%s_logbuff%d", IDname, buffer);
-            if(buffer == 0)
-            {
-                IDb = IDb0;
-            }
-            else
-            {
-                IDb = IDb1;
-            }
-
             // update buffer content
             memcpy(data.image[IDb].kw,
                    data.image[ID].kw,
@@ -1189,7 +1347,7 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                     timenowStart.tv_sec % 60,
                     timenowStart.tv_nsec);
 
-            strcpy(tmsg->iname, iname);
+            strcpy(tmsg->iname, ring.cube[buffer].iname);
             strcpy(tmsg->fname, fname);
             strcpy(tmsg->fnameascii, fnameascii);
             tmsg->saveascii = 1;
@@ -1213,61 +1371,11 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
                 }
             }
 
-            {
-                long cnt0start = data.image[ID].md[0].cnt0;
-
-                // Wait for save thread to complete to launch next one
-                if(tOK == 1)
-                {
-                    if(pthread_tryjoin_np(thread_savefits, NULL) == EBUSY)
-                    {
-                        if(VERBOSE > 0)
-                        {
-                            printf(
-                                "%5d  PREVIOUS SAVE THREAD "
-                                "NOT TERMINATED -> "
-                                "waiting\n",
-                                __LINE__);
-                        }
-                        pthread_join(thread_savefits, NULL);
-                        if(VERBOSE > 0)
-                        {
-                            printf(
-                                "%5d  PREVIOUS SAVE THREAD "
-                                "NOW COMPLETED -> "
-                                "continuing\n",
-                                __LINE__);
-                        }
-                    }
-                    else
-                    {
-                        if(VERBOSE > 0)
-                        {
-                            printf(
-                                "%5d  PREVIOUS SAVE THREAD "
-                                "ALREADY COMPLETED -> OK\n",
-                                __LINE__);
-                        }
-                    }
-                }
-
-                printf("\n ************** MISSED = %ld\n",
-                       data.image[ID].md[0].cnt0 - cnt0start);
-            }
-
             COREMOD_MEMORY_image_set_sempost_byID(IDb, -1);
             data.image[IDb].md[0].cnt0++;
             data.image[IDb].md[0].write = 0;
 
             tmsg->cubesize = index;
-            strcpy(tmsg->iname, iname);
-
-            memcpy(array_time_cp, array_time, sizeof(double) * index);
-            memcpy(array_aqtime_cp, array_aqtime, sizeof(double) * index);
-
-            memcpy(array_cnt0_cp, array_cnt0, sizeof(uint64_t) * index);
-
-            memcpy(array_cnt1_cp, array_cnt1, sizeof(uint64_t) * index);
 
             NBframemissing =
                 (array_cnt0[index - 1] - array_cnt0[0]) - (index - 1);
@@ -1282,74 +1390,131 @@ COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
 
             if(VERBOSE > 0)
             {
-                printf("%5d  Starting image save thread\n", __LINE__);
+                printf("%5d  Queuing cube %d for writer threads\n",
+                       __LINE__,
+                       buffer);
                 fflush(stdout);
             }
 
-            tmsg->arrayindex  = array_cnt0_cp;
-            tmsg->arraycnt0   = array_cnt0_cp;
-            tmsg->arraycnt1   = array_cnt1_cp;
-            tmsg->arraytime   = array_time_cp;
-            tmsg->arrayaqtime = array_aqtime_cp;
+            tmsg->arrayindex  = array_cnt0;
+            tmsg->arraycnt0   = array_cnt0;
+            tmsg->arraycnt1   = array_cnt1;
+            tmsg->arraytime   = array_time;
+            tmsg->arrayaqtime = array_aqtime;
             WRITE_FILENAME(tmsg->fname_auxFITSheader,
                            "%s/%s.aux.fits",
                            data.shmdir,
                            IDname);
 
-            iret_savefits = pthread_create(&thread_savefits,
-                                           NULL,
-                                           save_fits_function,
-                                           tmsg);
+            // queue cube
+            pthread_mutex_lock(&ring.lock);
+            ring.cube[buffer].status = LOGCUBE_QUEUED;
+            ring.cube[buffer].nbbyte = framesize * index;
+            ring.queue[(ring.queuestart + ring.NBinqueue) % NBcube] = buffer;
+            ring.NBinqueue++;
+            logshimconf[0].NBcubequeued++;
+            logshimconf[0].bytesinflight += ring.cube[buffer].nbbyte;
+            logshimconf[0].NBframedropped += NBframemissing;
+            pthread_cond_signal(&ring.cond_queued);
+            pthread_mutex_unlock(&ring.lock);
 
             logshimconf[0].cnt++;
 
-            tOK = 1;
-            if(iret_savefits)
-            {
-                fprintf(stderr,
-                        "Error - pthread_create() return code: %d\n",
-                        iret_savefits);
-                exit(EXIT_FAILURE);
-            }
-
             index = 0;
             buffer++;
-            if(buffer == 2)
+            if(buffer == NBcube)
             {
                 buffer = 0;
             }
-            //            printf("[%ld -> %d]", cnt, buffer);
-            //           fflush(stdout);
-            if(buffer == 0)
-            {
-                IDb = IDb0;
-            }
-            else
+
+            // wait for next cube buffer to be available
+            pthread_mutex_lock(&ring.lock);
+            if(ring.cube[buffer].status != LOGCUBE_FREE)
             {
-                IDb = IDb1;
+                uint64_t cnt0start = data.image[ID].md[0].cnt0;
+
+                logshimconf[0].NBringfull++;
+                if(VERBOSE > 0)
+                {
+                    printf("%5d  CUBE BUFFER %d NOT WRITTEN -> waiting\n",
+                           __LINE__,
+                           buffer);
+                }
+                while(ring.cube[buffer].status != LOGCUBE_FREE)
+                {
+                    pthread_cond_wait(&ring.cond_free, &ring.lock);
+                }
+                logshimconf[0].NBframedropped +=
+                    data.image[ID].md[0].cnt0 - cnt0start;
+
+                printf("\n ************** MISSED = %ld\n",
+                       (long)(data.image[ID].md[0].cnt0 - cnt0start));
             }
+            ring.cube[buffer].status = LOGCUBE_FILLING;
+            pthread_mutex_unlock(&ring.lock);
+
+            IDb          = ring.cube[buffer].IDb;
+            array_time   = ring.cube[buffer].array_time;
+            array_aqtime = ring.cube[buffer].array_aqtime;
+            array_cnt0   = ring.cube[buffer].array_cnt0;
+            array_cnt1   = ring.cube[buffer].array_cnt1;
 
             ptr1_0 = (char *) data.image[IDb].array.raw;
 
             data.image[IDb].md[0].write = 1;
             logshimconf[0].filecnt++;
+
+            if(processinfo != NULL)
+            {
+                char msgstring[STRINGMAXLEN_PROCESSINFO_STATUSMSG];
+                snprintf(msgstring,
+                         STRINGMAXLEN_PROCESSINFO_STATUSMSG,
+                         "cube %lld  queued %d/%d  %.1f MB  full %lld  "
+                         "drop %lld",
+                         logshimconf[0].filecnt,
+                         logshimconf[0].NBcubequeued,
+                         NBcube,
+                         1.0e-6 * logshimconf[0].bytesinflight,
+                         logshimconf[0].NBringfull,
+                         logshimconf[0].NBframedropped);
+                processinfo_WriteMessage(processinfo, msgstring);
+                processinfo->loopcnt++;
+            }
         }
 
         cnt = data.image[ID].md[0].cnt0;
     }
 
-    free(imsizearray);
-    free(tmsg);
+    // let writers complete queued cubes
+    pthread_mutex_lock(&ring.lock);
+    ring.writerexit = 1;
+    pthread_cond_broadcast(&ring.cond_queued);
+    pthread_mutex_unlock(&ring.lock);
+    for(int wi = 0; wi < NBwriter; wi++)
+    {
+        pthread_join(thread_writer[wi], NULL);
+    }
+    free(thread_writer);
 
-    free(array_time);
-    free(array_aqtime);
-    free(array_cnt0);
-    free(array_cnt1);
+    for(int cubei = 0; cubei < NBcube; cubei++)
+    {
+        free(ring.cube[cubei].array_time);
+        free(ring.cube[cubei].array_aqtime);
+        free(ring.cube[cubei].array_cnt0);
+        free(ring.cube[cubei].array_cnt1);
+    }
+    free(ring.cube);
+    free(ring.queue);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.cond_queued);
+    pthread_cond_destroy(&ring.cond_free);
 
-    free(array_time_cp);
-    free(array_aqtime_cp);
-    free(array_cnt0_cp);
-    free(array_cnt1_cp);
+    free(imsizearray);
+
+    if(processinfo != NULL)
+    {
+        processinfo_cleanExit(processinfo);
+    }
 
     return RETURN_SUCCESS;
 }
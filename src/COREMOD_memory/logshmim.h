@@ -5,10 +5,16 @@
 #ifndef CLICORE_MEMORY_LOGSHMIM_H
 #define CLICORE_MEMORY_LOGSHMIM_H
 
+#include "shmimlog_types.h"
+
 errno_t logshmim_addCLIcmd();
 
+void logshmim_savecube(STREAMSAVE_THREAD_MESSAGE *tmsg);
+
 void *save_fits_function(void *ptr);
 
+LOGSHIM_CONF *COREMOD_MEMORY_logshim_create_SHMconf(const char *logshimname);
+
 errno_t COREMOD_MEMORY_logshim_printstatus(const char *IDname);
 
 errno_t COREMOD_MEMORY_logshim_set_on(const char *IDname, int setv);
@@ -20,4 +26,11 @@ errno_t COREMOD_MEMORY_sharedMem_2Dim_log(const char *IDname,
         const char *logdir,
         const char *IDlogdata_name);
 
+errno_t COREMOD_MEMORY_sharedMem_2Dim_logring(const char *IDname,
+        uint32_t    zsize,
+        const char *logdir,
+        const char *IDlogdata_name,
+        int         NBcube,
+        int         NBwriter);
+
 #endif
@@ -63,10 +63,13 @@ imageID read_sharedmem_image(
         {
             printf("read shared mem image failed -> ID = -1\n");
             fflush(stdout);
+            image->used = 0; // release slot
             ID = -1;
         }
         else
         {
+            image_ID_index_insert(IDmem);
+
             IMGID img = mkIMGID_from_name(sname);
             //DEBUG_TRACEPOINT("resolving image");
             //ID = resolveIMGID(&img, ERRMODE_ABORT);
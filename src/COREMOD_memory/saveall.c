@@ -2,6 +2,8 @@
  */
 
 #include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
 #include "create_image.h"
 #include "delete_image.h"
 #include "image_ID.h"
@@ -10,6 +12,9 @@
 
 #include "COREMOD_iofits/COREMOD_iofits.h"
 
+// copy attempts per stream before giving up on a consistent snapshot
+#define SAVEALL_SNAPSHOT_NBATTEMPT 10
+
 // ==========================================
 // Forward declaration(s)
 // ==========================================
@@ -85,27 +90,100 @@ errno_t saveall_addCLIcmd()
     return RETURN_SUCCESS;
 }
 
+/** @brief Write snapshot manifest
+ *
+ * One line per stream : name, cnt0 and time at capture, 1 if the copy
+ * did not overlap a write, and FITS file name.
+ */
+static errno_t saveall_manifest(const char      *dirname,
+                                long             imcnt,
+                                long            *IDarray,
+                                uint64_t        *cnt0array,
+                                struct timespec *tarray,
+                                int             *okarray,
+                                const char      *suffix)
+{
+    char  fname[STRINGMAXLEN_FULLFILENAME];
+    FILE *fp;
+
+    WRITE_FULLFILENAME(fname, "./%s/snapshot.txt", dirname);
+    fp = fopen(fname, "w");
+    if(fp == NULL)
+    {
+        PRINT_ERROR("cannot create file %s", fname);
+        return RETURN_FAILURE;
+    }
+
+    fprintf(fp, "# %-30s %20s %21s %3s  %s\n",
+            "stream",
+            "cnt0",
+            "capture time",
+            "ok",
+            "file");
+    for(long i = 0; i < imcnt; i++)
+    {
+        fprintf(fp,
+                "%-32s %20lu %11ld.%09ld %3d  %s%s.fits\n",
+                data.image[IDarray[i]].name,
+                (unsigned long) cnt0array[i],
+                (long) tarray[i].tv_sec,
+                (long) tarray[i].tv_nsec,
+                okarray[i],
+                data.image[IDarray[i]].name,
+                suffix);
+    }
+    fclose(fp);
+
+    return RETURN_SUCCESS;
+}
+
 //
 // save all current images/stream onto file
 //
+// Two phases, so that the snapshot is as consistent as possible across
+// streams :
+// 1 - in-memory copy of all streams, back to back. Copies are allocated
+//     beforehand. A copy is retried if the stream was written meanwhile.
+//     cnt0 and capture time are recorded for each stream.
+// 2 - copies are written to FITS files by the async save worker pool,
+//     with a manifest (snapshot.txt) listing stream, cnt0 and capture time.
+//
 errno_t COREMOD_MEMORY_SaveAll_snapshot(const char *dirname)
 {
-    long *IDarray;
-    long *IDarraycp;
-    long  i;
-    long  imcnt = 0;
-    char  imnamecp[STRINGMAXLEN_IMGNAME];
-    char  fnamecp[STRINGMAXLEN_FULLFILENAME];
-    long  ID;
+    long            *IDarray;
+    long            *IDarraycp;
+    uint64_t        *cnt0array;
+    struct timespec *tarray;
+    int             *okarray;
+    long             i;
+    long             imcnt = 0;
+    char             imnamecp[STRINGMAXLEN_IMGNAME];
+    char             fnamecp[STRINGMAXLEN_FULLFILENAME];
+    long             ID;
+    struct timespec  t0, t1;
 
     for(i = 0; i < data.NB_MAX_IMAGE; i++)
         if(data.image[i].used == 1)
         {
             imcnt++;
         }
+    if(imcnt == 0)
+    {
+        printf("no image to save\n");
+        return RETURN_SUCCESS;
+    }
 
     IDarray   = (long *) malloc(sizeof(long) * imcnt);
     IDarraycp = (long *) malloc(sizeof(long) * imcnt);
+    cnt0array = (uint64_t *) malloc(sizeof(uint64_t) * imcnt);
+    tarray    = (struct timespec *) malloc(sizeof(struct timespec) * imcnt);
+    okarray   = (int *) malloc(sizeof(int) * imcnt);
+    if((IDarray == NULL) || (IDarraycp == NULL) || (cnt0array == NULL) ||
+            (tarray == NULL) || (okarray == NULL))
+    {
+        PRINT_ERROR("malloc error");
+        abort();
+    }
 
     imcnt = 0;
     for(i = 0; i < data.NB_MAX_IMAGE; i++)
@@ -120,29 +198,114 @@ errno_t COREMOD_MEMORY_SaveAll_snapshot(const char *dirname)
     EXECUTE_SYSTEM_COMMAND("mkdir -p %s", dirname);
 
     // create array for each image
+    // data.image may be reallocated here : only keep IDs
     for(i = 0; i < imcnt; i++)
     {
         ID = IDarray[i];
         WRITE_IMAGENAME(imnamecp, "%s_cp", data.image[ID].name);
-        //printf("image %s\n", data.image[ID].name);
-        IDarraycp[i] = copy_image_ID(data.image[ID].name, imnamecp, 0);
+        delete_image_ID(imnamecp, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(imnamecp,
+                        data.image[ID].md[0].naxis,
+                        data.image[ID].md[0].size,
+                        data.image[ID].md[0].datatype,
+                        0,
+                        data.image[ID].md[0].NBkw,
+                        0,
+                        &IDarraycp[i]);
     }
 
-    list_image_ID();
+    // capture
+    milk_clock_gettime(&t0);
+    for(i = 0; i < imcnt; i++)
+    {
+        IMAGE *imsrc  = &data.image[IDarray[i]];
+        IMAGE *imdest = &data.image[IDarraycp[i]];
+        size_t nbyte  = ImageStreamIO_typesize(imsrc->md[0].datatype) *
+                        imsrc->md[0].nelement;
+
+        okarray[i] = 0;
+        for(int attempt = 0; attempt < SAVEALL_SNAPSHOT_NBATTEMPT; attempt++)
+        {
+            uint64_t cnt0 = imsrc->md[0].cnt0;
+
+            memcpy(imdest->array.raw, imsrc->array.raw, nbyte);
+            if((imsrc->md[0].write == 0) && (imsrc->md[0].cnt0 == cnt0))
+            {
+                okarray[i] = 1;
+                break;
+            }
+        }
+        cnt0array[i] = imsrc->md[0].cnt0;
+        milk_clock_gettime(&tarray[i]);
 
+        if(imsrc->md[0].NBkw > 0)
+        {
+            memcpy(imdest->kw,
+                   imsrc->kw,
+                   sizeof(IMAGE_KEYWORD) * imsrc->md[0].NBkw);
+        }
+        imdest->md[0].cnt0 = cnt0array[i];
+    }
+    milk_clock_gettime(&t1);
+
+    printf("captured %ld streams in %.3f ms\n",
+           imcnt,
+           1.0e3 * timespec_diff_double(t0, t1));
     for(i = 0; i < imcnt; i++)
     {
+        if(okarray[i] == 0)
+        {
+            PRINT_WARNING("stream %s updated during copy",
+                          data.image[IDarray[i]].name);
+        }
+    }
+
+    saveall_manifest(dirname, imcnt, IDarray, cnt0array, tarray, okarray, "");
+
+    for(i = 0; i < imcnt; i++)
+    {
+        IMAGE_KEYWORD kwarray[2];
+
+        strcpy(kwarray[0].name, "CNT0");
+        kwarray[0].type       = 'L';
+        kwarray[0].value.numl = cnt0array[i];
+        strcpy(kwarray[0].comment, "stream cnt0 at capture");
+
+        strcpy(kwarray[1].name, "SNAPTIME");
+        kwarray[1].type       = 'D';
+        kwarray[1].value.numf = tarray[i].tv_sec + 1.0e-9 * tarray[i].tv_nsec;
+        strcpy(kwarray[1].comment, "capture time [s]");
+
         ID = IDarray[i];
-        WRITE_IMAGENAME(imnamecp, "%s_cp", data.image[ID].name);
         WRITE_FULLFILENAME(fnamecp,
                            "./%s/%s.fits",
                            dirname,
                            data.image[ID].name);
-        save_fits(imnamecp, fnamecp);
+        saveFITS_async_submit(data.image[IDarraycp[i]].name,
+                              -1,
+                              fnamecp,
+                              0,
+                              "",
+                              kwarray,
+                              2);
+    }
+
+    if(saveFITS_async_waitall() != 0)
+    {
+        PRINT_ERROR("snapshot : failed to save some images");
+    }
+
+    for(i = 0; i < imcnt; i++)
+    {
+        delete_image_ID(data.image[IDarraycp[i]].name,
+                        DELETE_IMAGE_ERRMODE_WARNING);
     }
 
     free(IDarray);
     free(IDarraycp);
+    free(cnt0array);
+    free(tarray);
+    free(okarray);
 
     return RETURN_SUCCESS;
 }
@@ -170,6 +333,11 @@ errno_t COREMOD_MEMORY_SaveAll_sequ(const char *dirname,
     char     *ptr1;
     uint32_t *imsizearray;
 
+    // first frame, for manifest
+    uint64_t        *cnt0array;
+    struct timespec *tarray;
+    int             *okarray;
+
     for(i = 0; i < data.NB_MAX_IMAGE; i++)
         if(data.image[i].used == 1)
         {
@@ -187,6 +355,9 @@ errno_t COREMOD_MEMORY_SaveAll_sequ(const char *dirname,
             imcnt++;
         }
     imsizearray = (uint32_t *) malloc(sizeof(uint32_t) * imcnt);
+    cnt0array   = (uint64_t *) malloc(sizeof(uint64_t) * imcnt);
+    tarray      = (struct timespec *) malloc(sizeof(struct timespec) * imcnt);
+    okarray     = (int *) malloc(sizeof(int) * imcnt);
 
     EXECUTE_SYSTEM_COMMAND("mkdir -p %s", dirname);
 
@@ -233,6 +404,12 @@ errno_t COREMOD_MEMORY_SaveAll_sequ(const char *dirname,
             ptr0 = (char *) data.image[IDarrayout[i]].array.F;
             ptr1 = ptr0 + imsizearray[i] * frame;
             memcpy(ptr1, data.image[ID].array.F, imsizearray[i]);
+            if(frame == 0)
+            {
+                cnt0array[i] = data.image[ID].md[0].cnt0;
+                milk_clock_gettime(&tarray[i]);
+                okarray[i] = 1;
+            }
         }
         frame++;
     }
@@ -242,17 +419,32 @@ errno_t COREMOD_MEMORY_SaveAll_sequ(const char *dirname,
 
     list_image_ID();
 
+    saveall_manifest(dirname,
+                     imcnt,
+                     IDarray,
+                     cnt0array,
+                     tarray,
+                     okarray,
+                     "_out");
+
     for(i = 0; i < imcnt; i++)
     {
         ID = IDarray[i];
         sprintf(imnameout, "%s_out", data.image[ID].name);
         sprintf(fnameout, "./%s/%s_out.fits", dirname, data.image[ID].name);
-        save_fits(imnameout, fnameout);
+        saveFITS_async_submit(imnameout, -1, fnameout, 0, "", NULL, 0);
+    }
+    if(saveFITS_async_waitall() != 0)
+    {
+        PRINT_ERROR("failed to save some images");
     }
 
     free(IDarray);
     free(IDarrayout);
     free(imsizearray);
+    free(cnt0array);
+    free(tarray);
+    free(okarray);
 
     return RETURN_SUCCESS;
 }
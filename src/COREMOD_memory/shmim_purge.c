@@ -80,6 +80,7 @@ errno_t shmim_purge(const char *strfilter)
             else
             {
                 printf("Purging stream %s\n", streaminfo[sindex].sname);
+                image_ID_index_remove(ID);
                 ImageStreamIO_destroyIm(&data.image[ID]);
             }
         }
@@ -87,6 +88,7 @@ errno_t shmim_purge(const char *strfilter)
         {
             // owner unset: assumes no owner
             printf("Purging stream %s\n", streaminfo[sindex].sname);
+            image_ID_index_remove(ID);
             ImageStreamIO_destroyIm(&data.image[ID]);
         }
     }
@@ -45,6 +45,48 @@ typedef struct
 
     uint32_t CBindex; // last frame grabbed
     uint64_t CBcycle; // last frame grabbed
+
+    // cube buffer ring and writer threads
+    int       NBcube;         // number of cube buffers
+    int       NBwriter;       // number of writer threads
+    int       NBcubequeued;   // cubes queued or being written
+    long long bytesinflight;  // bytes queued or being written
+    long long NBringfull;     // times logger waited for a free cube buffer
+    long long NBframedropped; // cumulative frames not logged
 } LOGSHIM_CONF;
 
+// Raw log format
+//
+// <name>.raw    : SHMIMLOGRAW_HEADER, padded to SHMIMLOGRAW_BLOCKSIZE,
+//                 followed by frames, framesize bytes each, no padding
+// <name>.rawidx : one SHMIMLOGRAW_INDEX entry per frame
+//
+// Frame data starts on a block boundary so that the logger can append
+// aligned blocks with O_DIRECT.
+
+#define SHMIMLOGRAW_MAGIC     "MILKRAW1"
+#define SHMIMLOGRAW_BLOCKSIZE 4096
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint8_t  datatype;
+    uint8_t  naxis;       // frame naxis (2)
+    uint32_t size[2];     // frame size
+    uint64_t framesize;   // bytes per frame
+    uint64_t dataoffset;  // offset of first frame in file
+    char     iname[STRINGMAXLEN_IMGNAME]; // logged stream
+    double   tstart;      // file creation time
+} SHMIMLOGRAW_HEADER;
+
+typedef struct
+{
+    uint64_t cnt0;
+    uint64_t cnt1;
+    double   aqtime;    // acquisition time (_MAQTIME keyword), 0 if none
+    double   writetime; // time at which frame was logged
+    uint64_t offset;    // frame offset in raw file
+} SHMIMLOGRAW_INDEX;
+
 #endif
@@ -0,0 +1,671 @@
+/**
+ * @file    shmimlograw.c
+ * @brief   log stream to raw append-only file
+ *
+ * Frames are appended to <logdir>/<name>_HH:MM:SS.nnnnnnnnn.raw, and one
+ * SHMIMLOGRAW_INDEX entry per frame (cnt0, cnt1, acquisition time,
+ * write time, file offset) to the .rawidx sidecar file.
+ * See shmimlog_types.h for the format.
+ *
+ * Frames are staged in two block-aligned buffers. When one is full, it is
+ * handed to a flush thread, which writes it in large aligned blocks, with
+ * O_DIRECT if the file system supports it, bypassing the page cache, while
+ * frames go to the other buffer. No FITS formatting takes place while
+ * logging; use shmimraw2fits to convert raw files to FITS cubes.
+ *
+ * Index entries are written by the logger, and may reach disk before the
+ * data they point to : after a crash, shmimraw2fits skips index entries
+ * beyond the end of the raw file.
+ *
+ * A new file is started every NBframe frames, or after 5 sec without
+ * new frame. Logging can be paused and stopped with shmimslogonset and
+ * shmimslogexitset, as for shmimstreamlog.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "image_ID.h"
+#include "logshmim.h"
+#include "read_shmim.h"
+
+#include "shmimlog_types.h"
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+// variables local to this translation unit
+static char    *instreamname;
+static char    *logdir;
+static int64_t *NBframefile;
+static int64_t *bufMB;
+static int32_t *odirect;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_STREAM,
+        ".in_sname",
+        "input stream name",
+        "im1",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &instreamname,
+        NULL
+    },
+    {
+        CLIARG_STR,
+        ".logdir",
+        "log directory",
+        "/media/data",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &logdir,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".NBframe",
+        "number of frames per file",
+        "100000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframefile,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".bufMB",
+        "write buffer size [MB]",
+        "16",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &bufMB,
+        NULL
+    },
+    {
+        CLIARG_INT32,
+        ".odirect",
+        "use O_DIRECT if available",
+        "1",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &odirect,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"shmimlograw",
+                                "log stream to raw file + index",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    printf(
+        "Append stream frames to raw file <logdir>/<name>_<UTtime>.raw\n"
+        "with binary index <logdir>/<name>_<UTtime>.rawidx\n"
+        "A new file is started every NBframe frames, or after 5 sec\n"
+        "without new frame.\n"
+        "Convert to FITS cubes with shmimraw2fits.\n");
+
+    return RETURN_SUCCESS;
+}
+
+typedef struct
+{
+    int    fd;
+    FILE  *fpidx;
+    int    directio; // 1 if fd opened with O_DIRECT
+    char   fname[STRINGMAXLEN_FULLFILENAME];
+    long   NBframe;  // frames in current file
+    off_t  fileoffset; // data handed to flush thread, aligned
+    char  *buffarray[2]; // aligned staging buffers
+    char  *buff;     // staging buffer being filled
+    size_t buffsize;
+    size_t buffpos;  // bytes in staging buffer
+} RAWLOG_FILE;
+
+// staging buffer handed to flush thread
+typedef struct
+{
+    int    fd;
+    char  *buff;
+    size_t nbwrite; // multiple of SHMIMLOGRAW_BLOCKSIZE
+
+    // last buffer of file : truncate to filesize, close fd and fpidx
+    int   closefile;
+    off_t filesize;
+    FILE *fpidx;
+    char  fname[STRINGMAXLEN_FULLFILENAME];
+    long  NBframe;
+} RAWLOG_JOB;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_queued; // job queued, or exit
+    pthread_cond_t  cond_done;   // job written
+
+    RAWLOG_JOB job;
+    int        pending;   // 1 while job is queued or being written
+    int        flushexit; // thread exits when no job is pending
+    errno_t    status;    // RETURN_FAILURE after write error
+
+    LOGSHIM_CONF *logshimconf; // bytesinflight is published there
+} RAWLOG_FLUSH;
+
+static errno_t rawlog_writejob(RAWLOG_JOB *job)
+{
+    errno_t ret    = RETURN_SUCCESS;
+    size_t  nbdone = 0;
+
+    while(nbdone < job->nbwrite)
+    {
+        ssize_t wret = write(job->fd, job->buff + nbdone, job->nbwrite - nbdone);
+        if(wret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            PRINT_ERROR("write error on %s: %s", job->fname, strerror(errno));
+            ret = RETURN_FAILURE;
+            break;
+        }
+        nbdone += wret;
+    }
+
+    if(job->closefile == 1)
+    {
+        if((ret == RETURN_SUCCESS) && (ftruncate(job->fd, job->filesize) != 0))
+        {
+            PRINT_ERROR("ftruncate error on %s", job->fname);
+            ret = RETURN_FAILURE;
+        }
+        close(job->fd);
+        fclose(job->fpidx);
+
+        printf("%s : %ld frames\n", job->fname, job->NBframe);
+    }
+
+    return ret;
+}
+
+/** @brief Flush thread: write jobs handed by logger until exit
+ */
+static void *rawlog_flush_thread(void *ptr)
+{
+    RAWLOG_FLUSH *fl = (RAWLOG_FLUSH *) ptr;
+
+    pthread_mutex_lock(&fl->lock);
+    while(1)
+    {
+        while((fl->pending == 0) && (fl->flushexit == 0))
+        {
+            pthread_cond_wait(&fl->cond_queued, &fl->lock);
+        }
+        if(fl->pending == 0)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&fl->lock);
+
+        errno_t ret = rawlog_writejob(&fl->job);
+
+        pthread_mutex_lock(&fl->lock);
+        if(ret != RETURN_SUCCESS)
+        {
+            fl->status = RETURN_FAILURE;
+        }
+        fl->pending = 0;
+        fl->logshimconf[0].bytesinflight -= fl->job.nbwrite;
+        pthread_cond_broadcast(&fl->cond_done);
+    }
+    pthread_mutex_unlock(&fl->lock);
+
+    return NULL;
+}
+
+// wait until previous job is written
+static errno_t rawlog_flush_wait(RAWLOG_FLUSH *fl)
+{
+    pthread_mutex_lock(&fl->lock);
+    while(fl->pending == 1)
+    {
+        pthread_cond_wait(&fl->cond_done, &fl->lock);
+    }
+    errno_t ret = fl->status;
+    pthread_mutex_unlock(&fl->lock);
+
+    return ret;
+}
+
+/** @brief Hand staging buffer to flush thread, continue in other buffer
+ *
+ * Complete blocks are written, the trailing partial block is carried over
+ * to the other buffer. If flushall is set, the trailing block is written
+ * zero-padded, then the file is truncated to actual data size and closed.
+ *
+ * Waits for the previous buffer to be written : the logger only blocks if
+ * the disk is slower than the stream.
+ */
+static errno_t rawlog_flush(RAWLOG_FILE *rf, RAWLOG_FLUSH *fl, int flushall)
+{
+    RAWLOG_JOB job;
+    size_t     nbdata = rf->buffpos;
+
+    job.fd        = rf->fd;
+    job.buff      = rf->buff;
+    job.nbwrite   = nbdata - (nbdata % SHMIMLOGRAW_BLOCKSIZE);
+    job.closefile = flushall;
+    job.filesize  = rf->fileoffset + nbdata;
+    job.fpidx     = rf->fpidx;
+    job.NBframe   = rf->NBframe;
+    strcpy(job.fname, rf->fname);
+
+    if(flushall == 1)
+    {
+        job.nbwrite = nbdata + (SHMIMLOGRAW_BLOCKSIZE - 1);
+        job.nbwrite -= job.nbwrite % SHMIMLOGRAW_BLOCKSIZE;
+        memset(rf->buff + nbdata, 0, job.nbwrite - nbdata);
+    }
+
+    // other buffer is free once previous job is written
+    if(rawlog_flush_wait(fl) != RETURN_SUCCESS)
+    {
+        if(flushall == 1)
+        {
+            close(rf->fd);
+            fclose(rf->fpidx);
+            rf->fd    = -1;
+            rf->fpidx = NULL;
+        }
+        return RETURN_FAILURE;
+    }
+    char *buffnext =
+        (rf->buff == rf->buffarray[0]) ? rf->buffarray[1] : rf->buffarray[0];
+
+    if(flushall == 1)
+    {
+        rf->fileoffset += nbdata;
+        rf->buffpos = 0;
+        rf->fd      = -1;
+        rf->fpidx   = NULL;
+    }
+    else
+    {
+        rf->fileoffset += job.nbwrite;
+        rf->buffpos -= job.nbwrite;
+        memcpy(buffnext, rf->buff + job.nbwrite, rf->buffpos);
+    }
+    rf->buff = buffnext;
+
+    pthread_mutex_lock(&fl->lock);
+    fl->job     = job;
+    fl->pending = 1;
+    fl->logshimconf[0].bytesinflight += job.nbwrite;
+    pthread_cond_signal(&fl->cond_queued);
+    pthread_mutex_unlock(&fl->lock);
+
+    return RETURN_SUCCESS;
+}
+
+static errno_t rawlog_open(RAWLOG_FILE        *rf,
+                           const char         *dirname,
+                           SHMIMLOGRAW_HEADER *header,
+                           int                 usedirectio)
+{
+    struct timespec tnow;
+    struct tm       uttime;
+    char            fnameidx[STRINGMAXLEN_FULLFILENAME];
+
+    clock_gettime(CLOCK_REALTIME, &tnow);
+    gmtime_r(&tnow.tv_sec, &uttime);
+
+    WRITE_FULLFILENAME(rf->fname,
+                       "%s/%s_%02d:%02d:%02ld.%09ld.raw",
+                       dirname,
+                       header->iname,
+                       uttime.tm_hour,
+                       uttime.tm_min,
+                       tnow.tv_sec % 60,
+                       tnow.tv_nsec);
+    WRITE_FULLFILENAME(fnameidx, "%sidx", rf->fname);
+
+    rf->directio = 0;
+    rf->fd       = -1;
+    if(usedirectio == 1)
+    {
+        rf->fd = open(rf->fname, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if(rf->fd != -1)
+        {
+            rf->directio = 1;
+        }
+    }
+    if(rf->fd == -1)
+    {
+        // O_DIRECT not requested or not supported (tmpfs...)
+        rf->fd = open(rf->fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(rf->fd == -1)
+    {
+        PRINT_ERROR("cannot create file %s", rf->fname);
+        return RETURN_FAILURE;
+    }
+
+    if((rf->fpidx = fopen(fnameidx, "w")) == NULL)
+    {
+        PRINT_ERROR("cannot create file %s", fnameidx);
+        close(rf->fd);
+        return RETURN_FAILURE;
+    }
+
+    header->tstart = tnow.tv_sec + 1.0e-9 * tnow.tv_nsec;
+
+    // header block
+    memset(rf->buff, 0, SHMIMLOGRAW_BLOCKSIZE);
+    memcpy(rf->buff, header, sizeof(SHMIMLOGRAW_HEADER));
+    rf->buffpos    = header->dataoffset;
+    rf->fileoffset = 0;
+    rf->NBframe    = 0;
+
+    return RETURN_SUCCESS;
+}
+
+static errno_t rawlog_close(RAWLOG_FILE *rf, RAWLOG_FLUSH *fl)
+{
+    // last block is written zero-padded, then file is truncated to size
+    // and closed by flush thread
+    return rawlog_flush(rf, fl, 1);
+}
+
+static errno_t __attribute__((hot)) shmimlograw(const char *IDname,
+        const char *dirname,
+        long        NBframemax,
+        long        buffMB,
+        int         usedirectio)
+{
+    DEBUG_TRACE_FSTART();
+
+    SHMIMLOGRAW_HEADER header;
+    RAWLOG_FILE        rf;
+    LOGSHIM_CONF      *logshimconf;
+
+    read_sharedmem_image(IDname);
+    imageID ID = image_ID(IDname);
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("cannot connect to stream %s", IDname);
+    }
+    IMAGE *image = &data.image[ID];
+
+    int typesize = ImageStreamIO_typesize(image->md[0].datatype);
+    if(typesize == -1)
+    {
+        FUNC_RETURN_FAILURE("wrong data type");
+    }
+
+    int is3Dcube = 0; // rolling buffer, log slice cnt1
+    if(image->md[0].naxis == 3)
+    {
+        is3Dcube = 1;
+    }
+
+    memset(&header, 0, sizeof(SHMIMLOGRAW_HEADER));
+    memcpy(header.magic, SHMIMLOGRAW_MAGIC, 8);
+    header.version  = 1;
+    header.datatype = image->md[0].datatype;
+    header.naxis    = 2;
+    header.size[0]  = image->md[0].size[0];
+    header.size[1]  = image->md[0].size[1];
+    if(image->md[0].naxis == 1)
+    {
+        header.size[1] = 1;
+    }
+    header.framesize  = (uint64_t) typesize * header.size[0] * header.size[1];
+    header.dataoffset = SHMIMLOGRAW_BLOCKSIZE;
+    strncpy(header.iname, IDname, STRINGMAXLEN_IMGNAME - 1);
+
+    size_t framesize = header.framesize;
+
+    // each staging buffer holds at least 2 frames and one extra block
+    rf.buffsize = (size_t) buffMB * 1024 * 1024;
+    if(rf.buffsize < 2 * framesize + 2 * SHMIMLOGRAW_BLOCKSIZE)
+    {
+        rf.buffsize = 2 * framesize + 2 * SHMIMLOGRAW_BLOCKSIZE;
+    }
+    rf.buffsize -= rf.buffsize % SHMIMLOGRAW_BLOCKSIZE;
+    rf.buffarray[1] = NULL;
+    if((posix_memalign((void **) &rf.buffarray[0],
+                       SHMIMLOGRAW_BLOCKSIZE,
+                       rf.buffsize) != 0) ||
+            (posix_memalign((void **) &rf.buffarray[1],
+                            SHMIMLOGRAW_BLOCKSIZE,
+                            rf.buffsize) != 0))
+    {
+        free(rf.buffarray[0]);
+        free(rf.buffarray[1]);
+        FUNC_RETURN_FAILURE("posix_memalign error");
+    }
+    rf.buff = rf.buffarray[0];
+    // write staging buffer when there is no room for next frame
+    size_t buffwritelim = rf.buffsize - framesize - SHMIMLOGRAW_BLOCKSIZE;
+
+    // find creation time keyword
+    int aqtimekwi = -1;
+    for(int kwi = 0; kwi < image->md[0].NBkw; kwi++)
+    {
+        if(strcmp(image->kw[kwi].name, "_MAQTIME") == 0)
+        {
+            aqtimekwi = kwi;
+        }
+    }
+
+    logshimconf                 = COREMOD_MEMORY_logshim_create_SHMconf(IDname);
+    logshimconf[0].on           = 1;
+    logshimconf[0].cnt          = 0;
+    logshimconf[0].filecnt      = 0;
+    logshimconf[0].logexit      = 0;
+    logshimconf[0].interval     = 1;
+    logshimconf[0].NBcube       = 1;
+    logshimconf[0].NBwriter     = 0;
+    logshimconf[0].NBcubequeued = 0;
+    logshimconf[0].bytesinflight  = 0;
+    logshimconf[0].NBringfull     = 0;
+    logshimconf[0].NBframedropped = 0;
+
+    RAWLOG_FLUSH fl;
+    pthread_t    thread_flush;
+    pthread_mutex_init(&fl.lock, NULL);
+    pthread_cond_init(&fl.cond_queued, NULL);
+    pthread_cond_init(&fl.cond_done, NULL);
+    fl.pending     = 0;
+    fl.flushexit   = 0;
+    fl.status      = RETURN_SUCCESS;
+    fl.logshimconf = logshimconf;
+    pthread_create(&thread_flush, NULL, rawlog_flush_thread, &fl);
+
+    PROCESSINFO *processinfo = NULL;
+    if(data.processinfo == 1)
+    {
+        char pinfoname[STRINGMAXLEN_PROCESSINFO_NAME];
+        snprintf(pinfoname,
+                 STRINGMAXLEN_PROCESSINFO_NAME,
+                 "lograw-%s",
+                 IDname);
+        processinfo           = processinfo_shm_create(pinfoname, 0);
+        processinfo->loopstat = 1;
+
+        strcpy(processinfo->source_FUNCTION, __FUNCTION__);
+        strcpy(processinfo->source_FILE, __FILE__);
+        processinfo->source_LINE = __LINE__;
+    }
+
+    // If no new frame during this time, close current file
+    int WaitSec = 5;
+
+    int semindex = ImageStreamIO_getsemwaitindex(image, 0);
+    ImageStreamIO_semflush(image, semindex);
+
+    rf.fd       = -1;
+    uint64_t cnt0prev = image->md[0].cnt0;
+    int      loopOK   = 1;
+    while(loopOK == 1)
+    {
+        struct timespec ts;
+        struct timespec tnow;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += WaitSec;
+        int semr = ImageStreamIO_semtimedwait(image, semindex, &ts);
+
+        if((data.signal_INT == 1) || (data.signal_TERM == 1) ||
+                (logshimconf[0].logexit == 1))
+        {
+            loopOK = 0;
+        }
+
+        if((semr != 0) || (logshimconf[0].on == 0) || (loopOK == 0))
+        {
+            // close file while idle, so that it can be converted
+            if((rf.fd != -1) && ((semr != 0) || (logshimconf[0].on == 0)))
+            {
+                if(rawlog_close(&rf, &fl) != RETURN_SUCCESS)
+                {
+                    loopOK = 0;
+                }
+            }
+            cnt0prev = image->md[0].cnt0;
+            continue;
+        }
+
+        // extra posts from a backed-up semaphore : frame already logged
+        if(image->md[0].cnt0 == cnt0prev)
+        {
+            continue;
+        }
+
+        if(unlikely(rf.fd == -1))
+        {
+            if(rawlog_open(&rf, dirname, &header, usedirectio) !=
+                    RETURN_SUCCESS)
+            {
+                break;
+            }
+            logshimconf[0].filecnt++;
+            strcpy(logshimconf[0].fname, rf.fname);
+            if(processinfo != NULL)
+            {
+                char msgstring[STRINGMAXLEN_PROCESSINFO_STATUSMSG];
+                snprintf(msgstring,
+                         STRINGMAXLEN_PROCESSINFO_STATUSMSG,
+                         "file %lld %s  drop %lld",
+                         logshimconf[0].filecnt,
+                         rf.directio ? "O_DIRECT" : "buffered",
+                         logshimconf[0].NBframedropped);
+                processinfo_WriteMessage(processinfo, msgstring);
+            }
+        }
+
+        clock_gettime(CLOCK_REALTIME, &tnow);
+
+        SHMIMLOGRAW_INDEX idx;
+        idx.cnt0      = image->md[0].cnt0;
+        idx.cnt1      = image->md[0].cnt1;
+        idx.writetime = tnow.tv_sec + 1.0e-9 * tnow.tv_nsec;
+        idx.aqtime    = 0.0;
+        if(aqtimekwi != -1)
+        {
+            idx.aqtime = 1.0e-6 * image->kw[aqtimekwi].value.numl;
+        }
+        idx.offset = rf.fileoffset + rf.buffpos;
+
+        char *ptr0 = (char *) image->array.raw;
+        if(is3Dcube == 1)
+        {
+            ptr0 += framesize * idx.cnt1;
+        }
+        memcpy(rf.buff + rf.buffpos, ptr0, framesize);
+        rf.buffpos += framesize;
+        fwrite(&idx, sizeof(SHMIMLOGRAW_INDEX), 1, rf.fpidx);
+
+        if(idx.cnt0 > cnt0prev + 1)
+        {
+            logshimconf[0].NBframedropped += idx.cnt0 - cnt0prev - 1;
+        }
+        cnt0prev = idx.cnt0;
+
+        rf.NBframe++;
+        logshimconf[0].cnt++;
+
+        if(rf.NBframe == NBframemax)
+        {
+            if(rawlog_close(&rf, &fl) != RETURN_SUCCESS)
+            {
+                loopOK = 0;
+            }
+        }
+        else if(rf.buffpos > buffwritelim)
+        {
+            if(rawlog_flush(&rf, &fl, 0) != RETURN_SUCCESS)
+            {
+                loopOK = 0;
+            }
+        }
+
+        if(processinfo != NULL)
+        {
+            processinfo->loopcnt++;
+        }
+    }
+
+    if(rf.fd != -1)
+    {
+        rawlog_close(&rf, &fl);
+    }
+    rawlog_flush_wait(&fl);
+    pthread_mutex_lock(&fl.lock);
+    fl.flushexit = 1;
+    pthread_cond_signal(&fl.cond_queued);
+    pthread_mutex_unlock(&fl.lock);
+    pthread_join(thread_flush, NULL);
+    pthread_mutex_destroy(&fl.lock);
+    pthread_cond_destroy(&fl.cond_queued);
+    pthread_cond_destroy(&fl.cond_done);
+    free(rf.buffarray[0]);
+    free(rf.buffarray[1]);
+
+    if(processinfo != NULL)
+    {
+        processinfo_cleanExit(processinfo);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    FUNC_CHECK_RETURN(
+        shmimlograw(instreamname, logdir, *NBframefile, *bufMB, *odirect));
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_COREMOD_memory__shmimlograw()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
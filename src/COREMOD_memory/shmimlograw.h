@@ -0,0 +1,10 @@
+/**
+ * @file    shmimlograw.h
+ */
+
+#ifndef COREMOD_MEMORY_SHMIMLOGRAW_H
+#define COREMOD_MEMORY_SHMIMLOGRAW_H
+
+errno_t CLIADDCMD_COREMOD_memory__shmimlograw();
+
+#endif
@@ -0,0 +1,267 @@
+/**
+ * @file    shmimraw2fits.c
+ * @brief   convert raw stream log to FITS cubes
+ *
+ * Reads a .raw file and its .rawidx index written by shmimlograw, and
+ * writes FITS cubes and ASCII timing files identical to the ones written
+ * by shmimstreamlog.
+ * Frames listed in the index but not present in the raw file (logger
+ * interrupted : index entries may reach disk before frame data) are
+ * skipped.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "create_image.h"
+#include "delete_image.h"
+#include "logshmim.h"
+
+#include "shmimlog_types.h"
+
+// variables local to this translation unit
+static char    *rawfname;
+static int64_t *cubesize;
+static char    *outdir;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_FILENAME,
+        ".rawfname",
+        "raw log file",
+        "im.raw",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &rawfname,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".cubesize",
+        "cube size",
+        "10000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &cubesize,
+        NULL
+    },
+    {
+        CLIARG_STR,
+        ".outdir",
+        "output directory",
+        ".",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &outdir,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"shmimraw2fits",
+                                "convert raw stream log to FITS cubes",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    printf(
+        "Convert raw log <name>.raw and index <name>.rawidx written by\n"
+        "shmimlograw into FITS cubes of cubesize frames in outdir.\n"
+        "Each cube has an ASCII timing file (.txt) with cnt0, cnt1, logging\n"
+        "and acquisition times, as written by shmimstreamlog.\n"
+        "Files are named from the logging time of the cube's first frame.\n"
+        "The last cube holds the remaining frames. Frames missing from an\n"
+        "interrupted raw file are skipped.\n");
+
+    return RETURN_SUCCESS;
+}
+
+static errno_t shmimraw2fits(const char *fname,
+                             long        zsize,
+                             const char *dirname)
+{
+    DEBUG_TRACE_FSTART();
+
+    SHMIMLOGRAW_HEADER header;
+    struct stat        file_stat;
+    char               fnameidx[STRINGMAXLEN_FULLFILENAME];
+
+    if(zsize < 1)
+    {
+        zsize = 1;
+    }
+
+    int fd = open(fname, O_RDONLY);
+    if(fd == -1)
+    {
+        FUNC_RETURN_FAILURE("cannot open file %s", fname);
+    }
+    fstat(fd, &file_stat);
+    if((file_stat.st_size < (off_t) sizeof(SHMIMLOGRAW_HEADER)) ||
+            (pread(fd, &header, sizeof(SHMIMLOGRAW_HEADER), 0) !=
+             (ssize_t) sizeof(SHMIMLOGRAW_HEADER)) ||
+            (memcmp(header.magic, SHMIMLOGRAW_MAGIC, 8) != 0))
+    {
+        close(fd);
+        FUNC_RETURN_FAILURE("%s is not a raw log file", fname);
+    }
+
+    char *map =
+        (char *) mmap(0, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        FUNC_RETURN_FAILURE("cannot mmap file %s", fname);
+    }
+    madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+
+    // load index
+    WRITE_FULLFILENAME(fnameidx, "%sidx", fname);
+    FILE *fpidx = fopen(fnameidx, "r");
+    if(fpidx == NULL)
+    {
+        munmap(map, file_stat.st_size);
+        FUNC_RETURN_FAILURE("cannot open index file %s", fnameidx);
+    }
+    fseek(fpidx, 0, SEEK_END);
+    long NBidx = ftell(fpidx) / sizeof(SHMIMLOGRAW_INDEX);
+    fseek(fpidx, 0, SEEK_SET);
+
+    SHMIMLOGRAW_INDEX *idxarray =
+        (SHMIMLOGRAW_INDEX *) malloc(sizeof(SHMIMLOGRAW_INDEX) * (NBidx + 1));
+    NBidx = fread(idxarray, sizeof(SHMIMLOGRAW_INDEX), NBidx, fpidx);
+    fclose(fpidx);
+
+    long NBframe = 0;
+    while((NBframe < NBidx) &&
+            (idxarray[NBframe].offset + header.framesize <=
+             (uint64_t) file_stat.st_size))
+    {
+        NBframe++;
+    }
+    printf("%s : %ld frames (%ld in index)  %u x %u\n",
+           fname,
+           NBframe,
+           NBidx,
+           header.size[0],
+           header.size[1]);
+
+    if(zsize > NBframe)
+    {
+        zsize = NBframe;
+    }
+
+    imageID                   IDb = -1;
+    STREAMSAVE_THREAD_MESSAGE tmsg;
+    uint64_t                 *array_cnt0 = NULL;
+    uint64_t                 *array_cnt1 = NULL;
+    double                   *array_time = NULL;
+    double                   *array_aqtime = NULL;
+
+    if(NBframe > 0)
+    {
+        uint32_t imsize[3] = {header.size[0], header.size[1], (uint32_t) zsize};
+
+        strcpy(tmsg.iname, "_raw2fits_buff");
+        delete_image_ID(tmsg.iname, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(tmsg.iname, 3, imsize, header.datatype, 0, 0, 0, &IDb);
+
+        array_cnt0   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
+        array_cnt1   = (uint64_t *) malloc(sizeof(uint64_t) * zsize);
+        array_time   = (double *) malloc(sizeof(double) * zsize);
+        array_aqtime = (double *) malloc(sizeof(double) * zsize);
+    }
+
+    tmsg.saveascii              = 1;
+    tmsg.fname_auxFITSheader[0] = '\0';
+    tmsg.arrayindex             = array_cnt0;
+    tmsg.arraycnt0              = array_cnt0;
+    tmsg.arraycnt1              = array_cnt1;
+    tmsg.arraytime              = array_time;
+    tmsg.arrayaqtime            = array_aqtime;
+
+    long index = 0;
+    for(long frame = 0; frame < NBframe; frame++)
+    {
+        memcpy((char *) data.image[IDb].array.raw + header.framesize * index,
+               map + idxarray[frame].offset,
+               header.framesize);
+        array_cnt0[index]   = idxarray[frame].cnt0;
+        array_cnt1[index]   = idxarray[frame].cnt1;
+        array_time[index]   = idxarray[frame].writetime;
+        array_aqtime[index] = idxarray[frame].aqtime;
+        index++;
+
+        if((index == zsize) || (frame == NBframe - 1))
+        {
+            // file name from logging time of first frame, as shmimstreamlog
+            struct tm uttime;
+            time_t    tsec = (time_t) array_time[0];
+            long      tnsec =
+                (long)((array_time[0] - tsec) * 1.0e9);
+            gmtime_r(&tsec, &uttime);
+
+            WRITE_FULLFILENAME(tmsg.fname,
+                               "%s/%s_%02d:%02d:%02ld.%09ld.fits",
+                               dirname,
+                               header.iname,
+                               uttime.tm_hour,
+                               uttime.tm_min,
+                               (long)(tsec % 60),
+                               tnsec);
+            WRITE_FULLFILENAME(tmsg.fnameascii,
+                               "%s/%s_%02d:%02d:%02ld.%09ld.txt",
+                               dirname,
+                               header.iname,
+                               uttime.tm_hour,
+                               uttime.tm_min,
+                               (long)(tsec % 60),
+                               tnsec);
+
+            tmsg.cubesize = index;
+            tmsg.partial  = (index < zsize) ? 1 : 0;
+
+            logshmim_savecube(&tmsg);
+
+            index = 0;
+        }
+    }
+
+    if(IDb != -1)
+    {
+        delete_image_ID(tmsg.iname, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+    free(array_cnt0);
+    free(array_cnt1);
+    free(array_time);
+    free(array_aqtime);
+    free(idxarray);
+    munmap(map, file_stat.st_size);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    FUNC_CHECK_RETURN(shmimraw2fits(rawfname, *cubesize, outdir));
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_COREMOD_memory__shmimraw2fits()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    shmimraw2fits.h
+ */
+
+#ifndef COREMOD_MEMORY_SHMIMRAW2FITS_H
+#define COREMOD_MEMORY_SHMIMRAW2FITS_H
+
+errno_t CLIADDCMD_COREMOD_memory__shmimraw2fits();
+
+#endif
@@ -1,12 +1,32 @@
 /**
  * @file    stream_TCP.c
  * @brief   TCP stream transfer
+ *
+ * Each frame is followed by TCP_BUFFER_METADATA : counters, and source /
+ * transmit timestamps used by the receiver for latency tracing (see
+ * stream_latency.c). Transmitter and receiver must be built from the same
+ * version.
+ *
+ * Connection starts with the stream IMAGE_METADATA, followed by
+ * TCP_HANDSHAKE : protocol magic and version, and frame encoding. The
+ * receiver stops if magic or version do not match (transmitter built from
+ * another version).
+ *
+ * Frames may be encoded (stream_codec.c). The transmitter sends the
+ * STREAM_CODEC_* flags in TCP_HANDSHAKE, the receiver decodes accordingly. Encoded frames are sent as
+ * TCP_BUFFER_METADATA followed by encsize bytes of encoded pixel data and
+ * keywords. Delta coding relies on every frame being received, in order :
+ * it is not offered on UDP transfers, which may drop frames.
  */
 
 #include <arpa/inet.h>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <sched.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "CommandLineInterface/CLIcore.h"
 #include "create_image.h"
@@ -14,15 +34,56 @@
 #include "image_ID.h"
 #include "list_image.h"
 #include "read_shmim.h"
+#include "stream_codec.h"
+#include "stream_latency.h"
 #include "stream_sem.h"
+#include "stream_TCP.h"
 
 // set to 1 if transfering keywords
 static int TCPTRANSFERKW = 1;
 
+// max number of MSG_ZEROCOPY sends awaiting kernel completion
+// transmit loop blocks on completion queue beyond this
+#define TCP_ZEROCOPY_MAXINFLIGHT 16
+
+// max wait for MSG_ZEROCOPY completions [ms]
+// transmit loop stops if peer does not acknowledge data within this time
+#define TCP_ZEROCOPY_TIMEOUT_MS 5000
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// TCP_HANDSHAKE magic and version
+// increment version when handshake or frame format changes
+#define TCPSTREAM_MAGIC   0x736E746D
+#define TCPSTREAM_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;   // TCPSTREAM_MAGIC
+    uint32_t version; // TCPSTREAM_VERSION
+    int32_t  codec;   // STREAM_CODEC_* flags, 0 : frames not encoded
+    int32_t  reserved;
+} TCP_HANDSHAKE;
+
 typedef struct
 {
     long cnt0;
     long cnt1;
+
+    // CLOCK_REALTIME [ns], 0 if unset
+    int64_t atime;     // source md.atime
+    int64_t writetime; // source md.writetime
+    int64_t txtime;    // frame handed to send()
+
+    // encoded frames only
+    int64_t encsize;    // encoded pixel data + keywords [byte]
+    int64_t frameflags; // STREAM_CODEC_FRAME_* flags
 } TCP_BUFFER_METADATA;
 
 // ==========================================
@@ -118,9 +179,11 @@ errno_t stream__TCP_addCLIcmd()
     RegisterCLIcommand("imnetwtransmit",
                        __FILE__,
                        COREMOD_MEMORY_image_NETWORKtransmit__cli,
-                       "transmit image over network",
-                       "<image> <IP addr> <port [long]> <sync mode [int]>",
-                       "imnetwtransmit im1 127.0.0.1 0 8888 0",
+                       "transmit image over network. mode flags: 1 sync on "
+                       "counter, 2 scatter-gather send, 4 MSG_ZEROCOPY, "
+                       "8 delta, 16 shuffle, 32 zero-run encoding",
+                       "<image> <IP addr> <port [long]> <mode [int]> <RT priority>",
+                       "imnetwtransmit im1 127.0.0.1 8888 2 80",
                        "long COREMOD_MEMORY_image_NETWORKtransmit(const char "
                        "*IDname, const char *IPaddr, int port, int mode)");
 
@@ -237,8 +300,190 @@ errno_t COREMOD_MEMORY_testfunction_semaphore(const char *IDname,
     return RETURN_SUCCESS;
 }
 
+/** @brief Send full iovec array, resuming after partial sends
+ *
+ * iov entries are modified in place.
+ * Returns total number of bytes sent, or -1 on error.
+ * Each call to sendmsg() with MSG_ZEROCOPY yields one completion ID,
+ * the number of calls is added to *nbcall if non-NULL.
+ */
+ssize_t TCP_sendmsg_all(
+    int fd, struct iovec *iov, int iovcnt, int flags, uint32_t *nbcall)
+{
+    struct msghdr msg;
+    ssize_t       totsent = 0;
+
+    while(iovcnt > 0)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t rs = sendmsg(fd, &msg, flags);
+        if(rs < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if(nbcall != NULL)
+        {
+            (*nbcall)++;
+        }
+        totsent += rs;
+
+        // skip fully sent entries, advance into partially sent one
+        while((iovcnt > 0) && ((size_t) rs >= iov->iov_len))
+        {
+            rs -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + rs;
+            iov->iov_len -= rs;
+        }
+    }
+
+    return totsent;
+}
+
+/** @brief Reap MSG_ZEROCOPY completions from socket error queue
+ *
+ * Completion IDs are consecutive, starting at 0 for the first
+ * zerocopy sendmsg() call on the socket. Updates *zc_done to one past
+ * the highest completed ID. *zc_copied is incremented when the kernel
+ * reports it had to fall back to copying (e.g. loopback device).
+ *
+ * Waits at most timeout_ms [ms] for a first notification, 0 : do not wait.
+ * Returns RETURN_SUCCESS on timeout, caller checks *zc_done.
+ */
+static errno_t TCP_zerocopy_reap(
+    int fd, long timeout_ms, uint32_t *zc_done, long *zc_copied)
+{
+    for(;;)
+    {
+        char           control[100];
+        struct msghdr  msg;
+        struct cmsghdr *cm;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if(recvmsg(fd, &msg, MSG_ERRQUEUE) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                if(timeout_ms <= 0)
+                {
+                    return RETURN_SUCCESS;
+                }
+                struct pollfd pfd;
+                pfd.fd      = fd;
+                pfd.events  = 0; // POLLERR is always reported
+                pfd.revents = 0;
+                int pret    = poll(&pfd, 1, (int) timeout_ms);
+                if(pret < 0)
+                {
+                    return (errno == EINTR) ? RETURN_SUCCESS : RETURN_FAILURE;
+                }
+                if(pret == 0)
+                {
+                    return RETURN_SUCCESS;
+                }
+                timeout_ms = 0; // notification queued
+                continue;
+            }
+            return RETURN_FAILURE;
+        }
+
+        for(cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if(!(((cm->cmsg_level == SOL_IP) && (cm->cmsg_type == IP_RECVERR)) ||
+                    ((cm->cmsg_level == SOL_IPV6) &&
+                     (cm->cmsg_type == IPV6_RECVERR))))
+            {
+                continue;
+            }
+            struct sock_extended_err *serr =
+                (struct sock_extended_err *) CMSG_DATA(cm);
+            if((serr->ee_errno != 0) ||
+                    (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+            {
+                continue;
+            }
+            // range [ee_info, ee_data] has completed
+            if(serr->ee_data + 1 - *zc_done < 0x80000000u)
+            {
+                *zc_done = serr->ee_data + 1;
+            }
+            if(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                (*zc_copied)++;
+            }
+        }
+        timeout_ms = 0; // got one, drain remaining without waiting
+    }
+}
+
+/** @brief Wait until at most maxinflight MSG_ZEROCOPY sends are pending
+ *
+ * Returns RETURN_FAILURE on socket error, or if completions did not arrive
+ * within TCP_ZEROCOPY_TIMEOUT_MS.
+ */
+static errno_t TCP_zerocopy_wait(int       fd,
+                                 uint32_t  zc_sent,
+                                 uint32_t  maxinflight,
+                                 uint32_t *zc_done,
+                                 long     *zc_copied)
+{
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while(zc_sent - *zc_done > maxinflight)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        long dtms = 1000L * (t1.tv_sec - t0.tv_sec) +
+                    (t1.tv_nsec - t0.tv_nsec) / 1000000L;
+        if(dtms >= TCP_ZEROCOPY_TIMEOUT_MS)
+        {
+            return RETURN_FAILURE;
+        }
+        if(TCP_zerocopy_reap(fd,
+                             TCP_ZEROCOPY_TIMEOUT_MS - dtms,
+                             zc_done,
+                             zc_copied) != RETURN_SUCCESS)
+        {
+            return RETURN_FAILURE;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
 /** continuously transmits 2D image through TCP link
- * mode = 1, force counter to be used for synchronization, ignore semaphores if they exist
+ *
+ * mode is a combination of NETWORKTRANSMIT_MODE_* flags (see stream_TCP.h) :
+ * - COUNTER     : force counter to be used for synchronization, ignore semaphores if they exist
+ * - SGSEND      : no staging buffer, scatter-gather send from stream memory
+ * - MSGZEROCOPY : SGSEND + pixel data sent with MSG_ZEROCOPY
+ * - DELTA, SHUFFLE, RLE : frame encoding, see stream_codec.h
+ *
+ * Without encoding, the byte stream is identical in all modes. The encoding
+ * is announced to the receiver in the handshake.
+ *
+ * With MSGZEROCOPY, the kernel reads pixels from the stream after sendmsg()
+ * returns, so a slice overwritten by the writer before completion is sent
+ * with the new content. Use a circular buffer (size[2] > 1) stream to avoid
+ * this.
  */
 
 imageID COREMOD_MEMORY_image_NETWORKtransmit(
@@ -259,6 +504,7 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
     int                rs;
 
     struct timespec ts;
+    struct timespec tnow;
     long            scnt;
     int             semval;
     int             semr;
@@ -274,6 +520,21 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
     // IMPORTANT: do not use semtrig 0
     int UseSem = 1;
 
+    // scatter-gather / zero-copy send
+    int          SGsend     = 0;
+    int          ZCsend     = 0;
+    uint32_t     zc_sent    = 0; // number of MSG_ZEROCOPY sendmsg() calls
+    uint32_t     zc_done    = 0; // number of completed calls
+    long         zc_copied  = 0; // completions where kernel copied anyway
+    struct iovec iov[3];
+
+    // frame encoding
+    int          codec = (mode >> NETWORKTRANSMIT_MODE_CODEC_SHIFT) &
+                         STREAM_CODEC_ALL;
+    STREAM_CODEC cd;
+    char        *encbuf = NULL;
+    long         txsize; // bytes sent for current frame
+
     char errmsg[200];
 
     printf("Transmit stream %s over IP %s port %d\n", IDname, IPaddr, port);
@@ -334,6 +595,37 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
         loopOK = 0;
     }
 
+    if(mode & (NETWORKTRANSMIT_MODE_SGSEND | NETWORKTRANSMIT_MODE_MSGZEROCOPY))
+    {
+        if(codec == 0)
+        {
+            SGsend = 1;
+        }
+        else
+        {
+            // encoded frame is a copy
+            processinfo_WriteMessage(processinfo,
+                                     "encoding : SGSEND/MSGZEROCOPY ignored");
+            mode &= ~NETWORKTRANSMIT_MODE_MSGZEROCOPY;
+        }
+    }
+
+    if((loopOK == 1) && (mode & NETWORKTRANSMIT_MODE_MSGZEROCOPY))
+    {
+        if(setsockopt(fds_client, SOL_SOCKET, SO_ZEROCOPY, &flag, sizeof(flag)) ==
+                0)
+        {
+            ZCsend = 1;
+        }
+        else
+        {
+            // kernel < 4.14 : scatter-gather without MSG_ZEROCOPY
+            perror("setsockopt SO_ZEROCOPY");
+            processinfo_WriteMessage(processinfo,
+                                     "SO_ZEROCOPY unsupported, using sendmsg");
+        }
+    }
+
     if(loopOK == 1)
     {
         memset((char *) &sock_server, 0, sizeof(sock_server));
@@ -371,6 +663,22 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
         }
     }
 
+    if(loopOK == 1)
+    {
+        TCP_HANDSHAKE handshake;
+        memset(&handshake, 0, sizeof(TCP_HANDSHAKE));
+        handshake.magic   = TCPSTREAM_MAGIC;
+        handshake.version = TCPSTREAM_VERSION;
+        handshake.codec   = codec;
+
+        if(send(fds_client, (void *) &handshake, sizeof(TCP_HANDSHAKE), 0) !=
+                sizeof(TCP_HANDSHAKE))
+        {
+            processinfo_error(processinfo, "ERROR: handshake send() failed");
+            loopOK = 0;
+        }
+    }
+
     if(loopOK == 1)
     {
         xsize    = img_p->md[0].size[0];
@@ -407,7 +715,7 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
     {
         ptr0 = (char *) img_p->array.raw;
 
-        frame_md = (TCP_BUFFER_METADATA *) malloc(sizeof(TCP_BUFFER_METADATA));
+        frame_md = (TCP_BUFFER_METADATA *) calloc(1, sizeof(TCP_BUFFER_METADATA));
         framesize1 = framesize + sizeof(TCP_BUFFER_METADATA);
 
         if(TCPTRANSFERKW == 0)
@@ -420,7 +728,38 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
                 framesize1 + img_p->md[0].NBkw * sizeof(IMAGE_KEYWORD);
         }
 
-        buff = (char *) malloc(sizeof(char) * framesizeall);
+        if(SGsend == 0)
+        {
+            buff = (char *) malloc(sizeof(char) * framesizeall);
+        }
+        else
+        {
+            buff = NULL;
+        }
+
+        if(codec != 0)
+        {
+            int elemsize = ImageStreamIO_typesize(img_p->md[0].datatype);
+
+            if(stream_codec_init(&cd,
+                                 codec,
+                                 framesize / elemsize,
+                                 elemsize,
+                                 framesizeall - framesize1) != RETURN_SUCCESS)
+            {
+                processinfo_error(processinfo, "ERROR: codec init failed");
+                loopOK = 0;
+            }
+            else
+            {
+                encbuf = (char *) malloc(stream_codec_maxsize(&cd));
+                if(encbuf == NULL)
+                {
+                    processinfo_error(processinfo, "ERROR: malloc encbuf");
+                    loopOK = 0;
+                }
+            }
+        }
 
         printf("transfer buffer size = %ld\n", framesizeall);
         fflush(stdout);
@@ -431,7 +770,7 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
         fflush(stdout);
     }
 
-    if((img_p->md[0].sem == 0) || (mode == 1))
+    if((img_p->md[0].sem == 0) || (mode & NETWORKTRANSMIT_MODE_COUNTER))
     {
         processinfo_WriteMessage(processinfo, "sync using counter");
         UseSem = 0;
@@ -504,8 +843,12 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
 
             if(semr == 0)
             {
-                frame_md[0].cnt0 = img_p->md[0].cnt0;
-                frame_md[0].cnt1 = img_p->md[0].cnt1;
+                int sendOK = 1; // 0 : frame not sent, error already reported
+
+                frame_md[0].cnt0      = img_p->md[0].cnt0;
+                frame_md[0].cnt1      = img_p->md[0].cnt1;
+                frame_md[0].atime     = stream_latency_ns(img_p->md[0].atime);
+                frame_md[0].writetime = stream_latency_ns(img_p->md[0].writetime);
 
                 slice = img_p->md[0].cnt1;
                 if(slice > oldslice + 1)
@@ -528,19 +871,98 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
                     ptr0 +
                     framesize *
                     slice; //img_p->md[0].cnt1; // frame that was just written
-                memcpy(buff, ptr1, framesize);
-                memcpy(buff + framesize, frame_md, sizeof(TCP_BUFFER_METADATA));
 
-                if(TCPTRANSFERKW == 1)
+                txsize = framesizeall;
+                if(codec != 0)
                 {
-                    memcpy(buff + framesize1,
-                           (char *) img_p->kw,
-                           img_p->md[0].NBkw * sizeof(IMAGE_KEYWORD));
+                    int frameflags;
+
+                    // metadata first : receiver needs encoded size
+                    frame_md[0].encsize = stream_codec_encode(&cd,
+                                          ptr1,
+                                          (char *) img_p->kw,
+                                          encbuf,
+                                          &frameflags);
+                    frame_md[0].frameflags = frameflags;
+                    clock_gettime(CLOCK_REALTIME, &tnow);
+                    frame_md[0].txtime = stream_latency_ns(tnow);
+
+                    iov[0].iov_base = frame_md;
+                    iov[0].iov_len  = sizeof(TCP_BUFFER_METADATA);
+                    iov[1].iov_base = encbuf;
+                    iov[1].iov_len  = frame_md[0].encsize;
+                    txsize = sizeof(TCP_BUFFER_METADATA) + frame_md[0].encsize;
+
+                    rs = TCP_sendmsg_all(fds_client, iov, 2, 0, NULL);
                 }
+                else if(SGsend == 0)
+                {
+                    memcpy(buff, ptr1, framesize);
+                    clock_gettime(CLOCK_REALTIME, &tnow);
+                    frame_md[0].txtime = stream_latency_ns(tnow);
+                    memcpy(buff + framesize,
+                           frame_md,
+                           sizeof(TCP_BUFFER_METADATA));
+
+                    if(TCPTRANSFERKW == 1)
+                    {
+                        memcpy(buff + framesize1,
+                               (char *) img_p->kw,
+                               img_p->md[0].NBkw * sizeof(IMAGE_KEYWORD));
+                    }
 
-                rs = send(fds_client, buff, framesizeall, 0);
+                    rs = send(fds_client, buff, framesizeall, 0);
+                }
+                else
+                {
+                    clock_gettime(CLOCK_REALTIME, &tnow);
+                    frame_md[0].txtime = stream_latency_ns(tnow);
+
+                    iov[0].iov_base = ptr1;
+                    iov[0].iov_len  = framesize;
+                    iov[1].iov_base = frame_md;
+                    iov[1].iov_len  = sizeof(TCP_BUFFER_METADATA);
+                    iov[2].iov_base = img_p->kw;
+                    iov[2].iov_len  = framesizeall - framesize1;
 
-                if(rs != framesizeall)
+                    if(ZCsend == 0)
+                    {
+                        rs = TCP_sendmsg_all(fds_client, iov, 3, 0, NULL);
+                    }
+                    else if(TCP_zerocopy_wait(fds_client,
+                                              zc_sent,
+                                              TCP_ZEROCOPY_MAXINFLIGHT - 1,
+                                              &zc_done,
+                                              &zc_copied) != RETURN_SUCCESS)
+                    {
+                        // bound pinned memory : peer not acknowledging
+                        processinfo_WriteMessage(processinfo,
+                                                 "MSG_ZEROCOPY completion "
+                                                 "error or timeout");
+                        sendOK = 0;
+                        loopOK = 0;
+                    }
+                    else
+                    {
+                        // pixels are zero-copy, small trailer is copied
+                        // so frame_md can be re-used immediately
+                        rs = TCP_sendmsg_all(fds_client,
+                                             iov,
+                                             1,
+                                             MSG_ZEROCOPY | MSG_MORE,
+                                             &zc_sent);
+                        if(rs == framesize)
+                        {
+                            ssize_t rs1 =
+                                TCP_sendmsg_all(fds_client, iov + 1, 2, 0, NULL);
+                            rs = (rs1 < 0) ? rs1 : rs + rs1;
+                        }
+
+                        TCP_zerocopy_reap(fds_client, 0, &zc_done, &zc_copied);
+                    }
+                }
+
+                if((sendOK == 1) && (rs != txsize))
                 {
                     perror("socket send error ");
                     snprintf(errmsg,
@@ -550,7 +972,7 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
                              "expected %ld  %ld  %ld",
                              rs,
                              (long) framesize,
-                             (long) framesizeall,
+                             txsize,
                              (long) sizeof(TCP_BUFFER_METADATA));
                     printf("%s\n", errmsg);
                     fflush(stdout);
@@ -576,6 +998,34 @@ imageID COREMOD_MEMORY_image_NETWORKtransmit(
     // ==================================
     processinfo_cleanExit(processinfo);
 
+    if(ZCsend == 1)
+    {
+        // wait for pending sends before closing, bounded : pages stay
+        // pinned by the kernel until the socket releases them
+        if(TCP_zerocopy_wait(fds_client, zc_sent, 0, &zc_done, &zc_copied) !=
+                RETURN_SUCCESS)
+        {
+            printf("WARNING: %u MSG_ZEROCOPY sends not completed\n",
+                   zc_sent - zc_done);
+        }
+        printf("MSG_ZEROCOPY : %u sends, %ld copied by kernel\n",
+               zc_sent,
+               zc_copied);
+    }
+
+    if(encbuf != NULL)
+    {
+        if(cd.NBframe > 0)
+        {
+            printf("codec %d : ratio %.2f, %.1f us/frame encoding\n",
+                   codec,
+                   1.0 * cd.NBbyteraw / cd.NBbyteenc,
+                   1.0e-3 * cd.time_ns / cd.NBframe);
+        }
+        stream_codec_free(&cd);
+        free(encbuf);
+    }
+
     free(buff);
 
     close(fds_client);
@@ -629,7 +1079,13 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
     char                *buff;          // buffer
 
     size_t flushsize;
-    char *socket_flush_buff;
+    char *socket_flush_buff = NULL;
+
+    // frame encoding, set by transmitter in handshake
+    int          codec;
+    STREAM_CODEC cd;
+    char        *encbuf     = NULL;
+    long         encbufsize = 0;
 
 
 
@@ -800,6 +1256,52 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
         exit(0);
     }
 
+    // protocol version and frame encoding
+    {
+        TCP_HANDSHAKE handshake;
+
+        recvsize =
+            recv(fds_client, &handshake, sizeof(TCP_HANDSHAKE), MSG_WAITALL);
+        if((recvsize != sizeof(TCP_HANDSHAKE)) ||
+                (handshake.magic != TCPSTREAM_MAGIC) ||
+                (handshake.version != TCPSTREAM_VERSION))
+        {
+            char msgstring[200];
+
+            snprintf(msgstring,
+                     200,
+                     "ERROR handshake : transmitter protocol mismatch");
+            printf("%s\n", msgstring);
+
+            if(data.processinfo == 1)
+            {
+                processinfo->loopstat = 4;
+                processinfo_WriteMessage(processinfo, msgstring);
+            }
+
+            exit(0);
+        }
+        if((handshake.codec & ~STREAM_CODEC_ALL) != 0)
+        {
+            char msgstring[200];
+
+            snprintf(msgstring,
+                     200,
+                     "ERROR handshake : unknown codec %d",
+                     (int) handshake.codec);
+            printf("%s\n", msgstring);
+
+            if(data.processinfo == 1)
+            {
+                processinfo->loopstat = 4;
+                processinfo_WriteMessage(processinfo, msgstring);
+            }
+
+            exit(0);
+        }
+        codec = handshake.codec;
+    }
+
     if(data.processinfo == 1)
     {
         char msgstring[200];
@@ -885,6 +1387,16 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
 
     COREMOD_MEMORY_image_set_createsem(imgmd[0].name, IMAGE_NB_SEMAPHORE);
 
+    // per-frame latency record, read by imnetwlatency
+    imageID IDlat = stream_latency_create(imgmd[0].name);
+    if(IDlat == -1)
+    {
+        printf("WARNING: cannot create latency record\n");
+    }
+
+    // image table may have been reallocated
+    img_p = &data.image[ID];
+
     xsize    = img_p->md[0].size[0];
     ysize    = img_p->md[0].size[1];
     NBslices = 1;
@@ -949,6 +1461,36 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
 
     frame_md = (TCP_BUFFER_METADATA *)(buff + framesize);
 
+    if(codec != 0)
+    {
+        int elemsize = ImageStreamIO_typesize(img_p->md[0].datatype);
+
+        if(stream_codec_init(&cd,
+                             codec,
+                             framesize / elemsize,
+                             elemsize,
+                             framesizefull - framesize1) == RETURN_SUCCESS)
+        {
+            encbufsize = stream_codec_maxsize(&cd);
+            encbuf     = (char *) malloc(encbufsize);
+        }
+        if(encbuf == NULL)
+        {
+            char msgstring[200];
+
+            snprintf(msgstring, 200, "ERROR codec %d init", codec);
+            printf("%s\n", msgstring);
+
+            if(data.processinfo == 1)
+            {
+                processinfo->loopstat = 4;
+                processinfo_WriteMessage(processinfo, msgstring);
+            }
+            exit(0);
+        }
+        printf("frame encoding : codec %d\n", codec);
+    }
+
     if(data.processinfo == 1)
     {
         processinfo->loopstat =
@@ -968,6 +1510,11 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
     long monitorloopindex = 0;
     long cnt0previous     = 0;
 
+    // latency percentiles in processinfo message, once per second
+    struct timespec tlat;
+    time_t          tlatmsg = 0;
+
+    if(codec == 0)
     {
         // Finally, just before we start, flush the TCP receive buffer. BUT we need to flush an integer number of frames, that's important,
         // or we end up losing sync.
@@ -1009,7 +1556,40 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
             }
         }
 
-        if((recvsize = recv(fds_client, buff, framesizefull, MSG_WAITALL)) < 0)
+        if(codec == 0)
+        {
+            recvsize = recv(fds_client, buff, framesizefull, MSG_WAITALL);
+        }
+        else
+        {
+            // metadata first, then encoded pixel data + keywords
+            recvsize = recv(fds_client,
+                            frame_md,
+                            sizeof(TCP_BUFFER_METADATA),
+                            MSG_WAITALL);
+            if(recvsize == sizeof(TCP_BUFFER_METADATA))
+            {
+                if((frame_md[0].encsize <= 0) ||
+                        (frame_md[0].encsize > encbufsize))
+                {
+                    printf("ERROR encoded frame size %ld\n",
+                           (long) frame_md[0].encsize);
+                    recvsize = -1;
+                }
+                else
+                {
+                    recvsize = recv(fds_client,
+                                    encbuf,
+                                    frame_md[0].encsize,
+                                    MSG_WAITALL);
+                    if(recvsize > 0)
+                    {
+                        recvsize += sizeof(TCP_BUFFER_METADATA);
+                    }
+                }
+            }
+        }
+        if(recvsize < 0)
         {
             printf("ERROR recv()\n");
             socketOpen = 0;
@@ -1020,6 +1600,9 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
             processinfo_exec_start(processinfo);
         }
 
+        clock_gettime(CLOCK_REALTIME, &tlat);
+        int64_t rxtime = stream_latency_ns(tlat);
+
         if(recvsize != 0)
         {
             totsize += recvsize;
@@ -1035,17 +1618,34 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
 
             img_p->md[0].cnt1 = frame_md[0].cnt1;
 
-            // copy pixel data
+            char *ptrslice = ptr0;
             if(NBslices > 1)
             {
-                memcpy(ptr0 + framesize * frame_md[0].cnt1, buff, framesize);
+                ptrslice = ptr0 + framesize * frame_md[0].cnt1;
+            }
+
+            if(codec != 0)
+            {
+                // decode pixel data and kw
+                if(stream_codec_decode(&cd,
+                                       encbuf,
+                                       frame_md[0].encsize,
+                                       frame_md[0].frameflags,
+                                       ptrslice,
+                                       (char *) img_p->kw) != RETURN_SUCCESS)
+                {
+                    printf("ERROR decoding frame %ld\n",
+                           (long) frame_md[0].cnt0);
+                    break;
+                }
             }
             else
             {
-                memcpy(ptr0, buff, framesize);
+                // copy pixel data
+                memcpy(ptrslice, buff, framesize);
             }
 
-            if(TCPTRANSFERKW == 1)
+            if((TCPTRANSFERKW == 1) && (codec == 0))
             {
                 // copy kw
                 memcpy(img_p->kw,
@@ -1084,6 +1684,13 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
 
             monitorindex++;
 
+            // frame keeps source acquisition time across hops
+            int64_t t0 = (frame_md[0].atime != 0) ? frame_md[0].atime
+                         : frame_md[0].writetime;
+            img_p->md[0].atime.tv_sec  = t0 / 1000000000L;
+            img_p->md[0].atime.tv_nsec = t0 % 1000000000L;
+            clock_gettime(CLOCK_REALTIME, &img_p->md[0].writetime);
+
             img_p->md[0].cnt0++;
             for(semnb = 0; semnb < img_p->md[0].sem; semnb++)
             {
@@ -1099,6 +1706,32 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
             {
                 sem_post(img_p->semlog);
             }
+
+            if(IDlat != -1)
+            {
+                stream_latency_record(&data.image[IDlat],
+                                      frame_md[0].atime,
+                                      frame_md[0].writetime,
+                                      frame_md[0].txtime,
+                                      rxtime,
+                                      stream_latency_ns(img_p->md[0].writetime));
+
+                if((data.processinfo == 1) && (tlat.tv_sec != tlatmsg))
+                {
+                    STREAM_LATENCY_STATS stats;
+
+                    tlatmsg = tlat.tv_sec;
+                    stream_latency_stats(&data.image[IDlat],
+                                         STREAM_LATENCY_E2E,
+                                         &stats);
+                    processinfo_WriteMessage_fmt(
+                        processinfo,
+                        "latency p50 %.0f p99 %.0f max %.0f us",
+                        1.0e-3 * stats.p50,
+                        1.0e-3 * stats.p99,
+                        1.0e-3 * stats.max);
+                }
+            }
         }
 
         if(socketOpen == 0)
@@ -1161,6 +1794,19 @@ imageID COREMOD_MEMORY_image_NETWORKreceive(int                         port,
         processinfo_cleanExit(processinfo);
     }
 
+    if(encbuf != NULL)
+    {
+        if(cd.NBframe > 0)
+        {
+            printf("codec %d : ratio %.2f, %.1f us/frame decoding\n",
+                   codec,
+                   1.0 * cd.NBbyteraw / cd.NBbyteenc,
+                   1.0e-3 * cd.time_ns / cd.NBframe);
+        }
+        stream_codec_free(&cd);
+        free(encbuf);
+    }
+
     free(socket_flush_buff);
     free(buff);
 
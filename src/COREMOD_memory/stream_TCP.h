@@ -5,8 +5,34 @@
 #ifndef _STREAM_TCP_H
 #define _STREAM_TCP_H
 
+#include <sys/uio.h>
+
+// imnetwtransmit mode flags, may be combined
+
+// sync on counter, ignore semaphores if they exist
+#define NETWORKTRANSMIT_MODE_COUNTER 0x0001
+
+// scatter-gather send: pixels, metadata and keywords are passed to
+// sendmsg() straight from the stream, no staging copy
+#define NETWORKTRANSMIT_MODE_SGSEND 0x0002
+
+// as above, pixel slice sent with MSG_ZEROCOPY (kernel pins the pages,
+// completions are reaped from the socket error queue)
+#define NETWORKTRANSMIT_MODE_MSGZEROCOPY 0x0004
+
+// frame encoding : STREAM_CODEC_* flags (stream_codec.h) shifted by
+// NETWORKTRANSMIT_MODE_CODEC_SHIFT. Frames are encoded into a staging
+// buffer, SGSEND and MSGZEROCOPY are ignored
+#define NETWORKTRANSMIT_MODE_CODEC_SHIFT 3
+#define NETWORKTRANSMIT_MODE_DELTA       0x0008
+#define NETWORKTRANSMIT_MODE_SHUFFLE     0x0010
+#define NETWORKTRANSMIT_MODE_RLE         0x0020
+
 errno_t stream__TCP_addCLIcmd();
 
+ssize_t TCP_sendmsg_all(
+    int fd, struct iovec *iov, int iovcnt, int flags, uint32_t *nbcall);
+
 errno_t COREMOD_MEMORY_testfunction_semaphore(const char *IDname,
         int         semtrig,
         int         testmode);
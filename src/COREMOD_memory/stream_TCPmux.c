@@ -0,0 +1,1547 @@
+/**
+ * @file    stream_TCPmux.c
+ * @brief   multiplexed TCP stream transfer
+ *
+ * One transmitter process serves many streams over one or a few TCP
+ * connections. Streams are spread over connections by size, each
+ * connection is served by its own thread.
+ *
+ * Each connection starts with a HELLO message, followed by a DECL message
+ * (stream metadata) for each stream it carries. Frames are then sent as
+ * DATA messages of up to quantum bytes, tagged with stream index, so that
+ * frames of different streams are interleaved on the connection.
+ *
+ * Scheduling is deficit round robin : at each round, every stream with a
+ * frame to send gets priority x quantum bytes of credit. Only the latest
+ * frame of a stream is sent : updates arriving while a frame is in flight
+ * are coalesced.
+ *
+ * Receiver accepts the connections of a session and writes DATA payloads
+ * directly into the local streams, named prefix + remote name.
+ * A new session (transmitter restart) replaces the previous one.
+ *
+ * Streams may request frame encoding (see stream_codec.c) in their DECL
+ * message. Receiver answers each DECL with the codec it accepts, and the
+ * frame is then encoded once when its transfer starts, DATA messages
+ * carrying pieces of the encoded frame. Receiver decodes when the frame is
+ * complete. Encoder and decoder keep their delta reference in step because
+ * every started frame is sent in full.
+ *
+ * Without encoding, as with imnetwtransmit scatter-gather mode, pixels are
+ * sent from stream memory : a slice overwritten during transfer is sent
+ * with mixed content. Use a circular buffer (size[2] > 1) stream to avoid
+ * this. Encoded frames are a snapshot taken at transfer start.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/processtools_trigger.h"
+
+#include "create_image.h"
+#include "delete_image.h"
+#include "image_ID.h"
+#include "read_shmim.h"
+#include "stream_sem.h"
+#include "stream_TCP.h"
+#include "stream_TCPmux.h"
+#include "stream_codec.h"
+
+// max DATA message payload, and scheduler credit at priority 1 [byte]
+#define TCPMUX_QUANTUM 65536
+
+// transmit thread wait timeout when idle, receive poll timeout [us]
+#define TCPMUX_WAIT_US 100000
+
+// ==========================================
+// Forward declaration(s)
+// ==========================================
+
+errno_t COREMOD_MEMORY_image_NETWORKmux_transmit(const char *streamlist,
+        const char *IPaddr,
+        int         port,
+        int         NBconn,
+        int         RT_priority);
+
+errno_t COREMOD_MEMORY_image_NETWORKmux_receive(int port, int RT_priority);
+
+// ==========================================
+// Command line interface wrapper function(s)
+// ==========================================
+
+static errno_t COREMOD_MEMORY_image_NETWORKmux_transmit__cli()
+{
+    if(0 + CLI_checkarg(1, CLIARG_STR_NOT_IMG) +
+            CLI_checkarg(2, CLIARG_STR_NOT_IMG) + CLI_checkarg(3, CLIARG_INT64) +
+            CLI_checkarg(4, CLIARG_INT64) + CLI_checkarg(5, CLIARG_INT64) ==
+            0)
+    {
+        COREMOD_MEMORY_image_NETWORKmux_transmit(data.cmdargtoken[1].val.string,
+                data.cmdargtoken[2].val.string,
+                data.cmdargtoken[3].val.numl,
+                data.cmdargtoken[4].val.numl,
+                data.cmdargtoken[5].val.numl);
+        return CLICMD_SUCCESS;
+    }
+    else
+    {
+        return CLICMD_INVALID_ARG;
+    }
+}
+
+static errno_t COREMOD_MEMORY_image_NETWORKmux_receive__cli()
+{
+    if(0 + CLI_checkarg(1, CLIARG_INT64) + CLI_checkarg(2, CLIARG_INT64) == 0)
+    {
+        COREMOD_MEMORY_image_NETWORKmux_receive(data.cmdargtoken[1].val.numl,
+                                                data.cmdargtoken[2].val.numl);
+        return CLICMD_SUCCESS;
+    }
+    else
+    {
+        return CLICMD_INVALID_ARG;
+    }
+}
+
+// ==========================================
+// Register CLI command(s)
+// ==========================================
+
+errno_t stream__TCPmux_addCLIcmd()
+{
+    RegisterCLIcommand(
+        "imnetwmuxtx",
+        __FILE__,
+        COREMOD_MEMORY_image_NETWORKmux_transmit__cli,
+        "transmit streams over multiplexed TCP connections. streams is a "
+        "comma-separated list of name[:priority[:codec]], codec flags 1: "
+        "delta, 2: byte shuffle, 4: zero-run packing",
+        "<streams> <IP addr> <port [long]> <NBconn [long]> <RT priority>",
+        "imnetwmuxtx im1,im2:4,im3:1:7 127.0.0.1 8888 2 80",
+        "errno_t COREMOD_MEMORY_image_NETWORKmux_transmit(const char "
+        "*streamlist, const char *IPaddr, int port, int NBconn, int "
+        "RT_priority)");
+
+    RegisterCLIcommand("imnetwmuxrx",
+                       __FILE__,
+                       COREMOD_MEMORY_image_NETWORKmux_receive__cli,
+                       "receive streams over multiplexed TCP connections",
+                       "<port [long]> <RT priority>",
+                       "imnetwmuxrx 8888 80",
+                       "errno_t COREMOD_MEMORY_image_NETWORKmux_receive(int "
+                       "port, int RT_priority)");
+
+    return RETURN_SUCCESS;
+}
+
+// ==========================================
+// Messages
+// ==========================================
+
+static int tcpmux_recv_all(int fd, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+
+    while(iovcnt > 0)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t rs = recvmsg(fd, &msg, MSG_WAITALL);
+        if(rs < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if(rs == 0)
+        {
+            return 0; // connection closed
+        }
+
+        while((iovcnt > 0) && ((size_t) rs >= iov->iov_len))
+        {
+            rs -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + rs;
+            iov->iov_len -= rs;
+        }
+    }
+
+    return 1;
+}
+
+static int tcpmux_send_msg(int                  fd,
+                           const TCPMUX_HEADER *header,
+                           struct iovec        *payload,
+                           int                  iovcnt)
+{
+    struct iovec iov[4];
+    long         size = sizeof(TCPMUX_HEADER);
+
+    iov[0].iov_base = (void *) header;
+    iov[0].iov_len  = sizeof(TCPMUX_HEADER);
+    for(int i = 0; i < iovcnt; i++)
+    {
+        iov[1 + i] = payload[i];
+        size += payload[i].iov_len;
+    }
+
+    if(TCP_sendmsg_all(fd, iov, 1 + iovcnt, 0, NULL) != size)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// set up frame encoding, framesize and framesizeall must be set
+static errno_t tcpmux_codec_init(STREAM_CODEC *cd,
+                                 char        **encbuf,
+                                 int           codec,
+                                 IMAGE        *img_p,
+                                 long          framesize,
+                                 long          framesizeall)
+{
+    int elemsize = ImageStreamIO_typesize(img_p->md[0].datatype);
+
+    if(stream_codec_init(cd,
+                         codec,
+                         framesize / elemsize,
+                         elemsize,
+                         framesizeall - framesize) != RETURN_SUCCESS)
+    {
+        return RETURN_FAILURE;
+    }
+    *encbuf = (char *) malloc(stream_codec_maxsize(cd));
+    if(*encbuf == NULL)
+    {
+        stream_codec_free(cd);
+        return RETURN_FAILURE;
+    }
+
+    return RETURN_SUCCESS;
+}
+
+static void tcpmux_codec_free(STREAM_CODEC *cd, char **encbuf)
+{
+    if(*encbuf != NULL)
+    {
+        stream_codec_free(cd);
+        free(*encbuf);
+        *encbuf = NULL;
+    }
+}
+
+// ==========================================
+// Transmit
+// ==========================================
+
+// start sending latest frame of stream
+static void tcpmux_tx_startframe(TCPMUX_TXSTREAM *s)
+{
+    IMAGE   *img_p = &data.image[s->ID];
+    uint64_t cnt0  = __atomic_load_n(&img_p->md[0].cnt0, __ATOMIC_ACQUIRE);
+
+    if((s->NBframe > 0) && (cnt0 > s->cnt0 + 1))
+    {
+        s->NBskipped += cnt0 - s->cnt0 - 1;
+    }
+    s->cnt0    = cnt0;
+    s->slice   = (s->NBslices > 1) ? img_p->md[0].cnt1 % s->NBslices : 0;
+    s->offset  = 0;
+    s->active  = 1;
+    s->pending = 0;
+
+    s->total      = s->framesizeall;
+    s->frameflags = 0;
+    if(s->codec != 0)
+    {
+        s->total = stream_codec_encode(&s->cd,
+                                       (char *) img_p->array.raw +
+                                       s->framesize * s->slice,
+                                       (char *) img_p->kw,
+                                       s->encbuf,
+                                       &s->frameflags);
+    }
+}
+
+// send next piece of frame, up to quantum bytes
+static long tcpmux_tx_sendpiece(TCPMUX_TX *tx, int fd, long streamindex)
+{
+    TCPMUX_TXSTREAM *s     = &tx->stream[streamindex];
+    IMAGE           *img_p = &data.image[s->ID];
+    TCPMUX_HEADER    header;
+    struct iovec     iov[2];
+    int              iovcnt = 0;
+
+    long size = s->total - s->offset;
+    if(size > tx->quantum)
+    {
+        size = tx->quantum;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic  = TCPMUX_MAGIC;
+    header.type   = TCPMUX_MSG_DATA;
+    header.stream = streamindex;
+    header.size   = size;
+    header.offset = s->offset;
+    header.cnt0   = s->cnt0;
+    header.cnt1   = s->slice;
+    header.total  = s->total;
+    header.codec  = s->frameflags;
+
+    // pixel data, then keywords
+    long offset = s->offset;
+    long remain = size;
+    if(s->codec != 0)
+    {
+        iov[iovcnt].iov_base = s->encbuf + offset;
+        iov[iovcnt].iov_len  = remain;
+        iovcnt++;
+        remain = 0;
+    }
+    else if(offset < s->framesize)
+    {
+        long n = s->framesize - offset;
+        if(n > remain)
+        {
+            n = remain;
+        }
+        iov[iovcnt].iov_base =
+            (char *) img_p->array.raw + s->framesize * s->slice + offset;
+        iov[iovcnt].iov_len = n;
+        iovcnt++;
+        offset += n;
+        remain -= n;
+    }
+    if(remain > 0)
+    {
+        iov[iovcnt].iov_base = (char *) img_p->kw + (offset - s->framesize);
+        iov[iovcnt].iov_len  = remain;
+        iovcnt++;
+    }
+
+    if(tcpmux_send_msg(fd, &header, iov, iovcnt) != 0)
+    {
+        return -1;
+    }
+
+    s->offset += size;
+    s->NBbyte += size;
+    if(s->offset == s->total)
+    {
+        s->active = 0;
+        s->NBframe++;
+        if(s->pending == 1)
+        {
+            tcpmux_tx_startframe(s);
+        }
+    }
+
+    return size;
+}
+
+static void *tcpmux_tx_thread(void *ptr)
+{
+    TCPMUX_TXCONN    *conn = (TCPMUX_TXCONN *) ptr;
+    TCPMUX_TX        *tx   = (TCPMUX_TX *) conn->tx;
+    STREAM_MULTIWAIT *mw   = (STREAM_MULTIWAIT *) conn->mw;
+    long              rr   = 0; // first stream served in round
+
+    while((tx->stop == 0) && (conn->status == 0))
+    {
+        long NBactive = 0;
+        for(long k = 0; k < conn->NBstream; k++)
+        {
+            NBactive += tx->stream[conn->streamindex[k]].active;
+        }
+
+        // only sleep if nothing left to send
+        stream_multiwait_wait(mw, (NBactive == 0) ? TCPMUX_WAIT_US : 0);
+        for(long k = 0; k < conn->NBstream; k++)
+        {
+            if(mw->fired[k] > 0)
+            {
+                TCPMUX_TXSTREAM *s = &tx->stream[conn->streamindex[k]];
+                if(s->active == 1)
+                {
+                    s->pending = 1;
+                }
+                else
+                {
+                    tcpmux_tx_startframe(s);
+                }
+            }
+        }
+
+        // deficit round robin
+        for(long j = 0; (j < conn->NBstream) && (conn->status == 0); j++)
+        {
+            long             k = (rr + j) % conn->NBstream;
+            TCPMUX_TXSTREAM *s = &tx->stream[conn->streamindex[k]];
+
+            if(s->active == 0)
+            {
+                continue;
+            }
+            s->deficit += tx->quantum * s->priority;
+            while((s->active == 1) && (s->deficit > 0))
+            {
+                long size = tcpmux_tx_sendpiece(tx, conn->fd, conn->streamindex[k]);
+                if(size < 0)
+                {
+                    conn->status = -1;
+                    break;
+                }
+                s->deficit -= size;
+                if(s->active == 0)
+                {
+                    // frame done, no update pending : no credit carried
+                    // over by idle stream
+                    s->deficit = 0;
+                }
+            }
+        }
+        rr = (rr + 1) % conn->NBstream;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Connect to receiver and start transmit threads
+ *
+ * Streams are assigned to connections by decreasing size, each to the
+ * connection carrying the least bytes per frame.
+ *
+ * @param priority  scheduling weight per stream (>= 1), NULL for all 1
+ * @param codec     requested STREAM_CODEC_* flags per stream, NULL for none
+ *
+ * @return transmitter, NULL on error
+ */
+TCPMUX_TX *tcpmux_tx_open(imageID    *IDarray,
+                          int        *priority,
+                          int        *codec,
+                          long        NBstream,
+                          const char *IPaddr,
+                          int         port,
+                          int         NBconn)
+{
+    TCPMUX_TX *tx;
+
+    if((NBstream < 1) || (NBstream > TCPMUX_NBSTREAMMAX))
+    {
+        PRINT_ERROR("number of streams %ld out of range [1, %d]",
+                    NBstream,
+                    TCPMUX_NBSTREAMMAX);
+        return NULL;
+    }
+    if(NBconn < 1)
+    {
+        NBconn = 1;
+    }
+    if(NBconn > TCPMUX_NBCONNMAX)
+    {
+        NBconn = TCPMUX_NBCONNMAX;
+    }
+    if(NBconn > NBstream)
+    {
+        NBconn = NBstream;
+    }
+
+    tx = (TCPMUX_TX *) calloc(1, sizeof(TCPMUX_TX));
+    if(tx == NULL)
+    {
+        PRINT_ERROR("calloc() error");
+        return NULL;
+    }
+    tx->NBstream = NBstream;
+    tx->NBconn   = NBconn;
+    tx->quantum  = TCPMUX_QUANTUM;
+    tx->stream   = (TCPMUX_TXSTREAM *) calloc(NBstream, sizeof(TCPMUX_TXSTREAM));
+    tx->conn     = (TCPMUX_TXCONN *) calloc(NBconn, sizeof(TCPMUX_TXCONN));
+    long *order  = (long *) malloc(sizeof(long) * NBstream);
+    long *load   = (long *) calloc(NBconn, sizeof(long));
+    if((tx->stream == NULL) || (tx->conn == NULL) || (order == NULL) ||
+            (load == NULL))
+    {
+        PRINT_ERROR("malloc() error");
+        free(order);
+        free(load);
+        free(tx->stream);
+        free(tx->conn);
+        free(tx);
+        return NULL;
+    }
+
+    for(long i = 0; i < NBstream; i++)
+    {
+        TCPMUX_TXSTREAM *s     = &tx->stream[i];
+        IMAGE           *img_p = &data.image[IDarray[i]];
+
+        s->ID       = IDarray[i];
+        s->priority = ((priority == NULL) || (priority[i] < 1)) ? 1 : priority[i];
+        s->framesize =
+            ImageStreamIO_typesize(img_p->md[0].datatype) *
+            img_p->md[0].size[0] * ((img_p->md[0].naxis > 1) ? img_p->md[0].size[1] : 1);
+        s->NBslices = 1;
+        if((img_p->md[0].naxis > 2) && (img_p->md[0].size[2] > 1))
+        {
+            s->NBslices = img_p->md[0].size[2];
+        }
+        s->framesizeall =
+            s->framesize + img_p->md[0].NBkw * sizeof(IMAGE_KEYWORD);
+        order[i] = i;
+    }
+
+    // largest streams first, each to least loaded connection
+    for(long i = 1; i < NBstream; i++)
+    {
+        long k = order[i];
+        long j = i;
+        while((j > 0) &&
+                (tx->stream[order[j - 1]].framesizeall < tx->stream[k].framesizeall))
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = k;
+    }
+    for(long i = 0; i < NBstream; i++)
+    {
+        int c = 0;
+        for(int c1 = 1; c1 < NBconn; c1++)
+        {
+            if(load[c1] < load[c])
+            {
+                c = c1;
+            }
+        }
+        tx->stream[order[i]].conn = c;
+        load[c] += tx->stream[order[i]].framesizeall;
+        tx->conn[c].NBstream++;
+    }
+    free(order);
+    free(load);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t session = ((uint64_t) getpid() << 32) ^ (uint64_t) ts.tv_sec ^
+                       ((uint64_t) ts.tv_nsec << 16);
+
+    struct sockaddr_in sock_server;
+    memset((char *) &sock_server, 0, sizeof(sock_server));
+    sock_server.sin_family      = AF_INET;
+    sock_server.sin_port        = htons(port);
+    sock_server.sin_addr.s_addr = inet_addr(IPaddr);
+
+    imageID IDarray1[TCPMUX_NBSTREAMMAX];
+    int     NBconnOK = 0;
+    for(int c = 0; c < NBconn; c++)
+    {
+        TCPMUX_TXCONN *conn = &tx->conn[c];
+        int            flag = 1;
+
+        conn->index       = c;
+        conn->tx          = tx;
+        conn->fd          = -1;
+        conn->streamindex = (long *) malloc(sizeof(long) * conn->NBstream);
+        if(conn->streamindex == NULL)
+        {
+            break;
+        }
+        conn->NBstream = 0;
+        for(long i = 0; i < NBstream; i++)
+        {
+            if(tx->stream[i].conn == c)
+            {
+                IDarray1[conn->NBstream]            = tx->stream[i].ID;
+                conn->streamindex[conn->NBstream++] = i;
+            }
+        }
+
+        // updates are seen from here on
+        conn->mw = stream_multiwait_create(IDarray1, conn->NBstream, 0);
+        if(conn->mw == NULL)
+        {
+            break;
+        }
+
+        if((conn->fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+        {
+            PRINT_ERROR("ERROR creating socket");
+            break;
+        }
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag,
+                   sizeof(flag));
+        if(connect(conn->fd,
+                   (struct sockaddr *) &sock_server,
+                   sizeof(sock_server)) < 0)
+        {
+            perror("connect() failed");
+            break;
+        }
+
+        TCPMUX_HEADER header;
+        memset(&header, 0, sizeof(header));
+        header.magic  = TCPMUX_MAGIC;
+        header.type   = TCPMUX_MSG_HELLO;
+        header.stream = c;
+        header.offset = NBconn;
+        header.cnt0   = NBstream;
+        header.cnt1   = session;
+        if(tcpmux_send_msg(conn->fd, &header, NULL, 0) != 0)
+        {
+            break;
+        }
+
+        long k;
+        for(k = 0; k < conn->NBstream; k++)
+        {
+            long         i = conn->streamindex[k];
+            struct iovec iov;
+
+            header.type     = TCPMUX_MSG_DECL;
+            header.stream   = i;
+            header.size     = sizeof(IMAGE_METADATA);
+            header.offset   = tx->stream[i].priority;
+            header.cnt0     = 0;
+            header.cnt1     = 0;
+            header.codec    = (codec == NULL) ? 0 : codec[i];
+            iov.iov_base    = data.image[tx->stream[i].ID].md;
+            iov.iov_len     = sizeof(IMAGE_METADATA);
+            if(tcpmux_send_msg(conn->fd, &header, &iov, 1) != 0)
+            {
+                break;
+            }
+        }
+        if(k < conn->NBstream)
+        {
+            break;
+        }
+
+        // codec accepted by receiver, acknowledged in declaration order
+        for(k = 0; k < conn->NBstream; k++)
+        {
+            long             i = conn->streamindex[k];
+            TCPMUX_TXSTREAM *s = &tx->stream[i];
+            struct iovec     iov;
+
+            iov.iov_base = &header;
+            iov.iov_len  = sizeof(header);
+            if((tcpmux_recv_all(conn->fd, &iov, 1) != 1) ||
+                    (header.magic != TCPMUX_MAGIC) ||
+                    (header.type != TCPMUX_MSG_DECL) || (header.stream != i))
+            {
+                PRINT_ERROR("no declaration acknowledgement for stream %ld", i);
+                break;
+            }
+            s->codec = header.codec & STREAM_CODEC_ALL;
+            if((s->codec != 0) &&
+                    (tcpmux_codec_init(&s->cd,
+                                       &s->encbuf,
+                                       s->codec,
+                                       &data.image[s->ID],
+                                       s->framesize,
+                                       s->framesizeall) != RETURN_SUCCESS))
+            {
+                break;
+            }
+        }
+        if(k < conn->NBstream)
+        {
+            break;
+        }
+        NBconnOK++;
+    }
+
+    if(NBconnOK < NBconn)
+    {
+        PRINT_ERROR("cannot set up connection %d to %s:%d",
+                    NBconnOK,
+                    IPaddr,
+                    port);
+        for(int c = 0; c < NBconn; c++)
+        {
+            if(tx->conn[c].fd >= 0)
+            {
+                close(tx->conn[c].fd);
+            }
+            if(tx->conn[c].mw != NULL)
+            {
+                stream_multiwait_destroy(tx->conn[c].mw);
+            }
+            free(tx->conn[c].streamindex);
+        }
+        for(long i = 0; i < NBstream; i++)
+        {
+            tcpmux_codec_free(&tx->stream[i].cd, &tx->stream[i].encbuf);
+        }
+        free(tx->stream);
+        free(tx->conn);
+        free(tx);
+        return NULL;
+    }
+
+    for(int c = 0; c < NBconn; c++)
+    {
+        pthread_create(&tx->conn[c].thread, NULL, tcpmux_tx_thread, &tx->conn[c]);
+    }
+
+    return tx;
+}
+
+errno_t tcpmux_tx_close(TCPMUX_TX *tx)
+{
+    if(tx == NULL)
+    {
+        return RETURN_SUCCESS;
+    }
+
+    tx->stop = 1;
+    for(int c = 0; c < tx->NBconn; c++)
+    {
+        pthread_join(tx->conn[c].thread, NULL);
+        close(tx->conn[c].fd);
+        stream_multiwait_destroy(tx->conn[c].mw);
+        free(tx->conn[c].streamindex);
+    }
+    for(long i = 0; i < tx->NBstream; i++)
+    {
+        tcpmux_codec_free(&tx->stream[i].cd, &tx->stream[i].encbuf);
+    }
+    free(tx->stream);
+    free(tx->conn);
+    free(tx);
+
+    return RETURN_SUCCESS;
+}
+
+// ==========================================
+// Receive
+// ==========================================
+
+// local stream for remote metadata, created if needed
+static imageID tcpmux_rx_openstream(TCPMUX_RX *rx, IMAGE_METADATA *imgmd)
+{
+    char    name[STRINGMAXLEN_IMGNAME];
+    imageID ID;
+    int     OKim = 0;
+
+    imgmd->name[STRINGMAXLEN_IMAGE_NAME - 1] = '\0';
+    WRITE_IMAGENAME(name, "%s%s", rx->prefix, imgmd->name);
+
+    ID = image_ID(name);
+    if(ID == -1)
+    {
+        ID = read_sharedmem_image(name);
+    }
+    if(ID != -1)
+    {
+        IMAGE *img_p = &data.image[ID];
+
+        OKim = 1;
+        if((imgmd->naxis != img_p->md[0].naxis) ||
+                (imgmd->datatype != img_p->md[0].datatype) ||
+                (imgmd->NBkw != img_p->md[0].NBkw))
+        {
+            OKim = 0;
+        }
+        for(int axis = 0; (OKim == 1) && (axis < imgmd->naxis); axis++)
+        {
+            if(imgmd->size[axis] != img_p->md[0].size[axis])
+            {
+                OKim = 0;
+            }
+        }
+        if(OKim == 0)
+        {
+            delete_image_ID(name, DELETE_IMAGE_ERRMODE_WARNING);
+            ID = -1;
+        }
+    }
+
+    if(OKim == 0)
+    {
+        printf("IMAGE %s HAS TO BE CREATED\n", name);
+        create_image_ID(name,
+                        imgmd->naxis,
+                        imgmd->size,
+                        imgmd->datatype,
+                        imgmd->shared,
+                        imgmd->NBkw,
+                        0,
+                        &ID);
+    }
+    if((ID != -1) && (data.image[ID].md[0].shared == 1))
+    {
+        COREMOD_MEMORY_image_set_createsem(name, IMAGE_NB_SEMAPHORE);
+    }
+
+    return ID;
+}
+
+static void tcpmux_rx_closeconn(TCPMUX_RX *rx, int c)
+{
+    close(rx->fd[c]);
+    rx->fd[c]    = -1;
+    rx->hello[c] = 0;
+    rx->NBconnopen--;
+
+    // frames interrupted by connection loss are abandoned
+    // other connections keep their frames in progress
+    for(long i = 0; i < rx->NBstream; i++)
+    {
+        TCPMUX_RXSTREAM *s = &rx->stream[i];
+        if((s->ID != -1) && (s->offset > 0) && (s->conn == c))
+        {
+            s->offset                      = 0;
+            data.image[s->ID].md[0].write = 0;
+        }
+    }
+}
+
+static void tcpmux_rx_freestreams(TCPMUX_RX *rx)
+{
+    for(long i = 0; i < rx->NBstream; i++)
+    {
+        tcpmux_codec_free(&rx->stream[i].cd, &rx->stream[i].encbuf);
+    }
+    free(rx->stream);
+}
+
+static errno_t tcpmux_rx_newsession(TCPMUX_RX           *rx,
+                                    int                  c,
+                                    const TCPMUX_HEADER *header)
+{
+    // drop connections of previous session
+    for(int c1 = 0; c1 < TCPMUX_NBCONNMAX; c1++)
+    {
+        if((c1 != c) && (rx->fd[c1] != -1) && (rx->hello[c1] == 1))
+        {
+            tcpmux_rx_closeconn(rx, c1);
+        }
+    }
+
+    if((header->cnt0 < 1) || (header->cnt0 > TCPMUX_NBSTREAMMAX))
+    {
+        return RETURN_FAILURE;
+    }
+
+    pthread_mutex_lock(&rx->lock);
+    tcpmux_rx_freestreams(rx);
+    rx->stream = (TCPMUX_RXSTREAM *) calloc(header->cnt0, sizeof(TCPMUX_RXSTREAM));
+    rx->NBstream = (rx->stream == NULL) ? 0 : header->cnt0;
+    pthread_mutex_unlock(&rx->lock);
+    if(rx->stream == NULL)
+    {
+        return RETURN_FAILURE;
+    }
+    for(long i = 0; i < rx->NBstream; i++)
+    {
+        rx->stream[i].ID = -1;
+    }
+    rx->session = header->cnt1;
+    rx->NBconn  = header->offset;
+
+    printf("New session : %ld streams over %d connection(s)\n",
+           rx->NBstream,
+           rx->NBconn);
+    fflush(stdout);
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Receive one message from connection c
+ *
+ * @return 1 if message processed, 0 if connection closed, -1 on protocol
+ *         error
+ */
+static int tcpmux_rx_message(TCPMUX_RX *rx, int c)
+{
+    TCPMUX_HEADER header;
+    struct iovec  iov[2];
+    int           rv;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len  = sizeof(header);
+    if((rv = tcpmux_recv_all(rx->fd[c], iov, 1)) <= 0)
+    {
+        return rv;
+    }
+    if(header.magic != TCPMUX_MAGIC)
+    {
+        return -1;
+    }
+
+    if(header.type == TCPMUX_MSG_HELLO)
+    {
+        if((rx->NBstream == 0) || (header.cnt1 != rx->session))
+        {
+            if(tcpmux_rx_newsession(rx, c, &header) != RETURN_SUCCESS)
+            {
+                return -1;
+            }
+        }
+        rx->hello[c] = 1;
+        return 1;
+    }
+
+    if((rx->hello[c] == 0) || (header.stream >= rx->NBstream))
+    {
+        return -1;
+    }
+    TCPMUX_RXSTREAM *s = &rx->stream[header.stream];
+
+    if(header.type == TCPMUX_MSG_DECL)
+    {
+        IMAGE_METADATA imgmd;
+
+        if(header.size != sizeof(IMAGE_METADATA))
+        {
+            return -1;
+        }
+        iov[0].iov_base = &imgmd;
+        iov[0].iov_len  = sizeof(IMAGE_METADATA);
+        if((rv = tcpmux_recv_all(rx->fd[c], iov, 1)) <= 0)
+        {
+            return rv;
+        }
+
+        tcpmux_codec_free(&s->cd, &s->encbuf);
+        memset(s, 0, sizeof(TCPMUX_RXSTREAM));
+        s->ID = tcpmux_rx_openstream(rx, &imgmd);
+        if(s->ID == -1)
+        {
+            return -1;
+        }
+        IMAGE *img_p = &data.image[s->ID];
+
+        s->priority  = header.offset;
+        s->framesize = ImageStreamIO_typesize(img_p->md[0].datatype) *
+                       img_p->md[0].size[0] *
+                       ((img_p->md[0].naxis > 1) ? img_p->md[0].size[1] : 1);
+        s->NBslices = 1;
+        if((img_p->md[0].naxis > 2) && (img_p->md[0].size[2] > 1))
+        {
+            s->NBslices = img_p->md[0].size[2];
+        }
+        s->framesizeall =
+            s->framesize + img_p->md[0].NBkw * sizeof(IMAGE_KEYWORD);
+
+        // accept known encoding steps
+        s->codec = header.codec & STREAM_CODEC_ALL;
+        if((s->codec != 0) &&
+                (tcpmux_codec_init(&s->cd,
+                                   &s->encbuf,
+                                   s->codec,
+                                   img_p,
+                                   s->framesize,
+                                   s->framesizeall) != RETURN_SUCCESS))
+        {
+            s->codec = 0;
+        }
+        header.size  = 0;
+        header.codec = s->codec;
+        if(tcpmux_send_msg(rx->fd[c], &header, NULL, 0) != 0)
+        {
+            return -1;
+        }
+
+        printf("stream %3u  %-32s  %ld bytes  priority %d  codec %d\n",
+               header.stream,
+               img_p->md[0].name,
+               s->framesizeall,
+               s->priority,
+               s->codec);
+        fflush(stdout);
+        return 1;
+    }
+
+    if(header.type != TCPMUX_MSG_DATA)
+    {
+        return -1;
+    }
+    if((s->ID == -1) || (header.offset != s->offset) ||
+            (header.total > s->framesizeall) ||
+            ((s->codec == 0) && (header.total != s->framesizeall)) ||
+            ((long) header.offset + header.size > header.total) ||
+            ((s->offset > 0) &&
+             ((header.cnt0 != s->cnt0) || (header.total != s->total) ||
+              (s->conn != c))))
+    {
+        return -1;
+    }
+
+    IMAGE   *img_p = &data.image[s->ID];
+    uint64_t slice = header.cnt1 % s->NBslices;
+
+    if(header.offset == 0)
+    {
+        if((s->NBframe > 0) && (header.cnt0 > s->cnt0 + 1))
+        {
+            s->NBskipped += header.cnt0 - s->cnt0 - 1;
+        }
+        s->conn       = c;
+        s->cnt0       = header.cnt0;
+        s->total      = header.total;
+        s->frameflags = header.codec;
+        if(s->codec == 0)
+        {
+            img_p->md[0].write = 1;
+        }
+    }
+
+    // payload goes straight to pixel data and keywords
+    // encoded frames are assembled, then decoded
+    long offset = header.offset;
+    long remain = header.size;
+    int  iovcnt = 0;
+    if(s->codec != 0)
+    {
+        iov[iovcnt].iov_base = s->encbuf + offset;
+        iov[iovcnt].iov_len  = remain;
+        iovcnt++;
+        remain = 0;
+    }
+    else if(offset < s->framesize)
+    {
+        long n = s->framesize - offset;
+        if(n > remain)
+        {
+            n = remain;
+        }
+        iov[iovcnt].iov_base =
+            (char *) img_p->array.raw + s->framesize * slice + offset;
+        iov[iovcnt].iov_len = n;
+        iovcnt++;
+        offset += n;
+        remain -= n;
+    }
+    if(remain > 0)
+    {
+        iov[iovcnt].iov_base = (char *) img_p->kw + (offset - s->framesize);
+        iov[iovcnt].iov_len  = remain;
+        iovcnt++;
+    }
+    if((iovcnt > 0) && ((rv = tcpmux_recv_all(rx->fd[c], iov, iovcnt)) <= 0))
+    {
+        return rv;
+    }
+
+    s->offset += header.size;
+    s->NBbyte += header.size;
+    if(s->offset == s->total)
+    {
+        if(s->codec != 0)
+        {
+            img_p->md[0].write = 1;
+            if(stream_codec_decode(&s->cd,
+                                   s->encbuf,
+                                   s->total,
+                                   s->frameflags,
+                                   (char *) img_p->array.raw +
+                                   s->framesize * slice,
+                                   (char *) img_p->kw) != RETURN_SUCCESS)
+            {
+                img_p->md[0].write = 0;
+                return -1;
+            }
+        }
+        s->offset         = 0;
+        img_p->md[0].cnt1 = slice;
+        ImageStreamIO_UpdateIm(img_p);
+        processinfo_triggerstream_wake(img_p);
+        s->NBframe++;
+    }
+
+    return 1;
+}
+
+static void *tcpmux_rx_thread(void *ptr)
+{
+    TCPMUX_RX    *rx = (TCPMUX_RX *) ptr;
+    struct pollfd pfd[TCPMUX_NBCONNMAX + 1];
+    int           pfdconn[TCPMUX_NBCONNMAX + 1];
+
+    while((rx->stop == 0) && (rx->done == 0))
+    {
+        int NBpfd = 0;
+
+        pfd[NBpfd].fd      = rx->fdlisten;
+        pfd[NBpfd].events  = POLLIN;
+        pfd[NBpfd].revents = 0;
+        pfdconn[NBpfd]     = -1;
+        NBpfd++;
+        for(int c = 0; c < TCPMUX_NBCONNMAX; c++)
+        {
+            if(rx->fd[c] != -1)
+            {
+                pfd[NBpfd].fd      = rx->fd[c];
+                pfd[NBpfd].events  = POLLIN;
+                pfd[NBpfd].revents = 0;
+                pfdconn[NBpfd]     = c;
+                NBpfd++;
+            }
+        }
+
+        int rv = poll(pfd, NBpfd, TCPMUX_WAIT_US / 1000);
+        if(rv < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            rx->status = -1;
+            break;
+        }
+
+        for(int p = 1; p < NBpfd; p++)
+        {
+            if(pfd[p].revents == 0)
+            {
+                continue;
+            }
+            int c = pfdconn[p];
+            if(rx->fd[c] == -1)
+            {
+                continue; // closed by new session
+            }
+            int mrv = tcpmux_rx_message(rx, c);
+            if(mrv < 0)
+            {
+                printf("connection %d : protocol error, closing\n", c);
+                fflush(stdout);
+            }
+            if(mrv <= 0)
+            {
+                tcpmux_rx_closeconn(rx, c);
+                if((rx->NBconnopen == 0) && (rx->NBstream > 0))
+                {
+                    rx->done = 1;
+                }
+            }
+        }
+
+        if(pfd[0].revents & POLLIN)
+        {
+            int fd = accept(rx->fdlisten, NULL, NULL);
+            if(fd >= 0)
+            {
+                int c;
+                int flag = 1;
+                for(c = 0; c < TCPMUX_NBCONNMAX; c++)
+                {
+                    if(rx->fd[c] == -1)
+                    {
+                        break;
+                    }
+                }
+                if(c == TCPMUX_NBCONNMAX)
+                {
+                    close(fd);
+                }
+                else
+                {
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag,
+                               sizeof(flag));
+                    rx->fd[c]    = fd;
+                    rx->hello[c] = 0;
+                    rx->NBconnopen++;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Listen on port and start receive thread
+ *
+ * Local streams are named prefix + remote stream name.
+ *
+ * @param port    listening port, 0 to let system choose (see rx->port)
+ * @param prefix  NULL or "" for same names as remote
+ *
+ * @return receiver, NULL on error
+ */
+TCPMUX_RX *tcpmux_rx_open(int port, const char *prefix)
+{
+    TCPMUX_RX         *rx;
+    struct sockaddr_in sock_server;
+    int                flag = 1;
+
+    rx = (TCPMUX_RX *) calloc(1, sizeof(TCPMUX_RX));
+    if(rx == NULL)
+    {
+        PRINT_ERROR("calloc() error");
+        return NULL;
+    }
+    if(prefix != NULL)
+    {
+        strncpy(rx->prefix, prefix, STRINGMAXLEN_IMGNAME - 1);
+    }
+    for(int c = 0; c < TCPMUX_NBCONNMAX; c++)
+    {
+        rx->fd[c] = -1;
+    }
+    pthread_mutex_init(&rx->lock, NULL);
+
+    if((rx->fdlisten = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1)
+    {
+        PRINT_ERROR("ERROR creating socket");
+        pthread_mutex_destroy(&rx->lock);
+        free(rx);
+        return NULL;
+    }
+    setsockopt(rx->fdlisten, SOL_SOCKET, SO_REUSEADDR, (char *) &flag,
+               sizeof(flag));
+
+    memset((char *) &sock_server, 0, sizeof(sock_server));
+    sock_server.sin_family      = AF_INET;
+    sock_server.sin_port        = htons(port);
+    sock_server.sin_addr.s_addr = htonl(INADDR_ANY);
+    if((bind(rx->fdlisten,
+             (struct sockaddr *) &sock_server,
+             sizeof(sock_server)) == -1) ||
+            (listen(rx->fdlisten, TCPMUX_NBCONNMAX) < 0))
+    {
+        PRINT_ERROR("ERROR binding socket, port %d", port);
+        close(rx->fdlisten);
+        pthread_mutex_destroy(&rx->lock);
+        free(rx);
+        return NULL;
+    }
+
+    socklen_t addrlen = sizeof(sock_server);
+    getsockname(rx->fdlisten, (struct sockaddr *) &sock_server, &addrlen);
+    rx->port = ntohs(sock_server.sin_port);
+
+    pthread_create(&rx->thread, NULL, tcpmux_rx_thread, rx);
+
+    return rx;
+}
+
+errno_t tcpmux_rx_close(TCPMUX_RX *rx)
+{
+    if(rx == NULL)
+    {
+        return RETURN_SUCCESS;
+    }
+
+    rx->stop = 1;
+    pthread_join(rx->thread, NULL);
+    for(int c = 0; c < TCPMUX_NBCONNMAX; c++)
+    {
+        if(rx->fd[c] != -1)
+        {
+            close(rx->fd[c]);
+        }
+    }
+    close(rx->fdlisten);
+    pthread_mutex_destroy(&rx->lock);
+    tcpmux_rx_freestreams(rx);
+    free(rx);
+
+    return RETURN_SUCCESS;
+}
+
+// ==========================================
+// Processes
+// ==========================================
+
+// ends line started by caller
+static void tcpmux_print_codecstats(int codec, const STREAM_CODEC *cd)
+{
+    if((codec == 0) || (cd->NBframe == 0))
+    {
+        printf("\n");
+        return;
+    }
+    printf("  codec %d  ratio %6.2f  %8.1f us/frame\n",
+           codec,
+           1.0 * cd->NBbyteraw / cd->NBbyteenc,
+           1.0e-3 * cd->time_ns / cd->NBframe);
+}
+
+/** continuously transmits streams through multiplexed TCP connections
+ *
+ * streamlist is a comma-separated list of stream names, each optionally
+ * followed by :priority (scheduling weight, default 1) and :codec
+ * (STREAM_CODEC_* flags, default 0).
+ */
+errno_t COREMOD_MEMORY_image_NETWORKmux_transmit(const char *streamlist,
+        const char *IPaddr,
+        int         port,
+        int         NBconn,
+        int         RT_priority)
+{
+    imageID IDarray[TCPMUX_NBSTREAMMAX];
+    int     priority[TCPMUX_NBSTREAMMAX];
+    int     codec[TCPMUX_NBSTREAMMAX];
+    long    NBstream = 0;
+    char    liststr[STRINGMAXLEN_DEFAULT];
+
+    strncpy(liststr, streamlist, STRINGMAXLEN_DEFAULT - 1);
+    liststr[STRINGMAXLEN_DEFAULT - 1] = '\0';
+
+    char *saveptr;
+    for(char *tok = strtok_r(liststr, ",", &saveptr); tok != NULL;
+            tok       = strtok_r(NULL, ",", &saveptr))
+    {
+        char *sep = strchr(tok, ':');
+
+        if(NBstream == TCPMUX_NBSTREAMMAX)
+        {
+            PRINT_ERROR("too many streams, max %d", TCPMUX_NBSTREAMMAX);
+            return RETURN_FAILURE;
+        }
+        priority[NBstream] = 1;
+        codec[NBstream]    = 0;
+        if(sep != NULL)
+        {
+            *sep               = '\0';
+            priority[NBstream] = atoi(sep + 1);
+            sep                = strchr(sep + 1, ':');
+            if(sep != NULL)
+            {
+                codec[NBstream] = atoi(sep + 1);
+            }
+        }
+        IDarray[NBstream] = image_ID(tok);
+        if(IDarray[NBstream] == -1)
+        {
+            IDarray[NBstream] = read_sharedmem_image(tok);
+        }
+        if(IDarray[NBstream] == -1)
+        {
+            PRINT_ERROR("cannot load stream %s", tok);
+            return RETURN_FAILURE;
+        }
+        NBstream++;
+    }
+
+    printf("Transmit %ld streams over IP %s port %d, %d connection(s)\n",
+           NBstream,
+           IPaddr,
+           port,
+           NBconn);
+    fflush(stdout);
+
+    // ===========================
+    // processinfo support
+    // ===========================
+    char pinfoname[200];
+    snprintf(pinfoname, 200, "ntw-muxtx-%d", port);
+
+    char descr[200];
+    snprintf(descr, 200, "%ld streams->%s/%d", NBstream, IPaddr, port);
+
+    PROCESSINFO *processinfo = processinfo_setup(pinfoname,
+                               descr,
+                               "setup",
+                               __FUNCTION__,
+                               __FILE__,
+                               __LINE__);
+    processinfo->RT_priority = RT_priority;
+
+    // threads created after loopstart inherit RT priority
+    processinfo_loopstart(processinfo);
+
+    TCPMUX_TX *tx = tcpmux_tx_open(IDarray,
+                                   priority,
+                                   codec,
+                                   NBstream,
+                                   IPaddr,
+                                   port,
+                                   NBconn);
+    int loopOK = 1;
+    if(tx == NULL)
+    {
+        processinfo_error(processinfo, "ERROR: cannot connect");
+        loopOK = 0;
+    }
+
+    uint64_t NBframe0 = 0;
+    while(loopOK == 1)
+    {
+        loopOK = processinfo_loopstep(processinfo);
+
+        usleep(TCPMUX_WAIT_US);
+
+        uint64_t NBframe   = 0;
+        uint64_t NBskipped = 0;
+        uint64_t NBbyteraw = 0;
+        uint64_t NBbyteenc = 0;
+        for(long i = 0; i < tx->NBstream; i++)
+        {
+            NBframe += tx->stream[i].NBframe;
+            NBskipped += tx->stream[i].NBskipped;
+            NBbyteraw += tx->stream[i].cd.NBbyteraw;
+            NBbyteenc += tx->stream[i].cd.NBbyteenc;
+        }
+        processinfo_WriteMessage_fmt(processinfo,
+                                     "%lu frames (+%lu) %lu skipped ratio %.2f",
+                                     NBframe,
+                                     NBframe - NBframe0,
+                                     NBskipped,
+                                     (NBbyteenc > 0) ? 1.0 * NBbyteraw / NBbyteenc
+                                     : 1.0);
+        NBframe0 = NBframe;
+
+        for(int c = 0; c < tx->NBconn; c++)
+        {
+            if(tx->conn[c].status != 0)
+            {
+                processinfo_error(processinfo, "ERROR: send failed");
+                loopOK = 0;
+            }
+        }
+
+        if((data.signal_INT == 1) || (data.signal_TERM == 1) ||
+                (data.signal_ABRT == 1) || (data.signal_BUS == 1) ||
+                (data.signal_SEGV == 1) || (data.signal_HUP == 1) ||
+                (data.signal_PIPE == 1))
+        {
+            loopOK = 0;
+        }
+    }
+    processinfo_cleanExit(processinfo);
+
+    if(tx != NULL)
+    {
+        for(long i = 0; i < tx->NBstream; i++)
+        {
+            TCPMUX_TXSTREAM *s = &tx->stream[i];
+            printf("%-32s  conn %2d  priority %3d  %10lu frames  %10lu "
+                   "skipped",
+                   data.image[s->ID].md[0].name,
+                   s->conn,
+                   s->priority,
+                   s->NBframe,
+                   s->NBskipped);
+            tcpmux_print_codecstats(s->codec, &s->cd);
+        }
+        tcpmux_tx_close(tx);
+    }
+    printf("port %d closed\n", port);
+    fflush(stdout);
+
+    return RETURN_SUCCESS;
+}
+
+/** continuously receives streams through multiplexed TCP connections
+ *
+ * Exits when all connections of the session are closed.
+ */
+errno_t COREMOD_MEMORY_image_NETWORKmux_receive(int port, int RT_priority)
+{
+    char pinfoname[200];
+    snprintf(pinfoname, 200, "ntw-muxrx-%d", port);
+
+    char descr[200];
+    snprintf(descr, 200, "port %d", port);
+
+    PROCESSINFO *processinfo = processinfo_setup(pinfoname,
+                               descr,
+                               "waiting for connections",
+                               __FUNCTION__,
+                               __FILE__,
+                               __LINE__);
+    processinfo->RT_priority = RT_priority;
+
+    processinfo_loopstart(processinfo);
+
+    TCPMUX_RX *rx     = tcpmux_rx_open(port, NULL);
+    int        loopOK = 1;
+    if(rx == NULL)
+    {
+        processinfo_error(processinfo, "ERROR: cannot listen on port");
+        loopOK = 0;
+    }
+
+    uint64_t NBframe0 = 0;
+    while(loopOK == 1)
+    {
+        loopOK = processinfo_loopstep(processinfo);
+
+        usleep(TCPMUX_WAIT_US);
+
+        uint64_t NBframe   = 0;
+        uint64_t NBskipped = 0;
+        uint64_t NBbyteraw = 0;
+        uint64_t NBbyteenc = 0;
+        pthread_mutex_lock(&rx->lock);
+        for(long i = 0; i < rx->NBstream; i++)
+        {
+            NBframe += rx->stream[i].NBframe;
+            NBskipped += rx->stream[i].NBskipped;
+            NBbyteraw += rx->stream[i].cd.NBbyteraw;
+            NBbyteenc += rx->stream[i].cd.NBbyteenc;
+        }
+        pthread_mutex_unlock(&rx->lock);
+        processinfo_WriteMessage_fmt(
+            processinfo,
+            "%ld streams %lu frames (+%lu) %lu skipped ratio %.2f",
+            rx->NBstream,
+            NBframe,
+            NBframe - NBframe0,
+            NBskipped,
+            (NBbyteenc > 0) ? 1.0 * NBbyteraw / NBbyteenc : 1.0);
+        NBframe0 = NBframe;
+
+        if(rx->done == 1)
+        {
+            loopOK = 0;
+        }
+
+        if((data.signal_INT == 1) || (data.signal_TERM == 1) ||
+                (data.signal_ABRT == 1) || (data.signal_BUS == 1) ||
+                (data.signal_SEGV == 1) || (data.signal_HUP == 1) ||
+                (data.signal_PIPE == 1))
+        {
+            loopOK = 0;
+        }
+    }
+    processinfo_cleanExit(processinfo);
+
+    if(rx != NULL)
+    {
+        pthread_mutex_lock(&rx->lock);
+        for(long i = 0; i < rx->NBstream; i++)
+        {
+            TCPMUX_RXSTREAM *s = &rx->stream[i];
+            if(s->ID == -1)
+            {
+                continue;
+            }
+            printf("%-32s  priority %3d  %10lu frames  %10lu skipped",
+                   data.image[s->ID].md[0].name,
+                   s->priority,
+                   s->NBframe,
+                   s->NBskipped);
+            tcpmux_print_codecstats(s->codec, &s->cd);
+        }
+        pthread_mutex_unlock(&rx->lock);
+    }
+    tcpmux_rx_close(rx);
+    printf("port %d closed\n", port);
+    fflush(stdout);
+
+    return RETURN_SUCCESS;
+}
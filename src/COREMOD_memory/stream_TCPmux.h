@@ -0,0 +1,168 @@
+/**
+ * @file    stream_TCPmux.h
+ * @brief   multiplexed TCP stream transfer : many streams over few connections
+ */
+
+#ifndef COREMOD_MEMORY_STREAM_TCPMUX_H
+#define COREMOD_MEMORY_STREAM_TCPMUX_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "stream_codec.h"
+
+#define TCPMUX_MAGIC 0x786D6C6D
+
+// message types
+#define TCPMUX_MSG_HELLO 1 // first message on a connection
+#define TCPMUX_MSG_DECL  2 // stream declaration, IMAGE_METADATA payload
+                           // acknowledged by receiver with accepted codec
+#define TCPMUX_MSG_DATA  3 // piece of a frame
+
+#define TCPMUX_NBSTREAMMAX 1024
+#define TCPMUX_NBCONNMAX   16
+
+// Message header, followed by size bytes of payload
+// Both ends are assumed to have same byte order, as for IMAGE_METADATA
+typedef struct
+{
+    uint32_t magic;
+    uint16_t type;
+    uint16_t stream; // stream index, connection index for HELLO
+    uint32_t size;   // payload [byte]
+    uint32_t offset; // DATA : payload offset in frame
+                     // DECL : priority
+                     // HELLO : number of connections
+    uint64_t cnt0;   // DATA : source cnt0, HELLO : number of streams
+    uint64_t cnt1;   // DATA : slice index, HELLO : session identifier
+    uint32_t total;  // DATA : encoded frame size [byte]
+    uint16_t codec;  // DECL : requested / accepted STREAM_CODEC_* flags
+                     // DATA : STREAM_CODEC_FRAME_* flags
+    uint16_t reserved;
+} TCPMUX_HEADER;
+
+typedef struct
+{
+    imageID ID;
+    int     priority; // scheduling weight, bytes per round = priority x quantum
+    int     conn;     // connection carrying the stream
+    long    framesize;    // pixel data, one slice [byte]
+    long    framesizeall; // pixel data + keywords [byte]
+    long    NBslices;
+
+    // frame encoding, negotiated with receiver
+    int          codec;
+    STREAM_CODEC cd;
+    char        *encbuf; // encoded frame
+
+    // frame being sent
+    int      active;
+    int      pending; // stream updated while frame was sent
+    uint64_t cnt0;
+    uint64_t slice;
+    long     offset;
+    long     total;      // frame size on the wire [byte]
+    int      frameflags; // STREAM_CODEC_FRAME_* flags
+    long     deficit;    // scheduler credit [byte]
+
+    uint64_t NBframe;   // frames sent
+    uint64_t NBskipped; // updates superseded before they could be sent
+    uint64_t NBbyte;
+} TCPMUX_TXSTREAM;
+
+typedef struct
+{
+    int       fd;
+    int       index;
+    long      NBstream;
+    long     *streamindex; // streams carried, index in TCPMUX_TX stream array
+    void     *mw;          // STREAM_MULTIWAIT on streams carried
+    pthread_t thread;
+    int       status; // 0 while running, -1 on error
+    void     *tx;
+} TCPMUX_TXCONN;
+
+typedef struct
+{
+    long             NBstream;
+    TCPMUX_TXSTREAM *stream;
+    int              NBconn;
+    TCPMUX_TXCONN   *conn;
+    long             quantum; // max message payload [byte]
+    volatile int     stop;
+} TCPMUX_TX;
+
+typedef struct
+{
+    imageID ID;
+    int     priority;
+    long    framesize;
+    long    framesizeall;
+    long    NBslices;
+
+    int          codec;
+    STREAM_CODEC cd;
+    char        *encbuf; // encoded frame, as received
+
+    // frame being received
+    long     offset; // next expected payload offset
+    int      conn;   // connection carrying frame
+    uint64_t cnt0;
+    long     total;
+    int      frameflags;
+
+    uint64_t NBframe;
+    uint64_t NBskipped; // gaps in source cnt0
+    uint64_t NBbyte;
+} TCPMUX_RXSTREAM;
+
+typedef struct
+{
+    int  fdlisten;
+    int  port; // listening port, chosen by system if 0 was requested
+    char prefix[STRINGMAXLEN_IMGNAME]; // prepended to remote stream names
+
+    // session, set by first HELLO message
+    // lock held while stream array is replaced
+    pthread_mutex_t  lock;
+    uint64_t         session;
+    int              NBconn;
+    long             NBstream;
+    TCPMUX_RXSTREAM *stream;
+
+    // accepted connections, -1 if unused
+    int fd[TCPMUX_NBCONNMAX];
+    int hello[TCPMUX_NBCONNMAX];
+    int NBconnopen;
+
+    pthread_t    thread;
+    volatile int stop;
+    volatile int done;   // all connections of session closed, or error
+    int          status; // -1 on error
+} TCPMUX_RX;
+
+errno_t stream__TCPmux_addCLIcmd();
+
+TCPMUX_TX *tcpmux_tx_open(imageID    *IDarray,
+                          int        *priority,
+                          int        *codec,
+                          long        NBstream,
+                          const char *IPaddr,
+                          int         port,
+                          int         NBconn);
+
+errno_t tcpmux_tx_close(TCPMUX_TX *tx);
+
+TCPMUX_RX *tcpmux_rx_open(int port, const char *prefix);
+
+errno_t tcpmux_rx_close(TCPMUX_RX *rx);
+
+errno_t COREMOD_MEMORY_image_NETWORKmux_transmit(const char *streamlist,
+        const char *IPaddr,
+        int         port,
+        int         NBconn,
+        int         RT_priority);
+
+errno_t COREMOD_MEMORY_image_NETWORKmux_receive(int port, int RT_priority);
+
+#endif
@@ -1,6 +1,17 @@
 /**
- * @file    stream_TCP.c
- * @brief   TCP stream transfer
+ * @file    stream_UDP.c
+ * @brief   UDP stream transfer
+ *
+ * Frames are sent with the framed protocol of stream_UDP_frame.c : each
+ * datagram carries frame sequence number and chunk index, and optional XOR
+ * parity chunks allow recovery of lost datagrams.
+ *
+ * The receiver publishes its counters (frames, lost frames, late and
+ * recovered chunks, ...) in UINT64 stream <stream>_udpstat, one element
+ * per UDPFRAME_RXSTATS field.
+ *
+ * Frames are sent unencoded : delta coding (stream_codec.c) needs every
+ * frame to reach the receiver, which UDP does not guarantee.
  */
 
 #include <arpa/inet.h>
@@ -15,12 +26,18 @@
 #include "list_image.h"
 #include "read_shmim.h"
 #include "stream_sem.h"
+#include "stream_UDP_frame.h"
 
 // set to 1 if transfering keywords
 static int TCPTRANSFERKW = 1;
-static int MULTIGRAM_MAGIC = 0x3E; // Random magic to start datagrams with.
 static int DGRAM_CHUNK_SIZE = 62 *
                               1024; // Max payload per datagram, just shy of the maximum 65507 bytes
+// payload per datagram with segmentation offload, fits 1500-byte MTU
+static int DGRAM_GSO_CHUNK_SIZE = 1440;
+// messages per sendmmsg() / recvmmsg() call
+static int UDP_BATCH = 32;
+// set to 1 to use UDP segmentation / receive offload (GSO / GRO) if available
+static int UDP_OFFLOAD = 1;
 
 
 // ==========================================
@@ -33,6 +50,14 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
         int         do_counter_sync,
         int         RT_priority);
 
+imageID COREMOD_MEMORY_image_NETUDPtransmit_fec(const char *IDname,
+        const char *IPaddr,
+        int         port,
+        int         do_counter_sync,
+        int         RT_priority,
+        int         fecgroup,
+        double      lossfrac);
+
 imageID COREMOD_MEMORY_image_NETUDPreceive(int port,
         int do_counter_sync,
         int RT_priority);
@@ -61,6 +86,29 @@ static errno_t COREMOD_MEMORY_image_NETUDPtransmit__cli()
     }
 }
 
+static errno_t COREMOD_MEMORY_image_NETUDPtransmit_fec__cli()
+{
+    if(0 + CLI_checkarg(1, CLIARG_IMG) + CLI_checkarg(2, CLIARG_STR_NOT_IMG) +
+            CLI_checkarg(3, CLIARG_INT64) + CLI_checkarg(4, CLIARG_INT64) +
+            CLI_checkarg(5, CLIARG_INT64) + CLI_checkarg(6, CLIARG_INT64) +
+            CLI_checkarg(7, CLIARG_FLOAT64) ==
+            0)
+    {
+        COREMOD_MEMORY_image_NETUDPtransmit_fec(data.cmdargtoken[1].val.string,
+                                                data.cmdargtoken[2].val.string,
+                                                data.cmdargtoken[3].val.numl,
+                                                data.cmdargtoken[4].val.numl,
+                                                data.cmdargtoken[5].val.numl,
+                                                data.cmdargtoken[6].val.numl,
+                                                data.cmdargtoken[7].val.numf);
+        return CLICMD_SUCCESS;
+    }
+    else
+    {
+        return CLICMD_INVALID_ARG;
+    }
+}
+
 static errno_t COREMOD_MEMORY_image_NETUDPreceive__cli()
 {
     if(0 + CLI_checkarg(1, CLIARG_INT64) + CLI_checkarg(2, CLIARG_INT64) +
@@ -95,6 +143,19 @@ errno_t stream__UDP_addCLIcmd()
         "long COREMOD_MEMORY_image_NETWORKtransmit(const char "
         "*IDname, const char *IPaddr, int port, int do_counter_sync)");
 
+    RegisterCLIcommand(
+        "imudptransmitfec",
+        __FILE__,
+        COREMOD_MEMORY_image_NETUDPtransmit_fec__cli,
+        "transmit image over network, with parity chunks. lossfrac > 0 "
+        "drops datagrams for tests",
+        "<image> <IP addr> <port [long]> <do_counter_sync [int]> "
+        "<RT priority> <FEC group [int]> <lossfrac [float]>",
+        "imudptransmitfec im1 127.0.0.1 8888 0 80 8 0.0",
+        "long COREMOD_MEMORY_image_NETUDPtransmit_fec(const char *IDname, "
+        "const char *IPaddr, int port, int do_counter_sync, int RT_priority, "
+        "int fecgroup, double lossfrac)");
+
     RegisterCLIcommand(
         "imudpreceive",
         __FILE__,
@@ -109,7 +170,7 @@ errno_t stream__UDP_addCLIcmd()
     return RETURN_SUCCESS;
 }
 
-/** continuously transmits 2D image through TCP link
+/** continuously transmits 2D image through UDP link
  * do_counter_sync = 1, force counter to be used for synchronization, ignore semaphores if they exist
  */
 
@@ -118,6 +179,28 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
         int         port,
         int         do_counter_sync,
         int         RT_priority)
+{
+    return COREMOD_MEMORY_image_NETUDPtransmit_fec(IDname,
+            IPaddr,
+            port,
+            do_counter_sync,
+            RT_priority,
+            0,
+            0.0);
+}
+
+/** continuously transmits 2D image through UDP link
+ * fecgroup > 0 : send one parity chunk every fecgroup data chunks
+ * lossfrac > 0 : drop this fraction of datagrams, to test receiver
+ */
+
+imageID COREMOD_MEMORY_image_NETUDPtransmit_fec(const char *IDname,
+        const char *IPaddr,
+        int         port,
+        int         do_counter_sync,
+        int         RT_priority,
+        int         fecgroup,
+        double      lossfrac)
 {
     imageID            ID;
     struct sockaddr_in sock_server;
@@ -130,8 +213,6 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
     uint32_t           xsize, ysize;
     char              *ptr_img_data; // source
     char              *ptr_img_data_slice; // source - offset by slice
-    int                res; // Return status for socket ops
-    int                byte_sock_count;
 
     struct timespec ts;
     long            scnt;
@@ -143,16 +224,13 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
     long            framesize1; // pixel data + metadata
     long            framesizeall; // total frame size : pixel data + metadata + kw
 
-    char           *buff; // socket-side buffer (magic and metadata at beginning)
+    char           *buff; // socket-side buffer (metadata at beginning)
     char           *ptr_buff_metadata; // socket-side buffer at metadata offset
     char           *ptr_buff_data; // socket-side buffer at data offset
     char           *ptr_buff_keywords; // socket-side buffer at keyword offset
 
     // Datagrams
-    long            n_udp_dgrams;
-    long            last_dgram_chunk;
-    char           *ptr_this_dgram;
-    long            this_dgram_size;
+    UDPFRAME_TX     udptx;
 
 
     int semtrig = 6; // TODO - scan for available sem
@@ -257,19 +335,40 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
                 framesize1 + data.image[ID].md[0].NBkw * sizeof(IMAGE_KEYWORD);
         }
 
-        // Prepare segmentation into 62k datagrams
-        n_udp_dgrams = framesizeall / DGRAM_CHUNK_SIZE + 1;
-        last_dgram_chunk = framesizeall % DGRAM_CHUNK_SIZE;
+        // Prepare segmentation into 62k datagrams, or MTU-sized datagrams
+        // if the kernel segments them : chunk index must fit 16 bits
+        int      gso       = 0;
+        uint32_t chunksize = DGRAM_CHUNK_SIZE;
+        if((UDP_OFFLOAD == 1) && (udpframe_gso_available(fds_client) == 1) &&
+                (framesizeall <= 65535L * DGRAM_GSO_CHUNK_SIZE))
+        {
+            gso       = 1;
+            chunksize = DGRAM_GSO_CHUNK_SIZE;
+        }
+        if(udpframe_tx_init(&udptx, chunksize, fecgroup, lossfrac) !=
+                RETURN_SUCCESS)
+        {
+            processinfo_error(processinfo, "ERROR: invalid FEC group size");
+            loopOK = 0;
+        }
+        udpframe_tx_setbatch(&udptx, UDP_BATCH, gso);
 
-        // Prepare transmit buffer - add two bytes for the magic + dgram number
+        // Prepare transmit buffer
         buff = (char *) malloc(sizeof(char) * framesizeall);
-        ptr_buff_metadata = buff + 2;
+        ptr_buff_metadata = buff;
         ptr_buff_data = ptr_buff_metadata + sizeof(IMAGE_METADATA);
         ptr_buff_keywords = ptr_buff_data + framesize;
 
 
         printf("Transfer buffer size = %ld\n", framesizeall);
-        printf("Using %ld UDP datagrams\n", n_udp_dgrams);
+        if(loopOK == 1)
+        {
+            printf("Using %ld UDP datagrams, FEC group %d, batch %d, GSO %d\n",
+                   (framesizeall + udptx.chunksize - 1) / udptx.chunksize,
+                   fecgroup,
+                   udptx.batch,
+                   udptx.gso);
+        }
         fflush(stdout);
 
         oldslice = 0;
@@ -381,35 +480,18 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
                 }
 
                 // Send the datagrams
-                byte_sock_count = 0;
-                ptr_this_dgram = ptr_buff_metadata - 2;
-                for(int dgram = 0; dgram < n_udp_dgrams; ++dgram)
-                {
-                    this_dgram_size = dgram == n_udp_dgrams - 1 ? last_dgram_chunk + 2 :
-                                      DGRAM_CHUNK_SIZE + 2;
-                    // Using the extra 2 bytes at the beginning for the first dgram
-                    // Overwriting the 2 last bytes of previous dgrams for subsequent ones
-                    ptr_this_dgram[0] = MULTIGRAM_MAGIC;
-                    ptr_this_dgram[1] = dgram;
-
-                    //printf("This dgram id: %d, size: %ld\n", dgram, this_dgram_size);
-                    res = sendto(fds_client, ptr_this_dgram, this_dgram_size, 0,
-                                 (const struct sockaddr *)&sock_server, sizeof(sock_server));
-                    byte_sock_count += res;
-
-                    ptr_this_dgram += DGRAM_CHUNK_SIZE; // Shift by 62k
-                }
-
-                if(byte_sock_count != framesizeall + 2 * n_udp_dgrams)
+                if(udpframe_tx_send(&udptx,
+                                    fds_client,
+                                    (const struct sockaddr *) &sock_server,
+                                    sizeof(sock_server),
+                                    buff,
+                                    framesizeall) < 0)
                 {
                     perror("socket send error ");
                     snprintf(errmsg,
                              200,
-                             "ERROR: send() sent a different "
-                             "number of bytes (%d) than "
-                             "expected %ld",
-                             byte_sock_count,
-                             framesizeall + 2 * n_udp_dgrams);
+                             "ERROR: sendmsg() failed on frame %lu",
+                             udptx.stats.NBframe);
                     printf("%s\n", errmsg);
                     fflush(stdout);
                     processinfo_WriteMessage(processinfo, errmsg);
@@ -434,6 +516,12 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
     // ==================================
     processinfo_cleanExit(processinfo);
 
+    printf("%lu frames, %lu datagrams sent, %lu dropped, %lu send calls\n",
+           udptx.stats.NBframe,
+           udptx.stats.NBdgram - udptx.stats.NBdgramdropped,
+           udptx.stats.NBdgramdropped,
+           udptx.stats.NBsyscall);
+    udpframe_tx_free(&udptx);
     free(buff);
 
     close(fds_client);
@@ -453,13 +541,9 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
     int RT_priority)
 {
     struct sockaddr_in sock_server;
-    struct sockaddr_in sock_client;
     int                fds_server;
-    int                fds_client;
-    socklen_t          slen_client = (socklen_t) sizeof(sock_client);
 
     int  flag = 1;
-    long recvsize;
     int  result;
     int  MAXPENDING = 5;
 
@@ -478,13 +562,11 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
     char           *ptr_buff_data; // socket-side buffer at data offset
     char           *ptr_buff_keywords; // socket-side buffer at keyword offset
 
-    char           *buff; // socket-side complete buffer
-    char           *buff_udp; // socket-side datagram buffer
-    buff_udp = (char *) malloc(sizeof(char) * DGRAM_CHUNK_SIZE + 2);
+    int             framedone; // 1 if complete frame from reassembly
 
     // Datagrams
-    long            n_udp_dgrams;
-    long            last_dgram_chunk;
+    UDPFRAME_RX     udprx;
+    udpframe_rx_init(&udprx);
 
     long            NBslices;
     int             socketOpen = 1; // 0 if socket is closed
@@ -612,22 +694,21 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
         exit(0);
     }
 
-    // Try and receive only the metadata
-    // May have to go through several datagrams...
-    int MAX_DATAGRAM_WAIT = 300;
-    for(int n_dgram_wait = 0; n_dgram_wait < MAX_DATAGRAM_WAIT; ++n_dgram_wait)
+    udpframe_rx_setbatch(&udprx, fds_server, UDP_BATCH, UDP_OFFLOAD);
+
+    // Wait for first complete frame, which holds the metadata
+    framedone = 0;
+    while(framedone == 0)
     {
-        recvsize =
-            recvfrom(fds_server, buff_udp, sizeof(IMAGE_METADATA) + 2, 0,
-                     (struct sockaddr *)&sock_client, &slen_client);
-        if(recvsize < 0 || n_dgram_wait == MAX_DATAGRAM_WAIT - 1)
+        framedone = udpframe_rx_recv(&udprx, fds_server);
+        if(framedone < 0)
         {
             char msgstring[200];
 
             snprintf(msgstring,
                      200,
-                     "ERROR receiving image metadata, recvsize = %ld, n_dgram_wait = %d",
-                     recvsize, n_dgram_wait);
+                     "ERROR receiving image metadata, errno = %d",
+                     errno);
             printf("%s\n", msgstring);
 
             if(data.processinfo == 1)
@@ -638,16 +719,8 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
 
             exit(0);
         }
-
-        // printf("Init phase: recvsize = %ld, buff_udp[0] = %d, buff_udp[1] = %d\n", recvsize, buff_udp[0], buff_udp[1]);
-
-        // If this is a first datagram, we're having the metadata here:
-        if(buff_udp[0] == MULTIGRAM_MAGIC && buff_udp[1] == 0)
-        {
-            memcpy(imgmd, buff_udp + 2, sizeof(IMAGE_METADATA));
-            break;
-        }
     }
+    memcpy(imgmd, udprx.framemap->seg[0].iov_base, sizeof(IMAGE_METADATA));
 
     if(data.processinfo == 1)
     {
@@ -732,6 +805,27 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
 
     COREMOD_MEMORY_image_set_createsem(imgmd[0].name, IMAGE_NB_SEMAPHORE);
 
+    // receiver statistics, updated on every frame (no semaphore posted)
+    imageID IDstat = -1;
+    {
+        char     statname[STRINGMAXLEN_IMGNAME];
+        uint32_t statsize = UDPFRAME_RXSTATS_NBFIELD;
+
+        WRITE_IMAGENAME(statname,
+                        "%s%s",
+                        imgmd[0].name,
+                        UDPFRAME_RXSTATS_SUFFIX);
+        delete_image_ID(statname, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(statname,
+                        1,
+                        &statsize,
+                        _DATATYPE_UINT64,
+                        1,
+                        0,
+                        0,
+                        &IDstat);
+    }
+
     xsize    = data.image[ID].md[0].size[0];
     ysize    = data.image[ID].md[0].size[1];
     NBslices = 1;
@@ -786,14 +880,24 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
 
 
 
-    // TODO
-    buff = (char *) malloc(sizeof(char) * framesizefull);
-    ptr_buff_metadata = buff;
-    ptr_buff_data = ptr_buff_metadata + sizeof(IMAGE_METADATA);
-    ptr_buff_keywords = ptr_buff_data + framesize;
+    if((long) udprx.framesize != framesizefull)
+    {
+        char msgstring[200];
 
-    n_udp_dgrams = framesizefull / DGRAM_CHUNK_SIZE + 1;
-    last_dgram_chunk = framesizefull % DGRAM_CHUNK_SIZE;
+        snprintf(msgstring,
+                 200,
+                 "ERROR frame size %u, expected %ld",
+                 udprx.framesize,
+                 framesizefull);
+        printf("%s\n", msgstring);
+
+        if(data.processinfo == 1)
+        {
+            processinfo->loopstat = PROCESSINFO_LOOPSTAT_ERROR;
+            processinfo_WriteMessage(processinfo, msgstring);
+        }
+        exit(0);
+    }
 
     if(data.processinfo == 1)
     {
@@ -806,18 +910,11 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
     int  loopOK  = 1;
 
     // In-loop counter watch and debug prompts
-    long frameincr;
     long minputcnt        = 0;
     long moutputcnt       = 0;
     long monitorinterval  = 10000;
     long monitorindex     = 0;
     long monitorloopindex = 0;
-    long cnt0previous     = 0;
-
-    long first_dgram_bytes = n_udp_dgrams == 1 ? last_dgram_chunk + 2 :
-                             DGRAM_CHUNK_SIZE + 2;
-    long this_dgram_bytes;
-    int abort_frame;
 
 
     while(loopOK == 1)
@@ -840,45 +937,36 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
             }
         }
 
-        // Resync to a 0-zth datagram if necessary
-        abort_frame = 0;
-        for(int n_dgram_wait = 0; n_dgram_wait < MAX_DATAGRAM_WAIT; ++n_dgram_wait)
+        // Receive datagrams until a frame is complete
+        // First frame was received with metadata
+        // Datagrams are reassembled in udprx buffers, not in the image :
+        // incomplete or dropped frames never reach readers
+        while((framedone == 0) && (socketOpen == 1))
         {
-            recvsize = recvfrom(fds_server, buff_udp, first_dgram_bytes, 0,
-                                (struct sockaddr *)&sock_client, &slen_client);
-            if(recvsize < 0 || n_dgram_wait == MAX_DATAGRAM_WAIT - 1)
+            framedone = udpframe_rx_recv(&udprx, fds_server);
+            if(framedone < 0)
             {
-                printf("ERROR recvfrom`()\n");
+                printf("ERROR recvmmsg()\n");
                 socketOpen = 0;
                 break;
             }
-
-            if(buff_udp[0] == MULTIGRAM_MAGIC && buff_udp[1] == 0)
-            {
-                memcpy(buff, buff_udp + 2, first_dgram_bytes - 2);
-                break;
-            }
         }
 
-
-
         if((data.processinfo == 1) && (processinfo->MeasureTiming == 1))
         {
             processinfo_exec_start(processinfo);
         }
 
-        if(recvsize == 0)
-        {
-            socketOpen = 0;
-        }
-
         if(socketOpen == 1)
         {
-            // We already have the first datagram.
+            ptr_buff_metadata = udprx.framemap->seg[0].iov_base;
+            ptr_buff_data     = ptr_buff_metadata + sizeof(IMAGE_METADATA);
+            ptr_buff_keywords = ptr_buff_data + framesize;
 
-            // Weak copy although we now have all the metadata in buff
+            // Weak copy although we now have all the metadata in frame
             imgmd_remote = (IMAGE_METADATA *)(ptr_buff_metadata);
 
+            data.image[ID].md[0].write = 1;
             data.image[ID].md[0].cnt1 =
                 imgmd_remote[0].cnt1; // For multi-slice only, really.
 
@@ -892,34 +980,6 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
                 ptr_dest_data_sliceroot = ptr_dest_data_root + framesize * imgmd_remote[0].cnt1;
             }
 
-            // Acquire and copy subsequent datagrams
-            for(int k_dgram = 1; k_dgram < n_udp_dgrams ; ++k_dgram)
-            {
-                this_dgram_bytes = k_dgram == n_udp_dgrams - 1 ? last_dgram_chunk :
-                                   DGRAM_CHUNK_SIZE;
-                recvsize = recvfrom(fds_server, buff_udp, first_dgram_bytes, 0,
-                                    (struct sockaddr *)&sock_client, &slen_client);
-
-                if(recvsize < 0)
-                {
-                    printf("ERROR recvfrom`()\n");
-                    socketOpen = 0;
-                    break;
-                }
-                if(buff_udp[0] != MULTIGRAM_MAGIC || buff_udp[1] != k_dgram)
-                {
-                    printf("UDP datagram sequence error (magic: %d, seen: %d, expected: %d)\n",
-                           buff_udp[0], buff_udp[1], k_dgram);
-                    abort_frame = 1;
-                    break;
-                }
-                memcpy(buff + k_dgram * DGRAM_CHUNK_SIZE, buff_udp + 2, this_dgram_bytes);
-            }
-        }
-        if(socketOpen == 1 && abort_frame == 0)
-        {
-
-            // Copy the data !
             memcpy(ptr_dest_data_sliceroot, ptr_buff_data, framesize);
 
             if(TCPTRANSFERKW == 1)
@@ -930,18 +990,6 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
                        nbkw * sizeof(IMAGE_KEYWORD));
             }
 
-            frameincr = (long) imgmd_remote[0].cnt0 - cnt0previous;
-
-            if(frameincr > 1)
-            {
-                printf("Skipped %ld frame(s) at index %ld %ld\n",
-                       frameincr - 1,
-                       (long)(imgmd_remote[0].cnt0),
-                       (long)(imgmd_remote[0].cnt1));
-            }
-
-            cnt0previous = imgmd_remote[0].cnt0;
-
             if(monitorindex == monitorinterval)
             {
                 printf(
@@ -953,6 +1001,18 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
                     data.image[ID].md[0].cnt0,
                     data.image[ID].md[0].cnt0 - moutputcnt);
 
+                if(data.processinfo == 1)
+                {
+                    char msgstring[200];
+                    snprintf(msgstring,
+                             200,
+                             "%lu lost %lu late %lu recovered",
+                             udprx.stats.NBframelost,
+                             udprx.stats.NBchunklate,
+                             udprx.stats.NBchunkrecovered);
+                    processinfo_WriteMessage(processinfo, msgstring);
+                }
+
                 minputcnt  = imgmd_remote[0].cnt0;
                 moutputcnt = data.image[ID].md[0].cnt0;
 
@@ -962,6 +1022,7 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
 
             monitorindex++;
 
+            data.image[ID].md[0].write = 0;
             data.image[ID].md[0].cnt0++;
             for(semnb = 0; semnb < data.image[ID].md[0].sem; semnb++)
             {
@@ -977,6 +1038,18 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
             {
                 sem_post(data.image[ID].semlog);
             }
+
+            if(IDstat != -1)
+            {
+                memcpy(data.image[IDstat].array.UI64,
+                       &udprx.stats,
+                       sizeof(UDPFRAME_RXSTATS));
+                __atomic_fetch_add(&data.image[IDstat].md[0].cnt0,
+                                   1,
+                                   __ATOMIC_RELEASE);
+            }
+
+            framedone = 0;
         }
 
         if(socketOpen == 0)
@@ -1041,10 +1114,21 @@ imageID COREMOD_MEMORY_image_NETUDPreceive(
         processinfo_cleanExit(processinfo);
     }
 
-    free(buff);
-    free(buff_udp);
-
-    close(fds_client);
+    printf("%lu frames received, %lu lost, %lu late chunks, "
+           "%lu recovered chunks, %lu invalid datagrams\n",
+           udprx.stats.NBframe,
+           udprx.stats.NBframelost,
+           udprx.stats.NBchunklate,
+           udprx.stats.NBchunkrecovered,
+           udprx.stats.NBdgraminvalid);
+    printf("%lu datagrams in %lu receive calls, %lu copied\n",
+           udprx.stats.NBdgram,
+           udprx.stats.NBsyscall,
+           udprx.stats.NBdgramcopied);
+
+    udpframe_rx_free(&udprx);
+
+    close(fds_server);
 
     printf("port %d closed\n", port);
     fflush(stdout);
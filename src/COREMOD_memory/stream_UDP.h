@@ -13,6 +13,14 @@ imageID COREMOD_MEMORY_image_NETUDPtransmit(const char *IDname,
         int         mode,
         int         RT_priority);
 
+imageID COREMOD_MEMORY_image_NETUDPtransmit_fec(const char *IDname,
+        const char *IPaddr,
+        int         port,
+        int         mode,
+        int         RT_priority,
+        int         fecgroup,
+        double      lossfrac);
+
 imageID
 COREMOD_MEMORY_image_NETUDPreceive(int port, int mode, int RT_priority);
 
@@ -0,0 +1,1545 @@
+/**
+ * @file    stream_UDP_frame.c
+ * @brief   framed UDP protocol : sequence numbers, reassembly, XOR parity
+ *
+ * Each frame is cut into NBchunk data chunks of chunksize bytes (last one
+ * shorter). Each datagram holds a UDPFRAME_HEADER with frame sequence
+ * number and chunk index, so that chunks can be placed in the frame buffer
+ * in any arrival order.
+ *
+ * With fecgroup = G > 0, a parity chunk is sent after every G data chunks :
+ * XOR of the group's chunks, zero-padded to chunksize. A single lost data
+ * chunk per group is rebuilt from the parity chunk.
+ *
+ * The transmitter draws a random session ID when it is set up. A receiver
+ * seeing a new session ID drops frames in reassembly and restarts sequence
+ * numbering, so that a restarted sender is followed immediately.
+ *
+ * Receiver keeps up to UDPFRAME_NBSLOT frames in reassembly. A frame is
+ * delivered as soon as all its data chunks are available. Delivery is in
+ * sequence order : older incomplete frames are then dropped and counted
+ * lost, and chunks of frames older than the last delivered one are
+ * counted late.
+ *
+ * Batched transfer :
+ * Transmitter queues all datagrams of a frame and sends them with
+ * sendmmsg(). With UDP segmentation offload (GSO), consecutive datagrams of
+ * full size are passed to the kernel as a single message.
+ * Receiver calls recvmmsg() and predicts which datagram comes next : the
+ * payload iovec of each message points to the chunk's place in the frame,
+ * so that datagrams arriving in order are written in place by the kernel,
+ * into the slot buffer or directly into the destination map set by
+ * udpframe_rx_setdest(). Datagrams not matching the prediction are copied.
+ * With generic receive offload (GRO), a message holds several datagrams.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "stream_UDP_frame.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// iovecs per received message : header and frame pieces for each datagram,
+// and spare buffer
+#define UDPFRAME_RXNBIOV (UDPFRAME_NBSEGMAX * (1 + UDPFRAME_MAP_NBSEG) + 1)
+
+
+
+// predicted datagram in received message
+typedef struct
+{
+    long           offset; // in message
+    long           size;   // header + payload
+    uint64_t       frameseq;
+    long           chunk;
+    int            isparity;
+    UDPFRAME_SLOT *slot; // NULL if payload is not placed in frame
+    uint64_t       generation;
+} UDPFRAME_RXPRED;
+
+// received datagram, pending processing
+typedef struct
+{
+    UDPFRAME_HEADER header;
+    const char     *payload; // in bounce buffer, unless in place
+    long            payloadsize;
+    int             inplace;
+    UDPFRAME_SLOT  *slot;
+    uint64_t        generation;
+} UDPFRAME_RXDGRAM;
+
+typedef struct
+{
+    int NBmsg;
+    int NBmsgrecv; // messages set up for next recvmmsg()
+
+    struct mmsghdr  *mmsg;
+    struct iovec    *iov;    // NBmsg x UDPFRAME_RXNBIOV
+    char            *cmsg;   // NBmsg x CMSG_SPACE(sizeof(int))
+    UDPFRAME_HEADER *header; // NBmsg x UDPFRAME_NBSEGMAX
+    UDPFRAME_RXPRED *pred;   // NBmsg x UDPFRAME_NBSEGMAX
+    int             *NBpred; // NBmsg
+    char            *spare;  // NBmsg x UDPFRAME_DGRAM_MAXSIZE
+    char            *bounce; // NBmsg x UDPFRAME_DGRAM_MAXSIZE
+
+    UDPFRAME_RXDGRAM *dgram; // NBmsg x UDPFRAME_NBSEGMAX
+    long              NBdgram;
+    long              dgramindex; // next datagram to process
+
+    // next expected datagram
+    int      predOK;
+    uint64_t predseq;
+    long     predindex; // position in frame sending order
+
+    int nbsegpred; // datagrams per message
+} UDPFRAME_RXBATCH;
+
+
+
+
+static void udpframe_xor(char *dest, const char *src, long nbbyte)
+{
+    long nbword = nbbyte / sizeof(uint64_t);
+
+    // buffers may be unaligned when frame is scattered
+    for(long i = 0; i < nbword; i++)
+    {
+        uint64_t vdest;
+        uint64_t vsrc;
+        memcpy(&vdest, dest + i * sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&vsrc, src + i * sizeof(uint64_t), sizeof(uint64_t));
+        vdest ^= vsrc;
+        memcpy(dest + i * sizeof(uint64_t), &vdest, sizeof(uint64_t));
+    }
+    for(long i = nbword * sizeof(uint64_t); i < nbbyte; i++)
+    {
+        dest[i] ^= src[i];
+    }
+}
+
+// data chunk payload size
+static long udpframe_chunkbytes(uint32_t framesize,
+                                uint32_t chunksize,
+                                long     chunk)
+{
+    long nbbyte = (long) framesize - chunk * chunksize;
+
+    return (nbbyte < (long) chunksize) ? nbbyte : (long) chunksize;
+}
+
+static long udpframe_nbgroup(long NBchunk, int fecgroup)
+{
+    return (fecgroup > 0) ? (NBchunk + fecgroup - 1) / fecgroup : 0;
+}
+
+// position of datagram in sending order
+static long udpframe_dgramindex(long chunk,
+                                int  isparity,
+                                long NBchunk,
+                                int  fecgroup)
+{
+    if(isparity)
+    {
+        // parity follows last chunk of group
+        long chunkend = (chunk + 1) * fecgroup;
+        if(chunkend > NBchunk)
+        {
+            chunkend = NBchunk;
+        }
+        return chunkend + chunk;
+    }
+
+    return (fecgroup > 0) ? chunk + chunk / fecgroup : chunk;
+}
+
+// datagram at position index in sending order, returns 0 past end of frame
+static int udpframe_dgramchunk(long  index,
+                               long  NBchunk,
+                               int   fecgroup,
+                               long *chunk,
+                               int  *isparity)
+{
+    if(fecgroup == 0)
+    {
+        *chunk    = index;
+        *isparity = 0;
+        return (index < NBchunk);
+    }
+
+    long group    = index / (fecgroup + 1);
+    long c        = group * fecgroup + index % (fecgroup + 1);
+    long chunkend = group * fecgroup + fecgroup;
+    if(chunkend > NBchunk)
+    {
+        chunkend = NBchunk;
+    }
+
+    if(group * fecgroup >= NBchunk)
+    {
+        return 0;
+    }
+    if(c < chunkend)
+    {
+        *chunk    = c;
+        *isparity = 0;
+        return 1;
+    }
+    if(c == chunkend)
+    {
+        *chunk    = group;
+        *isparity = 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+
+
+static long udpframe_map_size(const UDPFRAME_MAP *map)
+{
+    long size = 0;
+
+    for(int s = 0; s < map->NBseg; s++)
+    {
+        size += map->seg[s].iov_len;
+    }
+    return size;
+}
+
+// pieces of frame bytes [offset, offset + nbbyte), returns number of pieces
+static int udpframe_map_iov(const UDPFRAME_MAP *map,
+                            long                offset,
+                            long                nbbyte,
+                            struct iovec       *iov)
+{
+    int NBpiece = 0;
+
+    for(int s = 0; (s < map->NBseg) && (nbbyte > 0); s++)
+    {
+        long seglen = map->seg[s].iov_len;
+        if(offset >= seglen)
+        {
+            offset -= seglen;
+            continue;
+        }
+
+        long len = seglen - offset;
+        if(len > nbbyte)
+        {
+            len = nbbyte;
+        }
+        iov[NBpiece].iov_base = (char *) map->seg[s].iov_base + offset;
+        iov[NBpiece].iov_len  = len;
+        NBpiece++;
+
+        nbbyte -= len;
+        offset = 0;
+    }
+    return NBpiece;
+}
+
+static void udpframe_map_write(const UDPFRAME_MAP *map,
+                               long                offset,
+                               const char         *src,
+                               long                nbbyte)
+{
+    struct iovec iov[UDPFRAME_MAP_NBSEG];
+
+    int NBpiece = udpframe_map_iov(map, offset, nbbyte, iov);
+    for(int i = 0; i < NBpiece; i++)
+    {
+        memcpy(iov[i].iov_base, src, iov[i].iov_len);
+        src += iov[i].iov_len;
+    }
+}
+
+// XOR frame bytes into dest
+static void udpframe_map_xorto(const UDPFRAME_MAP *map,
+                               long                offset,
+                               char               *dest,
+                               long                nbbyte)
+{
+    struct iovec iov[UDPFRAME_MAP_NBSEG];
+
+    int NBpiece = udpframe_map_iov(map, offset, nbbyte, iov);
+    for(int i = 0; i < NBpiece; i++)
+    {
+        udpframe_xor(dest, iov[i].iov_base, iov[i].iov_len);
+        dest += iov[i].iov_len;
+    }
+}
+
+// copy bytes [offset, offset + nbbyte) of iovec array
+static void udpframe_iov_gather(const struct iovec *iov,
+                                long                NBiov,
+                                long                offset,
+                                char               *dest,
+                                long                nbbyte)
+{
+    for(long i = 0; (i < NBiov) && (nbbyte > 0); i++)
+    {
+        long len = iov[i].iov_len;
+        if(offset >= len)
+        {
+            offset -= len;
+            continue;
+        }
+        len -= offset;
+        if(len > nbbyte)
+        {
+            len = nbbyte;
+        }
+        memcpy(dest, (char *) iov[i].iov_base + offset, len);
+        dest += len;
+        nbbyte -= len;
+        offset = 0;
+    }
+}
+
+
+
+
+// session ID from time and PID, mixed (splitmix64 finalizer)
+static uint64_t udpframe_newsession()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    uint64_t z = ((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec) ^
+                 ((uint64_t) getpid() << 40);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Set up frame transmitter
+ *
+ * @param chunksize  max datagram payload, rounded down to multiple of 8
+ * @param fecgroup   data chunks per parity chunk, 0 for no parity
+ * @param lossfrac   fraction of datagrams dropped, for tests
+ */
+errno_t udpframe_tx_init(UDPFRAME_TX *tx,
+                         uint32_t     chunksize,
+                         int          fecgroup,
+                         double       lossfrac)
+{
+    DEBUG_TRACE_FSTART();
+
+    memset(tx, 0, sizeof(UDPFRAME_TX));
+
+    tx->chunksize = chunksize & ~((uint32_t) 7);
+    if(tx->chunksize == 0)
+    {
+        FUNC_RETURN_FAILURE("chunk size %u too small", chunksize);
+    }
+    if((fecgroup < 0) || (fecgroup > 255))
+    {
+        FUNC_RETURN_FAILURE("FEC group size %d out of range", fecgroup);
+    }
+    tx->fecgroup = fecgroup;
+    tx->lossfrac = lossfrac;
+    tx->lossseed = 1;
+    tx->session  = udpframe_newsession();
+
+    tx->batch    = 1;
+    tx->gso      = 0;
+    tx->nbsegmax = 1;
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+errno_t udpframe_tx_free(UDPFRAME_TX *tx)
+{
+    free(tx->parity);
+    tx->parity     = NULL;
+    tx->paritysize = 0;
+
+    free(tx->header);
+    free(tx->iov);
+    free(tx->mmsg);
+    free(tx->cmsg);
+    tx->header     = NULL;
+    tx->iov        = NULL;
+    tx->mmsg       = NULL;
+    tx->cmsg       = NULL;
+    tx->NBdgrammax = 0;
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Check if kernel supports UDP segmentation offload on socket
+ *
+ * @return 1 if supported
+ */
+int udpframe_gso_available(int fd)
+{
+    int val = 0;
+
+    // fails with ENOPROTOOPT if not supported
+    return (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)) == 0);
+}
+
+/**
+ * @brief Set transmit batching
+ *
+ * @param batch  messages per sendmmsg() call, 1 for one sendmsg() per message
+ * @param gso    send consecutive datagrams as one message, see
+ *               udpframe_gso_available()
+ */
+errno_t udpframe_tx_setbatch(UDPFRAME_TX *tx, int batch, int gso)
+{
+    tx->batch    = (batch < 1) ? 1 : batch;
+    tx->gso      = gso;
+    tx->nbsegmax = 1;
+    if(gso == 1)
+    {
+        tx->nbsegmax = UDPFRAME_GSO_MAXSIZE /
+                       (sizeof(UDPFRAME_HEADER) + tx->chunksize);
+        if(tx->nbsegmax > UDPFRAME_NBSEGMAX)
+        {
+            tx->nbsegmax = UDPFRAME_NBSEGMAX;
+        }
+        if(tx->nbsegmax < 1)
+        {
+            tx->nbsegmax = 1;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+// per-frame datagram and message buffers
+static errno_t udpframe_tx_alloc(UDPFRAME_TX *tx, long NBdgram, long NBgroup)
+{
+    if(NBdgram > tx->NBdgrammax)
+    {
+        free(tx->header);
+        free(tx->iov);
+        free(tx->mmsg);
+        free(tx->cmsg);
+        tx->header =
+            (UDPFRAME_HEADER *) malloc(sizeof(UDPFRAME_HEADER) * NBdgram);
+        tx->iov  = (struct iovec *) malloc(sizeof(struct iovec) * 2 * NBdgram);
+        tx->mmsg = (struct mmsghdr *) malloc(sizeof(struct mmsghdr) * NBdgram);
+        tx->cmsg = (char *) malloc(CMSG_SPACE(sizeof(uint16_t)) * NBdgram);
+        if((tx->header == NULL) || (tx->iov == NULL) || (tx->mmsg == NULL) ||
+                (tx->cmsg == NULL))
+        {
+            udpframe_tx_free(tx);
+            return RETURN_FAILURE;
+        }
+        tx->NBdgrammax = NBdgram;
+    }
+
+    if(tx->paritysize < (size_t) NBgroup * tx->chunksize)
+    {
+        free(tx->parity);
+        tx->paritysize = (size_t) NBgroup * tx->chunksize;
+        tx->parity     = (char *) malloc(tx->paritysize);
+        if(tx->parity == NULL)
+        {
+            tx->paritysize = 0;
+            return RETURN_FAILURE;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+// queue datagram, unless dropped by loss injection
+static void udpframe_tx_queue(UDPFRAME_TX           *tx,
+                              const UDPFRAME_HEADER *header,
+                              const char            *payload,
+                              long                   nbbyte,
+                              long                  *NBqueued,
+                              long                  *NBmsg)
+{
+    if((tx->lossfrac > 0.0) &&
+            (1.0 * rand_r(&tx->lossseed) / RAND_MAX < tx->lossfrac))
+    {
+        tx->stats.NBdgramdropped++;
+        return;
+    }
+
+    long d = *NBqueued;
+
+    tx->header[d]               = *header;
+    tx->iov[2 * d].iov_base     = &tx->header[d];
+    tx->iov[2 * d].iov_len      = sizeof(UDPFRAME_HEADER);
+    tx->iov[2 * d + 1].iov_base = (void *) payload;
+    tx->iov[2 * d + 1].iov_len  = nbbyte;
+
+    // GSO segments have the same size, except last one
+    struct msghdr *msg = (*NBmsg > 0) ? &tx->mmsg[*NBmsg - 1].msg_hdr : NULL;
+    if((msg != NULL) && (msg->msg_iovlen < (size_t) 2 * tx->nbsegmax) &&
+            (tx->iov[2 * d - 1].iov_len == tx->chunksize))
+    {
+        msg->msg_iovlen += 2;
+    }
+    else
+    {
+        msg = &tx->mmsg[*NBmsg].msg_hdr;
+        memset(msg, 0, sizeof(struct msghdr));
+        msg->msg_iov    = &tx->iov[2 * d];
+        msg->msg_iovlen = 2;
+        (*NBmsg)++;
+    }
+    (*NBqueued)++;
+}
+
+static errno_t udpframe_tx_flush(UDPFRAME_TX *tx, int fd, long NBmsg)
+{
+    long m = 0;
+
+    while(m < NBmsg)
+    {
+        if(tx->batch == 1)
+        {
+            if(sendmsg(fd, &tx->mmsg[m].msg_hdr, 0) < 0)
+            {
+                return RETURN_FAILURE;
+            }
+            m++;
+        }
+        else
+        {
+            long n = NBmsg - m;
+            if(n > tx->batch)
+            {
+                n = tx->batch;
+            }
+            int NBsent = sendmmsg(fd, &tx->mmsg[m], n, 0);
+            if(NBsent < 0)
+            {
+                return RETURN_FAILURE;
+            }
+            m += NBsent;
+        }
+        tx->stats.NBsyscall++;
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Send one frame
+ *
+ * @return number of datagrams sent, -1 on socket error
+ */
+long udpframe_tx_send(UDPFRAME_TX           *tx,
+                      int                    fd,
+                      const struct sockaddr *addr,
+                      socklen_t              addrlen,
+                      const char            *frame,
+                      uint32_t               framesize)
+{
+    UDPFRAME_HEADER header;
+
+    long NBchunk = (framesize + tx->chunksize - 1) / tx->chunksize;
+    if(NBchunk == 0)
+    {
+        NBchunk = 1;
+    }
+    if(NBchunk > 65535)
+    {
+        PRINT_ERROR("frame size %u needs more than 65535 chunks", framesize);
+        return -1;
+    }
+
+    long NBgroup = udpframe_nbgroup(NBchunk, tx->fecgroup);
+    if(udpframe_tx_alloc(tx, NBchunk + NBgroup, NBgroup) != RETURN_SUCCESS)
+    {
+        PRINT_ERROR("malloc() error");
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic     = UDPFRAME_MAGIC;
+    header.fecgroup  = tx->fecgroup;
+    header.NBchunk   = NBchunk;
+    header.framesize = framesize;
+    header.chunksize = tx->chunksize;
+    header.session   = tx->session;
+    header.frameseq  = tx->frameseq;
+
+    long NBdgram  = 0;
+    long NBqueued = 0;
+    long NBmsg    = 0;
+    for(long chunk = 0; chunk < NBchunk; chunk++)
+    {
+        const char *payload = frame + chunk * tx->chunksize;
+        long nbbyte = udpframe_chunkbytes(framesize, tx->chunksize, chunk);
+
+        header.flags = 0;
+        header.chunk = chunk;
+        udpframe_tx_queue(tx, &header, payload, nbbyte, &NBqueued, &NBmsg);
+        NBdgram++;
+
+        if(NBgroup > 0)
+        {
+            long  group  = chunk / tx->fecgroup;
+            char *parity = tx->parity + group * tx->chunksize;
+            if(chunk % tx->fecgroup == 0)
+            {
+                memset(parity, 0, tx->chunksize);
+            }
+            udpframe_xor(parity, payload, nbbyte);
+
+            // parity chunk after last chunk of group
+            if((chunk % tx->fecgroup == tx->fecgroup - 1) ||
+                    (chunk == NBchunk - 1))
+            {
+                header.flags = UDPFRAME_FLAG_PARITY;
+                header.chunk = group;
+                udpframe_tx_queue(tx,
+                                  &header,
+                                  parity,
+                                  tx->chunksize,
+                                  &NBqueued,
+                                  &NBmsg);
+                NBdgram++;
+            }
+        }
+    }
+
+    for(long m = 0; m < NBmsg; m++)
+    {
+        struct msghdr *msg = &tx->mmsg[m].msg_hdr;
+
+        msg->msg_name    = (void *) addr;
+        msg->msg_namelen = addrlen;
+        if(msg->msg_iovlen > 2)
+        {
+            uint16_t segsize = sizeof(UDPFRAME_HEADER) + tx->chunksize;
+
+            msg->msg_control    = tx->cmsg + m * CMSG_SPACE(sizeof(uint16_t));
+            msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cm  = CMSG_FIRSTHDR(msg);
+            cm->cmsg_level      = SOL_UDP;
+            cm->cmsg_type       = UDP_SEGMENT;
+            cm->cmsg_len        = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cm), &segsize, sizeof(segsize));
+        }
+    }
+
+    if(udpframe_tx_flush(tx, fd, NBmsg) != RETURN_SUCCESS)
+    {
+        if(tx->gso == 1)
+        {
+            // device may not offload UDP checksum : send frame again without
+            // GSO, receiver ignores duplicates
+            PRINT_WARNING("UDP segmentation offload failed (%s), disabled",
+                          strerror(errno));
+            udpframe_tx_setbatch(tx, tx->batch, 0);
+            return udpframe_tx_send(tx, fd, addr, addrlen, frame, framesize);
+        }
+        perror("sendmsg");
+        return -1;
+    }
+
+    tx->stats.NBframe++;
+    tx->stats.NBdgram += NBdgram;
+    tx->frameseq++;
+
+    return NBdgram;
+}
+
+
+
+
+static void udpframe_rx_closeslot(UDPFRAME_RX *rx, UDPFRAME_SLOT *slot)
+{
+    if(slot->direct == 1)
+    {
+        rx->destclaimed = 0;
+    }
+    slot->active = 0;
+    slot->direct = 0;
+}
+
+static void udpframe_rx_freeslots(UDPFRAME_RX *rx)
+{
+    for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+    {
+        udpframe_rx_closeslot(rx, &rx->slot[s]);
+        free(rx->slot[s].buff);
+        free(rx->slot[s].chunkOK);
+        free(rx->slot[s].parity);
+        free(rx->slot[s].parityOK);
+        memset(&rx->slot[s], 0, sizeof(UDPFRAME_SLOT));
+    }
+    free(rx->tmpchunk);
+    rx->tmpchunk = NULL;
+    rx->generation++;
+}
+
+static void udpframe_rx_freebatch(UDPFRAME_RX *rx)
+{
+    UDPFRAME_RXBATCH *rb = (UDPFRAME_RXBATCH *) rx->rxbatch;
+
+    if(rb != NULL)
+    {
+        free(rb->mmsg);
+        free(rb->iov);
+        free(rb->cmsg);
+        free(rb->header);
+        free(rb->pred);
+        free(rb->NBpred);
+        free(rb->spare);
+        free(rb->bounce);
+        free(rb->dgram);
+        free(rb);
+    }
+    rx->rxbatch = NULL;
+}
+
+errno_t udpframe_rx_init(UDPFRAME_RX *rx)
+{
+    memset(rx, 0, sizeof(UDPFRAME_RX));
+    rx->batch = 1;
+
+    return RETURN_SUCCESS;
+}
+
+errno_t udpframe_rx_free(UDPFRAME_RX *rx)
+{
+    udpframe_rx_freeslots(rx);
+    udpframe_rx_freebatch(rx);
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Set batched receive, for udpframe_rx_recv()
+ *
+ * Datagrams received but not yet processed are dropped.
+ *
+ * @param batch  messages per recvmmsg() call
+ * @param gro    enable generic receive offload on socket, if supported
+ */
+errno_t udpframe_rx_setbatch(UDPFRAME_RX *rx, int fd, int batch, int gro)
+{
+    udpframe_rx_freebatch(rx);
+
+    rx->batch = (batch < 1) ? 1 : batch;
+    rx->gro   = 0;
+    if(gro == 1)
+    {
+        int val = 1;
+        if(setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)) == 0)
+        {
+            rx->gro = 1;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Write next frames directly to destination buffers
+ *
+ * Frame bytes are laid out consecutively over the map's buffers, which must
+ * add up to the frame size. Only one frame at a time is written to the
+ * destination, others are reassembled in internal buffers.
+ * Incomplete frames may leave partial data in destination, and the next
+ * frame overwrites it : the destination must not be visible to readers
+ * (e.g. a published stream slice) until the frame is delivered. Copy
+ * delivered frames from framemap otherwise.
+ *
+ * @param map  destination, NULL to stop direct writes
+ */
+errno_t udpframe_rx_setdest(UDPFRAME_RX *rx, const UDPFRAME_MAP *map)
+{
+    if(map == NULL)
+    {
+        rx->destset = 0;
+        return RETURN_SUCCESS;
+    }
+
+    if((map->NBseg < 1) || (map->NBseg > UDPFRAME_MAP_NBSEG))
+    {
+        PRINT_ERROR("destination map has %d buffers, max %d",
+                    map->NBseg,
+                    UDPFRAME_MAP_NBSEG);
+        return RETURN_FAILURE;
+    }
+    rx->destmap = *map;
+    rx->destset = 1;
+
+    return RETURN_SUCCESS;
+}
+
+// allocate slots for new frame geometry
+static errno_t udpframe_rx_setup(UDPFRAME_RX *rx, const UDPFRAME_HEADER *hd)
+{
+    DEBUG_TRACE_FSTART();
+
+    udpframe_rx_freeslots(rx);
+
+    rx->framesize = hd->framesize;
+    rx->chunksize = hd->chunksize;
+    rx->NBchunk   = hd->NBchunk;
+    rx->fecgroup  = hd->fecgroup;
+
+    long NBgroup = udpframe_nbgroup(rx->NBchunk, rx->fecgroup);
+    if(NBgroup == 0)
+    {
+        NBgroup = 1;
+    }
+
+    rx->tmpchunk = (char *) malloc(rx->chunksize);
+    if(rx->tmpchunk == NULL)
+    {
+        rx->NBchunk = 0;
+        FUNC_RETURN_FAILURE("cannot allocate reassembly buffers");
+    }
+
+    for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+    {
+        UDPFRAME_SLOT *slot = &rx->slot[s];
+
+        slot->buff     = (char *) malloc((size_t) rx->NBchunk * rx->chunksize);
+        slot->chunkOK  = (uint8_t *) malloc(rx->NBchunk);
+        slot->parity   = (char *) malloc((size_t) NBgroup * rx->chunksize);
+        slot->parityOK = (uint8_t *) malloc(NBgroup);
+        if((slot->buff == NULL) || (slot->chunkOK == NULL) ||
+                (slot->parity == NULL) || (slot->parityOK == NULL))
+        {
+            udpframe_rx_freeslots(rx);
+            rx->NBchunk = 0;
+            FUNC_RETURN_FAILURE("cannot allocate reassembly buffers");
+        }
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static UDPFRAME_SLOT *udpframe_rx_findslot(UDPFRAME_RX *rx, uint64_t frameseq)
+{
+    for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+    {
+        if((rx->slot[s].active == 1) && (rx->slot[s].frameseq == frameseq))
+        {
+            return &rx->slot[s];
+        }
+    }
+    return NULL;
+}
+
+// start frame in slot, incomplete frame in slot is dropped
+static UDPFRAME_SLOT *udpframe_rx_openslot(UDPFRAME_RX   *rx,
+        UDPFRAME_SLOT *slot,
+        uint64_t       frameseq)
+{
+    udpframe_rx_closeslot(rx, slot);
+
+    slot->active     = 1;
+    slot->frameseq   = frameseq;
+    slot->generation = ++rx->generation;
+    memset(slot->chunkOK, 0, rx->NBchunk);
+    if(rx->fecgroup > 0)
+    {
+        memset(slot->parityOK, 0, udpframe_nbgroup(rx->NBchunk, rx->fecgroup));
+    }
+    slot->NBchunkOK = 0;
+
+    if((rx->destset == 1) && (rx->destclaimed == 0) &&
+            (udpframe_map_size(&rx->destmap) == (long) rx->framesize))
+    {
+        slot->map       = rx->destmap;
+        slot->direct    = 1;
+        rx->destclaimed = 1;
+    }
+    else
+    {
+        slot->map.NBseg           = 1;
+        slot->map.seg[0].iov_base = slot->buff;
+        slot->map.seg[0].iov_len  = (size_t) rx->NBchunk * rx->chunksize;
+    }
+
+    return slot;
+}
+
+// rebuild missing chunk of group from parity, if possible
+static void udpframe_rx_recover(UDPFRAME_RX *rx, UDPFRAME_SLOT *slot, long group)
+{
+    long chunk0 = group * rx->fecgroup;
+    long chunk1 = chunk0 + rx->fecgroup;
+    if(chunk1 > rx->NBchunk)
+    {
+        chunk1 = rx->NBchunk;
+    }
+
+    if(slot->parityOK[group] == 0)
+    {
+        return;
+    }
+
+    long missing   = -1;
+    long NBmissing = 0;
+    for(long chunk = chunk0; chunk < chunk1; chunk++)
+    {
+        if(slot->chunkOK[chunk] == 0)
+        {
+            missing = chunk;
+            NBmissing++;
+        }
+    }
+    if(NBmissing != 1)
+    {
+        return;
+    }
+
+    memcpy(rx->tmpchunk, slot->parity + group * rx->chunksize, rx->chunksize);
+    for(long chunk = chunk0; chunk < chunk1; chunk++)
+    {
+        if(chunk != missing)
+        {
+            udpframe_map_xorto(&slot->map,
+                               chunk * rx->chunksize,
+                               rx->tmpchunk,
+                               udpframe_chunkbytes(rx->framesize,
+                                                   rx->chunksize,
+                                                   chunk));
+        }
+    }
+    udpframe_map_write(&slot->map,
+                       missing * rx->chunksize,
+                       rx->tmpchunk,
+                       udpframe_chunkbytes(rx->framesize, rx->chunksize,
+                                           missing));
+
+    slot->chunkOK[missing] = 1;
+    slot->NBchunkOK++;
+    rx->stats.NBchunkrecovered++;
+}
+
+// check datagram header, set up slots for new frame geometry
+// returns 0 if datagram is valid
+static int udpframe_rx_check(UDPFRAME_RX           *rx,
+                             const UDPFRAME_HEADER *hd,
+                             long                   payloadsize)
+{
+    if((hd->magic != UDPFRAME_MAGIC) || (hd->chunksize == 0) ||
+            (hd->NBchunk == 0) ||
+            ((long) hd->NBchunk * hd->chunksize < (long) hd->framesize))
+    {
+        rx->stats.NBdgraminvalid++;
+        return -1;
+    }
+
+    if((hd->flags & UDPFRAME_FLAG_PARITY) != 0)
+    {
+        if((hd->fecgroup == 0) ||
+                (hd->chunk >= udpframe_nbgroup(hd->NBchunk, hd->fecgroup)) ||
+                (payloadsize != (long) hd->chunksize))
+        {
+            rx->stats.NBdgraminvalid++;
+            return -1;
+        }
+    }
+    else
+    {
+        if((hd->chunk >= hd->NBchunk) ||
+                (payloadsize !=
+                 udpframe_chunkbytes(hd->framesize, hd->chunksize, hd->chunk)))
+        {
+            rx->stats.NBdgraminvalid++;
+            return -1;
+        }
+    }
+
+    if((hd->framesize != rx->framesize) || (hd->chunksize != rx->chunksize) ||
+            (hd->NBchunk != rx->NBchunk) || (hd->fecgroup != rx->fecgroup))
+    {
+        // first frame, or sender restarted with new settings
+        if(udpframe_rx_setup(rx, hd) != RETURN_SUCCESS)
+        {
+            return -1;
+        }
+        rx->delivered = 0;
+    }
+
+    if(hd->session != rx->session)
+    {
+        // first frame, or sender restarted : sequence starts again
+        for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+        {
+            if(rx->slot[s].active == 1)
+            {
+                udpframe_rx_closeslot(rx, &rx->slot[s]);
+            }
+        }
+        rx->session   = hd->session;
+        rx->delivered = 0;
+        rx->stats.NBsession++;
+    }
+
+    return 0;
+}
+
+// insert valid datagram, payload may already be in place in frame
+// returns 1 if a frame is complete
+static int udpframe_rx_insert(UDPFRAME_RX           *rx,
+                              const UDPFRAME_HEADER *hd,
+                              const char            *payload,
+                              long                   payloadsize,
+                              int                    inplace)
+{
+    int isparity = ((hd->flags & UDPFRAME_FLAG_PARITY) != 0);
+
+    if((rx->delivered == 1) && (hd->frameseq <= rx->frameseq))
+    {
+        if(!isparity)
+        {
+            rx->stats.NBchunklate++;
+        }
+        return 0;
+    }
+
+    // find frame, or oldest slot
+    UDPFRAME_SLOT *slot = udpframe_rx_findslot(rx, hd->frameseq);
+    if(slot == NULL)
+    {
+        UDPFRAME_SLOT *slotold = NULL;
+        for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+        {
+            if(rx->slot[s].active == 0)
+            {
+                if((slotold == NULL) || (slotold->active == 1))
+                {
+                    slotold = &rx->slot[s];
+                }
+            }
+            else if((slotold == NULL) ||
+                    ((slotold->active == 1) &&
+                     (rx->slot[s].frameseq < slotold->frameseq)))
+            {
+                slotold = &rx->slot[s];
+            }
+        }
+
+        if((slotold->active == 1) && (slotold->frameseq > hd->frameseq))
+        {
+            // older than all frames in reassembly
+            if(!isparity)
+            {
+                rx->stats.NBchunklate++;
+            }
+            return 0;
+        }
+        slot = udpframe_rx_openslot(rx, slotold, hd->frameseq);
+    }
+
+    long group;
+    if(isparity)
+    {
+        if(slot->parityOK[hd->chunk] == 1)
+        {
+            return 0;
+        }
+        if(inplace == 0)
+        {
+            memcpy(slot->parity + (long) hd->chunk * rx->chunksize,
+                   payload,
+                   payloadsize);
+        }
+        slot->parityOK[hd->chunk] = 1;
+        group                     = hd->chunk;
+    }
+    else
+    {
+        if(slot->chunkOK[hd->chunk] == 1)
+        {
+            return 0;
+        }
+        if(inplace == 0)
+        {
+            udpframe_map_write(&slot->map,
+                               (long) hd->chunk * rx->chunksize,
+                               payload,
+                               payloadsize);
+        }
+        slot->chunkOK[hd->chunk] = 1;
+        slot->NBchunkOK++;
+        group = (rx->fecgroup > 0) ? hd->chunk / rx->fecgroup : -1;
+    }
+
+    if((group >= 0) && (slot->NBchunkOK < rx->NBchunk))
+    {
+        udpframe_rx_recover(rx, slot, group);
+    }
+
+    if(slot->NBchunkOK < rx->NBchunk)
+    {
+        return 0;
+    }
+
+    // frame complete : deliver, drop older frames
+    if(rx->delivered == 1)
+    {
+        rx->stats.NBframelost += slot->frameseq - rx->frameseq - 1;
+    }
+    rx->delivered   = 1;
+    rx->frameseq    = slot->frameseq;
+    rx->framemap    = &slot->map;
+    rx->framedirect = slot->direct;
+    for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+    {
+        if((rx->slot[s].active == 1) &&
+                (rx->slot[s].frameseq <= rx->frameseq))
+        {
+            udpframe_rx_closeslot(rx, &rx->slot[s]);
+        }
+    }
+    rx->stats.NBframe++;
+
+    return 1;
+}
+
+/**
+ * @brief Process received datagram
+ *
+ * @return 1 if a frame is complete : see rx->framemap, valid until next call
+ */
+int udpframe_rx_dgram(UDPFRAME_RX *rx, const char *dgram, long dgramsize)
+{
+    UDPFRAME_HEADER hd;
+
+    rx->stats.NBdgram++;
+    if(dgramsize < (long) sizeof(UDPFRAME_HEADER))
+    {
+        rx->stats.NBdgraminvalid++;
+        return 0;
+    }
+    memcpy(&hd, dgram, sizeof(UDPFRAME_HEADER));
+    rx->stats.NBdgramcopied++;
+
+    if(udpframe_rx_check(rx, &hd, dgramsize - sizeof(UDPFRAME_HEADER)) != 0)
+    {
+        return 0;
+    }
+
+    return udpframe_rx_insert(rx,
+                              &hd,
+                              dgram + sizeof(UDPFRAME_HEADER),
+                              dgramsize - sizeof(UDPFRAME_HEADER),
+                              0);
+}
+
+
+
+
+static UDPFRAME_RXBATCH *udpframe_rx_allocbatch(UDPFRAME_RX *rx)
+{
+    UDPFRAME_RXBATCH *rb =
+        (UDPFRAME_RXBATCH *) calloc(1, sizeof(UDPFRAME_RXBATCH));
+    if(rb == NULL)
+    {
+        return NULL;
+    }
+    rx->rxbatch = rb;
+
+    long NBmsg    = rx->batch;
+    rb->NBmsg     = NBmsg;
+    rb->nbsegpred = 1;
+    rb->mmsg   = (struct mmsghdr *) calloc(NBmsg, sizeof(struct mmsghdr));
+    rb->iov    = (struct iovec *) malloc(sizeof(struct iovec) * NBmsg *
+                                         UDPFRAME_RXNBIOV);
+    rb->cmsg   = (char *) malloc(CMSG_SPACE(sizeof(int)) * NBmsg);
+    rb->header = (UDPFRAME_HEADER *) malloc(sizeof(UDPFRAME_HEADER) * NBmsg *
+                                            UDPFRAME_NBSEGMAX);
+    rb->pred   = (UDPFRAME_RXPRED *) malloc(sizeof(UDPFRAME_RXPRED) * NBmsg *
+                                            UDPFRAME_NBSEGMAX);
+    rb->NBpred = (int *) malloc(sizeof(int) * NBmsg);
+    rb->spare  = (char *) malloc((size_t) UDPFRAME_DGRAM_MAXSIZE * NBmsg);
+    rb->bounce = (char *) malloc((size_t) UDPFRAME_DGRAM_MAXSIZE * NBmsg);
+    rb->dgram  = (UDPFRAME_RXDGRAM *) malloc(sizeof(UDPFRAME_RXDGRAM) * NBmsg *
+                                             UDPFRAME_NBSEGMAX);
+    if((rb->mmsg == NULL) || (rb->iov == NULL) || (rb->cmsg == NULL) ||
+            (rb->header == NULL) || (rb->pred == NULL) ||
+            (rb->NBpred == NULL) || (rb->spare == NULL) ||
+            (rb->bounce == NULL) || (rb->dgram == NULL))
+    {
+        udpframe_rx_freebatch(rx);
+        return NULL;
+    }
+
+    return rb;
+}
+
+// frame slot for predicted datagram, NULL if payload is not placed in frame
+static UDPFRAME_SLOT *udpframe_rx_predslot(UDPFRAME_RX *rx, uint64_t frameseq)
+{
+    if((rx->delivered == 1) && (frameseq <= rx->frameseq))
+    {
+        return NULL;
+    }
+
+    UDPFRAME_SLOT *slot = udpframe_rx_findslot(rx, frameseq);
+    if(slot != NULL)
+    {
+        return slot;
+    }
+
+    // open next frame in free slot only, and keep destination for it
+    if((rx->destset == 1) && (rx->destclaimed == 1))
+    {
+        return NULL;
+    }
+    for(int s = 0; s < UDPFRAME_NBSLOT; s++)
+    {
+        if(rx->slot[s].active == 0)
+        {
+            return udpframe_rx_openslot(rx, &rx->slot[s], frameseq);
+        }
+    }
+    return NULL;
+}
+
+// set up messages : expected datagrams point to their place in frame
+static void udpframe_rx_predict(UDPFRAME_RX *rx, UDPFRAME_RXBATCH *rb)
+{
+    int      predOK    = rb->predOK && (rx->NBchunk > 0);
+    uint64_t predseq   = rb->predseq;
+    long     predindex = rb->predindex;
+    uint64_t predseq0  = rb->predseq;
+
+    rb->NBmsgrecv = rb->NBmsg;
+    for(int m = 0; m < rb->NBmsg; m++)
+    {
+        struct iovec    *iov       = rb->iov + (long) m * UDPFRAME_RXNBIOV;
+        UDPFRAME_HEADER *header    = rb->header + (long) m * UDPFRAME_NBSEGMAX;
+        UDPFRAME_RXPRED *pred      = rb->pred + (long) m * UDPFRAME_NBSEGMAX;
+        char            *spare     = rb->spare + (long) m * UDPFRAME_DGRAM_MAXSIZE;
+        long             spareused = 0;
+        long             offset    = 0;
+        int              NBiov     = 0;
+        int              NBpred    = 0;
+        int              truncate  = 0;
+
+        while(predOK && (NBpred < rb->nbsegpred))
+        {
+            long chunk;
+            int  isparity;
+
+            if(udpframe_dgramchunk(predindex,
+                                   rx->NBchunk,
+                                   rx->fecgroup,
+                                   &chunk,
+                                   &isparity) == 0)
+            {
+                // message does not span frames
+                predseq++;
+                predindex = 0;
+                if(NBpred > 0)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // next frame cannot be written to destination yet : receive it
+            // once current frame is delivered
+            if((m > 0) && (NBpred == 0) && (predseq != predseq0) &&
+                    (rx->destset == 1) && (rx->destclaimed == 1) &&
+                    (udpframe_rx_findslot(rx, predseq) == NULL))
+            {
+                truncate = 1;
+                break;
+            }
+
+            long nbbyte = isparity ? (long) rx->chunksize
+                          : udpframe_chunkbytes(rx->framesize,
+                                                rx->chunksize,
+                                                chunk);
+            if(offset + (long) sizeof(UDPFRAME_HEADER) + nbbyte >
+                    UDPFRAME_DGRAM_MAXSIZE)
+            {
+                break;
+            }
+
+            UDPFRAME_RXPRED *p = &pred[NBpred];
+            p->offset   = offset;
+            p->size     = sizeof(UDPFRAME_HEADER) + nbbyte;
+            p->frameseq = predseq;
+            p->chunk    = chunk;
+            p->isparity = isparity;
+            p->slot     = udpframe_rx_predslot(rx, predseq);
+            if(p->slot != NULL)
+            {
+                p->generation = p->slot->generation;
+                if((isparity && p->slot->parityOK[chunk]) ||
+                        (!isparity && p->slot->chunkOK[chunk]))
+                {
+                    // already there : do not overwrite
+                    p->slot = NULL;
+                }
+            }
+
+            iov[NBiov].iov_base = &header[NBpred];
+            iov[NBiov].iov_len  = sizeof(UDPFRAME_HEADER);
+            NBiov++;
+            if(p->slot == NULL)
+            {
+                iov[NBiov].iov_base = spare + spareused;
+                iov[NBiov].iov_len  = nbbyte;
+                NBiov++;
+                spareused += nbbyte;
+            }
+            else if(isparity)
+            {
+                iov[NBiov].iov_base = p->slot->parity + chunk * rx->chunksize;
+                iov[NBiov].iov_len  = nbbyte;
+                NBiov++;
+            }
+            else
+            {
+                NBiov += udpframe_map_iov(&p->slot->map,
+                                          chunk * rx->chunksize,
+                                          nbbyte,
+                                          &iov[NBiov]);
+            }
+
+            offset += p->size;
+            NBpred++;
+            predindex++;
+
+            // short datagram ends GSO message
+            if(nbbyte < (long) rx->chunksize)
+            {
+                break;
+            }
+        }
+        if(truncate == 1)
+        {
+            rb->NBmsgrecv = m;
+            break;
+        }
+        rb->NBpred[m] = NBpred;
+
+        // unexpected datagrams
+        iov[NBiov].iov_base = spare + spareused;
+        iov[NBiov].iov_len  = UDPFRAME_DGRAM_MAXSIZE - spareused;
+        NBiov++;
+
+        struct msghdr *msg = &rb->mmsg[m].msg_hdr;
+        memset(msg, 0, sizeof(struct msghdr));
+        msg->msg_iov        = iov;
+        msg->msg_iovlen     = NBiov;
+        msg->msg_control    = rb->cmsg + m * CMSG_SPACE(sizeof(int));
+        msg->msg_controllen = CMSG_SPACE(sizeof(int));
+    }
+}
+
+// split received messages into datagrams, copy datagrams not in place
+static void udpframe_rx_parse(UDPFRAME_RX *rx, UDPFRAME_RXBATCH *rb, int NBmsg)
+{
+    rb->NBdgram    = 0;
+    rb->dgramindex = 0;
+
+    for(int m = 0; m < NBmsg; m++)
+    {
+        struct msghdr   *msg        = &rb->mmsg[m].msg_hdr;
+        UDPFRAME_RXPRED *pred       = rb->pred + (long) m * UDPFRAME_NBSEGMAX;
+        char            *bounce     = rb->bounce + (long) m * UDPFRAME_DGRAM_MAXSIZE;
+        long             bounceused = 0;
+        long             msgsize    = rb->mmsg[m].msg_len;
+        long             segsize    = msgsize;
+
+        // GRO : message holds datagrams of segsize bytes, last one shorter
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm != NULL;
+                cm = CMSG_NXTHDR(msg, cm))
+        {
+            if((cm->cmsg_level == SOL_UDP) && (cm->cmsg_type == UDP_GRO))
+            {
+                int gsosize;
+                memcpy(&gsosize, CMSG_DATA(cm), sizeof(int));
+                if(gsosize > 0)
+                {
+                    segsize = gsosize;
+                }
+            }
+        }
+        if(msgsize == 0)
+        {
+            continue;
+        }
+
+        long NBseg = (msgsize + segsize - 1) / segsize;
+        if(NBseg > UDPFRAME_NBSEGMAX)
+        {
+            NBseg = UDPFRAME_NBSEGMAX;
+        }
+        if(NBseg > rb->nbsegpred)
+        {
+            rb->nbsegpred = NBseg;
+        }
+
+        int ipred = 0;
+        for(long seg = 0; seg < NBseg; seg++)
+        {
+            long offset = seg * segsize;
+            long size   = msgsize - offset;
+            if(size > segsize)
+            {
+                size = segsize;
+            }
+
+            rx->stats.NBdgram++;
+            if(size < (long) sizeof(UDPFRAME_HEADER))
+            {
+                rx->stats.NBdgraminvalid++;
+                continue;
+            }
+
+            UDPFRAME_RXDGRAM *dg = &rb->dgram[rb->NBdgram];
+            udpframe_iov_gather(msg->msg_iov,
+                                msg->msg_iovlen,
+                                offset,
+                                (char *) &dg->header,
+                                sizeof(UDPFRAME_HEADER));
+            dg->payloadsize = size - sizeof(UDPFRAME_HEADER);
+            int isparity = ((dg->header.flags & UDPFRAME_FLAG_PARITY) != 0);
+
+            while((ipred < rb->NBpred[m]) && (pred[ipred].offset < offset))
+            {
+                ipred++;
+            }
+            UDPFRAME_RXPRED *p = (ipred < rb->NBpred[m]) ? &pred[ipred] : NULL;
+
+            if((p != NULL) && (p->slot != NULL) && (p->offset == offset) &&
+                    (p->size == size) &&
+                    (p->frameseq == dg->header.frameseq) &&
+                    (p->chunk == dg->header.chunk) &&
+                    (p->isparity == isparity))
+            {
+                dg->inplace    = 1;
+                dg->payload    = NULL;
+                dg->slot       = p->slot;
+                dg->generation = p->generation;
+            }
+            else
+            {
+                dg->inplace = 0;
+                dg->payload = bounce + bounceused;
+                udpframe_iov_gather(msg->msg_iov,
+                                    msg->msg_iovlen,
+                                    offset + sizeof(UDPFRAME_HEADER),
+                                    bounce + bounceused,
+                                    dg->payloadsize);
+                bounceused += dg->payloadsize;
+                rx->stats.NBdgramcopied++;
+            }
+            rb->NBdgram++;
+
+            // next expected datagram
+            if((dg->header.magic == UDPFRAME_MAGIC) &&
+                    (dg->header.NBchunk == rx->NBchunk) &&
+                    (dg->header.fecgroup == rx->fecgroup))
+            {
+                rb->predOK    = 1;
+                rb->predseq   = dg->header.frameseq;
+                rb->predindex = udpframe_dgramindex(dg->header.chunk,
+                                                    isparity,
+                                                    rx->NBchunk,
+                                                    rx->fecgroup) + 1;
+            }
+            else
+            {
+                // new geometry : predict once slots are set up
+                rb->predOK = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Receive datagrams with recvmmsg(), until a frame is complete
+ *
+ * Datagrams received but not processed when a frame completes are kept for
+ * next call.
+ *
+ * @return 1 if a frame is complete : see rx->framemap, valid until next call
+ *         0 if no frame completed, or socket timeout
+ *        -1 on socket error
+ */
+int udpframe_rx_recv(UDPFRAME_RX *rx, int fd)
+{
+    UDPFRAME_RXBATCH *rb = (UDPFRAME_RXBATCH *) rx->rxbatch;
+    if(rb == NULL)
+    {
+        rb = udpframe_rx_allocbatch(rx);
+        if(rb == NULL)
+        {
+            PRINT_ERROR("cannot allocate receive buffers");
+            return -1;
+        }
+    }
+
+    if(rb->dgramindex == rb->NBdgram)
+    {
+        udpframe_rx_predict(rx, rb);
+        int NBmsg = recvmmsg(fd, rb->mmsg, rb->NBmsgrecv, MSG_WAITFORONE, NULL);
+        rx->stats.NBsyscall++;
+        if(NBmsg < 0)
+        {
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+            {
+                return 0;
+            }
+            return -1;
+        }
+        udpframe_rx_parse(rx, rb, NBmsg);
+    }
+
+    while(rb->dgramindex < rb->NBdgram)
+    {
+        UDPFRAME_RXDGRAM *dg = &rb->dgram[rb->dgramindex];
+        rb->dgramindex++;
+
+        if(udpframe_rx_check(rx, &dg->header, dg->payloadsize) != 0)
+        {
+            continue;
+        }
+        if((dg->inplace == 1) &&
+                ((dg->slot->active == 0) ||
+                 (dg->slot->generation != dg->generation)))
+        {
+            // frame buffer reused before datagram was processed
+            if((dg->header.flags & UDPFRAME_FLAG_PARITY) == 0)
+            {
+                rx->stats.NBchunklate++;
+            }
+            continue;
+        }
+        if(udpframe_rx_insert(rx,
+                              &dg->header,
+                              dg->payload,
+                              dg->payloadsize,
+                              dg->inplace) == 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file    stream_UDP_frame.h
+ * @brief   framed UDP protocol : sequence numbers, reassembly, XOR parity
+ */
+
+#ifndef _STREAM_UDP_FRAME_H
+#define _STREAM_UDP_FRAME_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define UDPFRAME_MAGIC 0x3F
+
+// datagram carries parity of a group of data chunks
+#define UDPFRAME_FLAG_PARITY 0x01
+
+// number of frames reassembled concurrently
+#define UDPFRAME_NBSLOT 4
+
+// large enough for any UDP datagram, or GRO message
+#define UDPFRAME_DGRAM_MAXSIZE 65536
+
+// max datagrams per GSO send or GRO receive
+#define UDPFRAME_NBSEGMAX 64
+
+// max payload of a GSO send, all segments included
+#define UDPFRAME_GSO_MAXSIZE 65507
+
+// max number of buffers a frame can be scattered to
+#define UDPFRAME_MAP_NBSEG 4
+
+// Datagram header, followed by chunk payload
+// Both ends are assumed to have same byte order, as for IMAGE_METADATA
+typedef struct
+{
+    uint8_t  magic;
+    uint8_t  flags;
+    uint8_t  fecgroup;  // data chunks per parity chunk, 0 if no parity
+    uint8_t  reserved;
+    uint16_t chunk;     // data chunk index, or parity group index
+    uint16_t NBchunk;   // number of data chunks in frame
+    uint32_t framesize; // frame payload [byte]
+    uint32_t chunksize; // chunk payload, except last data chunk [byte]
+    uint64_t session;   // random, new value when sender restarts
+    uint64_t frameseq;  // frame sequence number
+} UDPFRAME_HEADER;
+
+typedef struct
+{
+    uint64_t NBframe;          // frames sent
+    uint64_t NBdgram;          // datagrams sent
+    uint64_t NBdgramdropped;   // datagrams dropped by loss injection
+    uint64_t NBsyscall;        // send system calls
+} UDPFRAME_TXSTATS;
+
+// receiver statistics, all fields uint64_t : published as UINT64 stream
+typedef struct
+{
+    uint64_t NBframe;          // frames delivered
+    uint64_t NBframelost;      // frames skipped in sequence
+    uint64_t NBchunklate;      // data chunks received after frame delivery
+    uint64_t NBchunkrecovered; // data chunks rebuilt from parity
+    uint64_t NBdgraminvalid;   // datagrams with bad header or size
+    uint64_t NBdgram;          // datagrams received
+    uint64_t NBdgramcopied;    // datagrams not received in place
+    uint64_t NBsyscall;        // receive system calls
+    uint64_t NBsession;        // sender sessions seen
+} UDPFRAME_RXSTATS;
+
+#define UDPFRAME_RXSTATS_NBFIELD (sizeof(UDPFRAME_RXSTATS) / sizeof(uint64_t))
+
+// receiver statistics stream : <stream name> + suffix
+#define UDPFRAME_RXSTATS_SUFFIX "_udpstat"
+
+// Frame storage : frame bytes are laid out consecutively over NBseg buffers
+typedef struct
+{
+    int          NBseg;
+    struct iovec seg[UDPFRAME_MAP_NBSEG];
+} UDPFRAME_MAP;
+
+typedef struct
+{
+    uint32_t chunksize;
+    int      fecgroup;
+
+    // fraction of datagrams dropped before sending, for tests
+    double       lossfrac;
+    unsigned int lossseed;
+
+    uint64_t session;
+    uint64_t frameseq;
+
+    // messages per sendmmsg() call, 1 for one sendmsg() per message
+    int batch;
+    // UDP segmentation offload : up to nbsegmax datagrams per message
+    int gso;
+    int nbsegmax;
+
+    // parity chunks of current frame
+    char  *parity;
+    size_t paritysize;
+
+    // datagram headers and messages of current frame
+    long             NBdgrammax;
+    UDPFRAME_HEADER *header;
+    struct iovec    *iov;
+    struct mmsghdr  *mmsg;
+    char            *cmsg;
+
+    UDPFRAME_TXSTATS stats;
+} UDPFRAME_TX;
+
+typedef struct
+{
+    int      active;
+    uint64_t frameseq;
+    uint64_t generation; // identifies frame in slot, see UDPFRAME_RX
+    char    *buff;      // NBchunk x chunksize
+    int      direct;    // frame is stored in receiver destination map
+    UDPFRAME_MAP map;   // where frame is stored : buff or destination
+    uint8_t *chunkOK;
+    char    *parity;    // NBgroup x chunksize
+    uint8_t *parityOK;
+    long     NBchunkOK;
+} UDPFRAME_SLOT;
+
+typedef struct
+{
+    // sender session, from last datagram header
+    uint64_t session;
+
+    // frame geometry, from last datagram header
+    uint32_t framesize;
+    uint32_t chunksize;
+    uint16_t NBchunk;
+    int      fecgroup;
+
+    UDPFRAME_SLOT slot[UDPFRAME_NBSLOT];
+    uint64_t      generation; // incremented when a slot is opened or freed
+    char         *tmpchunk;
+
+    // frames are written directly to destination map if set
+    int          destset;
+    int          destclaimed; // destination used by a slot
+    UDPFRAME_MAP destmap;
+
+    // last delivered frame, valid until next receive call
+    int                 delivered;
+    uint64_t            frameseq;
+    const UDPFRAME_MAP *framemap;
+    int                 framedirect;
+
+    // batched receive
+    int   batch;   // messages per recvmmsg() call
+    int   gro;     // UDP generic receive offload enabled
+    void *rxbatch; // message buffers, allocated on first receive
+
+    UDPFRAME_RXSTATS stats;
+} UDPFRAME_RX;
+
+errno_t udpframe_tx_init(UDPFRAME_TX *tx,
+                         uint32_t     chunksize,
+                         int          fecgroup,
+                         double       lossfrac);
+
+errno_t udpframe_tx_free(UDPFRAME_TX *tx);
+
+int udpframe_gso_available(int fd);
+
+errno_t udpframe_tx_setbatch(UDPFRAME_TX *tx, int batch, int gso);
+
+long udpframe_tx_send(UDPFRAME_TX           *tx,
+                      int                    fd,
+                      const struct sockaddr *addr,
+                      socklen_t              addrlen,
+                      const char            *frame,
+                      uint32_t               framesize);
+
+errno_t udpframe_rx_init(UDPFRAME_RX *rx);
+
+errno_t udpframe_rx_free(UDPFRAME_RX *rx);
+
+errno_t udpframe_rx_setbatch(UDPFRAME_RX *rx, int fd, int batch, int gro);
+
+errno_t udpframe_rx_setdest(UDPFRAME_RX *rx, const UDPFRAME_MAP *map);
+
+int udpframe_rx_dgram(UDPFRAME_RX *rx, const char *dgram, long dgramsize);
+
+int udpframe_rx_recv(UDPFRAME_RX *rx, int fd);
+
+#endif
@@ -1,4 +1,17 @@
 /** @file stream_ave.c
+ *
+ * Averaging modes, selected by .mode :
+ *
+ * - STREAMAVE_MODE_BLOCK   : coadd NBcoadd frames, write output, restart
+ * - STREAMAVE_MODE_SLIDING : average of last NBcoadd frames, output every
+ *                            frame. Frames are kept in a ring buffer, sums
+ *                            are updated by adding the new frame and
+ *                            subtracting the oldest one.
+ * - STREAMAVE_MODE_EMA     : exponential moving average with gain .emagain,
+ *                            output every frame
+ *
+ * Accumulation kernels are specialized for each input datatype, with
+ * simd loops over double-precision sums.
  */
 
 #include <math.h>
@@ -6,6 +19,15 @@
 #include "CommandLineInterface/CLIcore.h"
 
 
+#define STREAMAVE_MODE_BLOCK   0
+#define STREAMAVE_MODE_SLIDING 1
+#define STREAMAVE_MODE_EMA     2
+
+// sliding mode, floating point input : sums are recomputed from ring
+// every STREAMAVE_SLIDING_RESYNC ring wraps to remove rounding drift
+#define STREAMAVE_SLIDING_RESYNC 64
+
+
 
 static char *inimname;
 
@@ -26,6 +48,12 @@ static long     fpi_compave = -1;
 static uint64_t *comprms;
 static long     fpi_comprms = -1;
 
+static uint32_t *avemode;
+static long      fpi_avemode = -1;
+
+static double *emagain;
+static long    fpi_emagain = -1;
+
 
 static CLICMDARGDEF farg[] =
 {
@@ -91,6 +119,24 @@ static CLICMDARGDEF farg[] =
         CLIARG_HIDDEN_DEFAULT,
         (void **) &comprms,
         &fpi_comprms
+    },
+    {
+        CLIARG_UINT32,
+        ".mode",
+        "averaging mode: 0=block 1=sliding 2=EMA",
+        "0",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &avemode,
+        &fpi_avemode
+    },
+    {
+        CLIARG_FLOAT64,
+        ".emagain",
+        "EMA mode: gain applied to new frame, 0 < gain <= 1",
+        "0.01",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &emagain,
+        &fpi_emagain
     }
 };
 
@@ -99,6 +145,10 @@ static CLICMDARGDEF farg[] =
 
 static errno_t customCONFsetup()
 {
+    if(data.fpsptr != NULL)
+    {
+        data.fpsptr->parray[fpi_emagain].fpflag |= FPFLAG_WRITERUN;
+    }
 
     return RETURN_SUCCESS;
 }
@@ -129,6 +179,14 @@ static errno_t help_function()
 {
     printf("Average frames from stream\n");
     printf("output is by default float type\n");
+    printf(".mode 0 (block)   : average NBcoadd frames, then restart\n");
+    printf(".mode 1 (sliding) : average of last NBcoadd frames, updated "
+           "every frame\n");
+    printf(".mode 2 (EMA)     : exponential moving average, updated every "
+           "frame\n");
+    printf("                    ave += emagain * (in - ave)\n");
+    printf("                    0 < emagain <= 1\n");
+    printf("RMS output is the standard deviation over the same frames\n");
 
     return RETURN_SUCCESS;
 }
@@ -136,6 +194,189 @@ static errno_t help_function()
 
 
 
+// Accumulation kernels for input type TIN
+//
+// set   : sum = in, sumsq = in^2
+// add   : sum += in, sumsq += in^2
+// slide : sum += in - old, sumsq += in^2 - old^2
+// ema   : ave += gain * (in - ave), var = (1-gain) * (var + gain * d^2)
+//
+// sumsq and var may be NULL if RMS is not computed
+//
+#define STREAMAVE_KERNELS(SUFFIX, TIN)                                         \
+    static void streamave_set_##SUFFIX(const void *inv,                        \
+                                       double *restrict sum,                   \
+                                       double *restrict sumsq,                 \
+                                       long nelement)                          \
+    {                                                                          \
+        const TIN *restrict in = (const TIN *) inv;                            \
+        if(sumsq == NULL)                                                      \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                sum[ii] = (double) in[ii];                                     \
+            }                                                                  \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                double x  = (double) in[ii];                                   \
+                sum[ii]   = x;                                                 \
+                sumsq[ii] = x * x;                                             \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void streamave_add_##SUFFIX(const void *inv,                        \
+                                       double *restrict sum,                   \
+                                       double *restrict sumsq,                 \
+                                       long nelement)                          \
+    {                                                                          \
+        const TIN *restrict in = (const TIN *) inv;                            \
+        if(sumsq == NULL)                                                      \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                sum[ii] += (double) in[ii];                                    \
+            }                                                                  \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                double x = (double) in[ii];                                    \
+                sum[ii] += x;                                                  \
+                sumsq[ii] += x * x;                                            \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void streamave_slide_##SUFFIX(const void *inv,                      \
+                                         const void *oldv,                     \
+                                         double *restrict sum,                 \
+                                         double *restrict sumsq,               \
+                                         long nelement)                        \
+    {                                                                          \
+        const TIN *restrict in  = (const TIN *) inv;                           \
+        const TIN *restrict old = (const TIN *) oldv;                          \
+        if(sumsq == NULL)                                                      \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                sum[ii] += (double) in[ii] - (double) old[ii];                 \
+            }                                                                  \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                double x = (double) in[ii];                                    \
+                double o = (double) old[ii];                                   \
+                sum[ii] += x - o;                                              \
+                sumsq[ii] += x * x - o * o;                                    \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void streamave_ema_##SUFFIX(const void *inv,                        \
+                                       double gain,                            \
+                                       double *restrict ave,                   \
+                                       double *restrict var,                   \
+                                       long nelement)                          \
+    {                                                                          \
+        const TIN *restrict in = (const TIN *) inv;                            \
+        if(var == NULL)                                                        \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                ave[ii] += gain * ((double) in[ii] - ave[ii]);                 \
+            }                                                                  \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            _Pragma("omp simd") for(long ii = 0; ii < nelement; ii++)          \
+            {                                                                  \
+                double d = (double) in[ii] - ave[ii];                          \
+                ave[ii] += gain * d;                                           \
+                var[ii] = (1.0 - gain) * (var[ii] + gain * d * d);             \
+            }                                                                  \
+        }                                                                      \
+    }
+
+STREAMAVE_KERNELS(UI8, uint8_t)
+STREAMAVE_KERNELS(SI8, int8_t)
+STREAMAVE_KERNELS(UI16, uint16_t)
+STREAMAVE_KERNELS(SI16, int16_t)
+STREAMAVE_KERNELS(UI32, uint32_t)
+STREAMAVE_KERNELS(SI32, int32_t)
+STREAMAVE_KERNELS(UI64, uint64_t)
+STREAMAVE_KERNELS(SI64, int64_t)
+STREAMAVE_KERNELS(F, float)
+STREAMAVE_KERNELS(D, double)
+
+typedef struct
+{
+    uint8_t datatype;
+    void (*set)(const void *, double *, double *, long);
+    void (*add)(const void *, double *, double *, long);
+    void (*slide)(const void *, const void *, double *, double *, long);
+    void (*ema)(const void *, double, double *, double *, long);
+} STREAMAVE_KERNEL;
+
+#define STREAMAVE_KERNELENTRY(SUFFIX, DATATYPE)                                \
+    {                                                                          \
+        DATATYPE, streamave_set_##SUFFIX, streamave_add_##SUFFIX,              \
+            streamave_slide_##SUFFIX, streamave_ema_##SUFFIX                   \
+    }
+
+static STREAMAVE_KERNEL streamave_kerneltable[] =
+{
+    STREAMAVE_KERNELENTRY(UI8, _DATATYPE_UINT8),
+    STREAMAVE_KERNELENTRY(SI8, _DATATYPE_INT8),
+    STREAMAVE_KERNELENTRY(UI16, _DATATYPE_UINT16),
+    STREAMAVE_KERNELENTRY(SI16, _DATATYPE_INT16),
+    STREAMAVE_KERNELENTRY(UI32, _DATATYPE_UINT32),
+    STREAMAVE_KERNELENTRY(SI32, _DATATYPE_INT32),
+    STREAMAVE_KERNELENTRY(UI64, _DATATYPE_UINT64),
+    STREAMAVE_KERNELENTRY(SI64, _DATATYPE_INT64),
+    STREAMAVE_KERNELENTRY(F, _DATATYPE_FLOAT),
+    STREAMAVE_KERNELENTRY(D, _DATATYPE_DOUBLE)
+};
+
+
+
+
+// Write average and RMS from sums over cnt frames
+static void streamave_write_sums(const double *restrict sum,
+                                 const double *restrict sumsq,
+                                 uint64_t cnt,
+                                 float *restrict ave,
+                                 float *restrict rms,
+                                 long nelement)
+{
+    double coeff = 1.0 / cnt;
+
+    if(ave != NULL)
+    {
+        #pragma omp simd
+        for(long ii = 0; ii < nelement; ii++)
+        {
+            ave[ii] = sum[ii] * coeff;
+        }
+    }
+
+    if(rms != NULL)
+    {
+        for(long ii = 0; ii < nelement; ii++)
+        {
+            double m = sum[ii] * coeff;
+            double v = sumsq[ii] * coeff - m * m;
+            rms[ii]  = (v > 0.0) ? sqrt(v) : 0.0;
+        }
+    }
+}
+
 
 
 
@@ -166,6 +407,56 @@ static errno_t compute_function()
         imcreateIMGID(&outimgrms);
     }
 
+    STREAMAVE_KERNEL *kernel = NULL;
+    for(unsigned long k = 0;
+            k < sizeof(streamave_kerneltable) / sizeof(STREAMAVE_KERNEL);
+            k++)
+    {
+        if(streamave_kerneltable[k].datatype == inimg.datatype)
+        {
+            kernel = &streamave_kerneltable[k];
+        }
+    }
+    if(kernel == NULL)
+    {
+        FUNC_RETURN_FAILURE("datatype %d not supported", inimg.datatype);
+    }
+
+    uint32_t mode = *avemode;
+    if(mode > STREAMAVE_MODE_EMA)
+    {
+        FUNC_RETURN_FAILURE("unknown averaging mode %u", mode);
+    }
+
+    // gain outside (0,1] makes EMA variance negative
+    double gain = *emagain;
+    if((mode == STREAMAVE_MODE_EMA) && !((gain > 0.0) && (gain <= 1.0)))
+    {
+        FUNC_RETURN_FAILURE("emagain = %g, must be in (0,1]", gain);
+    }
+
+    uint64_t nbcoadd = *NBcoadd;
+    if(nbcoadd == 0)
+    {
+        nbcoadd = 1;
+    }
+
+
+    // sliding mode : ring of last nbcoadd frames, in input datatype
+    size_t   framesize   = ImageStreamIO_typesize(inimg.datatype) * xysize;
+    char    *ringbuff    = NULL;
+    uint64_t ringindex   = 0;
+    uint64_t ringwrapcnt = 0;
+    if(mode == STREAMAVE_MODE_SLIDING)
+    {
+        DEBUG_TRACEPOINT("Allocating ring buffer");
+        ringbuff = (char *) malloc(framesize * nbcoadd);
+        if(ringbuff == NULL)
+        {
+            FUNC_RETURN_FAILURE("cannot allocate %lu frames ring buffer",
+                                nbcoadd);
+        }
+    }
 
 
     INSERT_STD_PROCINFO_COMPUTEFUNC_INIT
@@ -178,172 +469,175 @@ static errno_t compute_function()
     }
 
     DEBUG_TRACEPOINT("Allocating summation array");
+    // block and sliding modes : sums
+    // EMA mode : average and variance
     double *imdataarray    = (double *) malloc(sizeof(double) * xysize);
-    double *imdataarrayPOW = (double *) malloc(sizeof(double) * xysize);
+    double *imdataarrayPOW = NULL;
+    if(*comprms == 1)
+    {
+        imdataarrayPOW = (double *) malloc(sizeof(double) * xysize);
+    }
+
+    float *outave = ((*compave) == 1) ? outimgave.im->array.F : NULL;
+    float *outrms = ((*comprms) == 1) ? outimgrms.im->array.F : NULL;
 
     *cntindex = 0;
 
     INSERT_STD_PROCINFO_COMPUTEFUNC_LOOPSTART
 
-    //DEBUG_TRACEPOINT("cntindex = %lu / %lu", *cntindex, *NBcoadd);
-
-    printf("Adding image %lu / %lu\n", *cntindex, *NBcoadd);
-
-    if(*cntindex == 0)
+    if(mode == STREAMAVE_MODE_BLOCK)
     {
-        // initialization
-        //
-
-        switch(inimg.datatype)
+        if(*cntindex == 0)
+        {
+            kernel->set(inimg.im->array.raw,
+                        imdataarray,
+                        imdataarrayPOW,
+                        xysize);
+        }
+        else
         {
+            kernel->add(inimg.im->array.raw,
+                        imdataarray,
+                        imdataarrayPOW,
+                        xysize);
+        }
 
-            case _DATATYPE_FLOAT :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] = inimg.im->array.F[pixi];
-                }
-                break;
+        (*cntindex)++;
+        if((*cntindex) >= nbcoadd)
+        {
+            DEBUG_TRACEPOINT("Writing output images");
+            streamave_write_sums(imdataarray,
+                                 imdataarrayPOW,
+                                 *cntindex,
+                                 outave,
+                                 outrms,
+                                 xysize);
+            (*cntindex) = 0;
+        }
+    }
 
-            case _DATATYPE_DOUBLE :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] = inimg.im->array.D[pixi];
-                }
-                break;
+    if(mode == STREAMAVE_MODE_SLIDING)
+    {
+        char *ringframe = ringbuff + framesize * ringindex;
 
-            case _DATATYPE_INT16 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] = (float) inimg.im->array.SI16[pixi];
-                }
-                break;
+        if(*cntindex == 0)
+        {
+            kernel->set(inimg.im->array.raw,
+                        imdataarray,
+                        imdataarrayPOW,
+                        xysize);
+        }
+        else if(*cntindex < nbcoadd)
+        {
+            kernel->add(inimg.im->array.raw,
+                        imdataarray,
+                        imdataarrayPOW,
+                        xysize);
+        }
+        else
+        {
+            // ring full : ringframe is oldest frame
+            kernel->slide(inimg.im->array.raw,
+                          ringframe,
+                          imdataarray,
+                          imdataarrayPOW,
+                          xysize);
+        }
+        memcpy(ringframe, inimg.im->array.raw, framesize);
 
-            case _DATATYPE_UINT16 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] = (float) inimg.im->array.UI16[pixi];
-                }
-                break;
+        if(*cntindex < nbcoadd)
+        {
+            (*cntindex)++;
+        }
+        ringindex++;
+        if(ringindex == nbcoadd)
+        {
+            ringindex = 0;
+            ringwrapcnt++;
 
-            case _DATATYPE_INT32 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
+            if(((inimg.datatype == _DATATYPE_FLOAT) ||
+                    (inimg.datatype == _DATATYPE_DOUBLE)) &&
+                    (ringwrapcnt % STREAMAVE_SLIDING_RESYNC == 0))
+            {
+                DEBUG_TRACEPOINT("Recomputing sums from ring buffer");
+                kernel->set(ringbuff, imdataarray, imdataarrayPOW, xysize);
+                for(uint64_t fr = 1; fr < nbcoadd; fr++)
                 {
-                    imdataarray[pixi] = (float) inimg.im->array.SI32[pixi];
+                    kernel->add(ringbuff + framesize * fr,
+                                imdataarray,
+                                imdataarrayPOW,
+                                xysize);
                 }
-                break;
+            }
+        }
 
-            case _DATATYPE_UINT32 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] = (float) inimg.im->array.UI32[pixi];
-                }
-                break;
+        streamave_write_sums(imdataarray,
+                             imdataarrayPOW,
+                             *cntindex,
+                             outave,
+                             outrms,
+                             xysize);
+    }
 
+    if(mode == STREAMAVE_MODE_EMA)
+    {
+        if(*cntindex == 0)
+        {
+            kernel->set(inimg.im->array.raw, imdataarray, NULL, xysize);
+            if(imdataarrayPOW != NULL)
+            {
+                memset(imdataarrayPOW, 0, sizeof(double) * xysize);
+            }
         }
-
-        if(*comprms == 1)
+        else
         {
-            for(uint64_t pixi = 0; pixi < xysize; pixi++)
+            // gain can be changed while running : invalid values ignored
+            if((*emagain > 0.0) && (*emagain <= 1.0))
             {
-                imdataarrayPOW[pixi] = imdataarray[pixi] * imdataarray[pixi];
+                gain = *emagain;
             }
+            kernel->ema(inimg.im->array.raw,
+                        gain,
+                        imdataarray,
+                        imdataarrayPOW,
+                        xysize);
         }
+        (*cntindex)++;
 
-    }
-    else
-    {
-
-        switch(inimg.datatype)
+        if(outave != NULL)
         {
-            case _DATATYPE_FLOAT :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += inimg.im->array.F[pixi];
-                }
-                break;
-
-            case _DATATYPE_DOUBLE :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += inimg.im->array.D[pixi];
-                }
-                break;
-
-            case _DATATYPE_INT16 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += (float) inimg.im->array.SI16[pixi];
-                }
-                break;
-
-            case _DATATYPE_UINT16 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += (float) inimg.im->array.UI16[pixi];
-                }
-                break;
-
-            case _DATATYPE_INT32 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += (float) inimg.im->array.SI32[pixi];
-                }
-                break;
-
-            case _DATATYPE_UINT32 :
-                for(uint64_t pixi = 0; pixi < xysize; pixi++)
-                {
-                    imdataarray[pixi] += (float) inimg.im->array.UI32[pixi];
-                }
-                break;
-
+            for(uint64_t pixi = 0; pixi < xysize; pixi++)
+            {
+                outave[pixi] = imdataarray[pixi];
+            }
         }
-
-
-        if(*comprms == 1)
+        if(outrms != NULL)
         {
             for(uint64_t pixi = 0; pixi < xysize; pixi++)
             {
-                imdataarrayPOW[pixi] += imdataarray[pixi] * imdataarray[pixi];
+                outrms[pixi] = sqrt(imdataarrayPOW[pixi]);
             }
         }
     }
 
-
-    (*cntindex)++;
-    if((*cntindex) >= (*NBcoadd))
+    // block mode writes output once per block, other modes every frame
+    if((mode != STREAMAVE_MODE_BLOCK) || (*cntindex == 0))
     {
-
         if(*compave == 1)
         {
-            DEBUG_TRACEPOINT("Writing output AVE image");
-
-            for(uint64_t pixi = 0; pixi < xysize; pixi++)
-            {
-                outimgave.im->array.F[pixi] = imdataarray[pixi] / (*cntindex);
-            }
-
             processinfo_update_output_stream(processinfo, outimgave.ID);
         }
-
         if(*comprms == 1)
         {
-            DEBUG_TRACEPOINT("Writing output RMS image");
-            for(uint64_t pixi = 0; pixi < xysize; pixi++)
-            {
-                outimgrms.im->array.F[pixi] =
-                    sqrt(imdataarrayPOW[pixi]) / (*cntindex);
-            }
-
             processinfo_update_output_stream(processinfo, outimgrms.ID);
         }
-
-        (*cntindex) = 0;
     }
 
     INSERT_STD_PROCINFO_COMPUTEFUNC_END
 
     free(imdataarray);
+    free(imdataarrayPOW);
+    free(ringbuff);
 
     DEBUG_TRACE_FEXIT();
     return RETURN_SUCCESS;
@@ -0,0 +1,640 @@
+/**
+ * @file    stream_codec.c
+ * @brief   lightweight frame encoding for network stream transfer
+ *
+ * Frames are pixel data followed by an optional trailer (keywords).
+ * Encoding steps, selected by STREAM_CODEC_* flags :
+ *
+ * - DELTA   : XOR with previous frame. Unchanged bytes become zero, and
+ *             for slowly varying float data, so do sign and exponent bytes.
+ * - SHUFFLE : pixel bytes are regrouped by significance (all first bytes,
+ *             then all second bytes...), so that zero bytes form long runs.
+ * - RLE     : zero runs and literal runs are packed :
+ *             token 0x00-0x7F : 1-128 literal bytes follow
+ *             token 0x81-0xFF : 1-127 zero bytes
+ *             token 0x80      : uint32 zero count follows
+ *
+ * Encoder and decoder each keep their own copy of the previous frame as
+ * delta reference, so both ends must see the same frame sequence : this
+ * suits reliable transports. First frame is sent without delta (KEY).
+ * If encoding does not reduce size, the frame is stored as is (RAW).
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "stream_codec.h"
+
+static inline uint64_t codec_load64(const unsigned char *ptr)
+{
+    uint64_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+// non-zero if any byte of v is zero
+static inline uint64_t codec_haszero64(uint64_t v)
+{
+    return (v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL;
+}
+
+static long codec_emit_literal(unsigned char       *out,
+                               long                 o,
+                               long                 outmax,
+                               const unsigned char *lit,
+                               long                 len)
+{
+    while(len > 0)
+    {
+        long l = (len > 128) ? 128 : len;
+        if(o + 1 + l > outmax)
+        {
+            return -1;
+        }
+        out[o++] = (unsigned char)(l - 1);
+        memcpy(out + o, lit, l);
+        o += l;
+        lit += l;
+        len -= l;
+    }
+    return o;
+}
+
+static long codec_emit_zeros(unsigned char *out, long o, long outmax, long len)
+{
+    while(len > 0)
+    {
+        if(len <= 127)
+        {
+            if(o + 1 > outmax)
+            {
+                return -1;
+            }
+            out[o++] = (unsigned char)(0x80 | len);
+            len      = 0;
+        }
+        else
+        {
+            uint32_t l = (len > UINT32_MAX) ? UINT32_MAX : (uint32_t) len;
+            if(o + 5 > outmax)
+            {
+                return -1;
+            }
+            out[o++] = 0x80;
+            memcpy(out + o, &l, sizeof(l));
+            o += sizeof(l);
+            len -= l;
+        }
+    }
+    return o;
+}
+
+/**
+ * @brief Pack zero runs
+ *
+ * Runs of 3 zeros or more are packed, shorter ones are left in literals.
+ *
+ * @return encoded size, -1 if larger than outmax
+ */
+static long codec_rle_encode(const unsigned char *in,
+                             long                 n,
+                             unsigned char       *out,
+                             long                 outmax)
+{
+    long i   = 0;
+    long lit = 0; // start of pending literal run
+    long o   = 0;
+
+    while(i < n)
+    {
+        // literal bytes, up to next zero run
+        while(i < n)
+        {
+            if(i + 8 <= n)
+            {
+                // zero byte in v | v>>8 | v>>16 : 3 zeros may start in word
+                uint64_t v = codec_load64(in + i);
+                if(codec_haszero64(v | (v >> 8) | (v >> 16)) == 0)
+                {
+                    i += 8;
+                    continue;
+                }
+            }
+            if((in[i] == 0) &&
+                    ((i + 2 >= n) || ((in[i + 1] == 0) && (in[i + 2] == 0))))
+            {
+                break;
+            }
+            i++;
+        }
+        if(o + (i - lit) > outmax)
+        {
+            return -1;
+        }
+        if(i == n)
+        {
+            break;
+        }
+
+        long j = i;
+        while((j + 8 <= n) && (codec_load64(in + j) == 0))
+        {
+            j += 8;
+        }
+        while((j < n) && (in[j] == 0))
+        {
+            j++;
+        }
+        o = codec_emit_literal(out, o, outmax, in + lit, i - lit);
+        if(o < 0)
+        {
+            return -1;
+        }
+        o = codec_emit_zeros(out, o, outmax, j - i);
+        if(o < 0)
+        {
+            return -1;
+        }
+        lit = j;
+        i   = j;
+    }
+
+    return codec_emit_literal(out, o, outmax, in + lit, i - lit);
+}
+
+/**
+ * @brief Unpack zero runs
+ *
+ * @return decoded size, -1 if input is malformed or exceeds outsize
+ */
+static long codec_rle_decode(const unsigned char *in,
+                             long                 insize,
+                             unsigned char       *out,
+                             long                 outsize)
+{
+    long i = 0;
+    long o = 0;
+
+    while(i < insize)
+    {
+        unsigned char t = in[i++];
+        if(t & 0x80)
+        {
+            long z = t & 0x7F;
+            if(z == 0)
+            {
+                uint32_t l;
+                if(i + (long) sizeof(l) > insize)
+                {
+                    return -1;
+                }
+                memcpy(&l, in + i, sizeof(l));
+                i += sizeof(l);
+                z = l;
+            }
+            if(o + z > outsize)
+            {
+                return -1;
+            }
+            memset(out + o, 0, z);
+            o += z;
+        }
+        else
+        {
+            long l = (long) t + 1;
+            if((i + l > insize) || (o + l > outsize))
+            {
+                return -1;
+            }
+            memcpy(out + o, in + i, l);
+            i += l;
+            o += l;
+        }
+    }
+
+    return o;
+}
+
+// dst byte plane b, element i <- src element i, byte b (XOR ref)
+static inline void codec_shuffle(unsigned char       *dst,
+                                 const unsigned char *src,
+                                 const unsigned char *ref,
+                                 long                 N,
+                                 int                  es)
+{
+    if(ref != NULL)
+    {
+        for(long i = 0; i < N; i++)
+        {
+            for(int b = 0; b < es; b++)
+            {
+                dst[b * N + i] = src[i * es + b] ^ ref[i * es + b];
+            }
+        }
+    }
+    else
+    {
+        for(long i = 0; i < N; i++)
+        {
+            for(int b = 0; b < es; b++)
+            {
+                dst[b * N + i] = src[i * es + b];
+            }
+        }
+    }
+}
+
+static inline void codec_unshuffle(unsigned char       *dst,
+                                   const unsigned char *src,
+                                   const unsigned char *ref,
+                                   long                 N,
+                                   int                  es)
+{
+    if(ref != NULL)
+    {
+        for(long i = 0; i < N; i++)
+        {
+            for(int b = 0; b < es; b++)
+            {
+                dst[i * es + b] = src[b * N + i] ^ ref[i * es + b];
+            }
+        }
+    }
+    else
+    {
+        for(long i = 0; i < N; i++)
+        {
+            for(int b = 0; b < es; b++)
+            {
+                dst[i * es + b] = src[b * N + i];
+            }
+        }
+    }
+}
+
+static void codec_xor(unsigned char       *dst,
+                      const unsigned char *src,
+                      const unsigned char *ref,
+                      long                 n)
+{
+    if(ref != NULL)
+    {
+        for(long k = 0; k < n; k++)
+        {
+            dst[k] = src[k] ^ ref[k];
+        }
+    }
+    else
+    {
+        memcpy(dst, src, n);
+    }
+}
+
+// pixels and trailer, to contiguous delta / shuffled buffer
+static void codec_transform(const STREAM_CODEC  *cd,
+                            unsigned char       *dst,
+                            const unsigned char *pix,
+                            const unsigned char *trail,
+                            const unsigned char *ref)
+{
+    long N       = cd->NBelem;
+    long pixsize = N * cd->elemsize;
+
+    if((cd->codec & STREAM_CODEC_SHUFFLE) && (cd->elemsize > 1))
+    {
+        // constant element sizes let the compiler unroll inner loop
+        switch(cd->elemsize)
+        {
+            case 2:
+                codec_shuffle(dst, pix, ref, N, 2);
+                break;
+            case 4:
+                codec_shuffle(dst, pix, ref, N, 4);
+                break;
+            case 8:
+                codec_shuffle(dst, pix, ref, N, 8);
+                break;
+            default:
+                codec_shuffle(dst, pix, ref, N, cd->elemsize);
+        }
+    }
+    else
+    {
+        codec_xor(dst, pix, ref, pixsize);
+    }
+
+    if(cd->trailsize > 0)
+    {
+        codec_xor(dst + pixsize,
+                  trail,
+                  (ref != NULL) ? ref + pixsize : NULL,
+                  cd->trailsize);
+    }
+}
+
+static void codec_untransform(const STREAM_CODEC  *cd,
+                              unsigned char       *pix,
+                              unsigned char       *trail,
+                              const unsigned char *src,
+                              const unsigned char *ref)
+{
+    long N       = cd->NBelem;
+    long pixsize = N * cd->elemsize;
+
+    if((cd->codec & STREAM_CODEC_SHUFFLE) && (cd->elemsize > 1))
+    {
+        switch(cd->elemsize)
+        {
+            case 2:
+                codec_unshuffle(pix, src, ref, N, 2);
+                break;
+            case 4:
+                codec_unshuffle(pix, src, ref, N, 4);
+                break;
+            case 8:
+                codec_unshuffle(pix, src, ref, N, 8);
+                break;
+            default:
+                codec_unshuffle(pix, src, ref, N, cd->elemsize);
+        }
+    }
+    else
+    {
+        codec_xor(pix, src, ref, pixsize);
+    }
+
+    if(cd->trailsize > 0)
+    {
+        codec_xor(trail,
+                  src + pixsize,
+                  (ref != NULL) ? ref + pixsize : NULL,
+                  cd->trailsize);
+    }
+}
+
+static void codec_setref(STREAM_CODEC *cd, const char *pix, const char *trail)
+{
+    long pixsize = cd->NBelem * cd->elemsize;
+
+    memcpy(cd->ref, pix, pixsize);
+    if(cd->trailsize > 0)
+    {
+        memcpy(cd->ref + pixsize, trail, cd->trailsize);
+    }
+    cd->refOK = 1;
+}
+
+static uint64_t codec_elapsed_ns(const struct timespec *t0)
+{
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1000000000L + (t1.tv_nsec - t0->tv_nsec);
+}
+
+/**
+ * @brief Set up encoder or decoder
+ *
+ * @param codec      STREAM_CODEC_* flags, 0 to send frames as is
+ * @param NBelem     number of pixels
+ * @param elemsize   pixel size [byte]
+ * @param trailsize  bytes following pixel data, e.g. keywords
+ */
+errno_t stream_codec_init(STREAM_CODEC *cd,
+                          int           codec,
+                          long          NBelem,
+                          int           elemsize,
+                          long          trailsize)
+{
+    memset(cd, 0, sizeof(STREAM_CODEC));
+
+    if(codec & ~STREAM_CODEC_ALL)
+    {
+        PRINT_ERROR("unknown codec flags 0x%x", codec);
+        return RETURN_FAILURE;
+    }
+    cd->codec     = codec;
+    cd->NBelem    = NBelem;
+    cd->elemsize  = (elemsize < 1) ? 1 : elemsize;
+    cd->trailsize = trailsize;
+    cd->framesize = NBelem * cd->elemsize + trailsize;
+
+    if(codec != 0)
+    {
+        cd->work = (char *) malloc(cd->framesize);
+        if(cd->work == NULL)
+        {
+            PRINT_ERROR("malloc() error");
+            return RETURN_FAILURE;
+        }
+    }
+    if(codec & STREAM_CODEC_DELTA)
+    {
+        cd->ref = (char *) malloc(cd->framesize);
+        if(cd->ref == NULL)
+        {
+            PRINT_ERROR("malloc() error");
+            free(cd->work);
+            cd->work = NULL;
+            return RETURN_FAILURE;
+        }
+    }
+
+    return RETURN_SUCCESS;
+}
+
+errno_t stream_codec_free(STREAM_CODEC *cd)
+{
+    free(cd->ref);
+    free(cd->work);
+    cd->ref  = NULL;
+    cd->work = NULL;
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Upper bound on encoded frame size
+ */
+long stream_codec_maxsize(const STREAM_CODEC *cd)
+{
+    return cd->framesize;
+}
+
+/**
+ * @brief Drop delta reference, next frame is sent as KEY
+ */
+errno_t stream_codec_reset(STREAM_CODEC *cd)
+{
+    cd->refOK = 0;
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Encode frame
+ *
+ * @param pix         pixel data, NBelem x elemsize bytes
+ * @param trail       trailer, trailsize bytes (may be NULL if 0)
+ * @param out         output, stream_codec_maxsize() bytes
+ * @param frameflags  STREAM_CODEC_FRAME_* flags, to be passed to decoder
+ *
+ * @return encoded size [byte]
+ */
+long stream_codec_encode(STREAM_CODEC *cd,
+                         const char   *pix,
+                         const char   *trail,
+                         char         *out,
+                         int          *frameflags)
+{
+    struct timespec t0;
+    long            pixsize = cd->NBelem * cd->elemsize;
+    long            size    = -1;
+    int             flags   = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if(cd->codec != 0)
+    {
+        const unsigned char *ref = NULL;
+
+        if(cd->codec & STREAM_CODEC_DELTA)
+        {
+            if(cd->refOK == 1)
+            {
+                ref = (const unsigned char *) cd->ref;
+            }
+            else
+            {
+                flags |= STREAM_CODEC_FRAME_KEY;
+            }
+        }
+
+        codec_transform(cd,
+                        (unsigned char *) cd->work,
+                        (const unsigned char *) pix,
+                        (const unsigned char *) trail,
+                        ref);
+
+        if(cd->codec & STREAM_CODEC_RLE)
+        {
+            // must beat raw size
+            size = codec_rle_encode((const unsigned char *) cd->work,
+                                    cd->framesize,
+                                    (unsigned char *) out,
+                                    cd->framesize - 1);
+        }
+        else
+        {
+            memcpy(out, cd->work, cd->framesize);
+            size = cd->framesize;
+        }
+    }
+
+    if(size < 0)
+    {
+        memcpy(out, pix, pixsize);
+        if(cd->trailsize > 0)
+        {
+            memcpy(out + pixsize, trail, cd->trailsize);
+        }
+        size  = cd->framesize;
+        flags = (cd->codec != 0) ? STREAM_CODEC_FRAME_RAW : 0;
+    }
+
+    if(cd->codec & STREAM_CODEC_DELTA)
+    {
+        codec_setref(cd, pix, trail);
+    }
+
+    cd->NBframe++;
+    cd->NBbyteraw += cd->framesize;
+    cd->NBbyteenc += size;
+    cd->time_ns += codec_elapsed_ns(&t0);
+
+    *frameflags = flags;
+    return size;
+}
+
+/**
+ * @brief Decode frame
+ *
+ * @param in          encoded frame
+ * @param insize      encoded size [byte]
+ * @param frameflags  flags set by encoder
+ * @param pix         output pixel data
+ * @param trail       output trailer (may be NULL if trailsize is 0)
+ */
+errno_t stream_codec_decode(STREAM_CODEC *cd,
+                            const char   *in,
+                            long          insize,
+                            int           frameflags,
+                            char         *pix,
+                            char         *trail)
+{
+    struct timespec t0;
+    long            pixsize = cd->NBelem * cd->elemsize;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if((cd->codec == 0) || (frameflags & STREAM_CODEC_FRAME_RAW))
+    {
+        if(insize != cd->framesize)
+        {
+            return RETURN_FAILURE;
+        }
+        memcpy(pix, in, pixsize);
+        if(cd->trailsize > 0)
+        {
+            memcpy(trail, in + pixsize, cd->trailsize);
+        }
+    }
+    else
+    {
+        const unsigned char *src = (const unsigned char *) in;
+        const unsigned char *ref = NULL;
+
+        if(cd->codec & STREAM_CODEC_RLE)
+        {
+            if(codec_rle_decode((const unsigned char *) in,
+                                insize,
+                                (unsigned char *) cd->work,
+                                cd->framesize) != cd->framesize)
+            {
+                return RETURN_FAILURE;
+            }
+            src = (const unsigned char *) cd->work;
+        }
+        else if(insize != cd->framesize)
+        {
+            return RETURN_FAILURE;
+        }
+
+        if((cd->codec & STREAM_CODEC_DELTA) &&
+                !(frameflags & STREAM_CODEC_FRAME_KEY))
+        {
+            if(cd->refOK == 0)
+            {
+                return RETURN_FAILURE;
+            }
+            ref = (const unsigned char *) cd->ref;
+        }
+
+        codec_untransform(cd,
+                          (unsigned char *) pix,
+                          (unsigned char *) trail,
+                          src,
+                          ref);
+    }
+
+    if(cd->codec & STREAM_CODEC_DELTA)
+    {
+        codec_setref(cd, pix, trail);
+    }
+
+    cd->NBframe++;
+    cd->NBbyteraw += cd->framesize;
+    cd->NBbyteenc += insize;
+    cd->time_ns += codec_elapsed_ns(&t0);
+
+    return RETURN_SUCCESS;
+}
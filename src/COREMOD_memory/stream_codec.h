@@ -0,0 +1,65 @@
+/**
+ * @file    stream_codec.h
+ * @brief   lightweight frame encoding for network stream transfer
+ */
+
+#ifndef COREMOD_MEMORY_STREAM_CODEC_H
+#define COREMOD_MEMORY_STREAM_CODEC_H
+
+#include <stdint.h>
+
+// encoding steps, may be combined
+#define STREAM_CODEC_DELTA   0x0001 // XOR with previous frame
+#define STREAM_CODEC_SHUFFLE 0x0002 // group pixel bytes by significance
+#define STREAM_CODEC_RLE     0x0004 // pack zero runs
+#define STREAM_CODEC_ALL     0x0007
+
+// per-frame flags, set by encoder
+#define STREAM_CODEC_FRAME_KEY 0x0001 // no delta : reference was reset
+#define STREAM_CODEC_FRAME_RAW 0x0002 // stored as is, encoding did not pay
+
+typedef struct
+{
+    int  codec; // STREAM_CODEC_* flags
+    long NBelem;
+    int  elemsize;  // pixel size [byte]
+    long trailsize; // bytes after pixel data (keywords), not shuffled
+    long framesize; // NBelem x elemsize + trailsize
+
+    char *ref;   // previous frame, delta reference
+    int   refOK; // reference is valid
+    char *work;  // delta / shuffled frame
+
+    // statistics
+    uint64_t NBframe;
+    uint64_t NBbyteraw;
+    uint64_t NBbyteenc;
+    uint64_t time_ns; // total encode or decode time
+} STREAM_CODEC;
+
+errno_t stream_codec_init(STREAM_CODEC *cd,
+                          int           codec,
+                          long          NBelem,
+                          int           elemsize,
+                          long          trailsize);
+
+errno_t stream_codec_free(STREAM_CODEC *cd);
+
+long stream_codec_maxsize(const STREAM_CODEC *cd);
+
+errno_t stream_codec_reset(STREAM_CODEC *cd);
+
+long stream_codec_encode(STREAM_CODEC *cd,
+                         const char   *pix,
+                         const char   *trail,
+                         char         *out,
+                         int          *frameflags);
+
+errno_t stream_codec_decode(STREAM_CODEC *cd,
+                            const char   *in,
+                            long          insize,
+                            int           frameflags,
+                            char         *pix,
+                            char         *trail);
+
+#endif
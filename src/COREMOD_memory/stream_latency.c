@@ -0,0 +1,311 @@
+/**
+ * @file    stream_latency.c
+ * @brief   per-frame latency record for network stream transfer
+ *
+ * Network receivers record, for each frame, the time spent between
+ * successive timestamps : source acquisition (md.atime), source write,
+ * transmit, receive and local write. Samples are kept in a shared memory
+ * INT64 stream named <stream>_netlat, size STREAM_LATENCY_NBSAMPLE x
+ * STREAM_LATENCY_NBSEG, used as a ring buffer : cnt0 counts frames, cnt1
+ * is the last sample index. Percentiles are computed on demand from the
+ * last STREAM_LATENCY_NBSAMPLE frames, by the receiver for its
+ * processinfo message, or by any process with imnetwlatency.
+ *
+ * Timestamps are CLOCK_REALTIME : segments across hosts need synchronized
+ * clocks (PTP), and may come out negative otherwise.
+ * As receivers copy source atime into the local stream, end-to-end
+ * latency accumulates over relay hops.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "create_image.h"
+#include "delete_image.h"
+#include "image_ID.h"
+#include "read_shmim.h"
+#include "stream_latency.h"
+
+// end-to-end histogram : log2 bins from 1 us
+#define STREAM_LATENCY_NBHISTBIN 24
+
+const char *stream_latency_segname[STREAM_LATENCY_NBSEG] = {"source atime->write",
+                                                            "source write->send",
+                                                            "network",
+                                                            "receive->write",
+                                                            "end-to-end"
+                                                           };
+
+// ==========================================
+// Command line interface
+// ==========================================
+
+static char *streamname;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_STR,
+        ".streamname",
+        "received stream",
+        "im1",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &streamname,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imnetwlatency",
+                                "network transfer latency of received stream",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    printf("Reads latency record %s written by imnetwreceive, prints\n"
+           "percentiles per segment and end-to-end histogram\n",
+           "<stream>" STREAM_LATENCY_SUFFIX);
+    return RETURN_SUCCESS;
+}
+
+// ==========================================
+// Record
+// ==========================================
+
+/**
+ * @brief Create latency record stream for received stream
+ *
+ * @return ID of record stream, -1 on error
+ */
+imageID stream_latency_create(const char *streamname)
+{
+    char     name[STRINGMAXLEN_IMGNAME];
+    uint32_t naxes[2] = {STREAM_LATENCY_NBSAMPLE, STREAM_LATENCY_NBSEG};
+    imageID  ID       = -1;
+
+    WRITE_IMAGENAME(name, "%s%s", streamname, STREAM_LATENCY_SUFFIX);
+    delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+    if(create_image_ID(name, 2, naxes, _DATATYPE_INT64, 1, 0, 0, &ID) !=
+            RETURN_SUCCESS)
+    {
+        return -1;
+    }
+
+    IMAGE *img_p = &data.image[ID];
+    for(long i = 0; i < STREAM_LATENCY_NBSAMPLE * STREAM_LATENCY_NBSEG; i++)
+    {
+        img_p->array.SI64[i] = STREAM_LATENCY_NONE;
+    }
+    img_p->md[0].cnt1 = STREAM_LATENCY_NBSAMPLE - 1;
+
+    return ID;
+}
+
+/**
+ * @brief Record frame timestamps [ns]
+ *
+ * atime and writetime are 0 if not set by source. No semaphore is posted.
+ */
+errno_t stream_latency_record(IMAGE  *latimg,
+                              int64_t atime,
+                              int64_t writetime,
+                              int64_t txtime,
+                              int64_t rxtime,
+                              int64_t localtime)
+{
+    int64_t  *lat = latimg->array.SI64;
+    uint64_t  k   = (latimg->md[0].cnt1 + 1) % STREAM_LATENCY_NBSAMPLE;
+    int64_t   t0  = (atime != 0) ? atime : writetime;
+
+    lat[STREAM_LATENCY_SRC * STREAM_LATENCY_NBSAMPLE + k] =
+        ((atime != 0) && (writetime != 0)) ? writetime - atime
+        : STREAM_LATENCY_NONE;
+    lat[STREAM_LATENCY_TX * STREAM_LATENCY_NBSAMPLE + k] =
+        (writetime != 0) ? txtime - writetime : STREAM_LATENCY_NONE;
+    lat[STREAM_LATENCY_NET * STREAM_LATENCY_NBSAMPLE + k] = rxtime - txtime;
+    lat[STREAM_LATENCY_RX * STREAM_LATENCY_NBSAMPLE + k]  = localtime - rxtime;
+    lat[STREAM_LATENCY_E2E * STREAM_LATENCY_NBSAMPLE + k] =
+        (t0 != 0) ? localtime - t0 : STREAM_LATENCY_NONE;
+
+    latimg->md[0].cnt1 = k;
+    __atomic_fetch_add(&latimg->md[0].cnt0, 1, __ATOMIC_RELEASE);
+
+    return RETURN_SUCCESS;
+}
+
+static int stream_latency_cmp(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *) a;
+    int64_t vb = *(const int64_t *) b;
+
+    return (va > vb) - (va < vb);
+}
+
+// valid samples of segment, sorted, returns number of samples
+static long stream_latency_sorted(IMAGE *latimg, int seg, int64_t *v)
+{
+    const int64_t *lat = latimg->array.SI64 + seg * STREAM_LATENCY_NBSAMPLE;
+    long           n   = 0;
+
+    for(long k = 0; k < STREAM_LATENCY_NBSAMPLE; k++)
+    {
+        int64_t x = lat[k];
+        if(x != STREAM_LATENCY_NONE)
+        {
+            v[n++] = x;
+        }
+    }
+    qsort(v, n, sizeof(int64_t), stream_latency_cmp);
+
+    return n;
+}
+
+/**
+ * @brief Percentiles over rolling window
+ *
+ * Record may be written concurrently : a few samples may be from
+ * frames newer than others.
+ */
+errno_t stream_latency_stats(IMAGE                *latimg,
+                             int                   seg,
+                             STREAM_LATENCY_STATS *stats)
+{
+    int64_t v[STREAM_LATENCY_NBSAMPLE];
+
+    memset(stats, 0, sizeof(STREAM_LATENCY_STATS));
+    if((seg < 0) || (seg >= STREAM_LATENCY_NBSEG))
+    {
+        return RETURN_FAILURE;
+    }
+
+    long n = stream_latency_sorted(latimg, seg, v);
+    stats->NBsample = n;
+    if(n > 0)
+    {
+        stats->p50 = v[(n - 1) / 2];
+        stats->p99 = v[(long)((n - 1) * 0.99)];
+        stats->max = v[n - 1];
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/**
+ * @brief Print latency percentiles and end-to-end histogram
+ */
+errno_t stream_latency_dump(const char *streamname)
+{
+    DEBUG_TRACE_FSTART();
+
+    char name[STRINGMAXLEN_IMGNAME];
+
+    WRITE_IMAGENAME(name, "%s%s", streamname, STREAM_LATENCY_SUFFIX);
+    imageID ID = image_ID(name);
+    if(ID == -1)
+    {
+        ID = read_sharedmem_image(name);
+    }
+    if(ID == -1)
+    {
+        FUNC_RETURN_FAILURE("no latency record %s", name);
+    }
+    IMAGE *img_p = &data.image[ID];
+    if((img_p->md[0].datatype != _DATATYPE_INT64) ||
+            (img_p->md[0].size[0] != STREAM_LATENCY_NBSAMPLE) ||
+            (img_p->md[0].size[1] != STREAM_LATENCY_NBSEG))
+    {
+        FUNC_RETURN_FAILURE("%s is not a latency record", name);
+    }
+
+    printf("%s : %lu frames received, last %d used\n",
+           streamname,
+           img_p->md[0].cnt0,
+           STREAM_LATENCY_NBSAMPLE);
+    printf("%-22s %8s %12s %12s %12s\n",
+           "segment",
+           "samples",
+           "p50 [us]",
+           "p99 [us]",
+           "max [us]");
+    for(int seg = 0; seg < STREAM_LATENCY_NBSEG; seg++)
+    {
+        STREAM_LATENCY_STATS stats;
+
+        stream_latency_stats(img_p, seg, &stats);
+        if(stats.NBsample == 0)
+        {
+            printf("%-22s %8ld %12s %12s %12s\n",
+                   stream_latency_segname[seg],
+                   0L,
+                   "-",
+                   "-",
+                   "-");
+            continue;
+        }
+        printf("%-22s %8ld %12.1f %12.1f %12.1f\n",
+               stream_latency_segname[seg],
+               stats.NBsample,
+               1.0e-3 * stats.p50,
+               1.0e-3 * stats.p99,
+               1.0e-3 * stats.max);
+    }
+
+    // end-to-end histogram, bin b : [2^b, 2^(b+1)[ us
+    int64_t v[STREAM_LATENCY_NBSAMPLE];
+    long    hist[STREAM_LATENCY_NBHISTBIN];
+    long    histmax = 0;
+    long    n       = stream_latency_sorted(img_p, STREAM_LATENCY_E2E, v);
+
+    memset(hist, 0, sizeof(hist));
+    for(long i = 0; i < n; i++)
+    {
+        int b = 0;
+        for(int64_t us = v[i] / 1000; (us > 1) && (b < STREAM_LATENCY_NBHISTBIN - 1);
+                us >>= 1)
+        {
+            b++;
+        }
+        hist[b]++;
+    }
+    for(int b = 0; b < STREAM_LATENCY_NBHISTBIN; b++)
+    {
+        if(hist[b] > histmax)
+        {
+            histmax = hist[b];
+        }
+    }
+    if(histmax > 0)
+    {
+        printf("\nend-to-end latency histogram\n");
+        for(int b = 0; b < STREAM_LATENCY_NBHISTBIN; b++)
+        {
+            if(hist[b] == 0)
+            {
+                continue;
+            }
+            char bar[51];
+            int  len = (int)(50 * hist[b] / histmax);
+            memset(bar, '#', len);
+            bar[len] = '\0';
+            printf("  < %9ld us  %6ld  %s\n", 2L << b, hist[b], bar);
+        }
+    }
+    fflush(stdout);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_latency_dump(streamname);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_COREMOD_memory__stream_latency()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
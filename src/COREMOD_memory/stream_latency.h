@@ -0,0 +1,66 @@
+/**
+ * @file    stream_latency.h
+ * @brief   per-frame latency record for network stream transfer
+ */
+
+#ifndef COREMOD_MEMORY_STREAM_LATENCY_H
+#define COREMOD_MEMORY_STREAM_LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+
+// rolling window, samples per segment
+#define STREAM_LATENCY_NBSAMPLE 4096
+
+// latency record stream : <stream name> + suffix
+#define STREAM_LATENCY_SUFFIX "_netlat"
+
+// no sample, e.g. source atime not set
+#define STREAM_LATENCY_NONE INT64_MIN
+
+// latency segments, between timestamps of a frame
+#define STREAM_LATENCY_SRC 0 // source atime -> source write
+#define STREAM_LATENCY_TX  1 // source write -> transmit
+#define STREAM_LATENCY_NET 2 // transmit -> received (clocks must be synced)
+#define STREAM_LATENCY_RX  3 // received -> local write
+#define STREAM_LATENCY_E2E 4 // source atime (or write) -> local write
+#define STREAM_LATENCY_NBSEG 5
+
+typedef struct
+{
+    long    NBsample;
+    int64_t p50; // [ns]
+    int64_t p99;
+    int64_t max;
+} STREAM_LATENCY_STATS;
+
+extern const char *stream_latency_segname[STREAM_LATENCY_NBSEG];
+
+// timestamp [ns], 0 if unset
+static inline int64_t stream_latency_ns(struct timespec ts)
+{
+    if(ts.tv_sec == 0)
+    {
+        return 0;
+    }
+    return (int64_t) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+errno_t CLIADDCMD_COREMOD_memory__stream_latency();
+
+imageID stream_latency_create(const char *streamname);
+
+errno_t stream_latency_record(IMAGE  *latimg,
+                              int64_t atime,
+                              int64_t writetime,
+                              int64_t txtime,
+                              int64_t rxtime,
+                              int64_t localtime);
+
+errno_t stream_latency_stats(IMAGE                *latimg,
+                             int                   seg,
+                             STREAM_LATENCY_STATS *stats);
+
+errno_t stream_latency_dump(const char *streamname);
+
+#endif
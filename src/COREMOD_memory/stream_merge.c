@@ -3,25 +3,46 @@
  * @brief   Merge n independently triggers streams into one
  *          This early version relies on very static naming conventions
  *          And will merge <shmname>_[0-N] into <shmname>
- *          Assuming equal framerates
  *
  *          Designed for parallel MVM computations.
+ *
+ * All inputs are waited on by a single STREAM_MULTIWAIT. The merge loop
+ * copies each new input frame into its slot of the output as soon as it
+ * arrives, and decides when to update the output according to the
+ * policy :
+ *
+ * - MERGE_POLICY_ALL    : all inputs have a new frame. If maxskewus > 0,
+ *                         update anyway maxskewus after the first arrival,
+ *                         missing inputs are counted as missed
+ * - MERGE_POLICY_ANY    : any input has a new frame
+ * - MERGE_POLICY_LATEST : input 0 has a new frame, other inputs contribute
+ *                         their latest frame
+ *
+ * Per-input statistics : frames received, frames dropped (overwritten
+ * before output update, or skipped by merge loop), frames missed (not
+ * available at output update in ALL policy), arrival skew relative to the
+ * first input of the output frame.
  */
 
 #include "CommandLineInterface/CLIcore.h"
 #include "CommandLineInterface/timeutils.h"
 
 //#include "image_ID.h"
-//#include "stream_sem.h"
+#include "stream_sem.h"
 
 //#include "COREMOD_tools/COREMOD_tools.h"
 
+#define MERGE_POLICY_ALL    0
+#define MERGE_POLICY_ANY    1
+#define MERGE_POLICY_LATEST 2
 
 
 // variables local to this translation unit
 static char *stream_basename; // stream basename, which also is the output name.
 static int32_t *ptr_n_input; // How many streams to merge?
 // static int32_t *ptr_concat_axis; // FUTURE - actually perform smarter concatenation along any axis.
+static int32_t *ptr_policy;
+static int64_t *ptr_maxskewus;
 
 static CLICMDARGDEF farg[] =
 {
@@ -42,6 +63,24 @@ static CLICMDARGDEF farg[] =
         CLIARG_VISIBLE_DEFAULT,
         (void **) &ptr_n_input,
         NULL
+    },
+    {
+        CLIARG_INT32,
+        ".policy",
+        "update policy: 0=all 1=any 2=latest",
+        "0",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &ptr_policy,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".maxskewus",
+        "all policy: max wait after first input [us], 0=unlimited",
+        "0",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &ptr_maxskewus,
+        NULL
     }
 };
 
@@ -53,52 +92,117 @@ static CLICMDDATA CLIcmddata = {"shmimmerge",
 // detailed help
 static errno_t help_function()
 {
+    printf("Inputs <name>_0 ... <name>_<N-1> are concatenated into <name>\n");
+    printf("Input sizes may differ, output must be large enough\n");
+    printf(".policy 0 (all)    : update when all inputs have new frame\n");
+    printf("                     .maxskewus > 0 : update after maxskewus "
+           "even if some inputs are missing\n");
+    printf(".policy 1 (any)    : update on any input frame\n");
+    printf(".policy 2 (latest) : update on input 0 frame, with latest frame of "
+           "other inputs\n");
     return RETURN_SUCCESS;
 }
 
 
 
+typedef struct
+{
+    IMGID    img;
+    uint64_t offset; // byte offset in output
+    uint64_t nbbyte;
+
+    int    newframe; // 1 if frame copied since last output update
+    double tarrival; // arrival time of last frame [s]
+
+    long   NBframe;
+    long   NBdrop;
+    long   NBmissed;
+    double skewus; // arrival time relative to first input, last update
+    double skewmaxus;
+} MERGE_INPUT;
+
+static double timespec_sec(struct timespec ts)
+{
+    return 1.0 * ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+
 // Wrapper function, used by all CLI calls
 static errno_t compute_function()
 {
     DEBUG_TRACE_FSTART();
 
-    int32_t n_input = *ptr_n_input;
+    int32_t n_input   = *ptr_n_input;
+    int32_t policy    = *ptr_policy;
+    int64_t maxskewus = *ptr_maxskewus;
 
-    // Open array of input images
-    IMGID *img_in_arr = (IMGID *) malloc(n_input * sizeof(IMGID));
-    char input_name[200];
-    for(int ii = 0; ii < n_input; ++ii)
+    if(n_input < 1)
+    {
+        FUNC_RETURN_FAILURE("n_input = %d, must be >0", n_input);
+    }
+    if((policy < MERGE_POLICY_ALL) || (policy > MERGE_POLICY_LATEST))
     {
-        sprintf(input_name, "%s_%d", stream_basename, ii);
-        img_in_arr[ii] = mkIMGID_from_name(input_name);
-        resolveIMGID(&img_in_arr[ii], ERRMODE_ABORT);
+        FUNC_RETURN_FAILURE("policy = %d, must be %d, %d or %d",
+                            policy,
+                            MERGE_POLICY_ALL,
+                            MERGE_POLICY_ANY,
+                            MERGE_POLICY_LATEST);
     }
 
     // Open output image
-    IMGID img_out = mkIMGID_from_name(stream_basename);
-    resolveIMGID(&img_out, ERRMODE_WARN);
+    IMGID merge_out = mkIMGID_from_name(stream_basename);
+    resolveIMGID(&merge_out, ERRMODE_ABORT);
+    uint64_t outnbbyte = merge_out.md->nelement *
+                         ImageStreamIO_typesize(merge_out.md->datatype);
 
-    // Perform some data offset computations.
-    // So that we know WHERE the memcopies should go and how big they should be.
-    int32_t *offset_bytes = (int32_t *) malloc(n_input * sizeof(int32_t));
-    int32_t *size_bytes = (int32_t *) malloc(n_input * sizeof(int32_t));
-    int32_t *sem_idxs = (int32_t *) malloc(n_input * sizeof(int32_t));
-
-    int acc = 0;
-    for(int kk = 0;  kk < n_input; ++kk)
+    // Open array of input images
+    // Inputs are concatenated in output memory, any naxis
+    MERGE_INPUT *inarray = (MERGE_INPUT *) calloc(n_input, sizeof(MERGE_INPUT));
+    imageID     *IDarray = (imageID *) malloc(sizeof(imageID) * n_input);
+    if((inarray == NULL) || (IDarray == NULL))
     {
-        offset_bytes[kk] = acc;
-        size_bytes[kk] = img_in_arr[kk].size[0] * ImageStreamIO_typesize(
-                             img_in_arr[kk].datatype);
-        acc += size_bytes[kk]; // Wildly assuming naxis=1 here.
-
-        sem_idxs[kk] = ImageStreamIO_getsemwaitindex(img_in_arr[kk].im, 0);
+        free(inarray);
+        free(IDarray);
+        FUNC_RETURN_FAILURE("malloc error");
+    }
+    uint64_t acc = 0;
+    for(int kk = 0; kk < n_input; ++kk)
+    {
+        char input_name[STRINGMAXLEN_IMGNAME];
+        WRITE_IMAGENAME(input_name, "%s_%d", stream_basename, kk);
+        inarray[kk].img = mkIMGID_from_name(input_name);
+        resolveIMGID(&inarray[kk].img, ERRMODE_ABORT);
+
+        inarray[kk].offset = acc;
+        inarray[kk].nbbyte =
+            inarray[kk].img.md->nelement *
+            ImageStreamIO_typesize(inarray[kk].img.md->datatype);
+        acc += inarray[kk].nbbyte;
+
+        IDarray[kk] = inarray[kk].img.ID;
+    }
+    if(acc > outnbbyte)
+    {
+        free(inarray);
+        free(IDarray);
+        FUNC_RETURN_FAILURE("inputs total %lu bytes > output %lu bytes",
+                            acc,
+                            outnbbyte);
     }
 
+    STREAM_MULTIWAIT *mw = stream_multiwait_create(IDarray, n_input, 0);
+    if(mw == NULL)
+    {
+        free(inarray);
+        free(IDarray);
+        FUNC_RETURN_FAILURE("cannot create stream waiter");
+    }
 
-    struct timespec t_spec1;
-    struct timespec t_spec2;
+    long   NBupdate  = 0;
+    double tmsg      = 0.0;
+    double tfirst    = 0.0; // first arrival of pending output frame
+    int    NBpending = 0;
 
     INSERT_STD_PROCINFO_COMPUTEFUNC_INIT
 
@@ -108,35 +212,166 @@ static errno_t compute_function()
 
     INSERT_STD_PROCINFO_COMPUTEFUNC_LOOPSTART
     {
-        // One sec timeout
-        milk_clock_gettime(&t_spec1);
-        t_spec2.tv_sec = t_spec1.tv_sec + 1;
-        t_spec2.tv_nsec = t_spec1.tv_nsec;
+        // One sec timeout, or end of max skew window if inputs are pending
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        double tnow       = timespec_sec(ts);
+        long   timeout_us = 1000000;
+        if((policy == MERGE_POLICY_ALL) && (maxskewus > 0) && (NBpending > 0))
+        {
+            double dtus = 1.0e6 * (tfirst - tnow) + maxskewus;
+            timeout_us  = (dtus < 0.0) ? 0 : (long) dtus;
+            if(timeout_us > 1000000)
+            {
+                timeout_us = 1000000;
+            }
+        }
+        stream_multiwait_wait(mw, timeout_us);
 
+        clock_gettime(CLOCK_REALTIME, &ts);
+        tnow = timespec_sec(ts);
 
+        // copy new input frames to their output slot
         for(int kk = 0; kk < n_input; kk++)
         {
-            ImageStreamIO_semtimedwait(img_in_arr[kk].im, sem_idxs[kk], &t_spec2);
-            // In case one input got ahead of the others
-            ImageStreamIO_semflush(img_in_arr[kk].im, sem_idxs[kk]);
+            if(mw->fired[kk] == 0)
+            {
+                continue;
+            }
+            merge_out.md->write = 1;
+            memcpy((char *) merge_out.im->array.raw + inarray[kk].offset,
+                   inarray[kk].img.im->array.raw,
+                   inarray[kk].nbbyte);
+
+            // updates between waits are skipped
+            inarray[kk].NBdrop += mw->fired[kk] - 1;
+            if(inarray[kk].newframe == 1)
+            {
+                // previous frame not sent
+                inarray[kk].NBdrop++;
+            }
+            else
+            {
+                inarray[kk].tarrival = tnow;
+            }
+            inarray[kk].newframe = 1;
+            inarray[kk].NBframe++;
         }
-        img_out.md->write = TRUE;
+
+        NBpending = 0;
+        tfirst    = tnow;
         for(int kk = 0; kk < n_input; kk++)
         {
-            memcpy(img_out.im->array.raw + offset_bytes[kk], img_in_arr[kk].im->array.raw,
-                   size_bytes[kk]);
+            if(inarray[kk].newframe == 1)
+            {
+                NBpending++;
+                if(inarray[kk].tarrival < tfirst)
+                {
+                    tfirst = inarray[kk].tarrival;
+                }
+            }
         }
 
+        int update = 0;
+        switch(policy)
+        {
+        case MERGE_POLICY_ANY:
+            update = (NBpending > 0);
+            break;
+
+        case MERGE_POLICY_LATEST:
+            update = inarray[0].newframe;
+            break;
+
+        case MERGE_POLICY_ALL:
+            if(NBpending == n_input)
+            {
+                update = 1;
+            }
+            else if((NBpending > 0) && (maxskewus > 0) &&
+                    (tnow - tfirst >= 1.0e-6 * maxskewus))
+            {
+                update = 1;
+            }
+            break;
+
+        default:
+            break;
+        }
 
-        // What about keywords?
-
-        // Finito!
-        processinfo_update_output_stream(processinfo, img_out.ID);
+        if(update == 1)
+        {
+            for(int kk = 0; kk < n_input; kk++)
+            {
+                if(inarray[kk].newframe == 1)
+                {
+                    inarray[kk].skewus =
+                        1.0e6 * (inarray[kk].tarrival - tfirst);
+                    if(inarray[kk].skewus > inarray[kk].skewmaxus)
+                    {
+                        inarray[kk].skewmaxus = inarray[kk].skewus;
+                    }
+                    inarray[kk].newframe = 0;
+                }
+                else if(policy == MERGE_POLICY_ALL)
+                {
+                    inarray[kk].NBmissed++;
+                }
+            }
+            NBpending = 0;
+
+            processinfo_update_output_stream(processinfo, merge_out.ID);
+            NBupdate++;
+
+            if((data.processinfo == 1) && (tnow > tmsg + 1.0))
+            {
+                long   NBdrop    = 0;
+                long   NBmissed  = 0;
+                double skewmaxus = 0.0;
+                for(int kk = 0; kk < n_input; kk++)
+                {
+                    NBdrop += inarray[kk].NBdrop;
+                    NBmissed += inarray[kk].NBmissed;
+                    if(inarray[kk].skewmaxus > skewmaxus)
+                    {
+                        skewmaxus = inarray[kk].skewmaxus;
+                    }
+                }
+
+                processinfo_WriteMessage_fmt(
+                    processinfo,
+                    "%ld upd  %ld drop  %ld miss  skew max %.0f us",
+                    NBupdate,
+                    NBdrop,
+                    NBmissed,
+                    skewmaxus);
+                tmsg = tnow;
+            }
+        }
     }
     INSERT_STD_PROCINFO_COMPUTEFUNC_END
 
+    stream_multiwait_destroy(mw);
+
+    printf("%ld output updates\n", NBupdate);
+    printf("input  %10s  %10s  %10s  %12s\n",
+           "frames",
+           "dropped",
+           "missed",
+           "skewmax[us]");
+    for(int kk = 0; kk < n_input; kk++)
+    {
+        printf("%5d  %10ld  %10ld  %10ld  %12.1f\n",
+               kk,
+               inarray[kk].NBframe,
+               inarray[kk].NBdrop,
+               inarray[kk].NBmissed,
+               inarray[kk].skewmaxus);
+    }
+
     // Mem cleanup
-    free(img_in_arr);
+    free(inarray);
+    free(IDarray);
 
     DEBUG_TRACE_FEXIT();
     return RETURN_SUCCESS;
@@ -3,15 +3,51 @@
  * @brief   stream semaphores
  */
 
-#include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/processtools_trigger.h"
+
 #include "image_ID.h"
 #include "list_image.h"
 #include "read_shmim.h"
+#include "stream_sem.h"
+
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
 
-static pthread_t *thrarray_semwait;
-static long       NB_thrarray_semwait;
+// futex_waitv() entry, see linux/futex.h
+struct multiwait_futexv
+{
+    uint64_t val;
+    uint64_t uaddr;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+// 32-bit, shared futex
+#define MULTIWAIT_FUTEX2_SIZE_U32 0x02
+// max number of entries in single futex_waitv() call
+#define MULTIWAIT_FUTEXV_MAX 128
+// max sleep when only the first stream can be waited on [ns]
+#define MULTIWAIT_FALLBACK_SLICE_NS 100000
+
+// glibc semaphore with 64-bit atomics : value in low half of first 64-bit
+// word, number of sleeping waiters in high half. sem_post() makes
+// FUTEX_WAKE on the value word when waiters are counted, so a counted
+// futex_waitv() entry on the value word is woken as sem_wait() would be.
+#if defined(__GLIBC__) && (__SIZEOF_POINTER__ == 8)
+#define MULTIWAIT_SEMFUTEX 1
+#else
+#define MULTIWAIT_SEMFUTEX 0
+#endif
 
 // ==========================================
 // Forward declaration(s)
@@ -33,8 +69,6 @@ imageID COREMOD_MEMORY_image_set_sempost_loop(const char *IDname,
 
 imageID COREMOD_MEMORY_image_set_semwait(const char *IDname, long index);
 
-void *waitforsemID(void *ID);
-
 errno_t COREMOD_MEMORY_image_set_semwait_OR_IDarray(imageID *IDarray,
         long     NB_ID);
 
@@ -325,71 +359,410 @@ imageID COREMOD_MEMORY_image_set_semwait(const char *IDname, long index)
     return ID;
 }
 
-// only works for sem0
-void *waitforsemID(void *ID)
+// 32-bit futex word holding low half of cnt0
+static uint32_t *multiwait_futexword(IMAGE *image)
 {
-    pthread_t tid;
-    int       t;
-    //    int semval;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return ((uint32_t *) &image->md[0].cnt0) + 1;
+#else
+    return (uint32_t *) &image->md[0].cnt0;
+#endif
+}
 
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    tid = pthread_self();
+#if MULTIWAIT_SEMFUTEX
+// 32-bit futex word holding semaphore value
+static uint32_t *multiwait_semword(sem_t *sem)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return ((uint32_t *) sem) + 1;
+#else
+    return (uint32_t *) sem;
+#endif
+}
 
-    //    sem_getvalue(data.image[(long) ID].semptr, &semval);
-    //    printf("tid %u waiting for sem ID %ld   sem = %d   (%s)\n", (unsigned int) tid, (long) ID, semval, data.image[(long) ID].name);
-    //    fflush(stdout);
-    sem_wait(data.image[(imageID) ID].semptr[0]);
-    //    printf("tid %u sem ID %ld done\n", (unsigned int) tid, (long) ID);
-    //    fflush(stdout);
+// count or uncount this thread as semaphore waiter
+static void multiwait_semwaiter(sem_t *sem, int waiting)
+{
+    if(waiting)
+    {
+        __atomic_fetch_add((uint64_t *) sem, 1ULL << 32, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_fetch_sub((uint64_t *) sem, 1ULL << 32, __ATOMIC_SEQ_CST);
+    }
+}
+#endif
 
-    for(t = 0; t < NB_thrarray_semwait; t++)
+// discard semaphore posts : updates are counted from cnt0, which writers
+// increment before posting
+static void multiwait_semdrain(STREAM_MULTIWAIT *mw, long i)
+{
+    if(mw->semindex[i] != -1)
     {
-        if(tid != thrarray_semwait[t])
+        while(sem_trywait(data.image[mw->IDarray[i]].semptr[mw->semindex[i]]) ==
+                0)
         {
-            //            printf("tid %u cancel thread %d tid %u\n", (unsigned int) tid, t, (unsigned int) (thrarray_semwait[t]));
-            //           fflush(stdout);
-            pthread_cancel(thrarray_semwait[t]);
         }
     }
+}
 
-    pthread_exit(NULL);
+static inline void multiwait_cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
 }
 
-/// \brief Wait for multiple images semaphores [OR], only works for sem0
-errno_t COREMOD_MEMORY_image_set_semwait_OR_IDarray(imageID *IDarray,
-        long     NB_ID)
+// check all counters, update fired array
+static long multiwait_poll(STREAM_MULTIWAIT *mw)
+{
+    long NBfired = 0;
+
+    for(long i = 0; i < mw->NBstream; i++)
+    {
+        uint64_t cnt0 =
+            *((volatile uint64_t *) &data.image[mw->IDarray[i]].md[0].cnt0);
+
+        mw->fired[i] = cnt0 - mw->cnt0[i];
+        if(mw->fired[i] != 0)
+        {
+            mw->cnt0[i] = cnt0;
+            NBfired++;
+        }
+    }
+
+    return NBfired;
+}
+
+// sleep until any futex word differs from last seen value, any reserved
+// semaphore is posted, or timeout
+static void
+multiwait_sleep(STREAM_MULTIWAIT *mw, struct timespec *tnow, long timeout_ns)
+{
+    struct multiwait_futexv *waitv = (struct multiwait_futexv *) mw->waitv;
+
+    if((mw->waitv_ok == 1) && (mw->NBstream <= MULTIWAIT_FUTEXV_MAX))
+    {
+        struct timespec tend;
+        long            NBwaitv = mw->NBstream;
+#if MULTIWAIT_SEMFUTEX
+        // semaphores waited on only if they all fit in single call
+        int semwait = (mw->NBstream + mw->NBsem <= MULTIWAIT_FUTEXV_MAX);
+#endif
+
+        for(long i = 0; i < mw->NBstream; i++)
+        {
+            waitv[i].val = (uint32_t) mw->cnt0[i];
+            waitv[i].uaddr =
+                (uint64_t)(uintptr_t) multiwait_futexword(
+                    &data.image[mw->IDarray[i]]);
+            waitv[i].flags = MULTIWAIT_FUTEX2_SIZE_U32;
+        }
+#if MULTIWAIT_SEMFUTEX
+        if(semwait)
+        {
+            for(long i = 0; i < mw->NBstream; i++)
+            {
+                if(mw->semindex[i] != -1)
+                {
+                    sem_t *sem =
+                        data.image[mw->IDarray[i]].semptr[mw->semindex[i]];
+
+                    // post after drain : value is not 0, wait returns
+                    multiwait_semdrain(mw, i);
+                    multiwait_semwaiter(sem, 1);
+                    waitv[NBwaitv].val = 0;
+                    waitv[NBwaitv].uaddr =
+                        (uint64_t)(uintptr_t) multiwait_semword(sem);
+                    waitv[NBwaitv].flags = MULTIWAIT_FUTEX2_SIZE_U32;
+                    NBwaitv++;
+                }
+            }
+        }
+#endif
+
+        // absolute timeout
+        tend.tv_sec  = tnow->tv_sec;
+        tend.tv_nsec = tnow->tv_nsec + timeout_ns;
+        while(tend.tv_nsec >= 1000000000L)
+        {
+            tend.tv_nsec -= 1000000000L;
+            tend.tv_sec++;
+        }
+
+        for(long i = 0; i < mw->NBstream; i++)
+        {
+            processinfo_triggerstream_waitbegin(&data.image[mw->IDarray[i]]);
+        }
+        // returns immediately if any value has changed
+        if((syscall(SYS_futex_waitv,
+                    waitv,
+                    (unsigned int) NBwaitv,
+                    0,
+                    &tend,
+                    CLOCK_MONOTONIC) == -1) &&
+                (errno == ENOSYS))
+        {
+            // kernel older than 5.16
+            mw->waitv_ok = 0;
+        }
+        for(long i = 0; i < mw->NBstream; i++)
+        {
+            processinfo_triggerstream_waitend(&data.image[mw->IDarray[i]]);
+        }
+#if MULTIWAIT_SEMFUTEX
+        if(semwait)
+        {
+            for(long i = 0; i < mw->NBstream; i++)
+            {
+                if(mw->semindex[i] != -1)
+                {
+                    multiwait_semwaiter(
+                        data.image[mw->IDarray[i]].semptr[mw->semindex[i]],
+                        0);
+                }
+            }
+        }
+#endif
+        return;
+    }
+
+    // fallback : wait on first stream, other streams polled every slice
+    struct timespec tslice;
+    tslice.tv_sec  = 0;
+    tslice.tv_nsec = timeout_ns;
+    if((mw->NBstream > 1) && (tslice.tv_nsec > MULTIWAIT_FALLBACK_SLICE_NS))
+    {
+        tslice.tv_nsec = MULTIWAIT_FALLBACK_SLICE_NS;
+    }
+
+    if(mw->semindex[0] != -1)
+    {
+        struct timespec ts;
+
+        multiwait_semdrain(mw, 0);
+        if(data.image[mw->IDarray[0]].md[0].cnt0 != mw->cnt0[0])
+        {
+            // update posted before drain
+            return;
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += tslice.tv_nsec;
+        while(ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_nsec -= 1000000000L;
+            ts.tv_sec++;
+        }
+        sem_timedwait(data.image[mw->IDarray[0]].semptr[mw->semindex[0]], &ts);
+        return;
+    }
+
+    processinfo_triggerstream_waitbegin(&data.image[mw->IDarray[0]]);
+    syscall(SYS_futex,
+            multiwait_futexword(&data.image[mw->IDarray[0]]),
+            FUTEX_WAIT,
+            (uint32_t) mw->cnt0[0],
+            &tslice,
+            NULL,
+            0);
+    processinfo_triggerstream_waitend(&data.image[mw->IDarray[0]]);
+}
+
+/**
+ * @brief Create multi-stream waiter
+ *
+ * Each stream's cnt0 is recorded at creation. Subsequent calls to
+ * stream_multiwait_wait() return when any cnt0 has moved past the last
+ * value seen. A semaphore is reserved on each stream, as for other
+ * semaphore readers, and released by stream_multiwait_destroy(). Posts to
+ * it wake the waiter; they are not counted, updates are read from cnt0.
+ *
+ * @param IDarray   stream IDs
+ * @param NBstream  number of streams
+ * @param spin_ns   busy-wait time before sleeping [ns], 0 for no spin
+ */
+STREAM_MULTIWAIT *
+stream_multiwait_create(imageID *IDarray, long NBstream, long spin_ns)
 {
-    int t;
-    //    int semval;
+    STREAM_MULTIWAIT *mw;
+
+    mw = (STREAM_MULTIWAIT *) calloc(1, sizeof(STREAM_MULTIWAIT));
+    if(mw == NULL)
+    {
+        PRINT_ERROR("calloc() error");
+        return NULL;
+    }
+
+    mw->NBstream = NBstream;
+    mw->spin_ns  = spin_ns;
+    mw->waitv_ok = 1;
+    mw->IDarray  = (imageID *) malloc(sizeof(imageID) * NBstream);
+    mw->cnt0     = (uint64_t *) malloc(sizeof(uint64_t) * NBstream);
+    mw->fired    = (uint64_t *) calloc(NBstream, sizeof(uint64_t));
+    mw->semindex = (int *) malloc(sizeof(int) * NBstream);
+    // cnt0 and semaphore of each stream
+    mw->waitv = calloc(2 * NBstream, sizeof(struct multiwait_futexv));
+    if((mw->IDarray == NULL) || (mw->cnt0 == NULL) || (mw->fired == NULL) ||
+            (mw->semindex == NULL) || (mw->waitv == NULL))
+    {
+        PRINT_ERROR("malloc() error");
+        free(mw->semindex);
+        mw->semindex = NULL;
+        stream_multiwait_destroy(mw);
+        return NULL;
+    }
+
+    for(long i = 0; i < NBstream; i++)
+    {
+        mw->IDarray[i] = IDarray[i];
+        mw->cnt0[i]    = data.image[IDarray[i]].md[0].cnt0;
+
+        mw->semindex[i] = -1;
+        if(data.image[IDarray[i]].md[0].sem > 0)
+        {
+            mw->semindex[i] =
+                ImageStreamIO_getsemwaitindex(&data.image[IDarray[i]], 0);
+        }
+        if(mw->semindex[i] != -1)
+        {
+            data.image[IDarray[i]].semReadPID[mw->semindex[i]] = getpid();
+            mw->NBsem++;
+        }
+    }
+
+    return mw;
+}
+
+/**
+ * @brief Wait until at least one stream is updated
+ *
+ * Checks cnt0 of all streams, spins for up to spin_ns, then sleeps on
+ * the streams' cnt0 futex words and reserved semaphores with a single
+ * futex_waitv call. Writers posting semaphores (ImageStreamIO_UpdateIm) or
+ * calling processinfo_triggerstream_wake() wake the waiter immediately.
+ * Updates of streams without reserved semaphore by other writers are seen
+ * within PROCESSINFO_TRIGGER_FUTEXSLICE_NS.
+ *
+ * On return, mw->fired[i] holds the number of updates of stream i since
+ * the previous call (0 if not updated).
+ *
+ * @param timeout_us  timeout [us], negative for no timeout
+ *
+ * @return number of updated streams, 0 on timeout
+ */
+long stream_multiwait_wait(STREAM_MULTIWAIT *mw, long timeout_us)
+{
+    struct timespec t0, tnow;
+    long            NBfired;
+
+    NBfired = multiwait_poll(mw);
+
+    if((NBfired == 0) && (mw->spin_ns > 0))
+    {
+        long spincnt = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        while(NBfired == 0)
+        {
+            multiwait_cpu_relax();
+            spincnt++;
+            // check elapsed time every 64 iterations
+            if((spincnt & 63) == 0)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &tnow);
+                if((tnow.tv_sec - t0.tv_sec) * 1000000000L +
+                        (tnow.tv_nsec - t0.tv_nsec) >
+                        mw->spin_ns)
+                {
+                    break;
+                }
+            }
+            NBfired = multiwait_poll(mw);
+        }
+    }
+
+    // all streams woken by semaphore posts : slice only bounds latency of
+    // writers not posting
+    long slice_ns = PROCESSINFO_TRIGGER_FUTEXSLICE_NS;
+    if((mw->NBsem == mw->NBstream) &&
+            ((MULTIWAIT_SEMFUTEX && (2 * mw->NBstream <= MULTIWAIT_FUTEXV_MAX)) ||
+             (mw->NBstream == 1)))
+    {
+        slice_ns = PROCESSINFO_TRIGGER_SEMSLICE_NS;
+    }
 
-    //   printf("======== ENTER COREMOD_MEMORY_image_set_semwait_OR_IDarray [%ld] =======\n", NB_ID);
-    //   fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while(NBfired == 0)
+    {
+        long timeout_ns = slice_ns;
 
-    thrarray_semwait    = (pthread_t *) malloc(sizeof(pthread_t) * NB_ID);
-    NB_thrarray_semwait = NB_ID;
+        clock_gettime(CLOCK_MONOTONIC, &tnow);
+        if(timeout_us >= 0)
+        {
+            long remain_ns = timeout_us * 1000L -
+                             ((tnow.tv_sec - t0.tv_sec) * 1000000000L +
+                              (tnow.tv_nsec - t0.tv_nsec));
+            if(remain_ns <= 0)
+            {
+                break;
+            }
+            if(remain_ns < timeout_ns)
+            {
+                timeout_ns = remain_ns;
+            }
+        }
 
-    for(t = 0; t < NB_ID; t++)
+        multiwait_sleep(mw, &tnow, timeout_ns);
+        NBfired = multiwait_poll(mw);
+    }
+
+    return NBfired;
+}
+
+errno_t stream_multiwait_destroy(STREAM_MULTIWAIT *mw)
+{
+    if(mw != NULL)
     {
-        //      printf("thread %d create, ID = %ld\n", t, IDarray[t]);
-        //      fflush(stdout);
-        pthread_create(&thrarray_semwait[t],
-                       NULL,
-                       waitforsemID,
-                       (void *) IDarray[t]);
+        if(mw->semindex != NULL)
+        {
+            for(long i = 0; i < mw->NBstream; i++)
+            {
+                if(mw->semindex[i] != -1)
+                {
+                    data.image[mw->IDarray[i]].semReadPID[mw->semindex[i]] = 0;
+                }
+            }
+            free(mw->semindex);
+        }
+        free(mw->IDarray);
+        free(mw->cnt0);
+        free(mw->fired);
+        free(mw->waitv);
+        free(mw);
     }
 
-    for(t = 0; t < NB_ID; t++)
+    return RETURN_SUCCESS;
+}
+
+/// \brief Wait for multiple images [OR]
+///
+/// Returns on next update of any image, as reported by cnt0.
+errno_t COREMOD_MEMORY_image_set_semwait_OR_IDarray(imageID *IDarray,
+        long     NB_ID)
+{
+    DEBUG_TRACE_FSTART();
+
+    STREAM_MULTIWAIT *mw = stream_multiwait_create(IDarray, NB_ID, 0);
+    if(mw == NULL)
     {
-        //         printf("thread %d tid %u join waiting\n", t, (unsigned int) thrarray_semwait[t]);
-        //fflush(stdout);
-        pthread_join(thrarray_semwait[t], NULL);
-        //    printf("thread %d tid %u joined\n", t, (unsigned int) thrarray_semwait[t]);
+        FUNC_RETURN_FAILURE("cannot create stream waiter");
     }
 
-    free(thrarray_semwait);
-    // printf("======== EXIT COREMOD_MEMORY_image_set_semwait_OR_IDarray =======\n");
-    //fflush(stdout);
+    stream_multiwait_wait(mw, -1);
+    stream_multiwait_destroy(mw);
 
+    DEBUG_TRACE_FEXIT();
     return RETURN_SUCCESS;
 }
 
@@ -2,6 +2,38 @@
  * @file    stream_sem.h
  */
 
+#ifndef COREMOD_MEMORY_STREAM_SEM_H
+#define COREMOD_MEMORY_STREAM_SEM_H
+
+/**
+ * @brief Waiter on multiple streams
+ *
+ * Created once by stream_multiwait_create(), then waited on repeatedly by
+ * stream_multiwait_wait(). Updates are detected from cnt0.
+ */
+typedef struct
+{
+    long     NBstream;
+    imageID *IDarray;
+
+    // semaphore reserved on each stream, -1 if none available
+    int *semindex;
+    long NBsem;
+
+    // cnt0 values seen at last wait
+    uint64_t *cnt0;
+
+    // updates since last wait, per stream
+    uint64_t *fired;
+
+    // busy-wait time before sleep [ns]
+    long spin_ns;
+
+    // futex_waitv() entries, and whether kernel supports it
+    void *waitv;
+    int   waitv_ok;
+} STREAM_MULTIWAIT;
+
 errno_t stream_sem_addCLIcmd();
 
 imageID COREMOD_MEMORY_image_set_createsem(const char *IDname, long NBsem);
@@ -20,7 +52,12 @@ imageID COREMOD_MEMORY_image_set_sempost_loop(const char *IDname,
 
 imageID COREMOD_MEMORY_image_set_semwait(const char *IDname, long index);
 
-void *waitforsemID(void *ID);
+STREAM_MULTIWAIT *
+stream_multiwait_create(imageID *IDarray, long NBstream, long spin_ns);
+
+long stream_multiwait_wait(STREAM_MULTIWAIT *mw, long timeout_us);
+
+errno_t stream_multiwait_destroy(STREAM_MULTIWAIT *mw);
 
 errno_t COREMOD_MEMORY_image_set_semwait_OR_IDarray(imageID *IDarray,
         long     NB_ID);
@@ -28,3 +65,5 @@ errno_t COREMOD_MEMORY_image_set_semwait_OR_IDarray(imageID *IDarray,
 errno_t COREMOD_MEMORY_image_set_semflush_IDarray(imageID *IDarray, long NB_ID);
 
 imageID COREMOD_MEMORY_image_set_semflush(const char *IDname, long index);
+
+#endif
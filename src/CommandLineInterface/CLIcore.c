@@ -80,6 +80,7 @@
 #include "CommandLineInterface/CLIcore/CLIcore_modules.h"
 #include "CommandLineInterface/CLIcore/CLIcore_setSHMdir.h"
 #include "CommandLineInterface/CLIcore/CLIcore_signals.h"
+#include "CommandLineInterface/CLIcore/CLIcore_tracepoint.h"
 
 /*-----------------------------------------
 *       Globals exported to all modules
@@ -1006,6 +1007,15 @@ void runCLI_cmd_init()
                        "usleep 1000",
                        "usleep(long tus)");
 
+    // trace points
+    RegisterCLIcommand("tracepointdump",
+                       __FILE__,
+                       tracepoint_dump__cli,
+                       "write per-thread trace points to file",
+                       "[NBevent]",
+                       "tracepointdump 100",
+                       "errno_t tracepoint_dump(FILE *fp, long NBevent)");
+
     //  init_modules();
     // printf("TEST   %s  %ld   data.image[4934].used = %d\n", __FILE__, __LINE__, data.image[4934].used);
 
@@ -701,6 +701,9 @@ errno_t help_command(
                         case PROCESSINFO_TRIGGERMODE_DELAY:
                             printf("DELAY");
                             break;
+                        case PROCESSINFO_TRIGGERMODE_FUTEX:
+                            printf("FUTEX");
+                            break;
                         default:
                             printf("unknown");
                             break;
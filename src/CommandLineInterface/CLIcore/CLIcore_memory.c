@@ -68,6 +68,9 @@ errno_t memory_re_alloc()
             data.image[i].semptr    = NULL;
             data.image[i].semlog    = NULL;
         }
+
+        // name index is sized to NB_MAX_IMAGE
+        image_ID_index_rebuild();
     }
 #endif
 
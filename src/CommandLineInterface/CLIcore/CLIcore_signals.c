@@ -232,6 +232,24 @@ errno_t write_process_exit_report(const char *__restrict errortypestring)
     }
 #endif
 
+    // per-thread trace points, also available in release build
+    {
+        FILE *fptp;
+        char  fnametp[STRINGMAXLEN_FILENAME];
+
+        WRITE_FILENAME(fnametp,
+                       "exitreport-%s.%05d.tracepoint.log",
+                       errortypestring,
+                       getpid());
+        fptp = fopen(fnametp, "w");
+        if(fptp != NULL)
+        {
+            tracepoint_dump(fptp, TRACEPOINT_RING_NBEVENT);
+            fclose(fptp);
+            printf("Trace points written to file %s\n", fnametp);
+        }
+    }
+
     return RETURN_SUCCESS;
 }
 
@@ -0,0 +1,177 @@
+/**
+ * @file CLIcore_tracepoint.c
+ *
+ * @brief low-overhead trace points
+ *
+ */
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "CLIcore_tracepoint.h"
+
+// this thread's circular buffer
+__thread TRACEPOINT_RING *tracepoint_ring = NULL;
+
+// all circular buffers, rings are never freed
+static TRACEPOINT_RING *tracepoint_ringlist = NULL;
+
+static pthread_key_t  tracepoint_key;
+static pthread_once_t tracepoint_key_once = PTHREAD_ONCE_INIT;
+
+// called on thread exit
+static void tracepoint_ring_release(void *ptr)
+{
+    TRACEPOINT_RING *ring = (TRACEPOINT_RING *) ptr;
+
+    __atomic_store_n(&ring->inuse, 0, __ATOMIC_RELEASE);
+}
+
+static void tracepoint_key_create()
+{
+    pthread_key_create(&tracepoint_key, tracepoint_ring_release);
+}
+
+/**
+ * @brief Attach circular buffer to calling thread
+ *
+ * Reuses buffer of an exited thread if available, so that processes
+ * creating short-lived threads do not accumulate buffers.
+ */
+TRACEPOINT_RING *tracepoint_ring_init()
+{
+    TRACEPOINT_RING *ring;
+
+    pthread_once(&tracepoint_key_once, tracepoint_key_create);
+
+    for(ring = __atomic_load_n(&tracepoint_ringlist, __ATOMIC_ACQUIRE);
+            ring != NULL;
+            ring = ring->next)
+    {
+        int inuse = 0;
+        if(__atomic_compare_exchange_n(&ring->inuse,
+                                       &inuse,
+                                       1,
+                                       0,
+                                       __ATOMIC_ACQ_REL,
+                                       __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+
+    if(ring == NULL)
+    {
+        ring = (TRACEPOINT_RING *) calloc(1, sizeof(TRACEPOINT_RING));
+        if(ring == NULL)
+        {
+            PRINT_ERROR("calloc error");
+            abort();
+        }
+        ring->inuse = 1;
+        ring->next  = __atomic_load_n(&tracepoint_ringlist, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&tracepoint_ringlist,
+                                           &ring->next,
+                                           ring,
+                                           0,
+                                           __ATOMIC_RELEASE,
+                                           __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+    ring->tid = syscall(SYS_gettid);
+    __atomic_store_n(&ring->cnt, 0, __ATOMIC_RELEASE);
+
+    tracepoint_ring = ring;
+    pthread_setspecific(tracepoint_key, ring);
+
+    return ring;
+}
+
+/**
+ * @brief Write last NBevent trace points of each thread
+ *
+ * Buffers are read while threads keep running: entries being overwritten
+ * during the dump may be inconsistent.
+ */
+errno_t tracepoint_dump(FILE *fp, long NBevent)
+{
+    for(TRACEPOINT_RING *ring =
+                __atomic_load_n(&tracepoint_ringlist, __ATOMIC_ACQUIRE);
+            ring != NULL;
+            ring = ring->next)
+    {
+        uint64_t cnt = __atomic_load_n(&ring->cnt, __ATOMIC_ACQUIRE);
+
+        uint64_t nbev = TRACEPOINT_RING_NBEVENT;
+        if((NBevent > 0) && ((uint64_t) NBevent < nbev))
+        {
+            nbev = NBevent;
+        }
+        if(cnt < nbev)
+        {
+            nbev = cnt;
+        }
+
+        fprintf(fp,
+                "THREAD %d %s: %lu trace points\n",
+                (int) ring->tid,
+                ring->inuse ? "" : "(exited) ",
+                cnt);
+
+        for(uint64_t k = cnt - nbev; k < cnt; k++)
+        {
+            const TRACEPOINT_SITE *site =
+                ring->event[k & (TRACEPOINT_RING_NBEVENT - 1)];
+            if(site == NULL)
+            {
+                continue;
+            }
+
+            // extract last word
+            const char *lastword = strrchr(site->file, '/');
+            lastword             = (lastword == NULL) ? site->file : lastword + 1;
+
+            fprintf(fp,
+                    "T %8lu %-20s %6d %-20s  %s\n",
+                    k,
+                    lastword,
+                    site->line,
+                    site->func,
+                    site->msg);
+        }
+        fprintf(fp, "\n");
+    }
+
+    return RETURN_SUCCESS;
+}
+
+errno_t tracepoint_dump__cli()
+{
+    long NBevent = TRACEPOINT_RING_NBEVENT;
+
+    if(CLI_checkarg_noerrmsg(1, CLIARG_INT64) == 0)
+    {
+        NBevent = data.cmdargtoken[1].val.numl;
+    }
+
+    char fname[STRINGMAXLEN_FILENAME];
+    WRITE_FILENAME(fname, "milk-tracepoint.%05d.log", getpid());
+
+    FILE *fp = fopen(fname, "w");
+    if(fp == NULL)
+    {
+        PRINT_ERROR("cannot create file %s", fname);
+        return RETURN_FAILURE;
+    }
+    tracepoint_dump(fp, NBevent);
+    fclose(fp);
+
+    printf("Trace points written to file %s\n", fname);
+
+    return RETURN_SUCCESS;
+}
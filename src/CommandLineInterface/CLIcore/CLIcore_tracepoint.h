@@ -0,0 +1,86 @@
+/**
+ * @file CLIcore_tracepoint.h
+ *
+ * @brief low-overhead trace points
+ *
+ * Each trace point site is a static descriptor (file, function, line,
+ * message text), set at compile time. Executing a trace point stores the
+ * descriptor address into a per-thread circular buffer: no formatting,
+ * no locking, no system call.
+ *
+ * Buffers of all threads can be written to file on demand (tracepointdump)
+ * and are written in the process exit report upon crash.
+ */
+
+#ifndef CLICORE_TRACEPOINT_H
+#define CLICORE_TRACEPOINT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// number of entries per thread, must be power of 2
+#define TRACEPOINT_RING_NBEVENT 1024
+
+typedef struct
+{
+    const char *file;
+    const char *func;
+    int         line;
+    const char *msg; // message source text, arguments are not expanded
+} TRACEPOINT_SITE;
+
+typedef struct TRACEPOINT_RING
+{
+    pid_t    tid;
+    int      inuse; // 0 when thread has exited, ring can be reused
+    uint64_t cnt;   // number of trace points recorded
+
+    const TRACEPOINT_SITE *event[TRACEPOINT_RING_NBEVENT];
+
+    struct TRACEPOINT_RING *next; // list of all rings
+} TRACEPOINT_RING;
+
+extern __thread TRACEPOINT_RING *tracepoint_ring;
+
+TRACEPOINT_RING *tracepoint_ring_init();
+
+static inline void tracepoint_record(const TRACEPOINT_SITE *site)
+{
+    TRACEPOINT_RING *ring = tracepoint_ring;
+
+    if(__builtin_expect(ring == NULL, 0))
+    {
+        ring = tracepoint_ring_init();
+    }
+    uint64_t cnt = ring->cnt;
+    ring->event[cnt & (TRACEPOINT_RING_NBEVENT - 1)] = site;
+    // single writer per ring : release store is enough for readers
+    __atomic_store_n(&ring->cnt, cnt + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief register trace point in per-thread circular buffer
+ *
+ * Arguments are not evaluated, message is stored as source text.
+ * Compiled out if NOTRACEPOINT is defined.
+ */
+#if defined NOTRACEPOINT
+#define TRACEPOINT_FAST(...)
+#else
+#define TRACEPOINT_FAST(...)                                                   \
+    do                                                                         \
+    {                                                                          \
+        static const TRACEPOINT_SITE tracepoint_site = {__FILE__,              \
+                                                        __func__,              \
+                                                        __LINE__,              \
+                                                        #__VA_ARGS__};         \
+        tracepoint_record(&tracepoint_site);                                   \
+    } while (0)
+#endif
+
+errno_t tracepoint_dump(FILE *fp, long NBevent);
+
+errno_t tracepoint_dump__cli();
+
+#endif
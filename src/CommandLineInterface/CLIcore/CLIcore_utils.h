@@ -217,6 +217,7 @@ typedef struct
                 CLIcmddata.cmdsettings->triggertimeout.tv_sec;                 \
             fps.cmdset.triggertimeout.tv_nsec =                                \
                 CLIcmddata.cmdsettings->triggertimeout.tv_nsec;                \
+            fps.cmdset.triggerspinns = CLIcmddata.cmdsettings->triggerspinns;  \
             fps_add_processinfo_entries(&fps);                                 \
         }                                                                      \
         data.fpsptr = &fps;                                                    \
@@ -263,6 +264,8 @@ typedef struct
             data.fpsptr->cmdset.triggertimeout.tv_sec;                         \
         CLIcmddata.cmdsettings->triggertimeout.tv_nsec =                       \
             data.fpsptr->cmdset.triggertimeout.tv_nsec;                        \
+        CLIcmddata.cmdsettings->triggerspinns =                                \
+            data.fpsptr->cmdset.triggerspinns;                                 \
     }                                                                          \
     if (CLIcmddata.cmdsettings->flags & CLICMDFLAG_PROCINFO)                   \
     {                                                                          \
@@ -306,6 +309,7 @@ typedef struct
                CLIcmddata.cmdsettings->triggerstreamname, STRINGMAXLEN_IMAGE_NAME-1);  \
         processinfo->triggerdelay   = CLIcmddata.cmdsettings->triggerdelay;    \
         processinfo->triggertimeout = CLIcmddata.cmdsettings->triggertimeout;  \
+        processinfo->triggerspin_ns = CLIcmddata.cmdsettings->triggerspinns;   \
         processinfo->triggerstreamID =                                         \
             image_ID(processinfo->triggerstreamname);                          \
         DEBUG_TRACEPOINT("triggerstreamID = %ld",                              \
@@ -330,11 +334,11 @@ typedef struct
     {                                                                          \
         if (CLIcmddata.cmdsettings->flags & CLICMDFLAG_PROCINFO)               \
         {                                                                      \
-            DEBUG_TRACEPOINT("loopstep");                                      \
+            TRACEPOINT_FAST("loopstep");                                       \
             processloopOK = processinfo_loopstep(processinfo);                 \
-            DEBUG_TRACEPOINT("waitoninputstream");                             \
+            TRACEPOINT_FAST("waitoninputstream");                              \
             processinfo_waitoninputstream(processinfo);                        \
-            DEBUG_TRACEPOINT("exec_start");                                    \
+            TRACEPOINT_FAST("exec_start");                                     \
             processinfo_exec_start(processinfo);                               \
         }                                                                      \
         else                                                                   \
@@ -21,6 +21,7 @@ typedef struct
     char            triggerstreamname[STRINGMAXLEN_IMAGE_NAME];
     struct timespec triggerdelay;
     struct timespec triggertimeout;
+    long            triggerspinns;
     int             semindexrequested;
 
     int       RT_priority; // -1 if unused. 0-99 for higher priority
@@ -327,6 +327,19 @@ long function_parameter_struct_connect(
                 }
             }
         }
+
+        {
+            // triggerspinns
+            int pindex =
+                functionparameter_GetParamIndex(fps, ".procinfo.triggerspinns");
+            if(pindex > -1)
+            {
+                if(fps->parray[pindex].type == FPTYPE_INT64)
+                {
+                    fps->cmdset.triggerspinns = fps->parray[pindex].val.i64[0];
+                }
+            }
+        }
     }
 
     return (NBparamMAX);
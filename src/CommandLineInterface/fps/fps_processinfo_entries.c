@@ -197,6 +197,20 @@ errno_t fps_add_processinfo_entries(FUNCTION_PARAMETER_STRUCT *fps)
                                  &triggertimeout_default,
                                  NULL);
 
+    // futex trigger mode: spin time before sleeping
+    long triggerspinns_default[4] = {fps->cmdset.triggerspinns,
+                                     0,
+                                     1000000,
+                                     0
+                                    };
+    function_parameter_add_entry(fps,
+                                 ".procinfo.triggerspinns",
+                                 "trigger spin budget [ns]",
+                                 FPTYPE_INT64,
+                                 FPFLAG,
+                                 &triggerspinns_default,
+                                 NULL);
+
     DEBUG_TRACE_FEXIT();
     return RETURN_SUCCESS;
 }
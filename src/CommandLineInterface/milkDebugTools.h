@@ -17,6 +17,7 @@ typedef int errno_t;
 #endif
 
 #include "CommandLineInterface/CLIcore/CLIcore_signals.h"
+#include "CommandLineInterface/CLIcore/CLIcore_tracepoint.h"
 
 // error mode
 // defines function behavior on error
@@ -408,19 +409,23 @@ typedef int errno_t;
     } while (0)
 #endif
 
+// Release build : trace point site recorded in per-thread circular buffer
+// Debug build   : also formats message into data.testpoint
 #if defined NDEBUG
-#define DEBUG_TRACEPOINT(...)
+#define DEBUG_TRACEPOINT(...) TRACEPOINT_FAST(__VA_ARGS__)
 #else
 #if defined DEBUGLOG
 #define DEBUG_TRACEPOINT(...)                                                  \
     do                                                                         \
     {                                                                          \
+        TRACEPOINT_FAST(__VA_ARGS__);                                          \
         DEBUG_TRACEPOINT_LOG(__VA_ARGS__);                                     \
     } while (0)
 #else
 #define DEBUG_TRACEPOINT(...)                                                  \
     do                                                                         \
     {                                                                          \
+        TRACEPOINT_FAST(__VA_ARGS__);                                          \
         DEBUG_TRACEPOINTRAW(__VA_ARGS__);                                      \
     } while (0)
 #endif
@@ -1,3 +1,20 @@
+/**
+ * @file procCTRL_GetCPUloads.c
+ *
+ * @brief per-CPU load and number of processes
+ *
+ * Reads /proc/stat for CPU loads, and scans /proc/<pid>/task/<tid>/stat
+ * for the CPU each thread last ran on. All files are read into a single
+ * reusable buffer : no external command, no pipe.
+ *
+ * Result is written to <procdname>/cpustat.txt for use by other programs.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "CLIcore.h"
 #include <processtools.h>
 
@@ -14,163 +31,330 @@ static struct timespec tdiff;
 static double scantime_CPUload;
 static double scantime_CPUpcnt;
 
+// reusable read buffer for /proc files
+static char  *procbuff     = NULL;
+static size_t procbuffsize = 0;
 
-int GetCPUloads(PROCINFOPROC *pinfop)
-{
-    char     *line      = NULL;
-    size_t    maxstrlen = 256;
-    FILE     *fp;
-    ssize_t   read;
-    int       cpu;
-    long long vall0, vall1, vall2, vall3, vall4, vall5, vall6, vall7, vall8;
-    long long v0, v1, v2, v3, v4, v5, v6, v7, v8;
-    char      string0[80];
 
-    static int cnt = 0;
 
-    clock_gettime(CLOCK_REALTIME, &t1);
+/**
+ * @brief Read /proc file into procbuff
+ *
+ * procfs files report size 0, so file is read until EOF.
+ * Buffer is null-terminated.
+ *
+ * @return number of bytes read, -1 if file cannot be read
+ */
+static ssize_t read_procfile(const char *fname)
+{
+    if(procbuff == NULL)
+    {
+        procbuffsize = 16384;
+        procbuff     = (char *) malloc(procbuffsize);
+        if(procbuff == NULL)
+        {
+            PRINT_ERROR("malloc returns NULL pointer");
+            abort();
+        }
+    }
 
-    line = (char *) malloc(sizeof(char) * maxstrlen);
-    if(line == NULL)
+    int fd = open(fname, O_RDONLY);
+    if(fd == -1)
     {
-        PRINT_ERROR("malloc returns NULL pointer");
-        abort();
+        return -1;
     }
 
-    fp = fopen("/proc/stat", "r");
-    if(fp == NULL)
+    size_t nbread = 0;
+    while(1)
     {
-        exit(EXIT_FAILURE);
+        ssize_t rval = read(fd, procbuff + nbread, procbuffsize - 1 - nbread);
+        if(rval < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        if(rval == 0)
+        {
+            break;
+        }
+        nbread += rval;
+        if(nbread == procbuffsize - 1)
+        {
+            procbuffsize *= 2;
+            procbuff = (char *) realloc(procbuff, procbuffsize);
+            if(procbuff == NULL)
+            {
+                PRINT_ERROR("realloc returns NULL pointer");
+                abort();
+            }
+        }
     }
+    close(fd);
+    procbuff[nbread] = '\0';
+
+    return nbread;
+}
 
-    cpu = 0;
 
-    read = getline(&line, &maxstrlen, fp);
-    if(read == -1)
+
+/**
+ * @brief CPU loads from /proc/stat
+ *
+ * Lines are indexed by CPU number, so that offline CPUs do not shift
+ * the following entries.
+ *
+ * @return number of CPUs read
+ */
+static int GetCPUloads_procstat(PROCINFOPROC *pinfop)
+{
+    int NBcpu = 0;
+
+    if(read_procfile("/proc/stat") < 0)
     {
-        printf("[%s][%d]  ERROR: cannot read file\n", __FILE__, __LINE__);
-        exit(EXIT_SUCCESS);
+        PRINT_ERROR("cannot read /proc/stat");
+        return 0;
     }
 
-    while(((read = getline(&line, &maxstrlen, fp)) != -1) &&
-            (cpu < pinfop->NBcpus))
+    char *line = procbuff;
+    while((line != NULL) && (*line != '\0'))
     {
+        char *nextline = strchr(line, '\n');
+        if(nextline != NULL)
+        {
+            *nextline = '\0';
+            nextline++;
+        }
+
+        // skip aggregate "cpu " line
+        if((strncmp(line, "cpu", 3) == 0) && isdigit(line[3]))
+        {
+            char     *ptr;
+            long long vall[9];
 
-        sscanf(line,
-               "%s %lld %lld %lld %lld %lld %lld %lld %lld %lld",
-               string0,
-               &vall0,
-               &vall1,
-               &vall2,
-               &vall3,
-               &vall4,
-               &vall5,
-               &vall6,
-               &vall7,
-               &vall8);
-
-        v0 = vall0 - pinfop->CPUcnt0[cpu];
-        v1 = vall1 - pinfop->CPUcnt1[cpu];
-        v2 = vall2 - pinfop->CPUcnt2[cpu];
-        v3 = vall3 - pinfop->CPUcnt3[cpu];
-        v4 = vall4 - pinfop->CPUcnt4[cpu];
-        v5 = vall5 - pinfop->CPUcnt5[cpu];
-        v6 = vall6 - pinfop->CPUcnt6[cpu];
-        v7 = vall7 - pinfop->CPUcnt7[cpu];
-        v8 = vall8 - pinfop->CPUcnt8[cpu];
-
-        pinfop->CPUcnt0[cpu] = vall0;
-        pinfop->CPUcnt1[cpu] = vall1;
-        pinfop->CPUcnt2[cpu] = vall2;
-        pinfop->CPUcnt3[cpu] = vall3;
-        pinfop->CPUcnt4[cpu] = vall4;
-        pinfop->CPUcnt5[cpu] = vall5;
-        pinfop->CPUcnt6[cpu] = vall6;
-        pinfop->CPUcnt7[cpu] = vall7;
-        pinfop->CPUcnt8[cpu] = vall8;
-
-        pinfop->CPUload[cpu] = (1.0 * v0 + v1 + v2 + v4 + v5 + v6) /
-                               (v0 + v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8);
-        cpu++;
+            int cpu = strtol(line + 3, &ptr, 10);
+            for(int k = 0; k < 9; k++)
+            {
+                vall[k] = strtoll(ptr, &ptr, 10);
+            }
+
+            if(cpu < MAXNBCPU)
+            {
+                long long v0 = vall[0] - pinfop->CPUcnt0[cpu];
+                long long v1 = vall[1] - pinfop->CPUcnt1[cpu];
+                long long v2 = vall[2] - pinfop->CPUcnt2[cpu];
+                long long v3 = vall[3] - pinfop->CPUcnt3[cpu];
+                long long v4 = vall[4] - pinfop->CPUcnt4[cpu];
+                long long v5 = vall[5] - pinfop->CPUcnt5[cpu];
+                long long v6 = vall[6] - pinfop->CPUcnt6[cpu];
+                long long v7 = vall[7] - pinfop->CPUcnt7[cpu];
+                long long v8 = vall[8] - pinfop->CPUcnt8[cpu];
+
+                pinfop->CPUcnt0[cpu] = vall[0];
+                pinfop->CPUcnt1[cpu] = vall[1];
+                pinfop->CPUcnt2[cpu] = vall[2];
+                pinfop->CPUcnt3[cpu] = vall[3];
+                pinfop->CPUcnt4[cpu] = vall[4];
+                pinfop->CPUcnt5[cpu] = vall[5];
+                pinfop->CPUcnt6[cpu] = vall[6];
+                pinfop->CPUcnt7[cpu] = vall[7];
+                pinfop->CPUcnt8[cpu] = vall[8];
+
+                long long vtot = v0 + v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8;
+                if(vtot > 0)
+                {
+                    pinfop->CPUload[cpu] =
+                        (1.0 * v0 + v1 + v2 + v4 + v5 + v6) / vtot;
+                }
+                NBcpu++;
+            }
+        }
+        line = nextline;
     }
-    free(line);
-    fclose(fp);
-    clock_gettime(CLOCK_REALTIME, &t2);
-    tdiff = timespec_diff(t1, t2);
-    scantime_CPUload += 1.0 * tdiff.tv_sec + 1.0e-9 * tdiff.tv_nsec;
 
-    clock_gettime(CLOCK_REALTIME, &t1);
+    return NBcpu;
+}
+
 
-    // number of process per CPU -> we can get that from ps
-    char command[STRINGMAXLEN_COMMAND];
-    char psoutfname[STRINGMAXLEN_FULLFILENAME];
-    char procdname[STRINGMAXLEN_DIRNAME];
-    processinfo_procdirname(procdname);
 
-    WRITE_FULLFILENAME(psoutfname, "%s/_psoutput.txt", procdname);
+/**
+ * @brief CPU on which task last ran, from /proc/<pid>/task/<tid>/stat
+ *
+ * Process name (field 2) may contain spaces and parentheses, so fields
+ * are counted from the last ')'. Processor is field 39.
+ *
+ * @return CPU number, -1 if not found
+ */
+static int procstat_processor(const char *statstr)
+{
+    const char *ptr = strrchr(statstr, ')');
+    if(ptr == NULL)
+    {
+        return -1;
+    }
 
-    // use ps command to scan processes, store result in file psoutfname
+    // ptr at end of field 2, skip fields 3 to 38
+    int field = 2;
+    while((*ptr != '\0') && (field < 39))
+    {
+        ptr++;
+        if(*ptr == ' ')
+        {
+            field++;
+        }
+    }
+    if(*ptr == '\0')
+    {
+        return -1;
+    }
 
-    EXECUTE_SYSTEM_COMMAND(
-        "{ if [ ! -f %s/_psOKlock ]; then touch %s/_psOKlock; ps -e -o "
-        "pid,psr,cpu,cmd > %s; fi; rm "
-        "%s/_psOKlock &> /dev/null; }",
-        procdname,
-        procdname,
-        psoutfname,
-        procdname);
+    return atoi(ptr + 1);
+}
 
 
-    // read and process psoutfname file
 
-    if(access(psoutfname, F_OK) != -1)
+/**
+ * @brief Number of threads per CPU
+ *
+ * Counts all threads (tasks) of all processes by CPU they last ran on.
+ */
+static int GetCPUpcnt_procscan(PROCINFOPROC *pinfop)
+{
+    int  pcnt[MAXNBCPU];
+    char dname[STRINGMAXLEN_FULLFILENAME];
+    char fname[STRINGMAXLEN_FULLFILENAME];
+
+    memset(pcnt, 0, sizeof(int) * MAXNBCPU);
+
+    DIR *dproc = opendir("/proc");
+    if(dproc == NULL)
     {
+        PRINT_ERROR("cannot open /proc");
+        return RETURN_FAILURE;
+    }
 
-        for(cpu = 0; cpu < pinfop->NBcpus; cpu++)
+    struct dirent *dpid;
+    while((dpid = readdir(dproc)) != NULL)
+    {
+        if(!isdigit(dpid->d_name[0]))
         {
-            char  outstring[STRINGMAXLEN_DEFAULT];
-            FILE *fpout;
-            {
-                int slen = snprintf(command,
-                                    STRINGMAXLEN_COMMAND,
-                                    "CORENUM=%d; cat %s | grep -E  "
-                                    "\"^[[:space:]][[:digit:]]+[[:"
-                                    "space:]]+${CORENUM}\"|wc -l",
-                                    cpu,
-                                    psoutfname);
-                if(slen < 1)
-                {
-                    PRINT_ERROR("snprintf wrote <1 char");
-                    abort(); // can't handle this error any other way
-                }
-                if(slen >= STRINGMAXLEN_COMMAND)
-                {
-                    PRINT_ERROR("snprintf string truncation");
-                    abort(); // can't handle this error any other way
-                }
-            }
-            fpout = popen(command, "r");
-            if(fpout == NULL)
+            continue;
+        }
+
+        WRITE_FULLFILENAME(dname, "/proc/%s/task", dpid->d_name);
+        DIR *dtask = opendir(dname);
+        if(dtask == NULL)
+        {
+            // process has exited
+            continue;
+        }
+
+        struct dirent *dtid;
+        while((dtid = readdir(dtask)) != NULL)
+        {
+            if(!isdigit(dtid->d_name[0]))
             {
-                printf("WARNING: cannot run command \"%s\"\n", command);
+                continue;
             }
-            else
+
+            WRITE_FULLFILENAME(fname, "%s/%s/stat", dname, dtid->d_name);
+            if(read_procfile(fname) > 0)
             {
-                if(fgets(outstring, STRINGMAXLEN_DEFAULT, fpout) == NULL)
+                int cpu = procstat_processor(procbuff);
+                if((cpu >= 0) && (cpu < MAXNBCPU))
                 {
-                    printf("WARNING: fgets error\n");
+                    pcnt[cpu]++;
                 }
-                pclose(fpout);
-                pinfop->CPUpcnt[cpu] = atoi(outstring);
             }
         }
-        remove(psoutfname);
+        closedir(dtask);
+    }
+    closedir(dproc);
+
+    memcpy(pinfop->CPUpcnt, pcnt, sizeof(int) * MAXNBCPU);
+
+    return RETURN_SUCCESS;
+}
+
+
+
+/**
+ * @brief Write CPU loads and thread counts to <procdname>/cpustat.txt
+ *
+ * File is written under temporary name and renamed, so that readers
+ * never see a partial file.
+ */
+static errno_t write_CPUstat_snapshot(PROCINFOPROC *pinfop)
+{
+    char procdname[STRINGMAXLEN_DIRNAME];
+    char fname[STRINGMAXLEN_FULLFILENAME];
+    char fnametmp[STRINGMAXLEN_FULLFILENAME];
+
+    processinfo_procdirname(procdname);
+    WRITE_FULLFILENAME(fname, "%s/cpustat.txt", procdname);
+    WRITE_FULLFILENAME(fnametmp, "%s/_cpustat.txt.%d", procdname, getpid());
+
+    FILE *fp = fopen(fnametmp, "w");
+    if(fp == NULL)
+    {
+        return RETURN_FAILURE;
+    }
+
+    struct timespec tnow;
+    clock_gettime(CLOCK_REALTIME, &tnow);
+
+    fprintf(fp, "# time %ld.%09ld\n", (long) tnow.tv_sec, tnow.tv_nsec);
+    fprintf(fp, "# col1 : CPU\n");
+    fprintf(fp, "# col2 : socket\n");
+    fprintf(fp, "# col3 : load [0-1]\n");
+    fprintf(fp, "# col4 : number of threads last run on CPU\n");
+    for(int cpuindex = 0; cpuindex < pinfop->NBcpus; cpuindex++)
+    {
+        int cpu = pinfop->CPUids[cpuindex];
+        fprintf(fp,
+                "%3d %2d %6.4f %5d\n",
+                cpu,
+                pinfop->CPUphys[cpuindex],
+                pinfop->CPUload[cpu],
+                pinfop->CPUpcnt[cpu]);
     }
-    cnt++;
+    fclose(fp);
+
+    if(rename(fnametmp, fname) != 0)
+    {
+        remove(fnametmp);
+        return RETURN_FAILURE;
+    }
+
+    return RETURN_SUCCESS;
+}
+
+
+
+int GetCPUloads(PROCINFOPROC *pinfop)
+{
+    int cpu;
+
+    clock_gettime(CLOCK_REALTIME, &t1);
+
+    cpu = GetCPUloads_procstat(pinfop);
+
+    clock_gettime(CLOCK_REALTIME, &t2);
+    tdiff = timespec_diff(t1, t2);
+    scantime_CPUload += 1.0 * tdiff.tv_sec + 1.0e-9 * tdiff.tv_nsec;
+
+    clock_gettime(CLOCK_REALTIME, &t1);
+
+    GetCPUpcnt_procscan(pinfop);
 
     clock_gettime(CLOCK_REALTIME, &t2);
     tdiff = timespec_diff(t1, t2);
     scantime_CPUpcnt += 1.0 * tdiff.tv_sec + 1.0e-9 * tdiff.tv_nsec;
 
+    write_CPUstat_snapshot(pinfop);
+
     return (cpu);
 }
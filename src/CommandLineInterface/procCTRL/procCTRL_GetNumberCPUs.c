@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include "CLIcore.h"
 #include <processtools.h>
 
@@ -65,45 +67,52 @@ int GetNumberCPUs(PROCINFOPROC *pinfop)
 
 #else
 
-    FILE *fpout;
-    char  outstring[16];
-    char  buf[100];
-
-    //unsigned int tmp_index = 0;
+    FILE   *fp;
+    char   *line      = NULL;
+    size_t  maxstrlen = 0;
 
-    fpout = popen("getconf _NPROCESSORS_ONLN", "r");
-    if(fpout == NULL)
-    {
-        printf("WARNING: cannot run command \"tmuxsessionname\"\n");
-    }
-    else
+    pinfop->NBcpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(pinfop->NBcpus > MAXNBCPU)
     {
-        if(fgets(outstring, 16, fpout) == NULL)
-        {
-            printf("WARNING: fgets error\n");
-        }
-        pclose(fpout);
+        pinfop->NBcpus = MAXNBCPU;
     }
-    pinfop->NBcpus = atoi(outstring);
 
-    fpout =
-        popen("cat /proc/cpuinfo |grep \"physical id\" | awk '{ print $NF }'",
-              "r");
+    // socket of each CPU, from "physical id" lines
     pu_index            = 0;
     pinfop->NBcpusocket = 1;
-    while((fgets(buf, sizeof(buf), fpout) != NULL) &&
-            (pu_index < pinfop->NBcpus))
+    fp                  = fopen("/proc/cpuinfo", "r");
+    if(fp == NULL)
     {
-        pinfop->CPUids[pu_index]  = pu_index;
-        pinfop->CPUphys[pu_index] = atoi(buf);
-
-        //printf("cpu %2d belongs to Physical CPU %d\n", pu_index, pinfop->CPUphys[pu_index] );
-        if(pinfop->CPUphys[pu_index] + 1 > pinfop->NBcpusocket)
+        printf("WARNING: cannot open /proc/cpuinfo\n");
+    }
+    else
+    {
+        while((getline(&line, &maxstrlen, fp) != -1) &&
+                (pu_index < pinfop->NBcpus))
         {
-            pinfop->NBcpusocket = pinfop->CPUphys[pu_index] + 1;
+            if(strncmp(line, "physical id", 11) != 0)
+            {
+                continue;
+            }
+            char *ptr = strchr(line, ':');
+            if(ptr == NULL)
+            {
+                continue;
+            }
+
+            pinfop->CPUids[pu_index]  = pu_index;
+            pinfop->CPUphys[pu_index] = atoi(ptr + 1);
+
+            //printf("cpu %2d belongs to Physical CPU %d\n", pu_index, pinfop->CPUphys[pu_index] );
+            if(pinfop->CPUphys[pu_index] + 1 > pinfop->NBcpusocket)
+            {
+                pinfop->NBcpusocket = pinfop->CPUphys[pu_index] + 1;
+            }
+
+            pu_index++;
         }
-
-        pu_index++;
+        free(line);
+        fclose(fp);
     }
 
 #endif
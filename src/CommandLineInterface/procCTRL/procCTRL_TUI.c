@@ -64,6 +64,7 @@ static int CTRLscreenExitLine = 0; // for debugging
 #include "processinfo/processinfo_shm_list_create.h"
 #include "processinfo/processinfo_exec_start.h"
 #include "processinfo/processinfo_exec_end.h"
+#include "processinfo/processinfo_hist.h"
 
 
 #include "procCTRL/procCTRL_PIDcollectSystemInfo.h"
@@ -269,6 +270,34 @@ static int processinfo_SelectFromList(STRINGLISTENTRY *StringList, int NBelem)
 }
 
 
+// print timing value [ns] in us, 7 chars
+static void processinfo_print_timing(long dt_ns)
+{
+    float tval = 0.001 * dt_ns;
+
+    if(tval > 9999.9)
+    {
+        TUI_printfw("  >10ms");
+    }
+    else
+    {
+        TUI_printfw("%7.1f", tval);
+    }
+}
+
+// print median [p99 p99.9 max] from timing histogram
+static void processinfo_print_timinghist(const char             *label,
+                                         PROCESSINFO_HIST_STATS *stats)
+{
+    TUI_printfw(" %s", label);
+    processinfo_print_timing(stats->p50);
+    TUI_printfw(" [");
+    processinfo_print_timing(stats->p99);
+    processinfo_print_timing(stats->p999);
+    processinfo_print_timing(stats->max);
+    TUI_printfw("]");
+}
+
 static void processinfo_CTRLscreen_atexit()
 {
     //echo();
@@ -1129,6 +1158,22 @@ errno_t processinfo_CTRLscreen()
                 break;
                 ;
 
+            case 'H': // reset timing histograms
+                pindex = pindexSelected;
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_iter);
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_exec);
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_wait);
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_iter_recent);
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_exec_recent);
+                processinfo_hist_reset(
+                    &procinfoproc.pinfoarray[pindex]->hist_wait_recent);
+                break;
+
             case 'm': // message
                 pindex = pindexSelected;
                 if(pinfolist->active[pindex] == 1)
@@ -1366,11 +1411,17 @@ errno_t processinfo_CTRLscreen()
                 TUI_newline();
 
                 attron(attrval);
-                TUI_printfw(" L H ");
+                TUI_printfw(" L M ");
                 attroff(attrval);
                 TUI_printfw("    Enable iteration/execution time limit");
                 TUI_newline();
 
+                attron(attrval);
+                TUI_printfw(" H");
+                attroff(attrval);
+                TUI_printfw("    reset timing histograms");
+                TUI_newline();
+
                 TUI_printfw("============ AFFINITY");
                 TUI_newline();
 
@@ -1873,6 +1924,8 @@ errno_t processinfo_CTRLscreen()
                     TUI_printfw(
                         "   STATUS    PID   process name       "
                         "             ");
+                    TUI_printfw(
+                        "timing [us] : median [p99 p99.9 max]");
                     TUI_newline();
                     TUI_newline();
                     DEBUG_TRACEPOINT(" ");
@@ -2652,6 +2705,14 @@ errno_t processinfo_CTRLscreen()
                                             ->triggermode);
                                         break;
 
+                                    case PROCESSINFO_TRIGGERMODE_FUTEX:
+                                        TUI_printfw(
+                                            "%2d:"
+                                            "FUTX ",
+                                            procinfoproc.pinfoarray[pindex]
+                                            ->triggermode);
+                                        break;
+
                                     default:
                                         TUI_printfw(
                                             "%2d:"
@@ -2691,9 +2752,9 @@ errno_t processinfo_CTRLscreen()
                                 if(procinfoproc.pinfoarray[pindex]
                                         ->MeasureTiming == 1)
                                 {
-                                    long *dtiter_array;
-                                    long *dtexec_array;
-                                    //int dtindex;
+                                    PROCESSINFO_HIST_STATS statsiter;
+                                    PROCESSINFO_HIST_STATS statsexec;
+                                    PROCESSINFO_HIST_STATS statswait;
 
                                     TUI_printfw(
                                         " %3d "
@@ -2706,90 +2767,20 @@ errno_t processinfo_CTRLscreen()
                                         ->timingbuffercnt %
                                         100);
 
-                                    // compute timing stat
-                                    dtiter_array = (long *) malloc(
-                                                       sizeof(long) *
-                                                       (PROCESSINFO_NBtimer - 1));
-                                    if(dtiter_array == NULL)
-                                    {
-                                        PRINT_ERROR(
-                                            "malloc returns NULL pointer");
-                                        abort();
-                                    }
-                                    dtexec_array = (long *) malloc(
-                                                       sizeof(long) *
-                                                       (PROCESSINFO_NBtimer - 1));
-                                    if(dtexec_array == NULL)
-                                    {
-                                        PRINT_ERROR(
-                                            "malloc returns NULL pointer");
-                                        abort();
-                                    }
-
-                                    int tindex;
-                                    //dtindex = 0;
-
-                                    // we exclude the current timerindex, as timers may not all be written
-                                    for(tindex = 0;
-                                            tindex < PROCESSINFO_NBtimer - 1;
-                                            tindex++)
-                                    {
-                                        int ti0, ti1;
-
-                                        ti1 = procinfoproc.pinfoarray[pindex]
-                                              ->timerindex -
-                                              tindex;
-                                        ti0 = ti1 - 1;
-
-                                        if(ti0 < 0)
-                                        {
-                                            ti0 += PROCESSINFO_NBtimer;
-                                        }
-
-                                        if(ti1 < 0)
-                                        {
-                                            ti1 += PROCESSINFO_NBtimer;
-                                        }
-
-                                        dtiter_array[tindex] =
-                                            (procinfoproc.pinfoarray[pindex]
-                                             ->texecstart[ti1]
-                                             .tv_nsec -
-                                             procinfoproc.pinfoarray[pindex]
-                                             ->texecstart[ti0]
-                                             .tv_nsec) +
-                                            1000000000 *
-                                            (procinfoproc
-                                             .pinfoarray[pindex]
-                                             ->texecstart[ti1]
-                                             .tv_sec -
-                                             procinfoproc
-                                             .pinfoarray[pindex]
-                                             ->texecstart[ti0]
-                                             .tv_sec);
-
-                                        dtexec_array[tindex] =
-                                            (procinfoproc.pinfoarray[pindex]
-                                             ->texecend[ti0]
-                                             .tv_nsec -
-                                             procinfoproc.pinfoarray[pindex]
-                                             ->texecstart[ti0]
-                                             .tv_nsec) +
-                                            1000000000 *
-                                            (procinfoproc
-                                             .pinfoarray[pindex]
-                                             ->texecend[ti0]
-                                             .tv_sec -
-                                             procinfoproc
-                                             .pinfoarray[pindex]
-                                             ->texecstart[ti0]
-                                             .tv_sec);
-                                    }
-
-                                    quick_sort_long(dtiter_array,
-                                                    PROCESSINFO_NBtimer - 1);
-                                    quick_sort_long(dtexec_array,
-                                                    PROCESSINFO_NBtimer - 1);
+                                    // timing stats over recent
+                                    // iterations, no sorting
+                                    processinfo_hist_stats(
+                                        &procinfoproc.pinfoarray[pindex]
+                                        ->hist_iter_recent,
+                                        &statsiter);
+                                    processinfo_hist_stats(
+                                        &procinfoproc.pinfoarray[pindex]
+                                        ->hist_exec_recent,
+                                        &statsexec);
+                                    processinfo_hist_stats(
+                                        &procinfoproc.pinfoarray[pindex]
+                                        ->hist_wait_recent,
+                                        &statswait);
 
                                     int colorcode;
 
@@ -2862,87 +2853,17 @@ errno_t processinfo_CTRLscreen()
                                         attroff(colorcode);
                                     }
 
-                                    float tval;
-
-                                    tval =
-                                        0.001 *
-                                        dtiter_array[(
-                                                         long)(0.5 * PROCESSINFO_NBtimer)];
                                     procinfoproc.pinfoarray[pindex]
-                                    ->dtmedian_iter_ns = dtiter_array[(
-                                                                          long)(0.5 * PROCESSINFO_NBtimer)];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw(" ITER    >10ms ");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw(" ITER %6.1fus ", tval);
-                                    }
-
-                                    tval = 0.001 * dtiter_array[0];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw("[   >10ms -");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw("[%6.1fus -", tval);
-                                    }
-
-                                    tval =
-                                        0.001 *
-                                        dtiter_array[PROCESSINFO_NBtimer - 2];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw("    >10ms ]");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw(" %6.1fus ]", tval);
-                                    }
-
-                                    tval =
-                                        0.001 *
-                                        dtexec_array[(
-                                                         long)(0.5 * PROCESSINFO_NBtimer)];
+                                    ->dtmedian_iter_ns = statsiter.p50;
                                     procinfoproc.pinfoarray[pindex]
-                                    ->dtmedian_exec_ns = dtexec_array[(
-                                                                          long)(0.5 * PROCESSINFO_NBtimer)];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw(" EXEC    >10ms ");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw(" EXEC %6.1fus ", tval);
-                                    }
-
-                                    tval = 0.001 * dtexec_array[0];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw("[   >10ms -");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw("[%6.1fus -", tval);
-                                    }
-
-                                    tval =
-                                        0.001 *
-                                        dtexec_array[PROCESSINFO_NBtimer - 2];
-                                    if(tval > 9999.9)
-                                    {
-                                        TUI_printfw("    >10ms ]");
-                                    }
-                                    else
-                                    {
-                                        TUI_printfw(" %6.1fus ]", tval);
-                                    }
-
-                                    //	TUI_printfw(" ITER %9.3fus [%9.3f - %9.3f] ", 0.001*dtiter_array[(long) (0.5*PROCESSINFO_NBtimer)], 0.001*dtiter_array[0], 0.001*dtiter_array[PROCESSINFO_NBtimer-2]);
+                                    ->dtmedian_exec_ns = statsexec.p50;
 
-                                    //	TUI_printfw(" EXEC %9.3fus [%9.3f - %9.3f] ", 0.001*dtexec_array[(long) (0.5*PROCESSINFO_NBtimer)], 0.001*dtexec_array[0], 0.001*dtexec_array[PROCESSINFO_NBtimer-2]);
+                                    processinfo_print_timinghist("ITER",
+                                                                 &statsiter);
+                                    processinfo_print_timinghist("EXEC",
+                                                                 &statsexec);
+                                    processinfo_print_timinghist("WAIT",
+                                                                 &statswait);
 
                                     TUI_printfw(
                                         "  "
@@ -2950,17 +2871,8 @@ errno_t processinfo_CTRLscreen()
                                         "= "
                                         "%6.2f "
                                         "%%",
-                                        100.0 *
-                                        dtexec_array[(
-                                                         long)(0.5 *
-                                                               PROCESSINFO_NBtimer)] /
-                                        (dtiter_array[(
-                                                          long)(0.5 *
-                                                                PROCESSINFO_NBtimer)] +
-                                         1));
-
-                                    free(dtiter_array);
-                                    free(dtexec_array);
+                                        100.0 * statsexec.p50 /
+                                        (statsiter.p50 + 1));
                                 }
                             }
 
@@ -19,6 +19,20 @@
 // timing info for real-time loop processes
 #define PROCESSINFO_NBtimer 100
 
+// log-bucketed timing histograms [ns]
+// values below 2^(SUBBITS+1) have their own bucket, larger values share
+// 2^SUBBITS buckets per power of 2 (3% resolution)
+// values are capped at 2^MAXBITS ns (~18 min)
+#define PROCESSINFO_HIST_SUBBITS 5
+#define PROCESSINFO_HIST_MAXBITS 40
+#define PROCESSINFO_HIST_NBBUCKET                                              \
+    ((PROCESSINFO_HIST_MAXBITS - PROCESSINFO_HIST_SUBBITS + 1)                 \
+     << PROCESSINFO_HIST_SUBBITS)
+
+// recent-sample histograms are halved when they reach 2 x WINDOW samples :
+// they hold the last 1 to 2 windows, older samples fade out
+#define PROCESSINFO_HIST_WINDOW 4096
+
 
 #define PROCESSINFO_CTRLVAL_RUN   0
 #define PROCESSINFO_CTRLVAL_PAUSE 1
@@ -36,6 +50,19 @@
 
 #include "CLIcore.h"
 
+/**
+ * Timing histogram, in processinfo shared memory
+ *
+ * Updated lock-free by the process, read by any process without locking.
+ */
+typedef struct
+{
+    uint64_t cnt; // number of samples
+    uint64_t max; // largest sample [ns]
+    uint64_t window; // 0 : keep all samples, otherwise see HIST_WINDOW
+    uint64_t bucket[PROCESSINFO_HIST_NBBUCKET];
+} PROCESSINFO_HIST;
+
 /**
  *
  * This structure hold process information and hooks required for basic
@@ -108,6 +135,10 @@ typedef struct
     //  2+ : frame(s) missed
     uint64_t triggermissedframe_cumul; // cumulative missed frames
     int      triggerstatus;            // see TRIGGERSTATUS codes
+    // fields below change the shared PROCESSINFO layout : processes and
+    // procCTRL must be built from the same sources
+    long triggerspin_ns;   // FUTEX mode: spin time before sleeping [ns]
+    long triggerwakeup_ns; // stream write to trigger latency [ns], -1: unknown
 
     int       RT_priority; // -1 if unused. 0-99 for higher priority
     cpu_set_t CPUmask;
@@ -124,10 +155,22 @@ typedef struct
     int timingbuffercnt; // increments every cycle of the circular buffer
     struct timespec texecstart[PROCESSINFO_NBtimer]; // task starts
     struct timespec texecend[PROCESSINFO_NBtimer];   // task ends
+    long twakeup_ns[PROCESSINFO_NBtimer]; // trigger wake-up latency [ns]
 
     long dtmedian_iter_ns; // median time offset between iterations [nanosec]
     long dtmedian_exec_ns; // median compute/busy time [nanosec]
 
+    // all iterations since start or last reset, updated by processinfo_exec_end
+    PROCESSINFO_HIST hist_iter; // time offset between iterations
+    PROCESSINFO_HIST hist_exec; // compute/busy time
+    PROCESSINFO_HIST hist_wait; // end of previous iteration to start
+
+    // same, recent iterations only (PROCESSINFO_HIST_WINDOW)
+    // shown by procCTRL, used for dtmedian_iter_ns / dtmedian_exec_ns
+    PROCESSINFO_HIST hist_iter_recent;
+    PROCESSINFO_HIST hist_exec_recent;
+    PROCESSINFO_HIST hist_wait_recent;
+
     // If enabled=1, pause process if dtiter larger than limit
     int  dtiter_limit_enable;
     long dtiter_limit_value;
@@ -1,28 +1,51 @@
 #include "CLIcore.h"
 #include <processtools.h>
 
+#include "processinfo_hist.h"
+
+static long timespec_diff_ns(struct timespec t0, struct timespec t1)
+{
+    return 1000000000L * (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec);
+}
+
 
 int processinfo_exec_end(PROCESSINFO *processinfo)
 {
     int loopOK = 1;
 
-    DEBUG_TRACEPOINT("End of execution loop, measure timing = %d",
-                     processinfo->MeasureTiming);
+    TRACEPOINT_FAST("End of execution loop, measure timing = %d",
+                    processinfo->MeasureTiming);
     if(processinfo->MeasureTiming == 1)
     {
-        clock_gettime(CLOCK_REALTIME,
-                      &processinfo->texecend[processinfo->timerindex]);
+        int  ti     = processinfo->timerindex;
+        int  tiprev = (ti == 0) ? PROCESSINFO_NBtimer - 1 : ti - 1;
+        long dtexec;
 
-        if(processinfo->dtexec_limit_enable != 0)
+        clock_gettime(CLOCK_REALTIME, &processinfo->texecend[ti]);
+
+        dtexec = timespec_diff_ns(processinfo->texecstart[ti],
+                                  processinfo->texecend[ti]);
+        processinfo_hist_add(&processinfo->hist_exec, dtexec);
+        processinfo_hist_add(&processinfo->hist_exec_recent, dtexec);
+
+        // previous iteration, if it was completed
+        if((processinfo->texecstart[tiprev].tv_sec != 0) &&
+                (timespec_diff_ns(processinfo->texecstart[tiprev],
+                                  processinfo->texecend[tiprev]) >= 0))
         {
-            long dtexec;
+            long dtiter = timespec_diff_ns(processinfo->texecstart[tiprev],
+                                           processinfo->texecstart[ti]);
+            long dtwait = timespec_diff_ns(processinfo->texecend[tiprev],
+                                           processinfo->texecstart[ti]);
 
-            dtexec = processinfo->texecend[processinfo->timerindex].tv_nsec -
-                     processinfo->texecstart[processinfo->timerindex].tv_nsec;
-            dtexec += 1000000000 *
-                      (processinfo->texecend[processinfo->timerindex].tv_sec -
-                       processinfo->texecend[processinfo->timerindex].tv_sec);
+            processinfo_hist_add(&processinfo->hist_iter, dtiter);
+            processinfo_hist_add(&processinfo->hist_iter_recent, dtiter);
+            processinfo_hist_add(&processinfo->hist_wait, dtwait);
+            processinfo_hist_add(&processinfo->hist_wait_recent, dtwait);
+        }
 
+        if(processinfo->dtexec_limit_enable != 0)
+        {
             if(dtexec > processinfo->dtexec_limit_value)
             {
                 char msgstring[STRINGMAXLEN_PROCESSINFO_STATUSMSG];
@@ -77,7 +100,7 @@ int processinfo_exec_end(PROCESSINFO *processinfo)
             }
         }
     }
-    DEBUG_TRACEPOINT("End of execution loop: check signals");
+    TRACEPOINT_FAST("End of execution loop: check signals");
     loopOK = processinfo_ProcessSignals(processinfo);
 
     processinfo->loopcnt++;
@@ -4,7 +4,7 @@
 
 int processinfo_exec_start(PROCESSINFO *processinfo)
 {
-    DEBUG_TRACEPOINT(" ");
+    TRACEPOINT_FAST(" ");
     if(processinfo->MeasureTiming == 1)
     {
 
@@ -18,6 +18,10 @@ int processinfo_exec_start(PROCESSINFO *processinfo)
         clock_gettime(CLOCK_REALTIME,
                       &processinfo->texecstart[processinfo->timerindex]);
 
+        // measured by processinfo_waitoninputstream
+        processinfo->twakeup_ns[processinfo->timerindex] =
+            processinfo->triggerwakeup_ns;
+
         if(processinfo->dtiter_limit_enable != 0)
         {
             long dtiter;
@@ -76,6 +80,6 @@ int processinfo_exec_start(PROCESSINFO *processinfo)
             }
         }
     }
-    DEBUG_TRACEPOINT(" ");
+    TRACEPOINT_FAST(" ");
     return 0;
 }
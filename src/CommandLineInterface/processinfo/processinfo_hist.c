@@ -0,0 +1,192 @@
+/**
+ * @file    processinfo_hist.c
+ * @brief   log-bucketed timing histograms
+ *
+ * Updated with atomics, no lock : processes write their own histograms,
+ * any number of readers in other processes. A reader may see a sample in
+ * a bucket before it is counted in cnt, so percentiles are computed from
+ * the bucket sum.
+ *
+ * A histogram with a window forgets old samples : when it reaches
+ * 2 x window samples, bucket counts are halved by the writer. Readers may
+ * see a partly halved histogram.
+ */
+
+#include "CLIcore.h"
+#include <processtools.h>
+
+#include "processinfo_hist.h"
+
+#define PROCESSINFO_HIST_SUB (1 << PROCESSINFO_HIST_SUBBITS)
+
+static int processinfo_hist_index(uint64_t v)
+{
+    if(v >= (1UL << PROCESSINFO_HIST_MAXBITS))
+    {
+        v = (1UL << PROCESSINFO_HIST_MAXBITS) - 1;
+    }
+    if(v < PROCESSINFO_HIST_SUB)
+    {
+        return v;
+    }
+
+    int e = 63 - __builtin_clzll(v); // >= SUBBITS
+    return ((e - PROCESSINFO_HIST_SUBBITS + 1) << PROCESSINFO_HIST_SUBBITS) +
+           (int)((v >> (e - PROCESSINFO_HIST_SUBBITS)) - PROCESSINFO_HIST_SUB);
+}
+
+// largest value in bucket
+static uint64_t processinfo_hist_value(int index)
+{
+    int g = index >> PROCESSINFO_HIST_SUBBITS;
+    int m = index & (PROCESSINFO_HIST_SUB - 1);
+
+    if(g == 0)
+    {
+        return index;
+    }
+    return (((uint64_t)(PROCESSINFO_HIST_SUB + m + 1)) << (g - 1)) - 1;
+}
+
+/** @brief Set window and clear histogram
+ *
+ * @param window  0 to keep all samples
+ */
+void processinfo_hist_init(PROCESSINFO_HIST *hist, uint64_t window)
+{
+    hist->window = window;
+    processinfo_hist_reset(hist);
+}
+
+// halve bucket counts, called by writer
+static void processinfo_hist_decay(PROCESSINFO_HIST *hist)
+{
+    uint64_t cnt  = 0;
+    int      imax = -1;
+
+    for(int i = 0; i < PROCESSINFO_HIST_NBBUCKET; i++)
+    {
+        uint64_t b = __atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED) >> 1;
+        __atomic_store_n(&hist->bucket[i], b, __ATOMIC_RELAXED);
+        cnt += b;
+        if(b > 0)
+        {
+            imax = i;
+        }
+    }
+    __atomic_store_n(&hist->cnt, cnt, __ATOMIC_RELAXED);
+
+    // largest remaining sample, to bucket resolution
+    uint64_t vmax = (imax < 0) ? 0 : processinfo_hist_value(imax);
+    if(vmax < __atomic_load_n(&hist->max, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&hist->max, vmax, __ATOMIC_RELAXED);
+    }
+}
+
+void processinfo_hist_add(PROCESSINFO_HIST *hist, long dt_ns)
+{
+    uint64_t v = (dt_ns < 0) ? 0 : dt_ns; // CLOCK_REALTIME may step back
+    uint64_t vmax;
+
+    // max first : a reader seeing the sample in its bucket also sees max
+    vmax = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while((v > vmax) && (!__atomic_compare_exchange_n(&hist->max,
+                         &vmax,
+                         v,
+                         1,
+                         __ATOMIC_RELAXED,
+                         __ATOMIC_RELAXED)))
+    {
+    }
+
+    __atomic_fetch_add(&hist->bucket[processinfo_hist_index(v)],
+                       1,
+                       __ATOMIC_RELEASE);
+    uint64_t cnt = __atomic_add_fetch(&hist->cnt, 1, __ATOMIC_RELAXED);
+
+    if((hist->window > 0) && (cnt >= 2 * hist->window))
+    {
+        processinfo_hist_decay(hist);
+    }
+}
+
+/** @brief Clear histogram, window is kept
+ *
+ * Can be called by another process : samples added concurrently may be
+ * lost.
+ */
+void processinfo_hist_reset(PROCESSINFO_HIST *hist)
+{
+    for(int i = 0; i < PROCESSINFO_HIST_NBBUCKET; i++)
+    {
+        __atomic_store_n(&hist->bucket[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&hist->cnt, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+
+/** @brief Percentiles from histogram, no sorting
+ *
+ * Percentiles are upper bounds of buckets, within 3% of exact value.
+ */
+void processinfo_hist_stats(PROCESSINFO_HIST *hist, PROCESSINFO_HIST_STATS *stats)
+{
+    uint64_t bucket[PROCESSINFO_HIST_NBBUCKET];
+    uint64_t cnt = 0;
+    uint64_t cumul = 0;
+    uint64_t max;
+
+    for(int i = 0; i < PROCESSINFO_HIST_NBBUCKET; i++)
+    {
+        bucket[i] = __atomic_load_n(&hist->bucket[i], __ATOMIC_ACQUIRE);
+        cnt += bucket[i];
+    }
+    max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    stats->cnt  = cnt;
+    stats->p50  = 0;
+    stats->p99  = 0;
+    stats->p999 = 0;
+    stats->max  = max;
+    if(cnt == 0)
+    {
+        return;
+    }
+
+    // rank of sample for each percentile, 1 to cnt
+    uint64_t r50  = (cnt * 500 + 999) / 1000;
+    uint64_t r99  = (cnt * 990 + 999) / 1000;
+    uint64_t r999 = (cnt * 999 + 999) / 1000;
+
+    for(int i = 0; i < PROCESSINFO_HIST_NBBUCKET; i++)
+    {
+        if(bucket[i] == 0)
+        {
+            continue;
+        }
+        uint64_t v = processinfo_hist_value(i);
+        if(v > max)
+        {
+            v = max;
+        }
+
+        if((cumul < r50) && (cumul + bucket[i] >= r50))
+        {
+            stats->p50 = v;
+        }
+        if((cumul < r99) && (cumul + bucket[i] >= r99))
+        {
+            stats->p99 = v;
+        }
+        if((cumul < r999) && (cumul + bucket[i] >= r999))
+        {
+            stats->p999 = v;
+        }
+        cumul += bucket[i];
+        if(cumul >= cnt)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _PROCESSINFO_HIST_H
+#define _PROCESSINFO_HIST_H
+
+typedef struct
+{
+    uint64_t cnt;
+    long     p50; // [ns]
+    long     p99;
+    long     p999;
+    long     max;
+} PROCESSINFO_HIST_STATS;
+
+void processinfo_hist_init(PROCESSINFO_HIST *hist, uint64_t window);
+
+void processinfo_hist_add(PROCESSINFO_HIST *hist, long dt_ns);
+
+void processinfo_hist_reset(PROCESSINFO_HIST *hist);
+
+void processinfo_hist_stats(PROCESSINFO_HIST *hist, PROCESSINFO_HIST_STATS *stats);
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "processinfo_shm_list_create.h"
 #include "processinfo_procdirname.h"
+#include "processinfo_hist.h"
 
 
 #define FILEMODE 0666
@@ -175,6 +176,12 @@ PROCESSINFO *processinfo_shm_create(const char *pname, int CTRLval)
     // initialize timer indexes and counters
     pinfo->timerindex      = 0;
     pinfo->timingbuffercnt = 0;
+    processinfo_hist_init(&pinfo->hist_iter, 0);
+    processinfo_hist_init(&pinfo->hist_exec, 0);
+    processinfo_hist_init(&pinfo->hist_wait, 0);
+    processinfo_hist_init(&pinfo->hist_iter_recent, PROCESSINFO_HIST_WINDOW);
+    processinfo_hist_init(&pinfo->hist_exec_recent, PROCESSINFO_HIST_WINDOW);
+    processinfo_hist_init(&pinfo->hist_wait_recent, PROCESSINFO_HIST_WINDOW);
 
     // disable timer limit feature
     pinfo->dtiter_limit_enable = 0;
@@ -15,12 +15,12 @@ errno_t processinfo_update_output_stream(PROCESSINFO *processinfo,
     {
         imageID IDin;
 
-        DEBUG_TRACEPOINT(" ");
+        TRACEPOINT_FAST(" ");
 
         if(processinfo != NULL)
         {
             IDin = processinfo->triggerstreamID;
-            DEBUG_TRACEPOINT("trigger IDin = %ld", IDin);
+            TRACEPOINT_FAST("trigger IDin = %ld", IDin);
 
             if(IDin > -1)
             {
@@ -32,7 +32,7 @@ errno_t processinfo_update_output_stream(PROCESSINFO *processinfo,
                        sizeof(STREAM_PROC_TRACE) * sptisize);
             }
 
-            DEBUG_TRACEPOINT("timing");
+            TRACEPOINT_FAST("timing");
             struct timespec ts;
             if(clock_gettime(CLOCK_REALTIME, &ts) == -1)
             {
@@ -41,7 +41,7 @@ errno_t processinfo_update_output_stream(PROCESSINFO *processinfo,
             }
 
             // write first streamproctrace entry
-            DEBUG_TRACEPOINT("trigger info");
+            TRACEPOINT_FAST("trigger info");
             data.image[outstreamID].streamproctrace[0].triggermode =
                 processinfo->triggermode;
 
@@ -67,10 +67,13 @@ errno_t processinfo_update_output_stream(PROCESSINFO *processinfo,
                     data.image[IDin].md[0].cnt0;
             }
         }
-        DEBUG_TRACEPOINT(" ");
+        TRACEPOINT_FAST(" ");
     }
 
     ImageStreamIO_UpdateIm(&data.image[outstreamID]);
 
+    // wake up readers in PROCESSINFO_TRIGGERMODE_FUTEX
+    processinfo_triggerstream_wake(&data.image[outstreamID]);
+
     return RETURN_SUCCESS;
 }
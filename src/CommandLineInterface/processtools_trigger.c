@@ -4,9 +4,16 @@
  *
  */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
 #include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -14,8 +21,161 @@
 #include "CLIcore/CLIcore_utils.h"
 
 #include "processinfo.h"
+#include "processinfo/processinfo_procdirname.h"
 #include "processtools_trigger.h"
 
+// futex waiter table, shared by all processes
+// NULL if it could not be mapped : writers then always wake
+static uint32_t      *futexwaittable = NULL;
+static pthread_once_t futexwaittable_once = PTHREAD_ONCE_INIT;
+
+/** @brief 32-bit futex word holding low half of cnt0
+ */
+static uint32_t *cnt0_futexword(IMAGE *image)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return ((uint32_t *) &image->md[0].cnt0) + 1;
+#else
+    return (uint32_t *) &image->md[0].cnt0;
+#endif
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/** @brief Measure latency between trigger stream write and now
+ *
+ * Uses writetime stamped by writer on stream update.
+ * Sets processinfo->triggerwakeup_ns to -1 if unknown.
+ */
+static void trigger_measure_wakeup(PROCESSINFO *processinfo)
+{
+    struct timespec writetime =
+        data.image[processinfo->triggerstreamID].md[0].writetime;
+
+    processinfo->triggerwakeup_ns = -1;
+    if(writetime.tv_sec != 0)
+    {
+        struct timespec tnow;
+        clock_gettime(CLOCK_REALTIME, &tnow);
+        processinfo->triggerwakeup_ns =
+            (tnow.tv_sec - writetime.tv_sec) * 1000000000L +
+            (tnow.tv_nsec - writetime.tv_nsec);
+    }
+}
+
+static void futexwaittable_map()
+{
+    char   procdname[STRINGMAXLEN_DIRNAME];
+    char   fname[STRINGMAXLEN_FULLFILENAME];
+    size_t tablesize = sizeof(uint32_t) * PROCESSINFO_TRIGGER_FUTEXWAIT_NBSLOT;
+
+    processinfo_procdirname(procdname);
+    WRITE_FULLFILENAME(fname, "%s/processinfo.futexwait.shm", procdname);
+
+    // owner only : processes of other users cannot open it, and always
+    // wake. ftruncate to the same size does not clear counters in use
+    int fd = open(fname, O_RDWR | O_CREAT, (mode_t) 0600);
+    if(fd == -1)
+    {
+        return;
+    }
+    if(ftruncate(fd, tablesize) == 0)
+    {
+        void *ptr =
+            mmap(NULL, tablesize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(ptr != MAP_FAILED)
+        {
+            futexwaittable = (uint32_t *) ptr;
+        }
+    }
+    close(fd);
+}
+
+/** @brief Waiter count of image, NULL if unknown
+ *
+ * Streams are hashed by inode : streams sharing a slot only cause
+ * unnecessary wake calls.
+ */
+static uint32_t *futexwait_slot(IMAGE *image)
+{
+    pthread_once(&futexwaittable_once, futexwaittable_map);
+    if(futexwaittable == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t h = (uint64_t) image->md[0].inode * 0x9E3779B97F4A7C15ULL;
+    return &futexwaittable[(h >> 32) % PROCESSINFO_TRIGGER_FUTEXWAIT_NBSLOT];
+}
+
+/** @brief Register waiter on image futex word
+ *
+ * Must be called before FUTEX_WAIT on cnt0, and followed by
+ * processinfo_triggerstream_waitend.
+ */
+errno_t processinfo_triggerstream_waitbegin(IMAGE *image)
+{
+    uint32_t *slot = futexwait_slot(image);
+
+    if(slot != NULL)
+    {
+        __atomic_fetch_add(slot, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return RETURN_SUCCESS;
+}
+
+errno_t processinfo_triggerstream_waitend(IMAGE *image)
+{
+    uint32_t *slot = futexwait_slot(image);
+
+    if(slot != NULL)
+    {
+        __atomic_fetch_sub(slot, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return RETURN_SUCCESS;
+}
+
+/** @brief Wake up processes waiting on image in futex trigger mode
+ *
+ * Should be called by writer after cnt0 increment.
+ * The FUTEX_WAKE syscall is only made if a waiter is registered on the
+ * stream. Waiters are also woken up by semaphore posts when they hold a
+ * stream semaphore; otherwise, they see updates within
+ * PROCESSINFO_TRIGGER_FUTEXSLICE_NS.
+ */
+errno_t processinfo_triggerstream_wake(IMAGE *image)
+{
+    uint32_t *slot = futexwait_slot(image);
+
+    if(slot != NULL)
+    {
+        // pairs with waiter's increment : either waiter sees new cnt0
+        // in FUTEX_WAIT, or writer sees waiter count
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(slot, __ATOMIC_RELAXED) == 0)
+        {
+            return RETURN_SUCCESS;
+        }
+    }
+
+    syscall(SYS_futex,
+            cnt0_futexword(image),
+            FUTEX_WAKE,
+            INT_MAX,
+            NULL,
+            NULL,
+            0);
+
+    return RETURN_SUCCESS;
+}
+
 /** @brief Set up input wait stream
  *
  * Specify stream on which the loop process will be triggering, and
@@ -53,6 +213,7 @@ errno_t processinfo_waitoninputstream_init(PROCESSINFO *processinfo,
     processinfo->triggermissedframe_cumul = 0;
     processinfo->trigggertimeoutcnt       = 0;
     processinfo->triggerstatus            = 0;
+    processinfo->triggerwakeup_ns         = -1;
 
     // default
     //processinfo->triggermode = PROCESSINFO_TRIGGERMODE_SEMAPHORE;
@@ -91,6 +252,36 @@ errno_t processinfo_waitoninputstream_init(PROCESSINFO *processinfo,
             data.image[processinfo->triggerstreamID].md[0].cnt1;
     }
 
+    if(triggermode == PROCESSINFO_TRIGGERMODE_FUTEX)
+    {
+        DEBUG_TRACEPOINT("trigger mode %d = futex on cnt0 of ID %ld",
+                         PROCESSINFO_TRIGGERMODE_FUTEX,
+                         trigID);
+
+        if(trigID == -1)
+        {
+            FUNC_RETURN_FAILURE("missing trigger ID");
+        }
+        // trigger on cnt0 increment
+        processinfo->triggermode = PROCESSINFO_TRIGGERMODE_FUTEX;
+        processinfo->triggerstreamcnt =
+            data.image[processinfo->triggerstreamID].md[0].cnt0;
+
+        // sleep on semaphore if available : posted by all writers
+        processinfo->triggersem = -1;
+        if(semindexrequested >= -1)
+        {
+            processinfo->triggersem =
+                ImageStreamIO_getsemwaitindex(&data.image[trigID],
+                                              semindexrequested);
+        }
+        if(processinfo->triggersem != -1)
+        {
+            // register PID to stream
+            data.image[trigID].semReadPID[processinfo->triggersem] = getpid();
+        }
+    }
+
     if(triggermode == PROCESSINFO_TRIGGERMODE_IMMEDIATE)
     {
         DEBUG_TRACEPOINT("trigger mode %d = immediate",
@@ -185,6 +376,7 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
         processinfo->triggermissedframe_cumul +=
             processinfo->triggermissedframe;
 
+        trigger_measure_wakeup(processinfo);
         processinfo->triggerstatus = PROCESSINFO_TRIGGERSTATUS_RECEIVED;
 
         return RETURN_SUCCESS;
@@ -212,11 +404,150 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
         processinfo->triggermissedframe_cumul +=
             processinfo->triggermissedframe;
 
+        trigger_measure_wakeup(processinfo);
         processinfo->triggerstatus = PROCESSINFO_TRIGGERSTATUS_RECEIVED;
 
         return RETURN_SUCCESS;
     }
 
+    if(processinfo->triggermode == PROCESSINFO_TRIGGERMODE_FUTEX)
+    {
+        // use cnt0, spin for up to triggerspin_ns, then sleep on the
+        // stream semaphore reserved at init, posted by all writers
+        // without semaphore, sleep on futex : the futex word is the low
+        // half of cnt0, and a wait on a stale value returns immediately
+
+        volatile uint64_t *cnt0ptr =
+            &data.image[processinfo->triggerstreamID].md[0].cnt0;
+        uint32_t *futexword =
+            cnt0_futexword(&data.image[processinfo->triggerstreamID]);
+        int tmpstatus = PROCESSINFO_TRIGGERSTATUS_RECEIVED;
+
+        processinfo->triggerstatus = PROCESSINFO_TRIGGERSTATUS_WAITING;
+
+        if((*cnt0ptr == processinfo->triggerstreamcnt) &&
+                (processinfo->triggerspin_ns > 0))
+        {
+            struct timespec t0, t1;
+            long            spincnt = 0;
+
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            while(*cnt0ptr == processinfo->triggerstreamcnt)
+            {
+                cpu_relax();
+                spincnt++;
+                // check elapsed time every 64 iterations
+                if((spincnt & 63) == 0)
+                {
+                    clock_gettime(CLOCK_MONOTONIC, &t1);
+                    if((t1.tv_sec - t0.tv_sec) * 1000000000L +
+                            (t1.tv_nsec - t0.tv_nsec) >
+                            processinfo->triggerspin_ns)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if(*cnt0ptr == processinfo->triggerstreamcnt)
+        {
+            struct timespec tdeadline, tnow;
+            long            timeout_ns;
+            sem_t          *sem = NULL;
+
+            if(processinfo->triggersem != -1)
+            {
+                sem = data.image[processinfo->triggerstreamID]
+                      .semptr[processinfo->triggersem];
+                // discard earlier posts : updates are counted from cnt0,
+                // which writers increment before posting
+                while(sem_trywait(sem) == 0)
+                {
+                }
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &tnow);
+            tdeadline.tv_sec =
+                tnow.tv_sec + processinfo->triggertimeout.tv_sec;
+            tdeadline.tv_nsec =
+                tnow.tv_nsec + processinfo->triggertimeout.tv_nsec;
+
+            while(*cnt0ptr == processinfo->triggerstreamcnt)
+            {
+                timeout_ns = (tdeadline.tv_sec - tnow.tv_sec) * 1000000000L +
+                             (tdeadline.tv_nsec - tnow.tv_nsec);
+                if(timeout_ns <= 0)
+                {
+                    // timeout condition
+                    processinfo->trigggertimeoutcnt++;
+                    tmpstatus = PROCESSINFO_TRIGGERSTATUS_TIMEDOUT;
+                    break;
+                }
+
+                if(sem != NULL)
+                {
+                    if(timeout_ns > PROCESSINFO_TRIGGER_SEMSLICE_NS)
+                    {
+                        timeout_ns = PROCESSINFO_TRIGGER_SEMSLICE_NS;
+                    }
+
+                    struct timespec ts;
+                    clock_gettime(CLOCK_REALTIME, &ts);
+                    ts.tv_nsec += timeout_ns;
+                    while(ts.tv_nsec >= 1000000000L)
+                    {
+                        ts.tv_nsec -= 1000000000L;
+                        ts.tv_sec++;
+                    }
+                    sem_timedwait(sem, &ts);
+                }
+                else
+                {
+                    if(timeout_ns > PROCESSINFO_TRIGGER_FUTEXSLICE_NS)
+                    {
+                        timeout_ns = PROCESSINFO_TRIGGER_FUTEXSLICE_NS;
+                    }
+
+                    struct timespec tslice;
+                    tslice.tv_sec  = 0;
+                    tslice.tv_nsec = timeout_ns;
+
+                    // returns immediately if cnt0 low half has changed
+                    processinfo_triggerstream_waitbegin(
+                        &data.image[processinfo->triggerstreamID]);
+                    syscall(SYS_futex,
+                            futexword,
+                            FUTEX_WAIT,
+                            (uint32_t) processinfo->triggerstreamcnt,
+                            &tslice,
+                            NULL,
+                            0);
+                    processinfo_triggerstream_waitend(
+                        &data.image[processinfo->triggerstreamID]);
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &tnow);
+            }
+        }
+
+        if(tmpstatus == PROCESSINFO_TRIGGERSTATUS_RECEIVED)
+        {
+            processinfo->triggermissedframe =
+                *cnt0ptr - processinfo->triggerstreamcnt - 1;
+            // update trigger counter
+            processinfo->triggerstreamcnt = *cnt0ptr;
+
+            processinfo->triggermissedframe_cumul +=
+                processinfo->triggermissedframe;
+
+            trigger_measure_wakeup(processinfo);
+        }
+        processinfo->triggerstatus = tmpstatus;
+
+        return RETURN_SUCCESS;
+    }
+
     if(processinfo->triggermode == PROCESSINFO_TRIGGERMODE_DELAY)
     {
         // return after fixed delay
@@ -237,7 +568,7 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
         int semr;
         int tmpstatus = PROCESSINFO_TRIGGERSTATUS_RECEIVED;
 
-        DEBUG_TRACEPOINT("wait on semaphore");
+        TRACEPOINT_FAST("wait on semaphore");
 
         processinfo->triggerstatus = PROCESSINFO_TRIGGERSTATUS_WAITING;
 
@@ -250,13 +581,13 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
         }
 
         // is semaphore at zero ?
-        DEBUG_TRACEPOINT("test sem status");
+        TRACEPOINT_FAST("test sem status");
         semr = 0;
         while(semr == 0)
         {
             // this should only run once, returning semr = -1 with errno = EAGAIN
             // otherwise, we're potentially missing frames
-            DEBUG_TRACEPOINT("sem_trywait %ld", processinfo->triggerstreamID);
+            TRACEPOINT_FAST("sem_trywait %ld", processinfo->triggerstreamID);
             semr = sem_trywait(data.image[processinfo->triggerstreamID]
                                .semptr[processinfo->triggersem]);
             if(semr == 0)
@@ -267,11 +598,11 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
 
         // expected state: NBmissedframe = 0, semr = -1, errno = EAGAIN
         // missed frame state: NBmissedframe>0, semr = -1, errno = EAGAIN
-        DEBUG_TRACEPOINT("triggermissedframe = %d",
-                         processinfo->triggermissedframe);
+        TRACEPOINT_FAST("triggermissedframe = %d",
+                        processinfo->triggermissedframe);
         if(processinfo->triggermissedframe == 0)
         {
-            DEBUG_TRACEPOINT("timedwait");
+            TRACEPOINT_FAST("timedwait");
             // add timeout
             ts.tv_sec += processinfo->triggertimeout.tv_sec;
             ts.tv_nsec += processinfo->triggertimeout.tv_nsec;
@@ -307,6 +638,10 @@ errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo)
         processinfo->triggermissedframe_cumul +=
             processinfo->triggermissedframe;
 
+        if(tmpstatus == PROCESSINFO_TRIGGERSTATUS_RECEIVED)
+        {
+            trigger_measure_wakeup(processinfo);
+        }
         processinfo->triggerstatus = tmpstatus;
 
         return RETURN_SUCCESS;
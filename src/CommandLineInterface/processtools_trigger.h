@@ -26,6 +26,22 @@
 // trigger after a time delay
 #define PROCESSINFO_TRIGGERMODE_DELAY 4
 
+// trigger when cnt0 increments, spin then sleep on stream semaphore,
+// or on cnt0 futex if no semaphore is available
+#define PROCESSINFO_TRIGGERMODE_FUTEX 5
+
+// max time in a single futex wait on cnt0 [ns]
+// bounds wake-up latency if writer does not call processinfo_triggerstream_wake
+#define PROCESSINFO_TRIGGER_FUTEXSLICE_NS 100000
+
+// max time in a single wait that includes a stream semaphore [ns]
+// semaphores are posted by ImageStreamIO writers : only bounds latency
+// for writers incrementing cnt0 without posting
+#define PROCESSINFO_TRIGGER_SEMSLICE_NS 1000000
+
+// number of futex waiter counters, shared by all streams (hashed by inode)
+#define PROCESSINFO_TRIGGER_FUTEXWAIT_NBSLOT 4096
+
 // trigger is currently waiting for input
 #define PROCESSINFO_TRIGGERSTATUS_WAITING 1
 
@@ -44,6 +60,12 @@ errno_t processinfo_waitoninputstream_init(PROCESSINFO *processinfo,
 
 errno_t processinfo_waitoninputstream(PROCESSINFO *processinfo);
 
+errno_t processinfo_triggerstream_waitbegin(IMAGE *image);
+
+errno_t processinfo_triggerstream_waitend(IMAGE *image);
+
+errno_t processinfo_triggerstream_wake(IMAGE *image);
+
 #define PROCINFO_TRIGGER_DELAYUS(delayus)                                      \
     do                                                                         \
     {                                                                          \
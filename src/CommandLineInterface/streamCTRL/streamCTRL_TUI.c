@@ -57,6 +57,7 @@ typedef int errno_t;
     data.shmdir /**< default location of file mapped semaphores, can be over-ridden by env variable MILK_SHM_DIR */
 
 #include "streamCTRL_TUI.h"
+#include "streamCTRL_shmusers.h"
 
 #include "TUItools.h"
 
@@ -421,6 +422,10 @@ void *streamCTRL_scan(void *argptr)
 
     streaminfoproc->loopcnt = 0;
 
+    // processes mapping streams, kept across scans
+    SHMUSERS_MAP shmusers;
+    memset(&shmusers, 0, sizeof(SHMUSERS_MAP));
+
     // if set, write file list to file on first scan
     //int WriteFlistToFile = 1;
 
@@ -782,140 +787,28 @@ void *streamCTRL_scan(void *argptr)
 
         if(streaminfoproc->fuserUpdate == 1)
         {
-            FILE *fp;
-            int   STRINGMAXLEN_LINE = 2000;
-            char  plistoutline[STRINGMAXLEN_LINE];
-            char  command[STRINGMAXLEN_COMMAND];
-
-            int NBpid = 0;
+            // single pass over /proc/*/maps, then resolve all streams
+            shmusers_scan(&shmusers);
 
-            //            sindexscan1 = ssindex[sindexscan];
-            int sindexscan1 = streaminfoproc->sindexscan;
-
-            if(streaminfoproc->sindexscan > NBsindex - 1)
-            {
-                streaminfoproc->fuserUpdate = 0;
-            }
-            else
+            for(int sindexscan1 = 0; sindexscan1 < NBsindex; sindexscan1++)
             {
-                int PReadMode = 1;
+                char shmfname[STRINGMAXLEN_FULLFILENAME];
+                WRITE_FULLFILENAME(shmfname,
+                                   "%s/%s.im.shm",
+                                   SHAREDSHMDIR,
+                                   streaminfo[sindexscan1].sname);
 
-                if(PReadMode == 0)
+                int NBpid = shmusers_find(&shmusers,
+                                          shmfname,
+                                          streaminfo[sindexscan1].streamOpenPID,
+                                          streamOpenNBpid_MAX);
+                if(NBpid < 0)
                 {
-                    // popen option
-                    {
-                        int slen = snprintf(command,
-                                            STRINGMAXLEN_COMMAND,
-                                            "/bin/fuser %s/%s.im.shm "
-                                            "2>/dev/null",
-                                            SHAREDSHMDIR,
-                                            streaminfo[sindexscan1].sname);
-                        if(slen < 1)
-                        {
-                            PRINT_ERROR("snprintf wrote <1 char");
-                            abort(); // can't handle this error any other way
-                        }
-                        if(slen >= STRINGMAXLEN_COMMAND)
-                        {
-                            PRINT_ERROR(
-                                "snprintf string "
-                                "truncation");
-                            abort(); // can't handle this error any other way
-                        }
-                    }
-
-                    fp = popen(command, "r");
-                    if(fp == NULL)
-                    {
-                        streaminfo[sindexscan1].streamOpenPID_status =
-                            2; // failed
-                    }
-                    else
-                    {
-                        streaminfo[sindexscan1].streamOpenPID_status = 1;
-
-                        if(fgets(plistoutline, STRINGMAXLEN_LINE - 1, fp) ==
-                                NULL)
-                        {
-                            snprintf(plistoutline, STRINGMAXLEN_LINE, " ");
-                        }
-                        pclose(fp);
-                    }
+                    streaminfo[sindexscan1].streamOpenPID_status = 2; // failed
+                    NBpid                                        = 0;
                 }
                 else
                 {
-                    // filesystem option
-                    char plistfname[STRINGMAXLEN_FULLFILENAME];
-                    WRITE_FULLFILENAME(plistfname,
-                                       "%s/%s.shmplist",
-                                       SHAREDSHMDIR,
-                                       streaminfo[sindexscan1].sname);
-
-                    {
-                        int slen = snprintf(command,
-                                            STRINGMAXLEN_COMMAND,
-                                            "/bin/fuser %s/%s.im.shm "
-                                            "2>/dev/null > %s",
-                                            SHAREDSHMDIR,
-                                            streaminfo[sindexscan1].sname,
-                                            plistfname);
-                        if(slen < 1)
-                        {
-                            PRINT_ERROR("snprintf wrote <1 char");
-                            abort(); // can't handle this error any other way
-                        }
-                        if(slen >= STRINGMAXLEN_COMMAND)
-                        {
-                            PRINT_ERROR(
-                                "snprintf string "
-                                "truncation");
-                            abort(); // can't handle this error any other way
-                        }
-                    }
-
-                    if(system(command) == -1)
-                    {
-                        perror("Command system() failed");
-                        exit(EXIT_FAILURE);
-                    }
-
-                    fp = fopen(plistfname, "r");
-                    if(fp == NULL)
-                    {
-                        streaminfo[sindexscan1].streamOpenPID_status = 2;
-                    }
-                    else
-                    {
-                        if(fgets(plistoutline, STRINGMAXLEN_LINE - 1, fp) ==
-                                NULL)
-                        {
-                            snprintf(plistoutline, STRINGMAXLEN_LINE, " ");
-                        }
-
-                        fclose(fp);
-                    }
-                }
-
-                if(streaminfo[sindexscan1].streamOpenPID_status != 2)
-                {
-                    char *pch;
-
-                    pch = strtok(plistoutline, " ");
-
-                    while(pch != NULL)
-                    {
-                        if(NBpid < streamOpenNBpid_MAX)
-                        {
-                            streaminfo[sindexscan1].streamOpenPID[NBpid] =
-                                atoi(pch);
-                            if(getpgid(streaminfo[sindexscan1]
-                                       .streamOpenPID[NBpid]) >= 0)
-                            {
-                                NBpid++;
-                            }
-                        }
-                        pch = strtok(NULL, " ");
-                    }
                     streaminfo[sindexscan1].streamOpenPID_status = 1; // success
                 }
 
@@ -945,8 +838,9 @@ void *streamCTRL_scan(void *argptr)
                 }
                 streaminfo[sindexscan1].streamOpenPID_cnt1 = cnt1;
 
-                streaminfoproc->sindexscan++;
+                streaminfoproc->sindexscan = sindexscan1 + 1;
             }
+            streaminfoproc->fuserUpdate = 0;
         }
 
         streaminfoproc->fuserUpdate0 = 0;
@@ -959,6 +853,8 @@ void *streamCTRL_scan(void *argptr)
         scancnt++;
     }
 
+    shmusers_free(&shmusers);
+
     return NULL;
 }
 
@@ -1263,6 +1159,13 @@ static errno_t streamCTRL_print_SPTRACE_details(
                             "DELA");
                 break;
 
+            case PROCESSINFO_TRIGGERMODE_FUTEX:
+                TUI_printfw("%d%*s",
+                            streamCTRLimages[ID].streamproctrace[spti].triggermode,
+                            Disp_type_NBchar - 1,
+                            "FUTX");
+                break;
+
             default:
                 TUI_printfw("%d%*s",
                             streamCTRLimages[ID].streamproctrace[spti].triggermode,
@@ -2641,6 +2544,10 @@ errno_t streamCTRL_CTRLscreen()
                                     snprintf(string, stringlen, "(%7lu DL ", inode);
                                     break;
 
+                                case PROCESSINFO_TRIGGERMODE_FUTEX:
+                                    snprintf(string, stringlen, "(%7lu FX ", inode);
+                                    break;
+
                                 default:
                                     snprintf(string, stringlen, "(%7lu ?? ", inode);
                                     break;
@@ -0,0 +1,385 @@
+/**
+ * @file streamCTRL_shmusers.c
+ * @brief find processes mapping shared memory streams
+ *
+ * Replaces one fuser call per stream by a single pass over /proc/<pid>/maps.
+ * Mapped .im.shm inodes are collected for each process and merged in an
+ * inode -> PID table, from which all streams are resolved.
+ *
+ * Process entries are kept between scans : maps files are only read for
+ * new processes (PID not seen before, or PID reused as detected by start
+ * time), and for entries older than SHMUSERS_MAXAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "streamCTRL_shmusers.h"
+
+
+
+static int cmp_proc_pid(const void *p1, const void *p2)
+{
+    pid_t pid1 = ((const SHMUSERS_PROC *) p1)->pid;
+    pid_t pid2 = ((const SHMUSERS_PROC *) p2)->pid;
+
+    return (pid1 > pid2) - (pid1 < pid2);
+}
+
+static int cmp_inodepid(const void *p1, const void *p2)
+{
+    const SHMUSERS_INODEPID *ip1 = (const SHMUSERS_INODEPID *) p1;
+    const SHMUSERS_INODEPID *ip2 = (const SHMUSERS_INODEPID *) p2;
+
+    if(ip1->inode != ip2->inode)
+    {
+        return (ip1->inode > ip2->inode) ? 1 : -1;
+    }
+    return (ip1->pid > ip2->pid) - (ip1->pid < ip2->pid);
+}
+
+
+
+/**
+ * @brief Read process start time from /proc/<pid>/stat
+ *
+ * Start time is field 22, counted from the last ')' as process name may
+ * contain spaces.
+ *
+ * @return 0 if OK, -1 if process does not exist
+ */
+static int read_starttime(pid_t pid, unsigned long long *starttime)
+{
+    char fname[64];
+    char buff[1024];
+
+    snprintf(fname, sizeof(fname), "/proc/%d/stat", (int) pid);
+    int fd = open(fname, O_RDONLY);
+    if(fd == -1)
+    {
+        return -1;
+    }
+    ssize_t nbread = read(fd, buff, sizeof(buff) - 1);
+    close(fd);
+    if(nbread <= 0)
+    {
+        return -1;
+    }
+    buff[nbread] = '\0';
+
+    char *ptr = strrchr(buff, ')');
+    if(ptr == NULL)
+    {
+        return -1;
+    }
+
+    // ptr at end of field 2
+    int field = 2;
+    while((*ptr != '\0') && (field < 22))
+    {
+        ptr++;
+        if(*ptr == ' ')
+        {
+            field++;
+        }
+    }
+    if(*ptr == '\0')
+    {
+        return -1;
+    }
+    *starttime = strtoull(ptr + 1, NULL, 10);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Collect inodes of .im.shm files mapped by process
+ *
+ * Processes which maps cannot be read (permissions, exited) get an empty
+ * list.
+ */
+static int read_maps(SHMUSERS_PROC *proc)
+{
+    // reused across calls
+    static char  *line      = NULL;
+    static size_t maxstrlen = 0;
+
+    char fname[64];
+    int  NBinodealloc = 0;
+
+    proc->NBinode = 0;
+    proc->inode   = NULL;
+
+    snprintf(fname, sizeof(fname), "/proc/%d/maps", (int) proc->pid);
+    FILE *fp = fopen(fname, "r");
+    if(fp == NULL)
+    {
+        return -1;
+    }
+
+    while(getline(&line, &maxstrlen, fp) != -1)
+    {
+        if(strstr(line, ".im.shm") == NULL)
+        {
+            continue;
+        }
+
+        // address perms offset dev inode pathname
+        unsigned long inode;
+        if(sscanf(line, "%*s %*s %*s %*s %lu", &inode) != 1)
+        {
+            continue;
+        }
+        if(inode == 0)
+        {
+            continue;
+        }
+
+        // file usually mapped once, but check
+        int known = 0;
+        for(int i = 0; i < proc->NBinode; i++)
+        {
+            if(proc->inode[i] == (ino_t) inode)
+            {
+                known = 1;
+                break;
+            }
+        }
+        if(known == 1)
+        {
+            continue;
+        }
+
+        if(proc->NBinode == NBinodealloc)
+        {
+            NBinodealloc = 2 * NBinodealloc + 4;
+            ino_t *inodeptr =
+                (ino_t *) realloc(proc->inode, sizeof(ino_t) * NBinodealloc);
+            if(inodeptr == NULL)
+            {
+                break;
+            }
+            proc->inode = inodeptr;
+        }
+        proc->inode[proc->NBinode] = (ino_t) inode;
+        proc->NBinode++;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Update process list and inode -> PID table
+ *
+ * @return number of processes
+ */
+int shmusers_scan(SHMUSERS_MAP *map)
+{
+    struct timespec t0;
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    double tnow = 1.0 * t0.tv_sec + 1.0e-9 * t0.tv_nsec;
+
+    DIR *d = opendir("/proc");
+    if(d == NULL)
+    {
+        return -1;
+    }
+
+    long           NBprocalloc = map->NBproc + 256;
+    long           NBproc      = 0;
+    SHMUSERS_PROC *proc =
+        (SHMUSERS_PROC *) malloc(sizeof(SHMUSERS_PROC) * NBprocalloc);
+    if(proc == NULL)
+    {
+        closedir(d);
+        return -1;
+    }
+
+    map->NBprocread = 0;
+
+    struct dirent *dir;
+    while((dir = readdir(d)) != NULL)
+    {
+        if(!isdigit(dir->d_name[0]))
+        {
+            continue;
+        }
+
+        SHMUSERS_PROC key;
+        key.pid = atoi(dir->d_name);
+
+        unsigned long long starttime;
+        if(read_starttime(key.pid, &starttime) != 0)
+        {
+            // process has exited
+            continue;
+        }
+
+        if(NBproc == NBprocalloc)
+        {
+            NBprocalloc *= 2;
+            SHMUSERS_PROC *procptr = (SHMUSERS_PROC *) realloc(
+                                         proc,
+                                         sizeof(SHMUSERS_PROC) * NBprocalloc);
+            if(procptr == NULL)
+            {
+                break;
+            }
+            proc = procptr;
+        }
+
+        SHMUSERS_PROC *procold = NULL;
+        if(map->NBproc > 0)
+        {
+            procold = (SHMUSERS_PROC *) bsearch(&key,
+                                                map->proc,
+                                                map->NBproc,
+                                                sizeof(SHMUSERS_PROC),
+                                                cmp_proc_pid);
+        }
+
+        if((procold != NULL) && (procold->starttime == starttime) &&
+                (tnow - procold->tscan < SHMUSERS_MAXAGE))
+        {
+            // known process, move entry to new list
+            proc[NBproc]   = *procold;
+            procold->inode = NULL;
+        }
+        else
+        {
+            proc[NBproc].pid       = key.pid;
+            proc[NBproc].starttime = starttime;
+            proc[NBproc].tscan     = tnow;
+            read_maps(&proc[NBproc]);
+            map->NBprocread++;
+        }
+        NBproc++;
+    }
+    closedir(d);
+
+    // entries of exited processes
+    for(long i = 0; i < map->NBproc; i++)
+    {
+        free(map->proc[i].inode);
+    }
+    free(map->proc);
+
+    qsort(proc, NBproc, sizeof(SHMUSERS_PROC), cmp_proc_pid);
+    map->proc   = proc;
+    map->NBproc = NBproc;
+
+    // build inode -> PID table
+    long NBinodepid = 0;
+    for(long i = 0; i < NBproc; i++)
+    {
+        NBinodepid += proc[i].NBinode;
+    }
+    free(map->inodepid);
+    map->inodepid   = (SHMUSERS_INODEPID *) malloc(
+                          sizeof(SHMUSERS_INODEPID) * (NBinodepid + 1));
+    map->NBinodepid = 0;
+    if(map->inodepid != NULL)
+    {
+        for(long i = 0; i < NBproc; i++)
+        {
+            for(int j = 0; j < proc[i].NBinode; j++)
+            {
+                map->inodepid[map->NBinodepid].inode = proc[i].inode[j];
+                map->inodepid[map->NBinodepid].pid   = proc[i].pid;
+                map->NBinodepid++;
+            }
+        }
+        qsort(map->inodepid,
+              map->NBinodepid,
+              sizeof(SHMUSERS_INODEPID),
+              cmp_inodepid);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    map->dtscan = 1.0 * (t1.tv_sec - t0.tv_sec) +
+                  1.0e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+    return NBproc;
+}
+
+
+
+/**
+ * @brief List processes mapping file fname
+ *
+ * Uses table built by last shmusers_scan call.
+ *
+ * @return number of PIDs written to pidarray, -1 if file cannot be accessed
+ */
+int shmusers_find(SHMUSERS_MAP *map,
+                  const char   *fname,
+                  pid_t        *pidarray,
+                  int           NBpidmax)
+{
+    struct stat file_stat;
+
+    if(stat(fname, &file_stat) != 0)
+    {
+        return -1;
+    }
+
+    // first entry with inode
+    long i0 = 0;
+    long i1 = map->NBinodepid;
+    while(i0 < i1)
+    {
+        long imid = (i0 + i1) / 2;
+        if(map->inodepid[imid].inode < file_stat.st_ino)
+        {
+            i0 = imid + 1;
+        }
+        else
+        {
+            i1 = imid;
+        }
+    }
+
+    int NBpid = 0;
+    while((i0 < map->NBinodepid) &&
+            (map->inodepid[i0].inode == file_stat.st_ino) && (NBpid < NBpidmax))
+    {
+        pidarray[NBpid] = map->inodepid[i0].pid;
+        NBpid++;
+        i0++;
+    }
+
+    return NBpid;
+}
+
+
+
+void shmusers_free(SHMUSERS_MAP *map)
+{
+    for(long i = 0; i < map->NBproc; i++)
+    {
+        free(map->proc[i].inode);
+    }
+    free(map->proc);
+    free(map->inodepid);
+
+    map->proc       = NULL;
+    map->NBproc     = 0;
+    map->inodepid   = NULL;
+    map->NBinodepid = 0;
+}
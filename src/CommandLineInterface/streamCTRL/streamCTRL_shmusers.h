@@ -0,0 +1,53 @@
+/**
+ * @file streamCTRL_shmusers.h
+ * @brief find processes mapping shared memory streams
+ *
+ */
+
+#ifndef _STREAMCTRL_SHMUSERS_H
+#define _STREAMCTRL_SHMUSERS_H
+
+#include <sys/types.h>
+
+// cached process maps older than this are re-read [s]
+#define SHMUSERS_MAXAGE 10.0
+
+typedef struct
+{
+    pid_t              pid;
+    unsigned long long starttime; // from /proc/<pid>/stat, detects PID reuse
+    double             tscan;     // time at which maps were read
+
+    int    NBinode;
+    ino_t *inode; // inodes of mapped .im.shm files
+} SHMUSERS_PROC;
+
+typedef struct
+{
+    ino_t inode;
+    pid_t pid;
+} SHMUSERS_INODEPID;
+
+typedef struct
+{
+    long           NBproc;
+    SHMUSERS_PROC *proc; // sorted by PID
+
+    long               NBinodepid;
+    SHMUSERS_INODEPID *inodepid; // sorted by inode
+
+    // last scan statistics
+    long   NBprocread; // number of maps files read
+    double dtscan;     // scan time [s]
+} SHMUSERS_MAP;
+
+int shmusers_scan(SHMUSERS_MAP *map);
+
+int shmusers_find(SHMUSERS_MAP *map,
+                  const char   *fname,
+                  pid_t        *pidarray,
+                  int           NBpidmax);
+
+void shmusers_free(SHMUSERS_MAP *map);
+
+#endif
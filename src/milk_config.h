@@ -0,0 +1,5 @@
+#define PROJECT_NAME "milk"
+#define VERSION_MAJOR 1
+#define VERSION_MINOR 03
+#define VERSION_PATCH 00
+#define VERSION_OPTION ""
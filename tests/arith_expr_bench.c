@@ -0,0 +1,264 @@
+/**
+ * @file    arith_expr_bench.c
+ * @brief   benchmark compiled arithmetic expressions
+ *
+ * For each test expression, checks that the compiled path gives the same
+ * result as the legacy execute_arith path, and measures throughput
+ * [Mpix/s] for both paths.
+ * Legacy float results are rounded at every operation, so float outputs
+ * are compared with a relative tolerance.
+ * Images are deleted on exit.
+ */
+
+#include <math.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "COREMOD_arith/arith_expr.h"
+#include "COREMOD_arith/execute_arith.h"
+
+// variables local to this translation unit
+static uint32_t *imsize;
+static uint32_t *NBiter;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".size",
+        "image size (square)",
+        "1024",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBiter",
+        "iterations per measurement",
+        "10",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBiter,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imexprbench",
+                                "benchmark compiled arithmetic expressions",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+static errno_t help_function()
+{
+    printf("Evaluates test expressions on images _iexa (float), _iexb "
+           "(float),\n_iexc (uint16) and _iexd (double) with and without "
+           "expression compilation\n");
+    return RETURN_SUCCESS;
+}
+
+static imageID mkbenchimage(const char *name,
+                            uint8_t     datatype,
+                            uint32_t    size,
+                            long        modulo,
+                            double      offset)
+{
+    imageID  ID;
+    uint32_t naxes[2] = {size, size};
+
+    delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+    create_image_ID(name, 2, naxes, datatype, 0, 0, 0, &ID);
+
+    for(long ii = 0; ii < (long) size * size; ii++)
+    {
+        double v = offset + 1.0 * (ii % modulo) / modulo;
+        switch(datatype)
+        {
+        case _DATATYPE_FLOAT:
+            data.image[ID].array.F[ii] = v;
+            break;
+        case _DATATYPE_DOUBLE:
+            data.image[ID].array.D[ii] = v;
+            break;
+        case _DATATYPE_UINT16:
+            data.image[ID].array.UI16[ii] = ii % modulo;
+            break;
+        }
+    }
+    return ID;
+}
+
+/** @brief Run expression nbiter times, return throughput [Mpix/s]
+ */
+static double expr_Mpixs(const char *expr, long nelement, uint32_t nbiter)
+{
+    struct timespec t0, t1;
+
+    milk_clock_gettime(&t0);
+    for(uint32_t iter = 0; iter < nbiter; iter++)
+    {
+        execute_arith(expr);
+    }
+    milk_clock_gettime(&t1);
+
+    return 1.0e-6 * nelement * nbiter / timespec_diff_double(t0, t1);
+}
+
+/** @brief Largest difference between images, relative to value
+ *
+ * @return -1 if images have different type or size
+ */
+static double expr_maxdiff(const char *name0, const char *name1)
+{
+    imageID ID0 = image_ID(name0);
+    imageID ID1 = image_ID(name1);
+    double  dmax = 0.0;
+
+    if((ID0 == -1) || (ID1 == -1) ||
+            (data.image[ID0].md[0].datatype != data.image[ID1].md[0].datatype) ||
+            (data.image[ID0].md[0].nelement != data.image[ID1].md[0].nelement))
+    {
+        return -1.0;
+    }
+
+    for(uint64_t ii = 0; ii < data.image[ID0].md[0].nelement; ii++)
+    {
+        double v0, v1;
+
+        if(data.image[ID0].md[0].datatype == _DATATYPE_DOUBLE)
+        {
+            v0 = data.image[ID0].array.D[ii];
+            v1 = data.image[ID1].array.D[ii];
+        }
+        else
+        {
+            v0 = data.image[ID0].array.F[ii];
+            v1 = data.image[ID1].array.F[ii];
+        }
+        double d = fabs(v1 - v0) / (1.0 + fabs(v0));
+        if(!(d <= dmax))
+        {
+            dmax = d;
+        }
+    }
+    return dmax;
+}
+
+static errno_t arith_expr_bench(uint32_t size, uint32_t nbiter)
+{
+    DEBUG_TRACE_FSTART();
+
+    // %s is output name
+    const char *exprtable[] =
+    {
+        "%s=(_iexa+_iexb)*_iexc-_iexa/_iexb",
+        "%s=sqrt(_iexa)*_iexb+exp(_iexb)-2.5*_iexc",
+        "%s=max(_iexa,_iexb)/min(_iexb,0.8)+fmod(_iexc,7)",
+        "%s=trunc(_iexa*_iexb,0.9,1.7)+testlt(_iexb,1.0)*3",
+        "%s=_iexa^2+_iexb^3-_iexd*_iexa",
+        "%s=fabs(_iexa-1.5)*(_iexb+_iexd)-ln(_iexc+1)",
+        "%s=2*3+1/4"
+    };
+    int NBexpr = sizeof(exprtable) / sizeof(exprtable[0]);
+
+    int  exprenable = arith_expr_get_enable();
+    long nelement;
+
+    if(size == 0)
+    {
+        size = 1;
+    }
+    if(nbiter == 0)
+    {
+        nbiter = 1;
+    }
+    nelement = (long) size * size;
+
+    mkbenchimage("_iexa", _DATATYPE_FLOAT, size, 1000, 1.0);
+    mkbenchimage("_iexb", _DATATYPE_FLOAT, size, 7, 0.5);
+    mkbenchimage("_iexc", _DATATYPE_UINT16, size, 100, 0.0);
+    mkbenchimage("_iexd", _DATATYPE_DOUBLE, size, 13, 0.25);
+
+    for(int iexpr = 0; iexpr < NBexpr; iexpr++)
+    {
+        char expr0[STRINGMAXLEN_COMMAND];
+        char expr1[STRINGMAXLEN_COMMAND];
+
+        snprintf(expr0, STRINGMAXLEN_COMMAND, exprtable[iexpr], "_iexout0");
+        snprintf(expr1, STRINGMAXLEN_COMMAND, exprtable[iexpr], "_iexout1");
+
+        // check compiled output against legacy output
+        arith_expr_set_enable(0);
+        execute_arith(expr0);
+        arith_expr_set_enable(1);
+        execute_arith(expr1);
+
+        if(variable_ID("_iexout0") != -1)
+        {
+            double v0 = data.variable[variable_ID("_iexout0")].value.f;
+            double v1 = -v0;
+            if(variable_ID("_iexout1") != -1)
+            {
+                v1 = data.variable[variable_ID("_iexout1")].value.f;
+            }
+            if(v0 != v1)
+            {
+                PRINT_WARNING("compiled result mismatch for %s : %g %g",
+                              exprtable[iexpr],
+                              v0,
+                              v1);
+            }
+            continue;
+        }
+
+        {
+            double dmax = expr_maxdiff("_iexout0", "_iexout1");
+            if((dmax < 0.0) || (dmax > 1.0e-5))
+            {
+                PRINT_WARNING("compiled result mismatch for %s : %g",
+                              exprtable[iexpr],
+                              dmax);
+            }
+        }
+
+        arith_expr_set_enable(0);
+        double legacyMpixs = expr_Mpixs(expr0, nelement, nbiter);
+        arith_expr_set_enable(1);
+        double exprMpixs = expr_Mpixs(expr1, nelement, nbiter);
+
+        printf("%-54s  legacy %8.1f  compiled %8.1f Mpix/s  speedup %6.2f\n",
+               exprtable[iexpr],
+               legacyMpixs,
+               exprMpixs,
+               exprMpixs / legacyMpixs);
+        fflush(stdout);
+    }
+
+    arith_expr_set_enable(exprenable);
+
+    delete_image_ID("_iexa", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_iexb", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_iexc", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_iexd", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_iexout0", DELETE_IMAGE_ERRMODE_IGNORE);
+    delete_image_ID("_iexout1", DELETE_IMAGE_ERRMODE_IGNORE);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return arith_expr_bench(*imsize, *NBiter);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__arith_expr_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    arith_expr_bench.h
+ */
+
+#ifndef MILK_TESTS_ARITH_EXPR_BENCH_H
+#define MILK_TESTS_ARITH_EXPR_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__arith_expr_bench();
+
+#endif
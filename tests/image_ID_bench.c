@@ -0,0 +1,164 @@
+/**
+ * @file    image_ID_bench.c
+ * @brief   benchmark image name lookup
+ *
+ * Creates up to NBimage 1x1 images named _imIDbench_XXXXX and measures
+ * lookup time [ns] of image_ID() (hash index) against image_ID_linearscan(),
+ * for hits and misses, at table sizes 16, 32, ... NBimage. A miss in the
+ * index falls back to a linear scan, so only hits are expected to be faster.
+ * Images are deleted on exit.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/CLIcore/CLIcore_memory.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/create_image.h"
+#include "COREMOD_memory/delete_image.h"
+#include "COREMOD_memory/image_ID.h"
+
+// variables local to this translation unit
+static uint32_t *NBimage;
+static uint32_t *NBlookup;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".NBimage",
+        "max number of images",
+        "4096",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBimage,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBlookup",
+        "lookups per measurement",
+        "100000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBlookup,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imIDbench",
+                                "benchmark image name lookup",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+/** @brief Average lookup time [ns]
+ *
+ * hit = 1 : look up existing names, hit = 0 : names that do not exist
+ */
+static double lookup_time_ns(imageID (*lookupfunc)(const char *),
+                             uint32_t nbim,
+                             uint32_t nblookup,
+                             int      hit)
+{
+    char            name[STRINGMAXLEN_IMAGE_NAME];
+    struct timespec t0, t1;
+    long            nbfound = 0;
+    unsigned int    seed    = 1;
+
+    milk_clock_gettime(&t0);
+    for(uint32_t i = 0; i < nblookup; i++)
+    {
+        int k = rand_r(&seed) % nbim;
+        snprintf(name,
+                 STRINGMAXLEN_IMAGE_NAME,
+                 hit ? "_imIDbench_%05d" : "_imIDbench_miss_%05d",
+                 k);
+        if(lookupfunc(name) != -1)
+        {
+            nbfound++;
+        }
+    }
+    milk_clock_gettime(&t1);
+
+    if(nbfound != (hit ? (long) nblookup : 0))
+    {
+        PRINT_WARNING("lookup returned wrong result (%ld / %u found)",
+                      nbfound,
+                      nblookup);
+    }
+
+    return 1.0e9 * timespec_diff_double(t0, t1) / nblookup;
+}
+
+static errno_t image_ID_bench(uint32_t nbimmax, uint32_t nblookup)
+{
+    DEBUG_TRACE_FSTART();
+
+    char     name[STRINGMAXLEN_IMAGE_NAME];
+    uint32_t size[2]   = {1, 1};
+    uint32_t nbim      = 0;
+    uint32_t nbimcheck = 16;
+
+    if(nblookup == 0)
+    {
+        nblookup = 1;
+    }
+
+    printf("%8s  %12s  %12s  %12s  %12s\n",
+           "NBimage",
+           "hit [ns]",
+           "hit scan",
+           "miss [ns]",
+           "miss scan");
+
+    while(nbim < nbimmax)
+    {
+        snprintf(name, STRINGMAXLEN_IMAGE_NAME, "_imIDbench_%05u", nbim);
+        FUNC_CHECK_RETURN(
+            create_image_ID(name, 2, size, _DATATYPE_FLOAT, 0, 0, 0, NULL));
+        nbim++;
+
+        // grow image table as needed, as the CLI does between commands
+        FUNC_CHECK_RETURN(memory_re_alloc());
+
+        if((nbim == nbimcheck) || (nbim == nbimmax))
+        {
+            // scan cost grows with table size, keep its run time bounded
+            uint32_t nblookupscan = nblookup / (1 + nbim / 64);
+            if(nblookupscan < 100)
+            {
+                nblookupscan = 100;
+            }
+
+            printf("%8u  %12.1f  %12.1f  %12.1f  %12.1f\n",
+                   nbim,
+                   lookup_time_ns(image_ID, nbim, nblookup, 1),
+                   lookup_time_ns(image_ID_linearscan, nbim, nblookupscan, 1),
+                   lookup_time_ns(image_ID, nbim, nblookup, 0),
+                   lookup_time_ns(image_ID_linearscan, nbim, nblookupscan, 0));
+            fflush(stdout);
+
+            nbimcheck *= 2;
+        }
+    }
+
+    for(uint32_t i = 0; i < nbim; i++)
+    {
+        snprintf(name, STRINGMAXLEN_IMAGE_NAME, "_imIDbench_%05u", i);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return image_ID_bench(*NBimage, *NBlookup);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__image_ID_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
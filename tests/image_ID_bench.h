@@ -0,0 +1,10 @@
+/**
+ * @file    image_ID_bench.h
+ */
+
+#ifndef MILK_TESTS_IMAGE_ID_BENCH_H
+#define MILK_TESTS_IMAGE_ID_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__image_ID_bench();
+
+#endif
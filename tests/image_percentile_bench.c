@@ -0,0 +1,279 @@
+/**
+ * @file    image_percentile_bench.c
+ * @brief   validate and benchmark percentile engine
+ *
+ * For each data type, checks that percentiles obtained by selection or
+ * histogram are identical to the ones read from a fully sorted copy, and
+ * compares execution times.
+ * Temporal median is checked against per-pixel sort on a small cube.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+#include "COREMOD_tools/COREMOD_tools.h"
+
+#include "COREMOD_arith/image_percentile.h"
+
+// variables local to this translation unit
+static uint32_t *imsize;
+static uint32_t *NBiter;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".size",
+        "image size (square)",
+        "1024",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBiter",
+        "iterations per measurement",
+        "5",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBiter,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"impercentilebench",
+                                "validate and benchmark percentile engine",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+// pseudo-random test values, with repeated values
+static double benchvalue(uint8_t datatype, long ii)
+{
+    long v = (ii * 2654435761L) % 100003;
+
+    switch(datatype)
+    {
+    case _DATATYPE_UINT16:
+        return v % 4096;
+    case _DATATYPE_INT16:
+        return v % 2000 - 1000;
+    case _DATATYPE_INT32:
+        return v - 50000;
+    case _DATATYPE_FLOAT:
+    case _DATATYPE_DOUBLE:
+        return 0.25 * v - 100.0;
+    }
+    return 0.0;
+}
+
+static void setbenchvalue(imageID ID, long ii, double v)
+{
+    switch(data.image[ID].md[0].datatype)
+    {
+    case _DATATYPE_UINT16:
+        data.image[ID].array.UI16[ii] = (uint16_t) v;
+        break;
+    case _DATATYPE_INT16:
+        data.image[ID].array.SI16[ii] = (int16_t) v;
+        break;
+    case _DATATYPE_INT32:
+        data.image[ID].array.SI32[ii] = (int32_t) v;
+        break;
+    case _DATATYPE_FLOAT:
+        data.image[ID].array.F[ii] = (float) v;
+        break;
+    case _DATATYPE_DOUBLE:
+        data.image[ID].array.D[ii] = v;
+        break;
+    }
+}
+
+static errno_t image_percentile_bench(uint32_t size, uint32_t nbiter)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct
+    {
+        const char *name;
+        uint8_t     datatype;
+    } typetable[] = {{"U16", _DATATYPE_UINT16},
+        {"I16", _DATATYPE_INT16},
+        {"I32", _DATATYPE_INT32},
+        {"F", _DATATYPE_FLOAT},
+        {"D", _DATATYPE_DOUBLE}
+    };
+    int nbtype = sizeof(typetable) / sizeof(typetable[0]);
+
+    double fraction[] = {0.0, 0.01, 0.1, 0.5, 0.9, 0.99, 1.0};
+    int    NBfraction = sizeof(fraction) / sizeof(fraction[0]);
+    double value[sizeof(fraction) / sizeof(fraction[0])];
+
+    struct timespec t0, t1;
+
+    if(size == 0)
+    {
+        size = 1;
+    }
+    if(nbiter == 0)
+    {
+        nbiter = 1;
+    }
+    long nelement = (long) size * size;
+
+    double *arrayD = (double *) malloc(sizeof(double) * nelement);
+    if(arrayD == NULL)
+    {
+        FUNC_RETURN_FAILURE("malloc() error");
+    }
+
+    printf("%-4s  %14s  %14s  %8s\n",
+           "type",
+           "sort [ms]",
+           "select [ms]",
+           "speedup");
+
+    for(int it = 0; it < nbtype; it++)
+    {
+        imageID  ID;
+        uint32_t naxes[2] = {size, size};
+
+        delete_image_ID("_impercbench", DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID("_impercbench",
+                        2,
+                        naxes,
+                        typetable[it].datatype,
+                        0,
+                        0,
+                        0,
+                        &ID);
+        for(long ii = 0; ii < nelement; ii++)
+        {
+            setbenchvalue(ID, ii, benchvalue(typetable[it].datatype, ii));
+        }
+
+        // reference : full sort
+        milk_clock_gettime(&t0);
+        for(uint32_t iter = 0; iter < nbiter; iter++)
+        {
+            for(long ii = 0; ii < nelement; ii++)
+            {
+                arrayD[ii] = benchvalue(typetable[it].datatype, ii);
+            }
+            quick_sort_double(arrayD, nelement);
+        }
+        milk_clock_gettime(&t1);
+        double dtsort = timespec_diff_double(t0, t1) / nbiter;
+
+        milk_clock_gettime(&t0);
+        for(uint32_t iter = 0; iter < nbiter; iter++)
+        {
+            arith_image_percentiles("_impercbench",
+                                    fraction,
+                                    NBfraction,
+                                    value);
+        }
+        milk_clock_gettime(&t1);
+        double dtselect = timespec_diff_double(t0, t1) / nbiter;
+
+        for(int i = 0; i < NBfraction; i++)
+        {
+            long rank = (long)(fraction[i] * nelement);
+            if(rank > nelement - 1)
+            {
+                rank = nelement - 1;
+            }
+            if(value[i] != arrayD[rank])
+            {
+                PRINT_WARNING("percentile mismatch for %s fraction %f: %g %g",
+                              typetable[it].name,
+                              fraction[i],
+                              value[i],
+                              arrayD[rank]);
+            }
+        }
+
+        printf("%-4s  %14.3f  %14.3f  %8.2f\n",
+               typetable[it].name,
+               1.0e3 * dtsort,
+               1.0e3 * dtselect,
+               dtsort / dtselect);
+        fflush(stdout);
+    }
+    delete_image_ID("_impercbench", DELETE_IMAGE_ERRMODE_WARNING);
+
+    // temporal median on small cube, odd and even number of slices
+    for(uint32_t zsize = 7; zsize < 9; zsize++)
+    {
+        imageID  IDc;
+        uint32_t naxes[3] = {37, 23, zsize};
+        long     xysize   = naxes[0] * naxes[1];
+
+        delete_image_ID("_impercbench_c", DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID("_impercbench_c",
+                        3,
+                        naxes,
+                        _DATATYPE_FLOAT,
+                        0,
+                        0,
+                        0,
+                        &IDc);
+        for(long ii = 0; ii < xysize * zsize; ii++)
+        {
+            data.image[IDc].array.F[ii] = benchvalue(_DATATYPE_FLOAT, ii);
+        }
+
+        delete_image_ID("_impercbench_m", DELETE_IMAGE_ERRMODE_IGNORE);
+        imageID IDm =
+            arith_image_temporal_median("_impercbench_c", "_impercbench_m");
+
+        long NBerr = 0;
+        for(long p = 0; p < xysize; p++)
+        {
+            for(uint32_t kk = 0; kk < zsize; kk++)
+            {
+                arrayD[kk] = data.image[IDc].array.F[kk * xysize + p];
+            }
+            quick_sort_double(arrayD, zsize);
+            if(data.image[IDm].array.F[p] != arrayD[zsize / 2])
+            {
+                NBerr++;
+            }
+        }
+        if(NBerr > 0)
+        {
+            PRINT_WARNING("temporal median mismatch for %ld pixels", NBerr);
+        }
+        else
+        {
+            printf("temporal median %u slices OK\n", zsize);
+        }
+        delete_image_ID("_impercbench_c", DELETE_IMAGE_ERRMODE_WARNING);
+        delete_image_ID("_impercbench_m", DELETE_IMAGE_ERRMODE_WARNING);
+    }
+
+    free(arrayD);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return image_percentile_bench(*imsize, *NBiter);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__image_percentile_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
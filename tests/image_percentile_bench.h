@@ -0,0 +1,10 @@
+/**
+ * @file    image_percentile_bench.h
+ */
+
+#ifndef MILK_TESTS_IMAGE_PERCENTILE_BENCH_H
+#define MILK_TESTS_IMAGE_PERCENTILE_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__image_percentile_bench();
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @file    images2cube_bench.c
+ * @brief   benchmark cube assembly and slicing
+ *
+ * Breaks a test cube into images and back (breakcube, imgs2cube), then
+ * into FITS files and back (breakcube2files, files2cube). Checks that both
+ * round trips give the original cube. Each step reports its throughput
+ * [frames/s].
+ * Files are written to /tmp and removed on exit.
+ */
+
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "COREMOD_iofits/breakcube.h"
+#include "COREMOD_iofits/images2cube.h"
+
+// variables local to this translation unit
+static uint32_t *NBframe;
+static uint32_t *imsize;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".NBframe",
+        "number of frames",
+        "1000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframe,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".size",
+        "frame size (square)",
+        "128",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imgs2cubebench",
+                                "benchmark cube assembly and slicing",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+static errno_t help_function()
+{
+    printf("Round trips a size x size x NBframe float cube through images "
+           "and FITS files\n");
+    return RETURN_SUCCESS;
+}
+
+/** @brief Compare cube with reference cube _i2cbench
+ */
+static void images2cube_check(const char *name)
+{
+    imageID ID0 = image_ID("_i2cbench");
+    imageID ID1 = image_ID(name);
+
+    if((ID1 == -1) ||
+            (data.image[ID0].md[0].nelement != data.image[ID1].md[0].nelement) ||
+            (data.image[ID0].md[0].datatype != data.image[ID1].md[0].datatype) ||
+            (memcmp(data.image[ID0].array.F,
+                    data.image[ID1].array.F,
+                    sizeof(float) * data.image[ID0].md[0].nelement) != 0))
+    {
+        PRINT_WARNING("cube %s mismatch", name);
+    }
+}
+
+static errno_t images2cube_bench(uint32_t nbframe, uint32_t size)
+{
+    DEBUG_TRACE_FSTART();
+
+    imageID  ID;
+    uint32_t naxes[3];
+    char     fileprefix[STRINGMAXLEN_FULLFILENAME];
+
+    if(nbframe == 0)
+    {
+        nbframe = 1;
+    }
+    if(size == 0)
+    {
+        size = 1;
+    }
+    naxes[0] = size;
+    naxes[1] = size;
+    naxes[2] = nbframe;
+
+    delete_image_ID("_i2cbench", DELETE_IMAGE_ERRMODE_IGNORE);
+    create_image_ID("_i2cbench", 3, naxes, _DATATYPE_FLOAT, 0, 0, 0, &ID);
+    for(uint64_t ii = 0; ii < data.image[ID].md[0].nelement; ii++)
+    {
+        data.image[ID].array.F[ii] = 0.37 * ((ii * 7919) % 65521);
+    }
+
+    // in memory
+    printf("--- breakcube\n");
+    break_cube("_i2cbench");
+    printf("--- imgs2cube\n");
+    images_to_cube("_i2cbench_", nbframe, "_i2cbench1");
+    images2cube_check("_i2cbench1");
+
+    for(uint32_t kk = 0; kk < nbframe; kk++)
+    {
+        CREATE_IMAGENAME(framename, "_i2cbench_%05u", kk);
+        delete_image_ID(framename, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+
+    // files
+    WRITE_FULLFILENAME(fileprefix, "/tmp/_i2cbench_%d_", (int) getpid());
+    printf("--- breakcube2files\n");
+    break_cube_files("_i2cbench", fileprefix);
+    printf("--- files2cube\n");
+    files_to_cube(fileprefix, nbframe, "_i2cbench2");
+    images2cube_check("_i2cbench2");
+
+    for(uint32_t kk = 0; kk < nbframe; kk++)
+    {
+        char fname[STRINGMAXLEN_FULLFILENAME];
+        WRITE_FULLFILENAME(fname, "%s%05u.fits", fileprefix, kk);
+        unlink(fname);
+    }
+
+    delete_image_ID("_i2cbench", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_i2cbench1", DELETE_IMAGE_ERRMODE_IGNORE);
+    delete_image_ID("_i2cbench2", DELETE_IMAGE_ERRMODE_IGNORE);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return images2cube_bench(*NBframe, *imsize);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__images2cube_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    images2cube_bench.h
+ */
+
+#ifndef MILK_TESTS_IMAGES2CUBE_BENCH_H
+#define MILK_TESTS_IMAGES2CUBE_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__images2cube_bench();
+
+#endif
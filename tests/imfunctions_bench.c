@@ -0,0 +1,240 @@
+/**
+ * @file    imfunctions_bench.c
+ * @brief   benchmark image arithmetic kernels
+ *
+ * For each operation (add, sub, mult, div, min, max) and input type
+ * combination, checks that the type-specialized kernel output is identical
+ * to the function pointer output, and measures in-place throughput
+ * [Mpix/s] for both paths.
+ * Images are deleted on exit.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "COREMOD_arith/imfunctions.h"
+#include "COREMOD_arith/imfunctions_kernels.h"
+#include "COREMOD_arith/mathfuncs.h"
+
+// variables local to this translation unit
+static uint32_t *imsize;
+static uint32_t *NBiter;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".size",
+        "image size (square)",
+        "1024",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBiter",
+        "iterations per measurement",
+        "20",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBiter,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imarithbench",
+                                "benchmark image arithmetic kernels",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+static imageID mkbenchimage(const char *name,
+                            uint8_t     datatype,
+                            uint32_t    size,
+                            long        modulo,
+                            long        offset)
+{
+    imageID  ID;
+    uint32_t naxes[2] = {size, size};
+
+    delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+    create_image_ID(name, 2, naxes, datatype, 0, 0, 0, &ID);
+
+    for(long ii = 0; ii < (long) size * size; ii++)
+    {
+        long v = offset + ii % modulo;
+        switch(datatype)
+        {
+        case _DATATYPE_FLOAT:
+            data.image[ID].array.F[ii] = 0.5 * v;
+            break;
+        case _DATATYPE_DOUBLE:
+            data.image[ID].array.D[ii] = 0.5 * v;
+            break;
+        case _DATATYPE_UINT16:
+            data.image[ID].array.UI16[ii] = v;
+            break;
+        }
+    }
+    return ID;
+}
+
+/** @brief Average in-place operation throughput [Mpix/s]
+ */
+static double inplace_Mpixs(imageID ID1,
+                            imageID ID2,
+                            double (*pt2function)(double, double),
+                            uint32_t nbiter)
+{
+    struct timespec t0, t1;
+
+    milk_clock_gettime(&t0);
+    for(uint32_t iter = 0; iter < nbiter; iter++)
+    {
+        arith_image_function_2_1_inplace_byID(ID1, ID2, pt2function);
+    }
+    milk_clock_gettime(&t1);
+
+    return 1.0e-6 * data.image[ID1].md[0].nelement * nbiter /
+           timespec_diff_double(t0, t1);
+}
+
+static errno_t imfunctions_bench(uint32_t size, uint32_t nbiter)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct
+    {
+        const char *name;
+        double (*pt2function)(double, double);
+    } optable[] = {{"add", &Padd},
+        {"sub", &Psub},
+        {"mult", &Pmult},
+        {"div", &Pdiv},
+        {"min", &Pminv},
+        {"max", &Pmaxv}
+    };
+    int nbop = sizeof(optable) / sizeof(optable[0]);
+
+    struct
+    {
+        const char *name;
+        uint8_t     datatype1;
+        uint8_t     datatype2;
+    } typetable[] = {{"F  F", _DATATYPE_FLOAT, _DATATYPE_FLOAT},
+        {"D  D", _DATATYPE_DOUBLE, _DATATYPE_DOUBLE},
+        {"U16 U16", _DATATYPE_UINT16, _DATATYPE_UINT16},
+        {"F  U16", _DATATYPE_FLOAT, _DATATYPE_UINT16}
+    };
+    int nbtype = sizeof(typetable) / sizeof(typetable[0]);
+
+    int kernelenable = arith_kernel_get_enable();
+
+    if(size == 0)
+    {
+        size = 1;
+    }
+    if(nbiter == 0)
+    {
+        nbiter = 1;
+    }
+
+    printf("%-8s  %-5s  %14s  %14s  %8s\n",
+           "types",
+           "op",
+           "ptr [Mpix/s]",
+           "kern [Mpix/s]",
+           "speedup");
+
+    for(int it = 0; it < nbtype; it++)
+    {
+        for(int iop = 0; iop < nbop; iop++)
+        {
+            double (*pt2function)(double, double) = optable[iop].pt2function;
+
+            mkbenchimage("_imarithbench_a",
+                         typetable[it].datatype1,
+                         size,
+                         1000,
+                         0);
+            mkbenchimage("_imarithbench_b",
+                         typetable[it].datatype2,
+                         size,
+                         3,
+                         1);
+
+            // check kernel output against function pointer output
+            arith_kernel_set_enable(0);
+            delete_image_ID("_imarithbench_out0", DELETE_IMAGE_ERRMODE_IGNORE);
+            arith_image_function_2_1("_imarithbench_a",
+                                     "_imarithbench_b",
+                                     "_imarithbench_out0",
+                                     pt2function);
+            arith_kernel_set_enable(1);
+            delete_image_ID("_imarithbench_out1", DELETE_IMAGE_ERRMODE_IGNORE);
+            arith_image_function_2_1("_imarithbench_a",
+                                     "_imarithbench_b",
+                                     "_imarithbench_out1",
+                                     pt2function);
+            {
+                imageID IDout0 = image_ID("_imarithbench_out0");
+                imageID IDout1 = image_ID("_imarithbench_out1");
+                size_t  nbbyte =
+                    ImageStreamIO_typesize(data.image[IDout0].md[0].datatype) *
+                    data.image[IDout0].md[0].nelement;
+
+                if((data.image[IDout0].md[0].datatype !=
+                        data.image[IDout1].md[0].datatype) ||
+                        (memcmp(data.image[IDout0].array.raw,
+                                data.image[IDout1].array.raw,
+                                nbbyte) != 0))
+                {
+                    PRINT_WARNING("kernel result mismatch for %s %s",
+                                  typetable[it].name,
+                                  optable[iop].name);
+                }
+            }
+
+            imageID IDa = image_ID("_imarithbench_a");
+            imageID IDb = image_ID("_imarithbench_b");
+
+            arith_kernel_set_enable(0);
+            double ptrMpixs = inplace_Mpixs(IDa, IDb, pt2function, nbiter);
+            arith_kernel_set_enable(1);
+            double kernMpixs = inplace_Mpixs(IDa, IDb, pt2function, nbiter);
+
+            printf("%-8s  %-5s  %14.1f  %14.1f  %8.2f\n",
+                   typetable[it].name,
+                   optable[iop].name,
+                   ptrMpixs,
+                   kernMpixs,
+                   kernMpixs / ptrMpixs);
+            fflush(stdout);
+        }
+    }
+
+    arith_kernel_set_enable(kernelenable);
+
+    delete_image_ID("_imarithbench_a", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_imarithbench_b", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_imarithbench_out0", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_imarithbench_out1", DELETE_IMAGE_ERRMODE_WARNING);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return imfunctions_bench(*imsize, *NBiter);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__imfunctions_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
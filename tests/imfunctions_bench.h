@@ -0,0 +1,10 @@
+/**
+ * @file    imfunctions_bench.h
+ */
+
+#ifndef MILK_TESTS_IMFUNCTIONS_BENCH_H
+#define MILK_TESTS_IMFUNCTIONS_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__imfunctions_bench();
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @file    loadfits_bench.c
+ * @brief   benchmark FITS loading, cfitsio vs mmap path
+ *
+ * For each FITS data type, saves a test image and loads it back through
+ * cfitsio and through the mmap path. Checks that both give the same
+ * image, and measures load throughput [MB/s].
+ * Files are written to /tmp and removed on exit.
+ */
+
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "COREMOD_iofits/loadfits.h"
+#include "COREMOD_iofits/loadfits_mmap.h"
+#include "COREMOD_iofits/savefits.h"
+
+// variables local to this translation unit
+static uint32_t *imsize;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".size",
+        "image size (square)",
+        "1024",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"loadfitsbench",
+                                "benchmark FITS loading, cfitsio vs mmap",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+static errno_t help_function()
+{
+    printf("Saves and loads a size x size x 4 cube of each FITS type\n");
+    return RETURN_SUCCESS;
+}
+
+/** @brief Load file, return throughput [MB/s]
+ */
+static double loadfits_MBs(const char *fname, const char *imname)
+{
+    struct timespec t0, t1;
+    imageID         ID;
+
+    delete_image_ID(imname, DELETE_IMAGE_ERRMODE_IGNORE);
+    milk_clock_gettime(&t0);
+    load_fits(fname, imname, LOADFITS_ERRMODE_WARNING, &ID);
+    milk_clock_gettime(&t1);
+
+    if(ID == -1)
+    {
+        return 0.0;
+    }
+    return 1.0e-6 * data.image[ID].md[0].nelement *
+           ImageStreamIO_typesize(data.image[ID].md[0].datatype) /
+           timespec_diff_double(t0, t1);
+}
+
+static errno_t loadfits_bench(uint32_t size)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct
+    {
+        const char *name;
+        uint8_t     datatype;
+    } typetable[] = {{"FLOAT", _DATATYPE_FLOAT},
+        {"DOUBLE", _DATATYPE_DOUBLE},
+        {"UINT8", _DATATYPE_UINT8},
+        {"UINT16", _DATATYPE_UINT16},
+        {"INT16", _DATATYPE_INT16},
+        {"INT32", _DATATYPE_INT32},
+        {"INT64", _DATATYPE_INT64}
+    };
+    int NBtype = sizeof(typetable) / sizeof(typetable[0]);
+
+    int  mmapenable = load_fits_mmap_get_enable();
+    char fname[STRINGMAXLEN_FULLFILENAME];
+
+    WRITE_FULLFILENAME(fname, "/tmp/_loadfitsbench_%d.fits", (int) getpid());
+
+    if(size == 0)
+    {
+        size = 1;
+    }
+
+    printf("%-8s  %14s  %14s  %8s\n",
+           "type",
+           "cfitsio [MB/s]",
+           "mmap [MB/s]",
+           "speedup");
+
+    for(int it = 0; it < NBtype; it++)
+    {
+        imageID  ID;
+        uint32_t naxes[3] = {size, size, 4};
+
+        delete_image_ID("_loadfitsbench", DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID("_loadfitsbench",
+                        3,
+                        naxes,
+                        typetable[it].datatype,
+                        0,
+                        10,
+                        0,
+                        &ID);
+        for(uint64_t ii = 0; ii < data.image[ID].md[0].nelement; ii++)
+        {
+            long v = (ii * 7919) % 65521;
+            switch(typetable[it].datatype)
+            {
+            case _DATATYPE_FLOAT:
+                data.image[ID].array.F[ii] = 0.37 * v - 1000.0;
+                break;
+            case _DATATYPE_DOUBLE:
+                data.image[ID].array.D[ii] = 0.37 * v - 1000.0;
+                break;
+            case _DATATYPE_UINT8:
+                data.image[ID].array.UI8[ii] = v;
+                break;
+            case _DATATYPE_UINT16:
+                data.image[ID].array.UI16[ii] = v;
+                break;
+            case _DATATYPE_INT16:
+                data.image[ID].array.SI16[ii] = v % 30000;
+                break;
+            case _DATATYPE_INT32:
+                data.image[ID].array.SI32[ii] = v * 4099 - 100000000;
+                break;
+            case _DATATYPE_INT64:
+                data.image[ID].array.SI64[ii] = v * 4099L * 4099L - 1000000000L;
+                break;
+            }
+        }
+        save_fits("_loadfitsbench", fname);
+
+        load_fits_mmap_set_enable(0);
+        double cfitsioMBs = loadfits_MBs(fname, "_loadfitsbench0");
+        load_fits_mmap_set_enable(1);
+        double mmapMBs = loadfits_MBs(fname, "_loadfitsbench1");
+
+        {
+            imageID ID0 = image_ID("_loadfitsbench0");
+            imageID ID1 = image_ID("_loadfitsbench1");
+
+            if((ID0 == -1) || (ID1 == -1) ||
+                    (data.image[ID0].md[0].datatype !=
+                     data.image[ID1].md[0].datatype) ||
+                    (data.image[ID0].md[0].nelement !=
+                     data.image[ID1].md[0].nelement) ||
+                    (memcmp(data.image[ID0].array.raw,
+                            data.image[ID1].array.raw,
+                            data.image[ID0].md[0].nelement *
+                            ImageStreamIO_typesize(
+                                data.image[ID0].md[0].datatype)) != 0))
+            {
+                PRINT_WARNING("mmap load mismatch for %s", typetable[it].name);
+            }
+        }
+
+        printf("%-8s  %14.1f  %14.1f  %8.2f\n",
+               typetable[it].name,
+               cfitsioMBs,
+               mmapMBs,
+               mmapMBs / cfitsioMBs);
+        fflush(stdout);
+    }
+
+    load_fits_mmap_set_enable(mmapenable);
+
+    unlink(fname);
+    delete_image_ID("_loadfitsbench", DELETE_IMAGE_ERRMODE_WARNING);
+    delete_image_ID("_loadfitsbench0", DELETE_IMAGE_ERRMODE_IGNORE);
+    delete_image_ID("_loadfitsbench1", DELETE_IMAGE_ERRMODE_IGNORE);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return loadfits_bench(*imsize);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__loadfits_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
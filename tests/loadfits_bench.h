@@ -0,0 +1,10 @@
+/**
+ * @file    loadfits_bench.h
+ */
+
+#ifndef MILK_TESTS_LOADFITS_BENCH_H
+#define MILK_TESTS_LOADFITS_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__loadfits_bench();
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file    milk_tests.c
+ * @brief   test and benchmark commands
+ *
+ * Built with the test suite only (BUILD_TESTING), not installed.
+ * ctest loads it in milk with soload, see tests/CMakeLists.txt :
+ * commands are not part of the user-facing command table.
+ */
+
+#define MODULE_SHORTNAME_DEFAULT ""
+#define MODULE_DESCRIPTION       "Test and benchmark commands"
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "arith_expr_bench.h"
+#include "image_ID_bench.h"
+#include "image_percentile_bench.h"
+#include "images2cube_bench.h"
+#include "imfunctions_bench.h"
+#include "loadfits_bench.h"
+#include "savefits_async_bench.h"
+#include "stream_TCPmux_bench.h"
+#include "stream_UDP_batchbench.h"
+#include "stream_UDP_bench.h"
+#include "stream_codec_bench.h"
+#include "stream_multiwait_bench.h"
+#include "tracepoint_bench.h"
+
+INIT_MODULE_LIB(milk_tests)
+
+static errno_t init_module_CLI()
+{
+    CLIADDCMD_milk_tests__tracepoint_bench();
+
+    // COREMOD_memory
+    CLIADDCMD_milk_tests__image_ID_bench();
+    CLIADDCMD_milk_tests__stream_multiwait_bench();
+    CLIADDCMD_milk_tests__stream_codec_bench();
+    CLIADDCMD_milk_tests__stream_TCPmux_bench();
+    CLIADDCMD_milk_tests__stream_UDP_bench();
+    CLIADDCMD_milk_tests__stream_UDP_batchbench();
+
+    // COREMOD_arith
+    CLIADDCMD_milk_tests__imfunctions_bench();
+    CLIADDCMD_milk_tests__arith_expr_bench();
+    CLIADDCMD_milk_tests__image_percentile_bench();
+
+    // COREMOD_iofits
+    CLIADDCMD_milk_tests__loadfits_bench();
+    CLIADDCMD_milk_tests__savefits_async_bench();
+    CLIADDCMD_milk_tests__images2cube_bench();
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,304 @@
+/**
+ * @file    savefits_async_bench.c
+ * @brief   benchmark concurrent FITS saving
+ *
+ * Saves a set of images sequentially, then through the async worker pool.
+ * Checks that files written concurrently load back identical to the
+ * images, also when images are created while jobs are pending or deleted
+ * right after submission, that a job writing to an invalid path fails
+ * without affecting the other jobs, and measures write throughput [MB/s].
+ * Files are written to /tmp and removed on exit.
+ *
+ * The failing job prints an error : "all checks passed" is printed at the
+ * end if results are as expected.
+ */
+
+#include <unistd.h>
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+#include "COREMOD_memory/COREMOD_memory.h"
+
+#include "COREMOD_iofits/loadfits.h"
+#include "COREMOD_iofits/savefits.h"
+#include "COREMOD_iofits/savefits_async.h"
+
+// variables local to this translation unit
+static uint32_t *NBimage;
+static uint32_t *imsize;
+static uint32_t *NBthread;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".NBimage",
+        "number of images",
+        "8",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBimage,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".size",
+        "image size (square)",
+        "1024",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &imsize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBthread",
+        "number of writer threads",
+        "4",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBthread,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"savefitsasyncbench",
+                                "benchmark concurrent FITS saving",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+static errno_t help_function()
+{
+    printf("Saves NBimage size x size x 4 float cubes, sequentially and "
+           "concurrently\n");
+    return RETURN_SUCCESS;
+}
+
+static void mkfname(char *fname, const char *mode, uint32_t i)
+{
+    WRITE_FULLFILENAME(fname,
+                       "/tmp/_savefitsasyncbench_%d_%s_%03u.fits",
+                       (int) getpid(),
+                       mode,
+                       i);
+}
+
+static errno_t savefits_async_bench(uint32_t nbimage,
+                                    uint32_t size,
+                                    uint32_t nbthread)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct timespec t0, t1;
+    char            imname[STRINGMAXLEN_IMGNAME];
+    char            fname[STRINGMAXLEN_FULLFILENAME];
+    double          MBytes;
+    long            jobfail;
+    long            NBcheckfail = 0;
+
+    if(nbimage == 0)
+    {
+        nbimage = 1;
+    }
+    if(size == 0)
+    {
+        size = 1;
+    }
+
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        imageID  ID;
+        uint32_t naxes[3] = {size, size, 4};
+
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        delete_image_ID(imname, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(imname, 3, naxes, _DATATYPE_FLOAT, 0, 0, 0, &ID);
+        for(uint64_t ii = 0; ii < data.image[ID].md[0].nelement; ii++)
+        {
+            data.image[ID].array.F[ii] = 0.37 * ((ii * 7919 + i) % 65521);
+        }
+    }
+    MBytes = 1.0e-6 * nbimage * size * size * 4 * sizeof(float);
+
+    // sequential
+    milk_clock_gettime(&t0);
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        mkfname(fname, "seq", i);
+        saveFITS_opt_trunc(imname, -1, fname, 0, "", NULL, 0);
+    }
+    milk_clock_gettime(&t1);
+    double seqMBs = MBytes / timespec_diff_double(t0, t1);
+
+    // concurrent
+    saveFITS_async_init(nbthread);
+    milk_clock_gettime(&t0);
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        mkfname(fname, "async", i);
+        saveFITS_async_submit(imname, -1, fname, 0, "", NULL, 0);
+    }
+    jobfail = saveFITS_async_waitall();
+    milk_clock_gettime(&t1);
+    double asyncMBs = MBytes / timespec_diff_double(t0, t1);
+
+    if(jobfail != 0)
+    {
+        PRINT_WARNING("async save mismatch : %ld jobs failed", jobfail);
+        NBcheckfail++;
+    }
+
+    // images created while jobs are pending : image table may be
+    // reallocated under the workers
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        mkfname(fname, "async", i);
+        saveFITS_async_submit(imname, -1, fname, 0, "", NULL, 0);
+    }
+    for(uint32_t i = 0; i < 4 * nbimage; i++)
+    {
+        imageID  ID;
+        uint32_t naxes[2] = {16, 16};
+
+        WRITE_IMAGENAME(imname, "_sfabenchtmp%03u", i);
+        create_image_ID(imname, 2, naxes, _DATATYPE_FLOAT, 0, 0, 0, &ID);
+    }
+    if(saveFITS_async_waitall() != 0)
+    {
+        PRINT_WARNING("async save mismatch : jobs failed during image creation");
+        NBcheckfail++;
+    }
+    for(uint32_t i = 0; i < 4 * nbimage; i++)
+    {
+        WRITE_IMAGENAME(imname, "_sfabenchtmp%03u", i);
+        delete_image_ID(imname, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+
+    // images deleted while jobs are pending : jobs write their own copy
+    // files are overwritten with identical content, checked below
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        imageID  ID;
+        imageID  IDdel;
+        uint32_t naxes[3] = {size, size, 4};
+
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        ID = image_ID(imname);
+        create_image_ID("_sfabenchdel",
+                        3,
+                        naxes,
+                        _DATATYPE_FLOAT,
+                        0,
+                        0,
+                        0,
+                        &IDdel);
+        memcpy(data.image[IDdel].array.F,
+               data.image[ID].array.F,
+               sizeof(float) * data.image[ID].md[0].nelement);
+        mkfname(fname, "async", i);
+        saveFITS_async_submit("_sfabenchdel", -1, fname, 0, "", NULL, 0);
+        delete_image_ID("_sfabenchdel", DELETE_IMAGE_ERRMODE_WARNING);
+    }
+    if(saveFITS_async_waitall() != 0)
+    {
+        PRINT_WARNING("async save mismatch : jobs failed after image deletion");
+        NBcheckfail++;
+    }
+
+    // error in one job must not be reported by the others
+    {
+        errno_t ret;
+
+        WRITE_IMAGENAME(imname, "_sfabench%03u", 0);
+        mkfname(fname, "async", nbimage);
+        long jobid0 = saveFITS_async_submit(imname, -1, fname, 0, "", NULL, 0);
+        long jobid1 = saveFITS_async_submit(imname,
+                                            -1,
+                                            "/nonexistent/_savefitsasyncbench.fits",
+                                            0,
+                                            "",
+                                            NULL,
+                                            0);
+        saveFITS_async_wait(jobid0, &ret);
+        if(ret != RETURN_SUCCESS)
+        {
+            PRINT_WARNING("async save status mismatch : valid job failed");
+            NBcheckfail++;
+        }
+        saveFITS_async_wait(jobid1, &ret);
+        if(ret == RETURN_SUCCESS)
+        {
+            PRINT_WARNING("async save status mismatch : invalid job succeeded");
+            NBcheckfail++;
+        }
+        if(saveFITS_async_waitall() != 1)
+        {
+            PRINT_WARNING("async save failure count mismatch");
+            NBcheckfail++;
+        }
+        unlink(fname);
+    }
+
+    for(uint32_t i = 0; i < nbimage; i++)
+    {
+        imageID ID;
+        imageID IDload;
+
+        WRITE_IMAGENAME(imname, "_sfabench%03u", i);
+        ID = image_ID(imname);
+        mkfname(fname, "async", i);
+
+        delete_image_ID("_sfabenchload", DELETE_IMAGE_ERRMODE_IGNORE);
+        load_fits(fname, "_sfabenchload", LOADFITS_ERRMODE_WARNING, &IDload);
+        if((IDload == -1) ||
+                (data.image[IDload].md[0].nelement !=
+                 data.image[ID].md[0].nelement) ||
+                (memcmp(data.image[IDload].array.F,
+                        data.image[ID].array.F,
+                        sizeof(float) * data.image[ID].md[0].nelement) != 0))
+        {
+            PRINT_WARNING("async save mismatch for %s", fname);
+            NBcheckfail++;
+        }
+
+        unlink(fname);
+        mkfname(fname, "seq", i);
+        unlink(fname);
+        delete_image_ID(imname, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+    delete_image_ID("_sfabenchload", DELETE_IMAGE_ERRMODE_IGNORE);
+
+    saveFITS_async_stop();
+
+    printf("%u images, %.1f MB : sequential %.1f MB/s, %u threads %.1f MB/s, "
+           "speedup %.2f\n",
+           nbimage,
+           MBytes,
+           seqMBs,
+           nbthread,
+           asyncMBs,
+           asyncMBs / seqMBs);
+
+    if(NBcheckfail == 0)
+    {
+        printf("savefitsasyncbench : all checks passed\n");
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return savefits_async_bench(*NBimage, *imsize, *NBthread);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__savefits_async_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    savefits_async_bench.h
+ */
+
+#ifndef MILK_TESTS_SAVEFITS_ASYNC_BENCH_H
+#define MILK_TESTS_SAVEFITS_ASYNC_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__savefits_async_bench();
+
+#endif
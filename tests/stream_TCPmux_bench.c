@@ -0,0 +1,404 @@
+/**
+ * @file    stream_TCPmux_bench.c
+ * @brief   test multiplexed TCP transfer over loopback
+ *
+ * NBstream streams of different sizes, some of them circular buffers, are
+ * sent over NBconn loopback connections to receiver streams in the same
+ * process. A writer thread updates random streams with
+ * ImageStreamIO_UpdateIm, as stream writers do, each stream being
+ * updated again only once its previous frame has been received and
+ * checked, so that many streams are in flight at any time.
+ * With a codec, only every 8th pixel changes between frames.
+ * Streams are deleted on exit.
+ */
+
+#include <pthread.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/create_image.h"
+#include "COREMOD_memory/delete_image.h"
+#include "COREMOD_memory/stream_sem.h"
+#include "COREMOD_memory/stream_TCPmux.h"
+
+#define TCPMUXBENCH_NBKW 4
+
+// variables local to this translation unit
+static uint32_t *NBstream;
+static uint32_t *NBframe;
+static uint32_t *NBconn;
+static uint32_t *codec;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".NBstream",
+        "number of streams",
+        "16",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBstream,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBframe",
+        "number of frames",
+        "2000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframe,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBconn",
+        "number of connections",
+        "2",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBconn,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".codec",
+        "frame encoding, STREAM_CODEC_* flags",
+        "0",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &codec,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imnetwmuxbench",
+                                "test multiplexed TCP transfer over loopback",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+typedef struct
+{
+    uint32_t NBstream;
+    uint32_t NBframe;
+    int      sparse; // only every 8th pixel changes
+    imageID *IDtx;
+
+    // last frame written, and last frame checked by receiver, per stream
+    uint64_t          *seq;
+    volatile uint64_t *verified;
+
+    volatile int stop;
+} TCPMUXBENCH;
+
+static uint32_t tcpmuxbench_pattern(int sparse, uint32_t k, uint64_t seq, long i)
+{
+    if((sparse == 1) && (i % 8 != 0))
+    {
+        seq = 0;
+    }
+    return ((uint32_t) seq * 2654435761u) ^ (k << 24) ^ (uint32_t) i;
+}
+
+static void *tcpmuxbench_writer(void *ptr)
+{
+    TCPMUXBENCH *bench = (TCPMUXBENCH *) ptr;
+    unsigned int seed  = 1;
+
+    for(uint32_t n = 0; (n < bench->NBframe) && (bench->stop == 0); n++)
+    {
+        // pick a random stream whose previous frame has been checked
+        uint32_t k = rand_r(&seed) % bench->NBstream;
+        uint32_t j;
+        while(bench->stop == 0)
+        {
+            for(j = 0; j < bench->NBstream; j++)
+            {
+                uint32_t k1 = (k + j) % bench->NBstream;
+                if(bench->verified[k1] == bench->seq[k1])
+                {
+                    k = k1;
+                    break;
+                }
+            }
+            if(j < bench->NBstream)
+            {
+                break;
+            }
+            usleep(10);
+        }
+        if(bench->stop == 1)
+        {
+            break;
+        }
+
+        IMAGE   *img_p    = &data.image[bench->IDtx[k]];
+        long     NBslices = (img_p->md[0].naxis > 2) ? img_p->md[0].size[2] : 1;
+        long     NBpix    = img_p->md[0].size[0] * img_p->md[0].size[1];
+        uint64_t slice    = (img_p->md[0].cnt1 + 1) % NBslices;
+        uint32_t *pix     = img_p->array.UI32 + NBpix * slice;
+
+        bench->seq[k]++;
+        pix[0] = (uint32_t) bench->seq[k];
+        for(long i = 1; i < NBpix; i++)
+        {
+            pix[i] = tcpmuxbench_pattern(bench->sparse, k, bench->seq[k], i);
+        }
+        img_p->kw[0].value.numl = bench->seq[k];
+
+        img_p->md[0].cnt1 = slice;
+        ImageStreamIO_UpdateIm(img_p);
+    }
+
+    return NULL;
+}
+
+static int
+tcpmuxbench_check(IMAGE *img_p, int sparse, uint32_t k, uint64_t seq)
+{
+    long      NBpix = img_p->md[0].size[0] * img_p->md[0].size[1];
+    uint32_t *pix   = img_p->array.UI32 + NBpix * img_p->md[0].cnt1;
+
+    if((pix[0] != (uint32_t) seq) || (img_p->kw[0].value.numl != (int64_t) seq))
+    {
+        return 1;
+    }
+    for(long i = 1; i < NBpix; i++)
+    {
+        if(pix[i] != tcpmuxbench_pattern(sparse, k, seq, i))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static errno_t stream_TCPmux_bench(uint32_t nbstream,
+                                   uint32_t nbframe,
+                                   uint32_t nbconn,
+                                   uint32_t nbcodec)
+{
+    DEBUG_TRACE_FSTART();
+
+    if(nbstream == 0)
+    {
+        nbstream = 1;
+    }
+    if(nbstream > TCPMUX_NBSTREAMMAX)
+    {
+        nbstream = TCPMUX_NBSTREAMMAX;
+    }
+
+    TCPMUXBENCH bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.NBstream = nbstream;
+    bench.NBframe  = nbframe;
+    bench.sparse   = (nbcodec != 0);
+    bench.IDtx     = (imageID *) malloc(sizeof(imageID) * nbstream);
+    bench.seq      = (uint64_t *) calloc(nbstream, sizeof(uint64_t));
+    bench.verified = (uint64_t *) calloc(nbstream, sizeof(uint64_t));
+    imageID *IDrx  = (imageID *) malloc(sizeof(imageID) * nbstream);
+    int *priority  = (int *) malloc(sizeof(int) * nbstream);
+    int *codecs    = (int *) malloc(sizeof(int) * nbstream);
+    if((bench.IDtx == NULL) || (bench.seq == NULL) ||
+            (bench.verified == NULL) || (IDrx == NULL) || (priority == NULL) ||
+            (codecs == NULL))
+    {
+        FUNC_RETURN_FAILURE("malloc() error");
+    }
+
+    // 1 kB to 256 kB frames, every 4th stream has 4 slices
+    long framebytes = 0;
+    for(uint32_t k = 0; k < nbstream; k++)
+    {
+        char     name[STRINGMAXLEN_IMGNAME];
+        uint32_t naxes[3];
+        long     naxis = 2;
+
+        naxes[0] = 64;
+        naxes[1] = (k == 0) ? 1024 : (4 << (k % 7));
+        naxes[2] = 1;
+        if(k % 4 == 3)
+        {
+            naxis    = 3;
+            naxes[2] = 4;
+        }
+        priority[k] = 1 + k % 3;
+        codecs[k]   = nbcodec;
+        framebytes += naxes[0] * naxes[1] * sizeof(uint32_t);
+
+        WRITE_IMAGENAME(name, "_muxbench%03u", k);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(name,
+                        naxis,
+                        naxes,
+                        _DATATYPE_UINT32,
+                        1,
+                        TCPMUXBENCH_NBKW,
+                        0,
+                        &bench.IDtx[k]);
+        COREMOD_MEMORY_image_set_createsem(name, IMAGE_NB_SEMAPHORE);
+
+        WRITE_IMAGENAME(name, "rx_muxbench%03u", k);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(name,
+                        naxis,
+                        naxes,
+                        _DATATYPE_UINT32,
+                        0,
+                        TCPMUXBENCH_NBKW,
+                        0,
+                        &IDrx[k]);
+    }
+
+    TCPMUX_RX *rx = tcpmux_rx_open(0, "rx");
+    if(rx == NULL)
+    {
+        FUNC_RETURN_FAILURE("cannot open receiver");
+    }
+    TCPMUX_TX *tx = tcpmux_tx_open(bench.IDtx,
+                                   priority,
+                                   codecs,
+                                   nbstream,
+                                   "127.0.0.1",
+                                   rx->port,
+                                   nbconn);
+    if(tx == NULL)
+    {
+        tcpmux_rx_close(rx);
+        FUNC_RETURN_FAILURE("cannot open transmitter");
+    }
+
+    STREAM_MULTIWAIT *mw = stream_multiwait_create(IDrx, nbstream, 0);
+    if(mw == NULL)
+    {
+        FUNC_RETURN_FAILURE("cannot create stream waiter");
+    }
+
+    // wait for stream declarations
+    for(uint32_t k = 0; (k < nbstream) && (rx->done == 0); k++)
+    {
+        while(((rx->NBstream != nbstream) || (rx->stream[k].framesizeall == 0)) &&
+                (rx->done == 0))
+        {
+            usleep(1000);
+        }
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    pthread_t thwriter;
+    pthread_create(&thwriter, NULL, tcpmuxbench_writer, &bench);
+
+    long   NBchecked = 0;
+    long   NBbad     = 0;
+    double bytes     = 0.0;
+    while(NBchecked < (long) nbframe)
+    {
+        if(stream_multiwait_wait(mw, 2000000) == 0)
+        {
+            break;
+        }
+        for(uint32_t k = 0; k < nbstream; k++)
+        {
+            if(mw->fired[k] == 0)
+            {
+                continue;
+            }
+            IMAGE *img_p = &data.image[IDrx[k]];
+
+            NBbad +=
+                tcpmuxbench_check(img_p, bench.sparse, k, bench.verified[k] + 1);
+            bytes += img_p->md[0].size[0] * img_p->md[0].size[1] *
+                     sizeof(uint32_t);
+            NBchecked++;
+            bench.verified[k] = bench.seq[k];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    bench.stop = 1;
+    pthread_join(thwriter, NULL);
+
+    uint64_t NBbyteraw  = 0;
+    uint64_t NBbyteenc  = 0;
+    uint64_t enc_ns     = 0;
+    uint64_t NBframeenc = 0;
+    for(uint32_t k = 0; k < nbstream; k++)
+    {
+        NBbyteraw += tx->stream[k].cd.NBbyteraw;
+        NBbyteenc += tx->stream[k].cd.NBbyteenc;
+        enc_ns += tx->stream[k].cd.time_ns;
+        NBframeenc += tx->stream[k].cd.NBframe;
+    }
+    tcpmux_tx_close(tx);
+    tcpmux_rx_close(rx);
+    stream_multiwait_destroy(mw);
+
+    double dt = (t1.tv_sec - t0.tv_sec) + 1.0e-9 * (t1.tv_nsec - t0.tv_nsec);
+    printf("%u streams over %u connection(s), %.1f kB per round of updates\n",
+           nbstream,
+           (nbconn < 1) ? 1 : nbconn,
+           framebytes / 1024.0);
+    printf("%ld frames checked in %.3f s : %.0f frames/s  %.1f MB/s\n",
+           NBchecked,
+           dt,
+           NBchecked / dt,
+           bytes / dt / 1.0e6);
+    if(NBframeenc > 0)
+    {
+        printf("codec %u : ratio %.2f, %.1f us/frame encoding\n",
+               nbcodec,
+               1.0 * NBbyteraw / NBbyteenc,
+               1.0e-3 * enc_ns / NBframeenc);
+    }
+    fflush(stdout);
+
+    if(NBbad > 0)
+    {
+        PRINT_WARNING("%ld corrupted frame(s)", NBbad);
+    }
+    if(NBchecked != (long) nbframe)
+    {
+        PRINT_WARNING("frame count mismatch : %ld received, %u sent",
+                      NBchecked,
+                      nbframe);
+    }
+
+    for(uint32_t k = 0; k < nbstream; k++)
+    {
+        char name[STRINGMAXLEN_IMGNAME];
+
+        WRITE_IMAGENAME(name, "_muxbench%03u", k);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_WARNING);
+        WRITE_IMAGENAME(name, "rx_muxbench%03u", k);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+    free(bench.IDtx);
+    free(bench.seq);
+    free((void *) bench.verified);
+    free(IDrx);
+    free(priority);
+    free(codecs);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_TCPmux_bench(*NBstream, *NBframe, *NBconn, *codec);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__stream_TCPmux_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
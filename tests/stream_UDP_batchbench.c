@@ -0,0 +1,437 @@
+/**
+ * @file    stream_UDP_batchbench.c
+ * @brief   framed UDP throughput over loopback : per-datagram vs batched
+ *
+ * A sender thread streams NBframe frames over loopback, keeping at most
+ * UDPBATCHBENCH_WINDOW frames ahead of the receiver. Transfer modes :
+ *
+ * - datagram : one sendmsg() / recv() per datagram, frame reassembled in
+ *   receiver buffer and copied to destination
+ * - batched  : sendmmsg() / recvmmsg(), payloads received in place in
+ *   destination
+ * - GSO/GRO  : as batched, with UDP segmentation and receive offload,
+ *   if supported by kernel
+ *
+ * Destination is scattered over a small metadata buffer and a data buffer,
+ * as for an image stream. Every delivered frame is checked against the
+ * pattern written by the sender (not included in timing).
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/stream_UDP_frame.h"
+
+#define UDPBATCHBENCH_WINDOW 2
+
+// metadata buffer size, odd to exercise unaligned scatter
+#define UDPBATCHBENCH_HEADSIZE 132
+
+// variables local to this translation unit
+static uint32_t *framesize;
+static uint32_t *NBframe;
+static uint32_t *chunksize;
+static uint32_t *batch;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".framesize",
+        "frame size [byte]",
+        "1000000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &framesize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBframe",
+        "number of frames",
+        "1000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframe,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".chunksize",
+        "datagram payload [byte]",
+        "1440",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &chunksize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".batch",
+        "messages per system call",
+        "32",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &batch,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imudpbatchbench",
+                                "framed UDP throughput, per-datagram vs batched",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+typedef struct
+{
+    int                fd;
+    struct sockaddr_in addr;
+    uint32_t           framesize;
+    uint32_t           NBframe;
+    UDPFRAME_TX        tx;
+
+    // last frame delivered to receiver, for flow control
+    volatile int64_t lastseq;
+} UDPBATCHBENCH_SENDER;
+
+static uint64_t udpbatchbench_pattern(uint64_t frameseq, long i)
+{
+    return (frameseq + 1) * 0x9E3779B97F4A7C15ULL ^ (uint64_t) i;
+}
+
+static double udpbatchbench_time()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1.0 * t.tv_sec + 1.0e-9 * t.tv_nsec;
+}
+
+static void *udpbatchbench_sender(void *ptr)
+{
+    UDPBATCHBENCH_SENDER *snd = (UDPBATCHBENCH_SENDER *) ptr;
+
+    char *frame = (char *) malloc(snd->framesize);
+    if(frame == NULL)
+    {
+        return NULL;
+    }
+
+    for(uint32_t fr = 0; fr < snd->NBframe; fr++)
+    {
+        for(long i = 0; i < (long)(snd->framesize / sizeof(uint64_t)); i++)
+        {
+            ((uint64_t *) frame)[i] = udpbatchbench_pattern(fr, i);
+        }
+
+        // wait for receiver, give up after 50 ms if frames are lost
+        double twait = udpbatchbench_time();
+        while(((int64_t) fr > snd->lastseq + UDPBATCHBENCH_WINDOW) &&
+                (udpbatchbench_time() - twait < 0.05))
+        {
+            usleep(10);
+        }
+
+        if(udpframe_tx_send(&snd->tx,
+                            snd->fd,
+                            (struct sockaddr *) &snd->addr,
+                            sizeof(snd->addr),
+                            frame,
+                            snd->framesize) < 0)
+        {
+            break;
+        }
+    }
+
+    free(frame);
+    return NULL;
+}
+
+// copy frame bytes from map into contiguous buffer
+static void udpbatchbench_gather(const UDPFRAME_MAP *map, char *dest, long size)
+{
+    for(int s = 0; (s < map->NBseg) && (size > 0); s++)
+    {
+        long len = map->seg[s].iov_len;
+        if(len > size)
+        {
+            len = size;
+        }
+        memcpy(dest, map->seg[s].iov_base, len);
+        dest += len;
+        size -= len;
+    }
+}
+
+// copy contiguous frame into map
+static void udpbatchbench_scatter(const UDPFRAME_MAP *map,
+                                  const char         *src,
+                                  long                size)
+{
+    for(int s = 0; (s < map->NBseg) && (size > 0); s++)
+    {
+        long len = map->seg[s].iov_len;
+        if(len > size)
+        {
+            len = size;
+        }
+        memcpy(map->seg[s].iov_base, src, len);
+        src += len;
+        size -= len;
+    }
+}
+
+// run transfer, returns number of corrupted frames, -1 on error
+static long udpbatchbench_run(const char *modename,
+                              int         mode,
+                              uint32_t    size,
+                              uint32_t    nbframe,
+                              uint32_t    chunk,
+                              int         nbbatch)
+{
+    UDPBATCHBENCH_SENDER snd;
+    UDPFRAME_RX          rx;
+    socklen_t            addrlen = sizeof(snd.addr);
+
+    memset(&snd, 0, sizeof(snd));
+    snd.framesize = size;
+    snd.NBframe   = nbframe;
+    snd.lastseq   = -1;
+
+    if(udpframe_tx_init(&snd.tx, chunk, 0, 0.0) != RETURN_SUCCESS)
+    {
+        return -1;
+    }
+    udpframe_rx_init(&rx);
+
+    snd.fd     = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int fdrecv = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if((snd.fd < 0) || (fdrecv < 0))
+    {
+        PRINT_ERROR("cannot create socket");
+        return -1;
+    }
+
+    // SO_RCVBUFFORCE may exceed rmem_max if privileged
+    int rcvbuf = 16 * 1024 * 1024;
+    if(setsockopt(fdrecv, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                  sizeof(rcvbuf)) != 0)
+    {
+        setsockopt(fdrecv, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    struct timeval tv;
+    tv.tv_sec  = 0;
+    tv.tv_usec = 200000;
+    setsockopt(fdrecv, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&snd.addr, 0, sizeof(snd.addr));
+    snd.addr.sin_family      = AF_INET;
+    snd.addr.sin_port        = 0;
+    snd.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(fdrecv, (struct sockaddr *) &snd.addr, sizeof(snd.addr)) != 0)
+    {
+        PRINT_ERROR("cannot bind loopback socket");
+        return -1;
+    }
+    getsockname(fdrecv, (struct sockaddr *) &snd.addr, &addrlen);
+
+    if(mode == 2)
+    {
+        if(udpframe_gso_available(snd.fd) == 0)
+        {
+            printf("%-10s  not supported by kernel\n", modename);
+            close(snd.fd);
+            close(fdrecv);
+            udpframe_tx_free(&snd.tx);
+            udpframe_rx_free(&rx);
+            return 0;
+        }
+        udpframe_tx_setbatch(&snd.tx, nbbatch, 1);
+        udpframe_rx_setbatch(&rx, fdrecv, nbbatch, 1);
+    }
+    else if(mode == 1)
+    {
+        udpframe_tx_setbatch(&snd.tx, nbbatch, 0);
+        udpframe_rx_setbatch(&rx, fdrecv, nbbatch, 0);
+    }
+
+    // destination : metadata buffer and data buffer
+    long         headsize = (size < UDPBATCHBENCH_HEADSIZE) ? size
+                            : UDPBATCHBENCH_HEADSIZE;
+    char        *dgram    = (char *) malloc(UDPFRAME_DGRAM_MAXSIZE);
+    char        *destbuff = (char *) malloc(size);
+    char        *checkbuff = (char *) malloc(size);
+    UDPFRAME_MAP destmap;
+    destmap.NBseg           = 2;
+    destmap.seg[0].iov_base = destbuff;
+    destmap.seg[0].iov_len  = headsize;
+    destmap.seg[1].iov_base = destbuff + headsize;
+    destmap.seg[1].iov_len  = size - headsize;
+    if((dgram == NULL) || (destbuff == NULL) || (checkbuff == NULL))
+    {
+        PRINT_ERROR("malloc() error");
+        return -1;
+    }
+    if(mode > 0)
+    {
+        udpframe_rx_setdest(&rx, &destmap);
+    }
+
+    pthread_t thsender;
+    pthread_create(&thsender, NULL, udpbatchbench_sender, &snd);
+
+    long   NBframebad = 0;
+    double tcheck     = 0.0;
+    double t0         = udpbatchbench_time();
+    while(snd.lastseq < (int64_t) nbframe - 1)
+    {
+        int framedone;
+
+        if(mode == 0)
+        {
+            long recvsize = recv(fdrecv, dgram, UDPFRAME_DGRAM_MAXSIZE, 0);
+            if(recvsize < 0)
+            {
+                break;
+            }
+            framedone = udpframe_rx_dgram(&rx, dgram, recvsize);
+        }
+        else
+        {
+            uint64_t NBsyscall0 = rx.stats.NBsyscall;
+            uint64_t NBdgram0   = rx.stats.NBdgram;
+            framedone           = udpframe_rx_recv(&rx, fdrecv);
+            if((framedone < 0) || ((rx.stats.NBsyscall > NBsyscall0) &&
+                                   (rx.stats.NBdgram == NBdgram0)))
+            {
+                // socket error or timeout
+                break;
+            }
+        }
+
+        if(framedone == 1)
+        {
+            if(rx.framedirect == 0)
+            {
+                udpbatchbench_scatter(&destmap,
+                                      rx.framemap->seg[0].iov_base,
+                                      size);
+            }
+
+            double tc0 = udpbatchbench_time();
+            udpbatchbench_gather(&destmap, checkbuff, size);
+            for(long k = 0; k < (long)(size / sizeof(uint64_t)); k++)
+            {
+                if(((uint64_t *) checkbuff)[k] !=
+                        udpbatchbench_pattern(rx.frameseq, k))
+                {
+                    NBframebad++;
+                    break;
+                }
+            }
+            tcheck += udpbatchbench_time() - tc0;
+
+            snd.lastseq = rx.frameseq;
+        }
+    }
+    double dt = udpbatchbench_time() - t0 - tcheck;
+
+    pthread_join(thsender, NULL);
+
+    long NBrecv = (rx.stats.NBframe > 0) ? rx.stats.NBframe : 1;
+    printf("%-10s  %10.1f  %8lu  %8lu  %12.2f  %12.2f  %8.1f\n",
+           modename,
+           1.0e-6 * size * rx.stats.NBframe / dt,
+           rx.stats.NBframe,
+           rx.stats.NBframelost,
+           1.0 * snd.tx.stats.NBsyscall /
+           ((snd.tx.stats.NBframe > 0) ? snd.tx.stats.NBframe : 1),
+           1.0 * ((mode == 0) ? rx.stats.NBdgram : rx.stats.NBsyscall) /
+           NBrecv,
+           (rx.stats.NBdgram > 0)
+           ? 100.0 * rx.stats.NBdgramcopied / rx.stats.NBdgram
+           : 0.0);
+    fflush(stdout);
+
+    free(dgram);
+    free(destbuff);
+    free(checkbuff);
+    udpframe_tx_free(&snd.tx);
+    udpframe_rx_free(&rx);
+    close(snd.fd);
+    close(fdrecv);
+
+    return NBframebad;
+}
+
+static errno_t stream_UDP_batchbench(uint32_t size,
+                                     uint32_t nbframe,
+                                     uint32_t chunk,
+                                     uint32_t nbbatch)
+{
+    DEBUG_TRACE_FSTART();
+
+    const char *modename[] = {"datagram", "batched", "GSO/GRO"};
+    long        NBframebad = 0;
+
+    if(size < sizeof(uint64_t))
+    {
+        FUNC_RETURN_FAILURE("frame size %u too small", size);
+    }
+
+    printf("frame size %u, chunk size %u, %u frames, batch %u\n",
+           size,
+           chunk,
+           nbframe,
+           nbbatch);
+    printf("%-10s  %10s  %8s  %8s  %12s  %12s  %8s\n",
+           "mode",
+           "MB/s",
+           "frames",
+           "lost",
+           "tx call/fr",
+           "rx call/fr",
+           "copied%");
+
+    for(int mode = 0; mode < 3; mode++)
+    {
+        long NBbad = udpbatchbench_run(modename[mode],
+                                       mode,
+                                       size,
+                                       nbframe,
+                                       chunk,
+                                       nbbatch);
+        if(NBbad < 0)
+        {
+            FUNC_RETURN_FAILURE("transfer setup failed");
+        }
+        NBframebad += NBbad;
+    }
+
+    if(NBframebad > 0)
+    {
+        PRINT_WARNING("%ld corrupted frame(s)", NBframebad);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_UDP_batchbench(*framesize, *NBframe, *chunksize, *batch);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__stream_UDP_batchbench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
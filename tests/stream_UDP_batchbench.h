@@ -0,0 +1,10 @@
+/**
+ * @file    stream_UDP_batchbench.h
+ */
+
+#ifndef MILK_TESTS_STREAM_UDP_BATCHBENCH_H
+#define MILK_TESTS_STREAM_UDP_BATCHBENCH_H
+
+errno_t CLIADDCMD_milk_tests__stream_UDP_batchbench();
+
+#endif
@@ -0,0 +1,348 @@
+/**
+ * @file    stream_UDP_bench.c
+ * @brief   test framed UDP protocol over loopback
+ *
+ * Sends NBframe frames over loopback with injected datagram loss. A
+ * receiver thread collects datagrams and feeds them to the reassembler in
+ * shuffled order, by blocks of UDPBENCH_SHUFFLEWINDOW datagrams.
+ * Delivered frames are checked against the pattern written by the sender.
+ * A restarted sender, with new session ID, must be followed immediately.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/stream_UDP_frame.h"
+
+#define UDPBENCH_SHUFFLEWINDOW 32
+
+// variables local to this translation unit
+static uint32_t *framesize;
+static uint32_t *NBframe;
+static uint32_t *fecgroup;
+static double   *lossfrac;
+static uint32_t *chunksize;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".framesize",
+        "frame size [byte]",
+        "1000000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &framesize,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBframe",
+        "number of frames",
+        "1000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframe,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".fecgroup",
+        "data chunks per parity chunk, 0 for none",
+        "8",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &fecgroup,
+        NULL
+    },
+    {
+        CLIARG_FLOAT64,
+        ".lossfrac",
+        "injected datagram loss fraction",
+        "0.01",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &lossfrac,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".chunksize",
+        "datagram payload [byte]",
+        "8192",
+        CLIARG_HIDDEN_DEFAULT,
+        (void **) &chunksize,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"imudpbench",
+                                "test framed UDP protocol over loopback",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+typedef struct
+{
+    int         fd;
+    long        dgrammaxsize;
+    volatile int stop;
+
+    UDPFRAME_RX rx;
+    uint64_t    frameseq0; // first delivered frame
+    long        NBframebad;
+} UDPBENCH_RECEIVER;
+
+static uint64_t udpbench_pattern(uint64_t frameseq, long i)
+{
+    return (frameseq + 1) * 0x9E3779B97F4A7C15ULL ^ (uint64_t) i;
+}
+
+static void udpbench_fillframe(char *frame, uint32_t size, uint64_t frameseq)
+{
+    for(long i = 0; i < (long)(size / sizeof(uint64_t)); i++)
+    {
+        ((uint64_t *) frame)[i] = udpbench_pattern(frameseq, i);
+    }
+    memset(frame + size / sizeof(uint64_t) * sizeof(uint64_t),
+           (int) frameseq,
+           size % sizeof(uint64_t));
+}
+
+static void udpbench_feed(UDPBENCH_RECEIVER *rcv,
+                          char             **dgram,
+                          long              *dgramsize,
+                          long               NBdgram,
+                          unsigned int      *seed)
+{
+    // Fisher-Yates shuffle of arrival order
+    for(long i = NBdgram - 1; i > 0; i--)
+    {
+        long j = rand_r(seed) % (i + 1);
+
+        char *tmpptr = dgram[i];
+        dgram[i]     = dgram[j];
+        dgram[j]     = tmpptr;
+
+        long tmpsize = dgramsize[i];
+        dgramsize[i] = dgramsize[j];
+        dgramsize[j] = tmpsize;
+    }
+
+    for(long i = 0; i < NBdgram; i++)
+    {
+        if(udpframe_rx_dgram(&rcv->rx, dgram[i], dgramsize[i]) == 1)
+        {
+            const char *frame    = rcv->rx.framemap->seg[0].iov_base;
+            uint64_t    frameseq = rcv->rx.frameseq;
+            uint32_t size     = rcv->rx.framesize;
+
+            if(rcv->rx.stats.NBframe == 1)
+            {
+                rcv->frameseq0 = frameseq;
+            }
+
+            for(long k = 0; k < (long)(size / sizeof(uint64_t)); k++)
+            {
+                if(((const uint64_t *) frame)[k] != udpbench_pattern(frameseq, k))
+                {
+                    rcv->NBframebad++;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void *udpbench_receiver(void *ptr)
+{
+    UDPBENCH_RECEIVER *rcv  = (UDPBENCH_RECEIVER *) ptr;
+    unsigned int       seed = 2;
+
+    char *dgram[UDPBENCH_SHUFFLEWINDOW];
+    long  dgramsize[UDPBENCH_SHUFFLEWINDOW];
+    long  NBdgram = 0;
+
+    for(int i = 0; i < UDPBENCH_SHUFFLEWINDOW; i++)
+    {
+        dgram[i] = (char *) malloc(rcv->dgrammaxsize);
+    }
+
+    while(1)
+    {
+        long recvsize =
+            recv(rcv->fd, dgram[NBdgram], rcv->dgrammaxsize, 0);
+        if(recvsize > 0)
+        {
+            dgramsize[NBdgram] = recvsize;
+            NBdgram++;
+        }
+        if((NBdgram == UDPBENCH_SHUFFLEWINDOW) ||
+                ((recvsize < 0) && (NBdgram > 0)))
+        {
+            udpbench_feed(rcv, dgram, dgramsize, NBdgram, &seed);
+            NBdgram = 0;
+        }
+        if((recvsize < 0) && (rcv->stop == 1))
+        {
+            break;
+        }
+    }
+
+    for(int i = 0; i < UDPBENCH_SHUFFLEWINDOW; i++)
+    {
+        free(dgram[i]);
+    }
+
+    return NULL;
+}
+
+static errno_t stream_UDP_bench(uint32_t size,
+                                uint32_t nbframe,
+                                uint32_t fecg,
+                                double   loss,
+                                uint32_t chunk)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct sockaddr_in addr;
+    socklen_t          addrlen = sizeof(addr);
+    UDPFRAME_TX        tx;
+    UDPBENCH_RECEIVER  rcv;
+
+    memset(&rcv, 0, sizeof(rcv));
+    FUNC_CHECK_RETURN(udpframe_tx_init(&tx, chunk, fecg, loss));
+    udpframe_rx_init(&rcv.rx);
+    rcv.dgrammaxsize = sizeof(UDPFRAME_HEADER) + tx.chunksize;
+
+    int fdtx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    rcv.fd   = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if((fdtx < 0) || (rcv.fd < 0))
+    {
+        FUNC_RETURN_FAILURE("cannot create socket");
+    }
+
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(rcv.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv;
+    tv.tv_sec  = 0;
+    tv.tv_usec = 200000;
+    setsockopt(rcv.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(rcv.fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+    {
+        FUNC_RETURN_FAILURE("cannot bind loopback socket");
+    }
+    getsockname(rcv.fd, (struct sockaddr *) &addr, &addrlen);
+
+    char *frame = (char *) malloc(size);
+    if(frame == NULL)
+    {
+        FUNC_RETURN_FAILURE("malloc() error");
+    }
+
+    pthread_t threceiver;
+    pthread_create(&threceiver, NULL, udpbench_receiver, &rcv);
+
+    for(uint32_t fr = 0; fr < nbframe; fr++)
+    {
+        udpbench_fillframe(frame, size, fr);
+        if(udpframe_tx_send(&tx,
+                            fdtx,
+                            (struct sockaddr *) &addr,
+                            addrlen,
+                            frame,
+                            size) < 0)
+        {
+            break;
+        }
+        // leave time to receiver, loopback socket buffer is small
+        usleep(size / 10000);
+    }
+
+    rcv.stop = 1;
+    pthread_join(threceiver, NULL);
+
+    printf("sent      %8lu frames  %8lu datagrams  %8lu dropped\n",
+           tx.stats.NBframe,
+           tx.stats.NBdgram,
+           tx.stats.NBdgramdropped);
+    printf("received  %8lu frames  %8lu lost  %8lu late chunks  "
+           "%8lu recovered chunks  %8lu invalid\n",
+           rcv.rx.stats.NBframe,
+           rcv.rx.stats.NBframelost,
+           rcv.rx.stats.NBchunklate,
+           rcv.rx.stats.NBchunkrecovered,
+           rcv.rx.stats.NBdgraminvalid);
+    fflush(stdout);
+
+    if(rcv.NBframebad > 0)
+    {
+        PRINT_WARNING("%ld corrupted frame(s)", rcv.NBframebad);
+    }
+    if((rcv.rx.delivered == 1) &&
+            (rcv.rx.stats.NBframe + rcv.rx.stats.NBframelost !=
+             rcv.rx.frameseq - rcv.frameseq0 + 1))
+    {
+        PRINT_WARNING("frame count mismatch");
+    }
+
+    // sender restarted with same settings : next frame must be delivered
+    {
+        UDPFRAME_TX txrestart;
+        uint64_t    NBframe0 = rcv.rx.stats.NBframe;
+        char       *dgram    = (char *) malloc(rcv.dgrammaxsize);
+        long        recvsize;
+
+        udpframe_tx_init(&txrestart, chunk, fecg, 0.0);
+        udpbench_fillframe(frame, size, 0);
+        udpframe_tx_send(&txrestart,
+                         fdtx,
+                         (struct sockaddr *) &addr,
+                         addrlen,
+                         frame,
+                         size);
+        while((recvsize = recv(rcv.fd, dgram, rcv.dgrammaxsize, 0)) > 0)
+        {
+            udpframe_rx_dgram(&rcv.rx, dgram, recvsize);
+        }
+        if((rcv.rx.stats.NBframe != NBframe0 + 1) || (rcv.rx.frameseq != 0))
+        {
+            PRINT_WARNING("sender restart mismatch");
+        }
+        free(dgram);
+        udpframe_tx_free(&txrestart);
+    }
+
+    free(frame);
+    udpframe_tx_free(&tx);
+    udpframe_rx_free(&rcv.rx);
+    close(fdtx);
+    close(rcv.fd);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_UDP_bench(*framesize, *NBframe, *fecgroup, *lossfrac,
+                            *chunksize);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__stream_UDP_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    stream_UDP_bench.h
+ */
+
+#ifndef MILK_TESTS_STREAM_UDP_BENCH_H
+#define MILK_TESTS_STREAM_UDP_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__stream_UDP_bench();
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file    stream_codec_bench.c
+ * @brief   check and time frame encoding on synthetic streams
+ *
+ * Each test sequence is encoded and decoded frame by frame, and decoded
+ * frames are compared to the original. Reports compression ratio and
+ * encoding / decoding throughput for several codec combinations.
+ */
+
+#include <math.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/stream_codec.h"
+
+#define CODECBENCH_TRAILSIZE 256 // keyword-like trailer [byte]
+
+// variables local to this translation unit
+static uint32_t *size;
+static uint32_t *NBframe;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".size",
+        "frame size, pixels per side",
+        "256",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &size,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBframe",
+        "number of frames",
+        "100",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBframe,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"streamcodecbench",
+                                "check and time stream frame encoding",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+typedef enum
+{
+    CODECBENCH_FLOAT_DRIFT, // slowly varying float, e.g. reference image
+    CODECBENCH_INT16_DM,    // 1% of int16 values change, e.g. DM command
+    CODECBENCH_UINT16_NOISE, // camera frame : offset + noise
+    CODECBENCH_FLOAT_CONST,  // unchanged frames
+    CODECBENCH_NBSEQ
+} CODECBENCH_SEQ;
+
+static const char *codecbench_seqname[CODECBENCH_NBSEQ] = {"float drift",
+                                                           "int16 sparse",
+                                                           "uint16 noise",
+                                                           "float constant"
+                                                          };
+
+static const int codecbench_elemsize[CODECBENCH_NBSEQ] = {4, 2, 2, 4};
+
+// frame n of sequence, pix holds frame n-1 on input
+static void codecbench_frame(int           seq,
+                             long          NBelem,
+                             long          n,
+                             char         *pix,
+                             char         *trail,
+                             unsigned int *seed)
+{
+    switch(seq)
+    {
+        case CODECBENCH_FLOAT_DRIFT:
+        {
+            float *f = (float *) pix;
+            for(long i = 0; i < NBelem; i++)
+            {
+                f[i] = sinf(0.01f * i) + 1.0e-4f * n * cosf(0.003f * i);
+            }
+        }
+        break;
+
+        case CODECBENCH_INT16_DM:
+        {
+            int16_t *v = (int16_t *) pix;
+            if(n == 0)
+            {
+                for(long i = 0; i < NBelem; i++)
+                {
+                    v[i] = (int16_t)(rand_r(seed) % 4096 - 2048);
+                }
+            }
+            for(long k = 0; k < NBelem / 100; k++)
+            {
+                v[rand_r(seed) % NBelem] += (int16_t)(rand_r(seed) % 64 - 32);
+            }
+        }
+        break;
+
+        case CODECBENCH_UINT16_NOISE:
+        {
+            uint16_t *v = (uint16_t *) pix;
+            for(long i = 0; i < NBelem; i++)
+            {
+                v[i] = 1000 + (rand_r(seed) & 31);
+            }
+        }
+        break;
+
+        default:
+        {
+            float *f = (float *) pix;
+            for(long i = 0; i < NBelem; i++)
+            {
+                f[i] = 1.0f + 0.001f * (i % 1000);
+            }
+        }
+    }
+
+    memset(trail, 0, CODECBENCH_TRAILSIZE);
+    memcpy(trail, &n, sizeof(n));
+}
+
+static errno_t stream_codec_bench(uint32_t side, uint32_t nbframe)
+{
+    DEBUG_TRACE_FSTART();
+
+    const int codeclist[] = {STREAM_CODEC_ALL,
+                             STREAM_CODEC_DELTA | STREAM_CODEC_RLE,
+                             STREAM_CODEC_SHUFFLE | STREAM_CODEC_RLE,
+                             STREAM_CODEC_DELTA
+                            };
+    const int NBcodec     = sizeof(codeclist) / sizeof(codeclist[0]);
+
+    long NBelem = (long) side * side;
+    if(NBelem < 1)
+    {
+        NBelem = 1;
+    }
+
+    // room for largest element size
+    char *pix    = (char *) malloc(NBelem * 4);
+    char *trail  = (char *) malloc(CODECBENCH_TRAILSIZE);
+    char *pixout = (char *) malloc(NBelem * 4);
+    char *trailout = (char *) malloc(CODECBENCH_TRAILSIZE);
+    char *enc    = (char *) malloc(NBelem * 4 + CODECBENCH_TRAILSIZE);
+    if((pix == NULL) || (trail == NULL) || (pixout == NULL) ||
+            (trailout == NULL) || (enc == NULL))
+    {
+        FUNC_RETURN_FAILURE("malloc() error");
+    }
+
+    long NBbad = 0;
+    for(int seq = 0; seq < CODECBENCH_NBSEQ; seq++)
+    {
+        int elemsize = codecbench_elemsize[seq];
+
+        for(int c = 0; c < NBcodec; c++)
+        {
+            STREAM_CODEC cdenc, cddec;
+            unsigned int seed = 1;
+
+            if((stream_codec_init(&cdenc,
+                                  codeclist[c],
+                                  NBelem,
+                                  elemsize,
+                                  CODECBENCH_TRAILSIZE) != RETURN_SUCCESS) ||
+                    (stream_codec_init(&cddec,
+                                       codeclist[c],
+                                       NBelem,
+                                       elemsize,
+                                       CODECBENCH_TRAILSIZE) != RETURN_SUCCESS))
+            {
+                FUNC_RETURN_FAILURE("cannot set up codec");
+            }
+
+            long NBbadseq = 0;
+            for(long n = 0; n < (long) nbframe; n++)
+            {
+                int flags;
+
+                codecbench_frame(seq, NBelem, n, pix, trail, &seed);
+                long encsize = stream_codec_encode(&cdenc, pix, trail, enc, &flags);
+                if((stream_codec_decode(&cddec,
+                                        enc,
+                                        encsize,
+                                        flags,
+                                        pixout,
+                                        trailout) != RETURN_SUCCESS) ||
+                        (memcmp(pix, pixout, NBelem * elemsize) != 0) ||
+                        (memcmp(trail, trailout, CODECBENCH_TRAILSIZE) != 0))
+                {
+                    NBbadseq++;
+                }
+            }
+
+            printf("%-16s codec %d : ratio %7.2f  encode %7.0f MB/s  decode "
+                   "%7.0f MB/s\n",
+                   codecbench_seqname[seq],
+                   codeclist[c],
+                   1.0 * cdenc.NBbyteraw / cdenc.NBbyteenc,
+                   1.0e3 * cdenc.NBbyteraw / (cdenc.time_ns + 1),
+                   1.0e3 * cddec.NBbyteraw / (cddec.time_ns + 1));
+            if(NBbadseq > 0)
+            {
+                PRINT_WARNING("%s, codec %d : %ld frame(s) decoded with mismatch",
+                              codecbench_seqname[seq],
+                              codeclist[c],
+                              NBbadseq);
+            }
+            NBbad += NBbadseq;
+
+            stream_codec_free(&cdenc);
+            stream_codec_free(&cddec);
+        }
+    }
+    fflush(stdout);
+
+    free(pix);
+    free(trail);
+    free(pixout);
+    free(trailout);
+    free(enc);
+
+    if(NBbad > 0)
+    {
+        PRINT_WARNING("%ld frame(s) decoded with mismatch", NBbad);
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_codec_bench(*size, *NBframe);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__stream_codec_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file    stream_codec_bench.h
+ */
+
+#ifndef MILK_TESTS_STREAM_CODEC_BENCH_H
+#define MILK_TESTS_STREAM_CODEC_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__stream_codec_bench();
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file    stream_multiwait_bench.c
+ * @brief   benchmark multi-stream waiter
+ *
+ * A writer thread updates one of NBstream shared streams at a time with
+ * ImageStreamIO_UpdateIm, as stream writers do, waits until the reader
+ * has seen it, pauses, and moves on to another stream.
+ * The reader waits on all streams with a single STREAM_MULTIWAIT and checks
+ * that exactly the updated stream is reported.
+ * Wake-up latency [us] is measured with and without spin phase.
+ * Streams are deleted on exit.
+ */
+
+#include <pthread.h>
+
+#include "CommandLineInterface/CLIcore.h"
+
+#include "COREMOD_memory/create_image.h"
+#include "COREMOD_memory/delete_image.h"
+#include "COREMOD_memory/stream_sem.h"
+
+// variables local to this translation unit
+static uint32_t *NBstream;
+static uint32_t *NBiter;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_UINT32,
+        ".NBstream",
+        "number of streams",
+        "16",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBstream,
+        NULL
+    },
+    {
+        CLIARG_UINT32,
+        ".NBiter",
+        "updates per measurement",
+        "10000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBiter,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"streamwaitbench",
+                                "benchmark multi-stream waiter",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+typedef struct
+{
+    imageID *IDarray;
+    uint32_t NBstream;
+    uint32_t NBiter;
+
+    // stream updated by writer, and update time
+    volatile long            streamindex;
+    volatile struct timespec twrite;
+
+    // set by reader when update has been seen
+    volatile int ack;
+} MULTIWAIT_BENCH;
+
+static void *multiwait_bench_writer(void *ptr)
+{
+    MULTIWAIT_BENCH *bench = (MULTIWAIT_BENCH *) ptr;
+    unsigned int     seed  = 1;
+
+    for(uint32_t iter = 0; iter < bench->NBiter; iter++)
+    {
+        long            k = rand_r(&seed) % bench->NBstream;
+        struct timespec tpause;
+        struct timespec twrite;
+
+        // leave time for reader to go to sleep
+        tpause.tv_sec  = 0;
+        tpause.tv_nsec = 20000 + rand_r(&seed) % 80000;
+        nanosleep(&tpause, NULL);
+
+        bench->ack         = 0;
+        bench->streamindex = k;
+        clock_gettime(CLOCK_MONOTONIC, &twrite);
+        bench->twrite = twrite;
+        ImageStreamIO_UpdateIm(&data.image[bench->IDarray[k]]);
+
+        while(bench->ack == 0)
+        {
+            tpause.tv_nsec = 1000;
+            nanosleep(&tpause, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static int cmp_double(const void *p1, const void *p2)
+{
+    double v1 = *((const double *) p1);
+    double v2 = *((const double *) p2);
+
+    return (v1 > v2) - (v1 < v2);
+}
+
+static errno_t stream_multiwait_bench(uint32_t nbstream, uint32_t nbiter)
+{
+    DEBUG_TRACE_FSTART();
+
+    long spintable[] = {0, 50000};
+    int  NBspin      = sizeof(spintable) / sizeof(spintable[0]);
+
+    if(nbstream == 0)
+    {
+        nbstream = 1;
+    }
+    if(nbiter == 0)
+    {
+        nbiter = 1;
+    }
+
+    MULTIWAIT_BENCH bench;
+    bench.IDarray  = (imageID *) malloc(sizeof(imageID) * nbstream);
+    bench.NBstream = nbstream;
+    bench.NBiter   = nbiter;
+
+    double *latency = (double *) malloc(sizeof(double) * nbiter);
+    if((bench.IDarray == NULL) || (latency == NULL))
+    {
+        FUNC_RETURN_FAILURE("malloc() error");
+    }
+
+    for(uint32_t i = 0; i < nbstream; i++)
+    {
+        char     name[STRINGMAXLEN_IMGNAME];
+        uint32_t naxes[2] = {1, 1};
+
+        WRITE_IMAGENAME(name, "_streamwaitbench_%04u", i);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_IGNORE);
+        create_image_ID(name,
+                        2,
+                        naxes,
+                        _DATATYPE_FLOAT,
+                        1,
+                        0,
+                        0,
+                        &bench.IDarray[i]);
+        COREMOD_MEMORY_image_set_createsem(name, IMAGE_NB_SEMAPHORE);
+    }
+
+    printf("%u streams, %u updates\n", nbstream, nbiter);
+    printf("%10s  %12s  %12s  %12s\n",
+           "spin [us]",
+           "median [us]",
+           "99% [us]",
+           "max [us]");
+
+    for(int is = 0; is < NBspin; is++)
+    {
+        STREAM_MULTIWAIT *mw =
+            stream_multiwait_create(bench.IDarray, nbstream, spintable[is]);
+        if(mw == NULL)
+        {
+            FUNC_RETURN_FAILURE("cannot create stream waiter");
+        }
+
+        long NBerr     = 0;
+        long NBtimeout = 0;
+
+        pthread_t thwriter;
+        bench.ack = 1;
+        pthread_create(&thwriter, NULL, multiwait_bench_writer, &bench);
+
+        for(uint32_t iter = 0; iter < nbiter; iter++)
+        {
+            struct timespec twake;
+
+            long NBfired = stream_multiwait_wait(mw, 1000000);
+            clock_gettime(CLOCK_MONOTONIC, &twake);
+
+            if(NBfired == 0)
+            {
+                NBtimeout++;
+                latency[iter] = 1.0e6;
+            }
+            else
+            {
+                long k = bench.streamindex;
+                if((NBfired != 1) || (mw->fired[k] != 1))
+                {
+                    NBerr++;
+                }
+                latency[iter] =
+                    1.0e6 * (twake.tv_sec - bench.twrite.tv_sec) +
+                    1.0e-3 * (twake.tv_nsec - bench.twrite.tv_nsec);
+            }
+            bench.ack = 1;
+        }
+        pthread_join(thwriter, NULL);
+        stream_multiwait_destroy(mw);
+
+        qsort(latency, nbiter, sizeof(double), cmp_double);
+        printf("%10.1f  %12.2f  %12.2f  %12.2f\n",
+               1.0e-3 * spintable[is],
+               latency[nbiter / 2],
+               latency[(long)(0.99 * (nbiter - 1))],
+               latency[nbiter - 1]);
+        fflush(stdout);
+
+        if(NBerr + NBtimeout > 0)
+        {
+            PRINT_WARNING("waiter returned wrong result (%ld errors, %ld "
+                          "timeouts)",
+                          NBerr,
+                          NBtimeout);
+        }
+    }
+
+    for(uint32_t i = 0; i < nbstream; i++)
+    {
+        char name[STRINGMAXLEN_IMGNAME];
+
+        WRITE_IMAGENAME(name, "_streamwaitbench_%04u", i);
+        delete_image_ID(name, DELETE_IMAGE_ERRMODE_WARNING);
+    }
+    free(bench.IDarray);
+    free(latency);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return stream_multiwait_bench(*NBstream, *NBiter);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__stream_multiwait_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file    tracepoint_bench.c
+ * @brief   measure trace point overhead
+ *
+ * Loop iterations contain three trace points, as the processinfo loop
+ * start (loopstep, waitoninputstream, exec_start). Overhead per iteration
+ * is reported for DEBUG_TRACEPOINTRAW and TRACEPOINT_FAST.
+ */
+
+#include "CommandLineInterface/CLIcore.h"
+#include "CommandLineInterface/timeutils.h"
+
+// variables local to this translation unit
+static int64_t *NBiter;
+
+static CLICMDARGDEF farg[] = {{
+        CLIARG_INT64,
+        ".NBiter",
+        "number of iterations",
+        "1000000",
+        CLIARG_VISIBLE_DEFAULT,
+        (void **) &NBiter,
+        NULL
+    }
+};
+
+static CLICMDDATA CLIcmddata = {"tracepointbench",
+                                "measure trace point overhead",
+                                CLICMD_FIELDS_NOFPS
+                               };
+
+// detailed help
+static errno_t help_function()
+{
+    return RETURN_SUCCESS;
+}
+
+static errno_t tracepoint_bench(long nbiter)
+{
+    DEBUG_TRACE_FSTART();
+
+    struct timespec t0, t1;
+    double          dtempty, dtraw, dtfast;
+
+    if(nbiter < 1)
+    {
+        nbiter = 1;
+    }
+
+    milk_clock_gettime(&t0);
+    for(long iter = 0; iter < nbiter; iter++)
+    {
+        __asm__ __volatile__("" ::: "memory");
+    }
+    milk_clock_gettime(&t1);
+    dtempty = timespec_diff_double(t0, t1);
+
+    milk_clock_gettime(&t0);
+    for(long iter = 0; iter < nbiter; iter++)
+    {
+        DEBUG_TRACEPOINTRAW("loopstep");
+        DEBUG_TRACEPOINTRAW("waitoninputstream");
+        DEBUG_TRACEPOINTRAW("exec_start");
+        __asm__ __volatile__("" ::: "memory");
+    }
+    milk_clock_gettime(&t1);
+    dtraw = timespec_diff_double(t0, t1);
+
+    milk_clock_gettime(&t0);
+    for(long iter = 0; iter < nbiter; iter++)
+    {
+        TRACEPOINT_FAST("loopstep");
+        TRACEPOINT_FAST("waitoninputstream");
+        TRACEPOINT_FAST("exec_start");
+        __asm__ __volatile__("" ::: "memory");
+    }
+    milk_clock_gettime(&t1);
+    dtfast = timespec_diff_double(t0, t1);
+
+    printf("%ld iterations, 3 trace points per iteration\n", nbiter);
+    printf("    empty loop          : %8.2f ns/iter\n", 1.0e9 * dtempty / nbiter);
+    printf("    DEBUG_TRACEPOINTRAW : %8.2f ns/iter\n",
+           1.0e9 * (dtraw - dtempty) / nbiter);
+    printf("    TRACEPOINT_FAST     : %8.2f ns/iter\n",
+           1.0e9 * (dtfast - dtempty) / nbiter);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+static errno_t compute_function()
+{
+    return tracepoint_bench(*NBiter);
+}
+
+INSERT_STD_CLIfunction
+
+// Register function in CLI
+errno_t
+CLIADDCMD_milk_tests__tracepoint_bench()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
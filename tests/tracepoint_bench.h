@@ -0,0 +1,10 @@
+/**
+ * @file    tracepoint_bench.h
+ */
+
+#ifndef MILK_TESTS_TRACEPOINT_BENCH_H
+#define MILK_TESTS_TRACEPOINT_BENCH_H
+
+errno_t CLIADDCMD_milk_tests__tracepoint_bench();
+
+#endif